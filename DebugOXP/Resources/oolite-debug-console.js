@@ -137,6 +137,18 @@ function getProfile(func : function [, this : Object]) : Object
 	in scripts. To see the structure of the object, run:
 	  console.getProfile(function(){PS.position.add([0, 0, 0])})
 
+function startTimeline([capacity : Number])
+	Start recording a timeline of every JavaScript and profiled native
+	function call, across any number of frames, in a ring buffer of capacity
+	events (default 262144). When it fills up, the oldest events are dropped.
+
+function stopTimeline() : String
+	Stop recording a timeline, and write it to the log folder as
+	“JavaScript timeline.json”, in Chrome Trace Event format (open it in
+	chrome://tracing), and “JavaScript timeline.folded”, as folded stacks for
+	flamegraph.pl. For example, to record a few seconds of play:
+	  console.startTimeline(); new Timer(this, function(){log(console.stopTimeline())}, 5)
+
 function writeLogMarker()
 	Writes a separator to the log.
 
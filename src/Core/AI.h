@@ -42,7 +42,7 @@ MA 02110-1301, USA.
 	id					_owner;						// OOWeakReference to the ShipEntity this is the AI for
 	NSString			*ownerDesc;					// describes the object this is the AI for
 	
-	NSDictionary		*stateMachine;
+	NSDictionary		*stateMachine;				// state name -> compiled handlers, see AI.m
 	NSString			*stateMachineName;
 	NSString			*currentState;
 	NSMutableSet		*pendingMessages;
@@ -56,6 +56,8 @@ MA 02110-1301, USA.
 	OOTimeAbsolute		nextThinkTime;
 	OOTimeDelta			thinkTimeInterval;
 	
+	uint8_t				queuedToThink: 1,			// Bookkeeping for OOAIScheduler.
+						hasThinkPhase: 1;
 }
 
 + (AI *) currentlyRunningAI;
@@ -107,6 +109,12 @@ MA 02110-1301, USA.
 - (void) setThinkTimeInterval:(OOTimeDelta) tti;
 - (OOTimeDelta) thinkTimeInterval;
 
+// Used by OOAIScheduler.
+- (BOOL) isQueuedToThink;
+- (void) setQueuedToThink:(BOOL)flag;
+- (BOOL) hasThinkPhase;
+- (void) setHasThinkPhase:(BOOL)flag;
+
 - (void) clearStack;
 
 - (void) clearAllData;
@@ -53,8 +53,73 @@ typedef struct
 } OOAIDeferredCallTrampolineInfo;
 
 
+/*	Messages handled by any loaded AI are interned and given a non-zero ID,
+	which the compiled states use to look up handlers. A message which has
+	never been interned has no handler in any state.
+*/
+typedef OOUInteger OOAIMessageID;
+
+
+/*	An action with its selector and parameter resolved. The parameter is the
+	rest of the action after the selector, with runs of whitespace collapsed to
+	single spaces, or nil if there is none.
+*/
+typedef struct
+{
+	SEL				selector;
+	NSString		*selectorName;
+	NSString		*parameter;
+	NSString		*source;		// The action as written, for diagnostics.
+} OOAIAction;
+
+
+/*	OOAIHandler: the actions for one message in one state. Immutable.
+*/
+@interface OOAIHandler: NSObject
+{
+@private
+	OOUInteger		_count;
+	OOAIAction		*_actions;
+}
+
+- (id) initWithActions:(NSArray *)actions;
+
+- (OOUInteger) count;
+- (const OOAIAction *) actions;
+
+@end
+
+
+/*	OOAIState: the handlers for one state of a state machine, sorted by message
+	ID. Immutable. A compiled state machine is a dictionary mapping state names
+	to OOAIStates.
+*/
+@interface OOAIState: NSObject
+{
+@private
+	OOUInteger		_count;
+	OOAIMessageID	*_messageIDs;
+	OOAIHandler		**_handlers;
+}
+
+- (id) initWithHandlers:(NSDictionary *)handlers;
+
+- (OOAIHandler *) handlerForMessageID:(OOAIMessageID)messageID;
+
+@end
+
+
 static AI *sCurrentlyRunningAI = nil;
 
+static NSMapTable *sMessageIDs = NULL;
+static OOAIMessageID sNextMessageID = 1;
+static NSMutableDictionary *sCompiledStateMachines = nil;
+
+
+static OOAIMessageID InternAIMessage(NSString *message);
+static OOAIMessageID LookUpAIMessage(NSString *message);
+static BOOL CompileAIAction(NSString *action, OOAIAction *outAction);
+
 
 @interface AI (OOPrivate)
 
@@ -64,7 +129,11 @@ static AI *sCurrentlyRunningAI = nil;
 
 - (void)refreshOwnerDesc;
 
+- (void) reactToMessage:(NSString *)message messageID:(OOAIMessageID)messageID context:(NSString *)debugContext;
+- (void) performAction:(const OOAIAction *)action;
+
 // Loading/whitelisting
+- (NSDictionary *) compiledStateMachine:(NSString *)smName;
 - (NSDictionary *) loadStateMachine:(NSString *)smName;
 - (NSDictionary *) cleanHandlers:(NSDictionary *)handlers forState:(NSString *)stateKey stateMachine:(NSString *)smName;
 - (NSArray *) cleanActions:(NSArray *)actions forHandler:(NSString *)handlerKey state:(NSString *)stateKey stateMachine:(NSString *)smName;
@@ -288,7 +357,7 @@ extern void GenerateGraphVizForAIStateMachine(NSDictionary *stateMachine, NSStri
 
 - (void) setStateMachine:(NSString *) smName
 {
-	NSDictionary *newSM = [self loadStateMachine:smName];
+	NSDictionary *newSM = [self compiledStateMachine:smName];
 	
 	if (newSM)
 	{
@@ -390,9 +459,15 @@ static AIStackElement *sStack = NULL;
 
 - (void) reactToMessage:(NSString *) message context:(NSString *)debugContext
 {
-	unsigned		i;
-	NSArray			*actions = nil;
-	NSDictionary	*messagesForState = nil;
+	[self reactToMessage:message messageID:LookUpAIMessage(message) context:debugContext];
+}
+
+
+- (void) reactToMessage:(NSString *)message messageID:(OOAIMessageID)messageID context:(NSString *)debugContext
+{
+	OOUInteger		i, count;
+	OOAIHandler		*handler = nil;
+	OOAIState		*state = nil;
 	ShipEntity		*owner = [self owner];
 	static unsigned	recursionLimiter = 0;
 	AI				*previousRunning = sCurrentlyRunningAI;
@@ -446,8 +521,8 @@ static AIStackElement *sStack = NULL;
 		return;
 	}
 	
-	messagesForState = [stateMachine objectForKey:currentState];
-	if (messagesForState == nil)  return;
+	state = [stateMachine objectForKey:currentState];
+	if (state == nil)  return;
 	
 #ifndef NDEBUG
 	if (currentState != nil && ![message isEqual:@"UPDATE"] && [owner reportAIMessages])
@@ -456,20 +531,24 @@ static AIStackElement *sStack = NULL;
 	}
 #endif
 	
-	actions = [[[messagesForState objectForKey:message] copy] autorelease];
+	// Retained in case an action changes the state machine.
+	handler = [[state handlerForMessageID:messageID] retain];
+	count = [handler count];
 	
 #ifdef OO_BRAIN_AI
 	if (rulingInstinct != nil)  [rulingInstinct freezeShipVars];	// preserve the pre-thinking state
 #endif
 	
 	sCurrentlyRunningAI = self;
-	if ([actions count] > 0)
+	if (count > 0)
 	{
+		const OOAIAction *actions = [handler actions];
+		
 		++recursionLimiter;
 		NS_DURING
-			for (i = 0; i < [actions count]; i++)
+			for (i = 0; i < count; i++)
 			{
-				[self takeAction:[actions objectAtIndex:i]];
+				[self performAction:&actions[i]];
 			}
 		NS_HANDLER
 			OOLog(kOOLogException, @"Squashing exception %@:%@ in AI handler %@:%@.%@", [localException name], [localException reason], stateMachineName, currentState, message);
@@ -488,6 +567,8 @@ static AIStackElement *sStack = NULL;
 		}
 	}
 	
+	[handler release];
+	
 	sCurrentlyRunningAI = previousRunning;
 #ifndef NDEBUG
 	// Unwind stack.
@@ -506,65 +587,22 @@ static AIStackElement *sStack = NULL;
 
 - (void) takeAction:(NSString *) action
 {
-	NSArray			*tokens = ScanTokensFromString(action);
-	NSString		*dataString = nil;
-	NSString		*selectorStr;
-	SEL				selector;
-	ShipEntity		*owner = [self owner];
-	
-#ifndef NDEBUG
-	BOOL report = [owner reportAIMessages];
-	if (report)
-	{
-		OOLog(@"ai.takeAction", @"%@ to take action %@", ownerDesc, action);
-		OOLogIndent();
-	}
-#endif
+	OOAIAction		compiledAction;
 	
-	if ([tokens count] != 0)
+	if (CompileAIAction(action, &compiledAction))
 	{
-		selectorStr = [tokens objectAtIndex:0];
+		[self performAction:&compiledAction];
 		
-		if (owner != nil)
-		{
-			if ([tokens count] > 1)
-			{
-				dataString = [[tokens subarrayWithRange:NSMakeRange(1, [tokens count] - 1)] componentsJoinedByString:@" "];
-			}
-			
-			selector = NSSelectorFromString(selectorStr);
-			if ([owner respondsToSelector:selector])
-			{
-				if (dataString)  [owner performSelector:selector withObject:dataString];
-				else  [owner performSelector:selector];
-			}
-			else
-			{
-				if ([selectorStr isEqual:@"debugMessage:"])
-				{
-					OOLog(@"ai.takeAction.debugMessage", @"DEBUG: AI MESSAGE from %@: %@", ownerDesc, dataString);
-				}
-				else
-				{
-					OOLogERR(@"ai.takeAction.badSelector", @"in AI %@ in state %@: %@ does not respond to %@", stateMachineName, currentState, ownerDesc, selectorStr);
-				}
-			}
-		}
-		else
-		{
-			OOLog(@"ai.takeAction.orphaned", @"***** AI %@, trying to perform %@, is orphaned (no owner)", stateMachineName, selectorStr);
-		}
-	}
-	else
-	{
-#ifndef NDEBUG
-		if (report)  OOLog(@"ai.takeAction.noAction", @"DEBUG: - no action '%@'", action);
-#endif
+		[compiledAction.selectorName release];
+		[compiledAction.parameter release];
+		[compiledAction.source release];
 	}
-	
 #ifndef NDEBUG
-	if (report)
+	else if ([[self owner] reportAIMessages])
 	{
+		OOLog(@"ai.takeAction", @"%@ to take action %@", ownerDesc, action);
+		OOLogIndent();
+		OOLog(@"ai.takeAction.noAction", @"DEBUG: - no action '%@'", action);
 		OOLogOutdent();
 	}
 #endif
@@ -575,10 +613,12 @@ static AIStackElement *sStack = NULL;
 {
 	NSArray			*ms_list = nil;
 	unsigned		i;
+	static OOAIMessageID updateMessageID = 0;
 	
 	if ([[self owner] universalID] == NO_TARGET || stateMachine == nil)  return;  // don't think until launched
 	
-	[self reactToMessage:@"UPDATE" context:@"periodic update"];
+	if (updateMessageID == 0)  updateMessageID = InternAIMessage(@"UPDATE");
+	[self reactToMessage:@"UPDATE" messageID:updateMessageID context:@"periodic update"];
 
 	if ([pendingMessages count] > 0)  ms_list = [pendingMessages allObjects];
 	[pendingMessages removeAllObjects];
@@ -667,6 +707,30 @@ static AIStackElement *sStack = NULL;
 }
 
 
+- (BOOL) isQueuedToThink
+{
+	return queuedToThink;
+}
+
+
+- (void) setQueuedToThink:(BOOL)flag
+{
+	queuedToThink = (flag != NO);
+}
+
+
+- (BOOL) hasThinkPhase
+{
+	return hasThinkPhase;
+}
+
+
+- (void) setHasThinkPhase:(BOOL)flag
+{
+	hasThinkPhase = (flag != NO);
+}
+
+
 - (void) clearStack
 {
 	[aiStack removeAllObjects];
@@ -771,6 +835,90 @@ static AIStackElement *sStack = NULL;
 }
 
 
+- (void) performAction:(const OOAIAction *)action
+{
+	ShipEntity		*owner = [self owner];
+	
+#ifndef NDEBUG
+	BOOL report = [owner reportAIMessages];
+	if (report)
+	{
+		OOLog(@"ai.takeAction", @"%@ to take action %@", ownerDesc, action->source);
+		OOLogIndent();
+	}
+#endif
+	
+	if (owner != nil)
+	{
+		// The owner's class may vary between uses of a state machine, so this can't be resolved in advance.
+		if ([owner respondsToSelector:action->selector])
+		{
+			if (action->parameter != nil)  [owner performSelector:action->selector withObject:action->parameter];
+			else  [owner performSelector:action->selector];
+		}
+		else
+		{
+			if (action->selector == @selector(debugMessage:))
+			{
+				OOLog(@"ai.takeAction.debugMessage", @"DEBUG: AI MESSAGE from %@: %@", ownerDesc, action->parameter);
+			}
+			else
+			{
+				OOLogERR(@"ai.takeAction.badSelector", @"in AI %@ in state %@: %@ does not respond to %@", stateMachineName, currentState, ownerDesc, action->selectorName);
+			}
+		}
+	}
+	else
+	{
+		OOLog(@"ai.takeAction.orphaned", @"***** AI %@, trying to perform %@, is orphaned (no owner)", stateMachineName, action->selectorName);
+	}
+	
+#ifndef NDEBUG
+	if (report)
+	{
+		OOLogOutdent();
+	}
+#endif
+}
+
+
+- (NSDictionary *) compiledStateMachine:(NSString *)smName
+{
+	NSDictionary			*source = nil;
+	NSDictionary			*record = nil;
+	NSMutableDictionary		*states = nil;
+	NSEnumerator			*stateEnum = nil;
+	NSString				*stateKey = nil;
+	OOAIState				*state = nil;
+	
+	source = [self loadStateMachine:smName];
+	if (source == nil)  return nil;
+	
+	/*	The cache manager hands back the same sanitized dictionary until the
+		caches are cleared, for instance by toggling strict mode, so a compiled
+		machine is reused for as long as its source is current.
+	*/
+	record = [sCompiledStateMachines objectForKey:smName];
+	if ([record objectForKey:@"source"] == source)  return [record objectForKey:@"states"];
+	
+	states = [NSMutableDictionary dictionaryWithCapacity:[source count]];
+	for (stateEnum = [source keyEnumerator]; (stateKey = [stateEnum nextObject]); )
+	{
+		state = [[OOAIState alloc] initWithHandlers:[source objectForKey:stateKey]];
+		if (state != nil)
+		{
+			[states setObject:state forKey:stateKey];
+			[state release];
+		}
+	}
+	
+	if (sCompiledStateMachines == nil)  sCompiledStateMachines = [[NSMutableDictionary alloc] init];
+	[sCompiledStateMachines setObject:[NSDictionary dictionaryWithObjectsAndKeys:source, @"source", states, @"states", nil] forKey:smName];
+	
+	return states;
+}
+
+
 - (NSDictionary *) loadStateMachine:(NSString *)smName
 {
 	NSDictionary			*newSM = nil;
@@ -949,3 +1097,209 @@ static AIStackElement *sStack = NULL;
 }
 
 @end
+
+
+@implementation OOAIHandler
+
+- (id) initWithActions:(NSArray *)actions
+{
+	if ((self = [super init]))
+	{
+		_actions = calloc([actions count], sizeof *_actions);
+		if (_actions == NULL && [actions count] != 0)
+		{
+			[self release];
+			return nil;
+		}
+		
+		NSEnumerator *actionEnum = nil;
+		NSString *action = nil;
+		for (actionEnum = [actions objectEnumerator]; (action = [actionEnum nextObject]); )
+		{
+			if (CompileAIAction(action, &_actions[_count]))  _count++;
+		}
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	OOUInteger i;
+	for (i = 0; i < _count; i++)
+	{
+		[_actions[i].selectorName release];
+		[_actions[i].parameter release];
+		[_actions[i].source release];
+	}
+	free(_actions);
+	
+	[super dealloc];
+}
+
+
+- (OOUInteger) count
+{
+	return _count;
+}
+
+
+- (const OOAIAction *) actions
+{
+	return _actions;
+}
+
+@end
+
+
+@implementation OOAIState
+
+typedef struct
+{
+	OOAIMessageID	messageID;
+	NSString		*message;
+} OOAIMessageEntry;
+
+
+static int CompareMessageEntries(const void *a, const void *b)
+{
+	OOAIMessageID idA = ((const OOAIMessageEntry *)a)->messageID;
+	OOAIMessageID idB = ((const OOAIMessageEntry *)b)->messageID;
+	
+	if (idA < idB)  return -1;
+	if (idA > idB)  return 1;
+	return 0;
+}
+
+
+- (id) initWithHandlers:(NSDictionary *)handlers
+{
+	if ((self = [super init]))
+	{
+		OOUInteger i, entryCount = 0, capacity = [handlers count];
+		NSEnumerator *messageEnum = nil;
+		NSString *message = nil;
+		OOAIMessageEntry *entries = malloc(capacity * sizeof *entries);
+		
+		_messageIDs = malloc(capacity * sizeof *_messageIDs);
+		_handlers = malloc(capacity * sizeof *_handlers);
+		if (capacity != 0 && (entries == NULL || _messageIDs == NULL || _handlers == NULL))
+		{
+			free(entries);
+			[self release];
+			return nil;
+		}
+		
+		for (messageEnum = [handlers keyEnumerator]; (message = [messageEnum nextObject]); )
+		{
+			entries[entryCount].messageID = InternAIMessage(message);
+			entries[entryCount].message = message;
+			entryCount++;
+		}
+		qsort(entries, entryCount, sizeof *entries, CompareMessageEntries);
+		
+		for (i = 0; i < entryCount; i++)
+		{
+			// Handlers with no actions are left out, so that the owner's interpretAIMessage: is used as before.
+			OOAIHandler *handler = [[OOAIHandler alloc] initWithActions:[handlers objectForKey:entries[i].message]];
+			if ([handler count] != 0)
+			{
+				_messageIDs[_count] = entries[i].messageID;
+				_handlers[_count] = handler;
+				_count++;
+			}
+			else
+			{
+				[handler release];
+			}
+		}
+		
+		free(entries);
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	OOUInteger i;
+	for (i = 0; i < _count; i++)
+	{
+		[_handlers[i] release];
+	}
+	free(_messageIDs);
+	free(_handlers);
+	
+	[super dealloc];
+}
+
+
+- (OOAIHandler *) handlerForMessageID:(OOAIMessageID)messageID
+{
+	OOUInteger low = 0, high = _count;
+	
+	if (messageID == 0)  return nil;
+	
+	while (low < high)
+	{
+		OOUInteger mid = (low + high) / 2;
+		if (_messageIDs[mid] < messageID)  low = mid + 1;
+		else  high = mid;
+	}
+	
+	if (low < _count && _messageIDs[low] == messageID)  return _handlers[low];
+	return nil;
+}
+
+@end
+
+
+static OOAIMessageID InternAIMessage(NSString *message)
+{
+	OOAIMessageID messageID = LookUpAIMessage(message);
+	
+	if (messageID == 0)
+	{
+		messageID = sNextMessageID++;
+		NSMapInsertKnownAbsent(sMessageIDs, [[message copy] autorelease], (void *)messageID);
+	}
+	
+	return messageID;
+}
+
+
+static OOAIMessageID LookUpAIMessage(NSString *message)
+{
+	if (sMessageIDs == NULL)
+	{
+		sMessageIDs = NSCreateMapTable(NSObjectMapKeyCallBacks, NSNonOwnedPointerMapValueCallBacks, 256);
+	}
+	
+	if (message == nil)  return 0;
+	return (OOAIMessageID)NSMapGet(sMessageIDs, message);
+}
+
+
+static BOOL CompileAIAction(NSString *action, OOAIAction *outAction)
+{
+	NSArray			*tokens = ScanTokensFromString(action);
+	OOUInteger		count = [tokens count];
+	
+	if (count == 0)  return NO;
+	
+	outAction->selectorName = [[tokens objectAtIndex:0] retain];
+	outAction->selector = NSSelectorFromString(outAction->selectorName);
+	if (count > 1)
+	{
+		outAction->parameter = [[[tokens subarrayWithRange:NSMakeRange(1, count - 1)] componentsJoinedByString:@" "] retain];
+	}
+	else
+	{
+		outAction->parameter = nil;
+	}
+	outAction->source = [action copy];
+	
+	return YES;
+}
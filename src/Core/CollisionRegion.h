@@ -31,7 +31,7 @@ MA 02110-1301, USA.
 #define	COLLISION_REGION_BORDER_RADIUS	32000.0f
 #define	COLLISION_MAX_ENTITIES			128
 
-@class	Entity;
+@class	Entity, OOCollisionBroadPhase;
 
 @interface CollisionRegion : NSObject
 {
@@ -83,7 +83,7 @@ NSArray* subregionsContainingPosition( Vector position, CollisionRegion* region)
 //
 - (BOOL) checkEntity:(Entity*) ent;
 //
-- (void) findCollisions;
+- (void) findCollisionsWithBroadPhase:(OOCollisionBroadPhase *)broadPhase;
 - (void) findShadowedEntities;
 
 - (NSString*) debugOut;
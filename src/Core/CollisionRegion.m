@@ -32,6 +32,7 @@ MA 02110-1301, USA.
 #import "StationEntity.h"
 #import "PlayerEntity.h"
 #import "OODebugFlags.h"
+#import "OOCollisionBroadPhase.h"
 
 
 @implementation CollisionRegion
@@ -292,7 +293,7 @@ NSArray* subregionsContainingPosition( Vector position, CollisionRegion* region)
 }
 
 
-- (void) findCollisions
+- (void) findCollisionsWithBroadPhase:(OOCollisionBroadPhase *)broadPhase
 {
 	//
 	// According to Shark, when this was in Universe this was where Oolite spent most time!
@@ -301,6 +302,8 @@ NSArray* subregionsContainingPosition( Vector position, CollisionRegion* region)
 	Vector p1, p2;
 	double dist2, r1, r2, r0, min_dist2;
 	int i;
+	OOUInteger pairIdx, pairCount;
+	OOCollisionCandidatePair *pairs = NULL;
 	Entity*	entities_to_test[n_entities];
 	//
 	
@@ -345,7 +348,7 @@ NSArray* subregionsContainingPosition( Vector position, CollisionRegion* region)
 	 
 	int n_subs = [subregions count];
 	for (i = 0; i < n_subs; i++)
-		[(CollisionRegion*)[subregions objectAtIndex: i] findCollisions];
+		[(CollisionRegion*)[subregions objectAtIndex: i] findCollisionsWithBroadPhase:broadPhase];
 	 
 	*/
 	//
@@ -353,87 +356,85 @@ NSArray* subregionsContainingPosition( Vector position, CollisionRegion* region)
 	checks_this_tick = 0;
 	checks_within_range = 0;
 	
-	// test each entity in this region against the entities in its collision chain
+	// test each candidate pair from the broad phase which lies in this region
 	//
-	for (i = 0; i < n_entities_to_test; i++)
+	pairs = [broadPhase pairs];
+	pairCount = [broadPhase pairCount];
+	for (pairIdx = 0; pairIdx < pairCount; pairIdx++)
 	{
-		e1 = entities_to_test[i];
+		e1 = pairs[pairIdx].a;
+		e2 = pairs[pairIdx].b;
+		if (e1->collisionRegion != self || e2->collisionRegion != self)
+			continue;
+		
+		checks_this_tick++;
+		
 		p1 = e1->position;
 		r1 = e1->collision_radius;
-		
-		// check against the first in the collision chain
-		e2 = e1->collision_chain;
-		while (e2 != nil)
+		p2 = e2->position;
+		r2 = e2->collision_radius;
+		r0 = r1 + r2;
+		p2 = vector_subtract(p2, p1);
+		dist2 = magnitude2(p2);
+		min_dist2 = r0 * r0;
+		if (dist2 < PROXIMITY_WARN_DISTANCE2 * min_dist2)
 		{
-			checks_this_tick++;
+#ifndef NDEBUG
+			if (gDebugFlags & DEBUG_COLLISIONS)
+			{
+				OOLog(@"collisionRegion.debug", @"DEBUG Testing collision between %@ (%@) and %@ (%@)",
+					  e1, (e1->collisionTestFilter)?@"YES":@"NO", e2, (e2->collisionTestFilter)?@"YES":@"NO");
+			}
+#endif
+			checks_within_range++;
 			
-			p2 = e2->position;
-			r2 = e2->collision_radius;
-			r0 = r1 + r2;
-			p2 = vector_subtract(p2, p1);
-			dist2 = magnitude2(p2);
-			min_dist2 = r0 * r0;
-			if (dist2 < PROXIMITY_WARN_DISTANCE2 * min_dist2)
+			if ((e1->isShip) && (e2->isShip))
 			{
-#ifndef NDEBUG
-				if (gDebugFlags & DEBUG_COLLISIONS)
+				if ((dist2 < PROXIMITY_WARN_DISTANCE2 * r2 * r2) || (dist2 < PROXIMITY_WARN_DISTANCE2 * r1 * r1))
 				{
-					OOLog(@"collisionRegion.debug", @"DEBUG Testing collision between %@ (%@) and %@ (%@)",
-						  e1, (e1->collisionTestFilter)?@"YES":@"NO", e2, (e2->collisionTestFilter)?@"YES":@"NO");
+					[(ShipEntity*)e1 setProximity_alert:(ShipEntity*)e2];
+					[(ShipEntity*)e2 setProximity_alert:(ShipEntity*)e1];
 				}
-#endif
-				checks_within_range++;
+			}
+			if (dist2 < min_dist2)
+			{
+				BOOL collision = NO;
 				
-				if ((e1->isShip) && (e2->isShip))
+				if (e1->isStation)
 				{
-					if ((dist2 < PROXIMITY_WARN_DISTANCE2 * r2 * r2) || (dist2 < PROXIMITY_WARN_DISTANCE2 * r1 * r1))
-					{
-						[(ShipEntity*)e1 setProximity_alert:(ShipEntity*)e2];
-						[(ShipEntity*)e2 setProximity_alert:(ShipEntity*)e1];
-					}
+					StationEntity* se1 = (StationEntity*) e1;
+					if ([se1 shipIsInDockingCorridor: (ShipEntity*)e2])
+						collision = NO;
+					else
+						collision = [e1 checkCloseCollisionWith: e2];
 				}
-				if (dist2 < min_dist2)
+				else if (e2->isStation)
 				{
-					BOOL collision = NO;
-					
-					if (e1->isStation)
-					{
-						StationEntity* se1 = (StationEntity*) e1;
-						if ([se1 shipIsInDockingCorridor: (ShipEntity*)e2])
-							collision = NO;
-						else
-							collision = [e1 checkCloseCollisionWith: e2];
-					}
-					else if (e2->isStation)
-					{
-						StationEntity* se2 = (StationEntity*) e2;
-						if ([se2 shipIsInDockingCorridor: (ShipEntity*)e1])
-							collision = NO;
-						else
-							collision = [e2 checkCloseCollisionWith: e1];
-					}
+					StationEntity* se2 = (StationEntity*) e2;
+					if ([se2 shipIsInDockingCorridor: (ShipEntity*)e1])
+						collision = NO;
 					else
-						collision = [e1 checkCloseCollisionWith: e2];
-				
-					if (collision)
-					{
-						// now we have no need to check the e2-e1 collision
-						if (e1->collider)
-							[[e1 collisionArray] addObject:e1->collider];
-						else
-							[[e1 collisionArray] addObject:e2];
-						e1->hasCollided = YES;
-						//
-						if (e2->collider)
-							[[e2 collisionArray] addObject:e2->collider];
-						else
-							[[e2 collisionArray] addObject:e1];
-						e2->hasCollided = YES;
-					}
+						collision = [e2 checkCloseCollisionWith: e1];
+				}
+				else
+					collision = [e1 checkCloseCollisionWith: e2];
+			
+				if (collision)
+				{
+					// now we have no need to check the e2-e1 collision
+					if (e1->collider)
+						[[e1 collisionArray] addObject:e1->collider];
+					else
+						[[e1 collisionArray] addObject:e2];
+					e1->hasCollided = YES;
+					//
+					if (e2->collider)
+						[[e2 collisionArray] addObject:e2->collider];
+					else
+						[[e2 collisionArray] addObject:e1];
+					e2->hasCollided = YES;
 				}
 			}
-			// check the next in the collision chain
-			e2 = e2->collision_chain;
 		}
 	}
 }
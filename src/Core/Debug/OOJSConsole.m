@@ -44,6 +44,7 @@ SOFTWARE.
 #import "OODebugMonitor.h"
 #import "OOProfilingStopwatch.h"
 #import "ResourceManager.h"
+#import "OOLogOutputHandler.h"
 
 
 @interface Entity (OODebugInspector)
@@ -88,6 +89,8 @@ static JSBool ConsoleDumpHeap(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleProfile(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleGetProfile(JSContext *context, uintN argc, jsval *vp);
 static JSBool ConsoleTrace(JSContext *context, uintN argc, jsval *vp);
+static JSBool ConsoleStartTimeline(JSContext *context, uintN argc, jsval *vp);
+static JSBool ConsoleStopTimeline(JSContext *context, uintN argc, jsval *vp);
 #endif
 
 static JSBool ConsoleSettingsDeleteProperty(JSContext *context, JSObject *this, jsid propID, jsval *value);
@@ -95,6 +98,7 @@ static JSBool ConsoleSettingsGetProperty(JSContext *context, JSObject *this, jsi
 static JSBool ConsoleSettingsSetProperty(JSContext *context, JSObject *this, jsid propID, JSBool strict, jsval *value);
 
 #if OOJS_PROFILE
+static BOOL CheckNotProfiling(JSContext *context);
 static JSBool PerformProfiling(JSContext *context, NSString *nominalFunction, uintN argc, jsval *argv, jsval *rval, BOOL trace, OOTimeProfile **profile);
 #endif
 
@@ -212,6 +216,8 @@ static JSFunctionSpec sConsoleMethods[] =
 	{ "profile",						ConsoleProfile,						1 },
 	{ "getProfile",						ConsoleGetProfile,					1 },
 	{ "trace",							ConsoleTrace,						1 },
+	{ "startTimeline",					ConsoleStartTimeline,				0 },
+	{ "stopTimeline",					ConsoleStopTimeline,				0 },
 #endif
 	{ 0 }
 };
@@ -986,11 +992,7 @@ static JSBool ConsoleProfile(JSContext *context, uintN argc, jsval *vp)
 {
 	OOJS_NATIVE_ENTER(context)
 	
-	if (EXPECT_NOT(OOJSIsProfiling()))
-	{
-		OOJSReportError(context, @"Profiling functions may not be called while already profiling.");
-		return NO;
-	}
+	if (EXPECT_NOT(!CheckNotProfiling(context)))  return NO;
 	
 	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
 	OOTimeProfile		*profile = nil;
@@ -1014,11 +1016,7 @@ static JSBool ConsoleGetProfile(JSContext *context, uintN argc, jsval *vp)
 	OOJS_NATIVE_ENTER(context)
 	
 	
-	if (EXPECT_NOT(OOJSIsProfiling()))
-	{
-		OOJSReportError(context, @"Profiling functions may not be called while already profiling.");
-		return NO;
-	}
+	if (EXPECT_NOT(!CheckNotProfiling(context)))  return NO;
 	
 	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
 	OOTimeProfile		*profile = nil;
@@ -1041,11 +1039,7 @@ static JSBool ConsoleTrace(JSContext *context, uintN argc, jsval *vp)
 {
 	OOJS_NATIVE_ENTER(context)
 	
-	if (EXPECT_NOT(OOJSIsProfiling()))
-	{
-		OOJSReportError(context, @"Profiling functions may not be called while already profiling.");
-		return NO;
-	}
+	if (EXPECT_NOT(!CheckNotProfiling(context)))  return NO;
 	
 	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
 	jsval				rval;
@@ -1063,6 +1057,82 @@ static JSBool ConsoleTrace(JSContext *context, uintN argc, jsval *vp)
 }
 
 
+// function startTimeline([capacity : Number])
+static JSBool ConsoleStartTimeline(JSContext *context, uintN argc, jsval *vp)
+{
+	OOJS_NATIVE_ENTER(context)
+	
+	if (EXPECT_NOT(!CheckNotProfiling(context)))  return NO;
+	
+	int32 capacity = 0;
+	if (argc > 0 && (!JS_ValueToInt32(context, OOJS_ARGV[0], &capacity) || capacity < 0))
+	{
+		OOJSReportBadArguments(context, @"Console", @"startTimeline", 1, OOJS_ARGV, nil, @"number of events");
+		return NO;
+	}
+	
+	if (EXPECT_NOT(!OOJSBeginTimelineRecording(capacity)))
+	{
+		OOJSReportError(context, @"Could not allocate the timeline buffer.");
+		return NO;
+	}
+	
+	OOJS_RETURN_VOID;
+	
+	OOJS_NATIVE_EXIT
+}
+
+
+// function stopTimeline() : String
+static JSBool ConsoleStopTimeline(JSContext *context, uintN argc, jsval *vp)
+{
+	OOJS_NATIVE_ENTER(context)
+	
+	if (EXPECT_NOT(!OOJSIsRecordingTimeline()))
+	{
+		OOJSReportError(context, @"stopTimeline() called without startTimeline().");
+		return NO;
+	}
+	
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	OOJSTimeline		*timeline = OOJSEndTimelineRecording();
+	NSString			*basePath = [OOLogHandlerGetLogBasePath() stringByAppendingPathComponent:@"JavaScript timeline"];
+	NSString			*tracePath = [basePath stringByAppendingPathExtension:@"json"];
+	NSString			*foldedPath = [basePath stringByAppendingPathExtension:@"folded"];
+	NSMutableString		*result = nil;
+	BOOL				OK;
+	
+	OOJS_BEGIN_FULL_NATIVE(context)
+	OK = [[timeline chromeTraceData] writeToFile:tracePath atomically:YES] &&
+		 [[[timeline foldedStacks] dataUsingEncoding:NSUTF8StringEncoding] writeToFile:foldedPath atomically:YES];
+	OOJS_END_FULL_NATIVE
+	
+	result = [NSMutableString stringWithFormat:@"Recorded %lu events over %g ms", (unsigned long)[timeline eventCount], [timeline duration] * 1000.0];
+	if ([timeline droppedEventCount] != 0)  [result appendFormat:@" (%llu older events dropped)", [timeline droppedEventCount]];
+	if ([timeline skippedFrameCount] != 0)  [result appendFormat:@"; %llu calls nested too deeply were skipped", [timeline skippedFrameCount]];
+	if (OK)  [result appendFormat:@".\nChrome trace: %@\nFolded stacks: %@", tracePath, foldedPath];
+	else  [result appendString:@", but the timeline could not be written to the log folder."];
+	
+	OOJS_SET_RVAL(OOJSValueFromNativeObject(context, result));
+	
+	[pool release];
+	return YES;
+	
+	OOJS_NATIVE_EXIT
+}
+
+
+static BOOL CheckNotProfiling(JSContext *context)
+{
+	if (EXPECT_NOT(OOJSIsProfiling() || OOJSIsRecordingTimeline()))
+	{
+		OOJSReportError(context, @"Profiling functions may not be called while already profiling or recording a timeline.");
+		return NO;
+	}
+	return YES;
+}
+
+
 static JSBool PerformProfiling(JSContext *context, NSString *nominalFunction, uintN argc, jsval *argv, jsval *outRval, BOOL trace, OOTimeProfile **outProfile)
 {
 	// Get function.
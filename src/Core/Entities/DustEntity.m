@@ -136,6 +136,17 @@ enum
 }
 
 
+- (BOOL) canUpdateConcurrently
+{
+#if OO_SHADERS
+	// -checkShaderMode talks to OpenGL, so the first update must be on the main thread.
+	return shaderMode != kShaderModeUnknown;
+#else
+	return YES;
+#endif
+}
+
+
 - (void) update:(OOTimeDelta) delta_t
 {
 #if OO_SHADERS
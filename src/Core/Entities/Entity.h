@@ -248,6 +248,16 @@ enum OOScanClass
 - (NSMutableArray *)collisionArray;
 
 - (void) update:(OOTimeDelta)delta_t;
+
+/*	Entities which return YES from -canUpdateConcurrently may have -update:
+	called on a worker thread, at the same time as other such entities. Their
+	-update: must only change the entity's own state; anything else, such as
+	removing an expired effect from the universe, goes in
+	-completeConcurrentUpdate, which Universe calls on the main thread after
+	all concurrent updates, in sortedEntities order.
+*/
+- (BOOL) canUpdateConcurrently;
+- (void) completeConcurrentUpdate;
 - (void) applyVelocityWithTimeDelta:(OOTimeDelta)delta_t;	// Newtonion mechanics is opt-in. (FIXME: is there actually anything with a non-zero velocity that doesn't want this? -- Ahruman 2011-01-31)
 
 - (BOOL) checkCloseCollisionWith:(Entity *)other;
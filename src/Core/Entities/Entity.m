@@ -593,6 +593,7 @@ static NSString * const kOOLogEntityUpdateError				= @"entity.linkedList.update.
 - (void) setPosition:(Vector) posn
 {
 	position = posn;
+	[UNIVERSE refitIndexForEntity:self];
 }
 
 
@@ -601,6 +602,7 @@ static NSString * const kOOLogEntityUpdateError				= @"entity.linkedList.update.
 	position.x = x;
 	position.y = y;
 	position.z = z;
+	[UNIVERSE refitIndexForEntity:self];
 }
 
 
@@ -733,6 +735,7 @@ static NSString * const kOOLogEntityUpdateError				= @"entity.linkedList.update.
 - (void) setScanClass:(OOScanClass)sClass
 {
 	scanClass = sClass;
+	[UNIVERSE refitIndexForEntity:self];
 }
 
 
@@ -880,6 +883,17 @@ static NSString * const kOOLogEntityUpdateError				= @"entity.linkedList.update.
 }
 
 
+- (BOOL) canUpdateConcurrently
+{
+	return NO;
+}
+
+
+- (void) completeConcurrentUpdate
+{
+}
+
+
 - (void) applyVelocityWithTimeDelta:(OOTimeDelta)delta_t
 {
 	position = vector_add(position, vector_multiply_scalar(velocity, delta_t));
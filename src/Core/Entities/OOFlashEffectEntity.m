@@ -118,9 +118,19 @@ static OOTexture *sFlashTexture = nil;
 	// Fade in and out.
 	OOTimeDelta lifeTime = [self timeElapsedSinceSpawn];
 	_colorComponents[3] = (lifeTime < tf) ? (lifeTime / tf) : (_duration - lifeTime) / tf1;
-	
+}
+
+
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
 	// Disappear as necessary.
-	if (lifeTime > _duration)  [UNIVERSE removeEntity:self];
+	if ([self timeElapsedSinceSpawn] > _duration)  [UNIVERSE removeEntity:self];
 }
 
 
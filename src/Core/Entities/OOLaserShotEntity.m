@@ -154,7 +154,17 @@ MA 02110-1301, USA.
 	_lifetime -= delta_t;
 	
 	[self applyVelocityWithTimeDelta:delta_t];
-	
+}
+
+
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
 	if (_lifetime < 0)  [UNIVERSE removeEntity:self];
 }
 
@@ -81,7 +81,7 @@ MA 02110-1301, USA.
 		}
 		
 		[self setStatus:STATUS_EFFECT];
-		scanClass = CLASS_NO_DRAW;
+		[self setScanClass:CLASS_NO_DRAW];
 	}
 	
 	return self;
@@ -121,7 +121,17 @@ MA 02110-1301, USA.
 	{
 		particlePosition[i] = vector_add(particlePosition[i], vector_multiply_scalar(particleVelocity[i], delta_t));
 	}
-	
+}
+
+
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
 	// disappear eventually.
 	if (_timePassed > _duration)  [UNIVERSE removeEntity:self];
 }
@@ -76,7 +76,7 @@ MA 02110-1301, USA.
 	self = [self init];
 	if (self == nil)  return nil;
 	
-	scanClass = CLASS_NO_DRAW;
+	[self setScanClass:CLASS_NO_DRAW];
 	
 	// Load random seed override.
 	NSString *seedStr = [dict oo_stringForKey:@"seed"];
@@ -293,7 +293,7 @@ static OOColor *ColorWithHSBColor(Vector c)
 	self = [self init];
 	if (self == nil)  return nil;
 	
-	scanClass = CLASS_NO_DRAW;
+	[self setScanClass:CLASS_NO_DRAW];
 	[self setStatus:STATUS_COCKPIT_DISPLAY];
 	
 	collision_radius = planet->collision_radius * PLANET_MINIATURE_FACTOR;
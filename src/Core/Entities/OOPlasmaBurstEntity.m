@@ -58,8 +58,18 @@ MA 02110-1301, USA.
 	_diameter = kPlasmaBurstInitialSize + lifeTime * kPlasmaBurstGrowthRate;
 	
 	_colorComponents[3] = attenuation;
-	
-	if (lifeTime > kPlasmaBurstDuration)  [UNIVERSE removeEntity:self];
+}
+
+
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
+	if ([self timeElapsedSinceSpawn] > kPlasmaBurstDuration)  [UNIVERSE removeEntity:self];
 }
 
 @end
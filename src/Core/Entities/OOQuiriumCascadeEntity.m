@@ -48,7 +48,7 @@ MA 02110-1301, USA.
 		[self setPosition:[ship position]];
 		
 		[self setStatus:STATUS_EFFECT];
-		scanClass = CLASS_MINE;
+		[self setScanClass:CLASS_MINE];
 		
 		[self setOwner:[ship owner]];
 		
@@ -124,7 +124,17 @@ static NSPoint sCircleVerts[kCircleSegments];	// holds vector coordinates for a
 	
 	_innerRadius += delta_t * _innerGrowthRate;
 	_outerRadius += delta_t * _outerGrowthRate;
-	
+}
+
+
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
 	if (_timePassed > kRingDuration)
 	{
 		[UNIVERSE removeEntity:self];
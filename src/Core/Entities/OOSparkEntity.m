@@ -66,6 +66,19 @@ MA 02110-1301, USA.
 }
 
 
+- (BOOL) canUpdateConcurrently
+{
+	return YES;
+}
+
+
+- (void) completeConcurrentUpdate
+{
+	// Disappear when gone.
+	if (_timeRemaining <= 0)  [UNIVERSE removeEntity:self];
+}
+
+
 - (void) performUpdate:(OOTimeDelta)delta_t
 {
 	position = vector_add(position, vector_multiply_scalar(velocity, delta_t));
@@ -78,9 +91,6 @@ MA 02110-1301, USA.
 	_colorComponents[1] = mix * _baseRGBA[1];
 	_colorComponents[2] = mix * _baseRGBA[2];
 	_colorComponents[3] = mix * _baseRGBA[3];
-	
-	// Disappear when gone.
-	if (mix == 0)  [UNIVERSE removeEntity:self];
 }
 
 @end
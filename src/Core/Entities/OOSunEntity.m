@@ -150,7 +150,7 @@ MA 02110-1301, USA.
 	
 	collision_radius = 100000.0; //  100km across
 	
-	scanClass = CLASS_NO_DRAW;
+	[self setScanClass:CLASS_NO_DRAW];
 	
 	[self setSunColor:sun_color];
 	
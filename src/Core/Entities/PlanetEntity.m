@@ -323,7 +323,7 @@ static const BaseFace kTexturedFaces[][3] =
 	last_launch_time = 0.0;
 	shuttle_launch_interval = 3600.0;
 	
-	scanClass = CLASS_NO_DRAW;
+	[self setScanClass:CLASS_NO_DRAW];
 	
 	// orientation.w =  M_SQRT1_2; // is already planet->orientation
 	// orientation.x =  M_SQRT1_2;
@@ -443,7 +443,7 @@ static const BaseFace kTexturedFaces[][3] =
 
 	collision_radius = radius_km * 10.0; // scale down by a factor of 100 !
 	
-	scanClass = CLASS_NO_DRAW;
+	[self setScanClass:CLASS_NO_DRAW];
 	
 	orientation.w =  M_SQRT1_2;
 	orientation.x =  M_SQRT1_2;
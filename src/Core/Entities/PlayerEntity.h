@@ -252,6 +252,8 @@ typedef enum
 	int						ship_trade_in_factor;
 	
 	NSDictionary			*worldScripts;
+	NSMutableDictionary		*worldScriptHandlers;		// Event ID -> world scripts with a handler for it, in dispatch order.
+	uint32_t				worldScriptHandlerGeneration;
 	NSMutableDictionary		*mission_variables;
 	NSMutableDictionary		*localVariables;
 	int						missionTextRow;
@@ -101,6 +101,10 @@ static NSString * const kOOLogBuyMountedFailed		= @"equip.buy.mounted.failed";
 PlayerEntity		*gOOPlayer = nil;
 static GLfloat		sBaseMass = 0.0;
 
+#if OO_DEBUG
+static void CountWorldScriptEvent(NSValue *key, jsid event, OOUInteger handlerCount, OOUInteger scriptCount);
+#endif
+
 
 @interface PlayerEntity (OOPrivate)
 
@@ -141,6 +145,8 @@ static GLfloat		sBaseMass = 0.0;
 - (double) hyperspaceJumpDistance;
 - (OOFuelQuantity) fuelRequiredForJump;
 
+- (NSArray *) worldScriptsWithHandler:(jsid)message inContext:(JSContext *)context;
+
 @end
 
 
@@ -1103,6 +1109,15 @@ static GLfloat		sBaseMass = 0.0;
 	[UNIVERSE setBlockJSPlayerShipProps:NO];	// full access to player.ship properties!
 	[worldScripts release];
 	worldScripts = [[ResourceManager loadScripts] retain];
+	DESTROY(worldScriptHandlers);
+	
+	// Only changes to world scripts' handlers need to invalidate worldScriptHandlers.
+	NSEnumerator *scriptEnum = nil;
+	OOScript *theScript = nil;
+	for (scriptEnum = [worldScripts objectEnumerator]; (theScript = [scriptEnum nextObject]); )
+	{
+		if ([theScript isKindOfClass:[OOJSScript class]])  [(OOJSScript *)theScript setTracksHandlerChanges:YES];
+	}
 	
 	// if there is cargo remaining from previously (e.g. a game restart), remove it
 	if ([self cargoList] != nil)
@@ -1252,7 +1267,7 @@ static GLfloat		sBaseMass = 0.0;
 	forward_shield			= [self maxForwardShieldLevel];
 	aft_shield				= [self maxAftShieldLevel];
 	
-	scanClass				= CLASS_PLAYER;
+	[self setScanClass:CLASS_PLAYER];
 	
 	[UNIVERSE clearGUIs];
 	
@@ -1417,6 +1432,7 @@ static GLfloat		sBaseMass = 0.0;
 	DESTROY(commLog);
 	
 	DESTROY(worldScripts);
+	DESTROY(worldScriptHandlers);
 	DESTROY(mission_variables);
 	
 	DESTROY(localVariables);
@@ -8176,7 +8192,7 @@ static NSString *last_outfitting_key=nil;
 
 - (BOOL) doWorldEventUntilMissionScreen:(jsid)message
 {
-	NSEnumerator	*scriptEnum = [worldScripts objectEnumerator];
+	NSEnumerator	*scriptEnum = nil;
 	OOScript		*theScript;
 
 	// Check for the pressence of report messages first.
@@ -8188,6 +8204,7 @@ static NSString *last_outfitting_key=nil;
 	}
 	
 	JSContext *context = OOJSAcquireContext();
+	scriptEnum = [[self worldScriptsWithHandler:message inContext:context] objectEnumerator];
 	while ((theScript = [scriptEnum nextObject]) && gui_screen != GUI_SCREEN_MISSION && [self isDocked])
 	{
 		[theScript callMethod:message inContext:context withArguments:NULL count:0 result:NULL];
@@ -8212,7 +8229,7 @@ static NSString *last_outfitting_key=nil;
 	NSEnumerator			*scriptEnum = nil;
 	OOScript				*theScript = nil;
 	
-	for (scriptEnum = [worldScripts objectEnumerator]; (theScript = [scriptEnum nextObject]); )
+	for (scriptEnum = [[self worldScriptsWithHandler:message inContext:context] objectEnumerator]; (theScript = [scriptEnum nextObject]); )
 	{
 		OOJSStartTimeLimiterWithTimeLimit(limit);
 		[theScript callMethod:message inContext:context withArguments:argv count:argc result:NULL];
@@ -8221,6 +8238,45 @@ static NSString *last_outfitting_key=nil;
 }
 
 
+/*	The world scripts which define a handler for message, in the same order as
+	worldScripts. The lists are built as events are first sent, and thrown
+	away whenever a world script gains or loses a function property. A handler
+	added while an event is being dispatched is first called for the next
+	event.
+*/
+- (NSArray *) worldScriptsWithHandler:(jsid)message inContext:(JSContext *)context
+{
+	NSValue					*key = nil;
+	NSMutableArray			*scripts = nil;
+	NSEnumerator			*scriptEnum = nil;
+	OOScript				*theScript = nil;
+	uint32_t				generation = [OOJSScript handlerGeneration];
+	
+	if (worldScriptHandlers == nil)  worldScriptHandlers = [[NSMutableDictionary alloc] init];
+	else if (generation != worldScriptHandlerGeneration)  [worldScriptHandlers removeAllObjects];
+	worldScriptHandlerGeneration = generation;
+	
+	key = [NSValue valueWithBytes:&message objCType:@encode(jsid)];
+	scripts = [worldScriptHandlers objectForKey:key];
+	if (scripts == nil)
+	{
+		scripts = [NSMutableArray array];
+		for (scriptEnum = [worldScripts objectEnumerator]; (theScript = [scriptEnum nextObject]); )
+		{
+			if ([theScript hasMethod:message inContext:context])  [scripts addObject:theScript];
+		}
+		[worldScriptHandlers setObject:scripts forKey:key];
+	}
+	
+#if OO_DEBUG
+	CountWorldScriptEvent(key, message, [scripts count], [worldScripts count]);
+#endif
+	
+	// The list may be thrown away by a handler while it's being used.
+	return [[scripts retain] autorelease];
+}
+
+
 - (void) setGalacticHyperspaceBehaviour:(OOGalacticHyperspaceBehaviour)inBehaviour
 {
 	if (GALACTIC_HYPERSPACE_BEHAVIOUR_UNKNOWN < inBehaviour && inBehaviour <= GALACTIC_HYPERSPACE_MAX)
@@ -8602,3 +8658,71 @@ else _dockTarget = NO_TARGET;
 }
 
 @end
+
+
+#if OO_DEBUG
+
+typedef struct
+{
+	jsid					event;
+	unsigned long long		dispatches;
+	unsigned long long		handlerCalls;
+	unsigned long long		skippedScripts;
+} WorldScriptEventStatistics;
+
+static NSMutableDictionary *sWorldScriptEventStats;
+
+
+@implementation PlayerEntity (WorldScriptEventStatistics)
+
+// :setM eventStats PS.callObjC("reportWorldScriptEventStatistics")
+// :eventStats
+
+- (NSString *) reportWorldScriptEventStatistics
+{
+	NSMutableString			*result = [NSMutableString string];
+	NSEnumerator			*statsEnum = nil;
+	NSData					*data = nil;
+	unsigned long long		totalCalls = 0, totalSkipped = 0;
+	
+	[result appendFormat:@"%u world scripts.\n", [worldScripts count]];
+	
+	for (statsEnum = [sWorldScriptEventStats objectEnumerator]; (data = [statsEnum nextObject]); )
+	{
+		const WorldScriptEventStatistics *stats = [data bytes];
+		[result appendFormat:@"%@: %llu events, %llu handler calls, %llu scripts skipped\n", OOStringFromJSID(stats->event), stats->dispatches, stats->handlerCalls, stats->skippedScripts];
+		totalCalls += stats->handlerCalls;
+		totalSkipped += stats->skippedScripts;
+	}
+	
+	[result appendFormat:@"total: %llu handler calls, %llu scripts skipped", totalCalls, totalSkipped];
+	return result;
+}
+
+
+- (void) clearWorldScriptEventStatistics
+{
+	DESTROY(sWorldScriptEventStats);
+}
+
+@end
+
+
+static void CountWorldScriptEvent(NSValue *key, jsid event, OOUInteger handlerCount, OOUInteger scriptCount)
+{
+	NSMutableData *data = [sWorldScriptEventStats objectForKey:key];
+	if (data == nil)
+	{
+		if (sWorldScriptEventStats == nil)  sWorldScriptEventStats = [[NSMutableDictionary alloc] init];
+		data = [NSMutableData dataWithLength:sizeof (WorldScriptEventStatistics)];
+		((WorldScriptEventStatistics *)[data mutableBytes])->event = event;
+		[sWorldScriptEventStats setObject:data forKey:key];
+	}
+	
+	WorldScriptEventStatistics *stats = [data mutableBytes];
+	stats->dispatches++;
+	stats->handlerCalls += handlerCount;
+	stats->skippedScripts += scriptCount - handlerCount;
+}
+
+#endif
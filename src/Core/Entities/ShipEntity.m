@@ -496,13 +496,14 @@ static ShipEntity *doOctreesCollide(ShipEntity *prime, ShipEntity *other);
 
 	// scan class settings. 'scanClass' is in common usage, but we could also have a more standard 'scan_class' key with higher precedence. Kaks 20090810 
 	// let's see if scan_class is set... 
-	scanClass = OOScanClassFromString([shipDict oo_stringForKey:@"scan_class" defaultValue:@"CLASS_NOT_SET"]);
+	OOScanClass sClass = OOScanClassFromString([shipDict oo_stringForKey:@"scan_class" defaultValue:@"CLASS_NOT_SET"]);
 	
 	// if not, try 'scanClass'. NOTE: non-standard capitalization is documented and entrenched.
-	if (scanClass == CLASS_NOT_SET)
+	if (sClass == CLASS_NOT_SET)
 	{
-		scanClass = OOScanClassFromString([shipDict oo_stringForKey:@"scanClass" defaultValue:@"CLASS_NOT_SET"]);
+		sClass = OOScanClassFromString([shipDict oo_stringForKey:@"scanClass" defaultValue:@"CLASS_NOT_SET"]);
 	}
+	[self setScanClass:sClass];
 	
 	// Populate the missiles here. Must come after scanClass.
 	_missileRole = [shipDict oo_stringForKey:@"missile_role"];
@@ -4678,8 +4679,10 @@ static GLfloat scripted_color[4] = 	{ 0.0, 0.0, 0.0, 0.0};	// to be defined by s
 {
 	if (![role isEqual:primaryRole])
 	{
-		[primaryRole release];
+		NSString *oldRole = primaryRole;
 		primaryRole = [role copy];
+		[UNIVERSE ship:self didChangePrimaryRoleFrom:oldRole];
+		[oldRole release];
 	}
 }
 
@@ -5889,7 +5892,7 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 				[UNIVERSE addEntity:ring];
 			}
 
-			BOOL add_debris = (UNIVERSE->n_entities < 0.95 * UNIVERSE_MAX_ENTITIES) &&
+			BOOL add_debris = (UNIVERSE->n_entities < 0.95 * UNIVERSE_DEBRIS_ENTITY_THRESHOLD) &&
 									  ([UNIVERSE getTimeDelta] < 0.125);	  // FPS > 8
 			
 			
@@ -6087,7 +6090,7 @@ NSComparisonResult ComparePlanetsBySurfaceDistance(id i1, id i2, void* context)
 				{
 					int n_wreckage = 0;
 					
-					if (add_debris && (UNIVERSE->n_entities < 0.50 * UNIVERSE_MAX_ENTITIES))
+					if (add_debris && (UNIVERSE->n_entities < 0.50 * UNIVERSE_DEBRIS_ENTITY_THRESHOLD))
 					{
 						// Create wreckage only when UNIVERSE is less than half full.
 						// (condition set in r906 - was < 0.75 before) --Kaks 2011.10.17
@@ -8056,7 +8059,11 @@ Vector positionOffsetForShipInRotationToAlignment(ShipEntity* ship, Quaternion q
 	if (![self hasCloakingDevice] || cloaking_device_active)  return cloaking_device_active; // no changes.
 	
 	if (!cloaking_device_active)  cloaking_device_active = (energy > CLOAKING_DEVICE_START_ENERGY * maxEnergy);
-	if (cloaking_device_active)  [self doScriptEvent:OOJSID("shipCloakActivated")];
+	if (cloaking_device_active)
+	{
+		[UNIVERSE refitIndexForEntity:self];	// scan class has changed
+		[self doScriptEvent:OOJSID("shipCloakActivated")];
+	}
 	return cloaking_device_active;
 }
 
@@ -8066,6 +8073,7 @@ Vector positionOffsetForShipInRotationToAlignment(ShipEntity* ship, Quaternion q
 	if ([self hasCloakingDevice] && cloaking_device_active)
 	{
 		cloaking_device_active = NO;
+		[UNIVERSE refitIndexForEntity:self];
 		[self doScriptEvent:OOJSID("shipCloakDeactivated")];
 	}
 }
@@ -1361,7 +1361,7 @@ MA 02110-1301, USA.
 		}
 	}
 	// now we're just a bunch of alien artefacts!
-	scanClass = CLASS_CARGO;
+	[self setScanClass:CLASS_CARGO];
 	reportAIMessages = NO;
 	[shipAI setStateMachine:@"dumbAI.plist"];
 	primaryTarget = NO_TARGET;
@@ -60,7 +60,7 @@ static void DrawWormholeCorona(GLfloat inner_radius, GLfloat outer_radius, int s
 		shipsInTransit = [[NSMutableArray arrayWithCapacity:4] retain];
 		collision_radius = 0.0;
 		[self setStatus:STATUS_EFFECT];
-		scanClass = CLASS_WORMHOLE;
+		[self setScanClass:CLASS_WORMHOLE];
 		isWormhole = YES;
 		scan_info = WH_SCANINFO_NONE;
 		scan_time = 0;
@@ -513,7 +513,7 @@ static void DrawWormholeCorona(GLfloat inner_radius, GLfloat outer_radius, int s
 		no_draw_distance = collision_radius * collision_radius * NO_DRAW_DISTANCE_FACTOR * NO_DRAW_DISTANCE_FACTOR;
 	}
 
-	scanClass = (witch_mass > 0.0)? CLASS_WORMHOLE : CLASS_NO_DRAW;
+	[self setScanClass:(witch_mass > 0.0)? CLASS_WORMHOLE : CLASS_NO_DRAW];
 	
 	if (now > expiry_time)
 	{
@@ -54,7 +54,7 @@ MA 02110-1301, USA.
 - (GLfloat) findMaxDimensionFromOrigin;
 
 - (Octree*) findOctreeToDepth: (int) depth;
-- (id) octreeWithinRadius:(GLfloat) octreeRadius toDepth: (int) depth;
+- (id) octreeWithinRadius:(GLfloat) octreeRadius toDepth: (int) depth leafCount:(int *) ioLeafCount;
 
 - (void) translate:(Vector) offset;
 - (void) scale:(GLfloat) scalar;
@@ -174,39 +174,35 @@ MA 02110-1301, USA.
 	return result;
 }
 
-static int leafcount;
-static float volumecount;
 - (Octree*) findOctreeToDepth: (int) depth
 {
-	//
-	leafcount = 0;
-	volumecount = 0.0f;
+	// The leaf count is passed down rather than kept in a static so octrees can be built on several threads at once.
+	int leafCount = 0;
 	//
 	GLfloat foundRadius = 0.5f + [self findMaxDimensionFromOrigin];	// pad out from geometry by a half meter
 	//	
-	NSObject* foundOctree = [self octreeWithinRadius:foundRadius toDepth:depth];
+	NSObject* foundOctree = [self octreeWithinRadius:foundRadius toDepth:depth leafCount:&leafCount];
 	//
-	Octree*	octreeRepresentation = [[Octree alloc] initWithRepresentationOfOctree:foundRadius :foundOctree :leafcount];
+	Octree*	octreeRepresentation = [[Octree alloc] initWithRepresentationOfOctree:foundRadius :foundOctree :leafCount];
 	//
 	return [octreeRepresentation autorelease];
 }
 
-- (id) octreeWithinRadius:(GLfloat)octreeRadius toDepth:(int)depth
+- (id) octreeWithinRadius:(GLfloat)octreeRadius toDepth:(int)depth leafCount:(int *)ioLeafCount
 {
 	//
 	GLfloat offset = 0.5f * octreeRadius;
 	//
 	if (![self testHasGeometry])
 	{
-		leafcount++;	// nil or zero or 0
+		(*ioLeafCount)++;	// nil or zero or 0
 		return [NSNumber numberWithBool:NO];	// empty octree
 	}
 	// there is geometry!
 	//
 	if ((octreeRadius <= OCTREE_MIN_RADIUS)||(depth <= 0))	// maximum resolution
 	{
-		leafcount++;	// partially full or -1
-		volumecount += octreeRadius * octreeRadius * octreeRadius * 0.5f;
+		(*ioLeafCount)++;	// partially full or -1
 		return [NSNumber numberWithBool:YES];	// at least partially full octree
 	}
 	//
@@ -217,8 +213,7 @@ static float volumecount;
 	{
 		if ([self testCornersWithinGeometry: octreeRadius])	// all eight corners inside or on!
 		{
-			leafcount++;	// full or -1
-			volumecount += octreeRadius * octreeRadius * octreeRadius;
+			(*ioLeafCount)++;	// full or -1
 			return [NSNumber numberWithBool:YES];	// full octree
 		}
 	}
@@ -282,16 +277,16 @@ static float volumecount;
 	[g_xx0 release];
 	[g_xx1 release];
 	
-	leafcount++;	// pointer to array
+	(*ioLeafCount)++;	// pointer to array
 	NSObject* result = [NSArray arrayWithObjects:
-		[g_000 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_001 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_010 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_011 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_100 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_101 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_110 octreeWithinRadius: offset toDepth:depth - 1],
-		[g_111 octreeWithinRadius: offset toDepth:depth - 1],
+		[g_000 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_001 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_010 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_011 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_100 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_101 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_110 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
+		[g_111 octreeWithinRadius: offset toDepth:depth - 1 leafCount:ioLeafCount],
 		nil];
 	[g_000 release];
 	[g_001 release];
@@ -29,6 +29,7 @@ SOFTWARE.
 */
 
 #import "OOTexture.h"
+#import "OOTypes.h"
 
 
 #define OOTEXTURE_RELOADABLE		1
@@ -49,10 +50,18 @@ SOFTWARE.
 #if OO_TEXTURE_CUBE_MAP
 							_isCubeMap: 1,
 #endif
+#if OOTEXTURE_RELOADABLE
+							_evicted: 1,
+#endif
+							_compressOnUpload: 1,
 							_valid: 1;
 	uint8_t					_mipLevels;
+	uint8_t					_baseLevel;		// Lowest uploaded mip level while streaming.
+	uint32_t				_lastUsedFrame;
+	size_t					_residentBytes;
 	
 	OOTextureLoader			*_loader;
+	OOTimeDelta				_loadTime;
 	
 	void					*_bytes;
 	GLuint					_textureName;
@@ -62,6 +71,8 @@ SOFTWARE.
 							_originalHeight;
 	
 	OOTextureDataFormat		_format;
+	GLenum					_compressedFormat;	// Internal format of block-compressed _bytes, or 0.
+	NSString				*_diskCacheKey;		// Set while compressed data is still to be cached.
 	uint32_t				_options;
 #if GL_EXT_texture_lod_bias
 	GLfloat					_lodBias;
@@ -36,12 +36,19 @@
 #import "OOMacroOpenGL.h"
 #import "OOCPUInfo.h"
 #import "OOPixMap.h"
+#import "OOTextureDiskCache.h"
 
 #ifndef NDEBUG
 #import "OOTextureGenerator.h"
 #endif
 
 
+enum
+{
+	kStreamingInitialSize		= 64	// Mip levels up to this size are uploaded immediately.
+};
+
+
 #if OOLITE_BIG_ENDIAN
 #define RGBA_IMAGE_TYPE GL_UNSIGNED_INT_8_8_8_8_REV
 #elif OOLITE_LITTLE_ENDIAN
@@ -54,6 +61,7 @@
 @interface OOConcreteTexture (Private)
 
 - (void)setUpTexture;
+- (void)ensureDimensionsKnown;
 - (void)uploadTexture;
 - (void)uploadTextureDataWithMipMap:(BOOL)mipMap format:(OOTextureDataFormat)format;
 #if OO_TEXTURE_CUBE_MAP
@@ -62,14 +70,24 @@
 
 - (GLenum) glTextureTarget;
 
+- (size_t) uploadMipLevel:(unsigned)level width:(uint32_t)w height:(uint32_t)h bytes:(const char *)bytes;
+- (void) noteUploadedBytes:(size_t)size;
+- (void) deleteTextureName;
+
+#if OO_TEXTURE_COMPRESSION
+- (void) storeCompressedTexture;
+#endif
+
 #if OOTEXTURE_RELOADABLE
 - (BOOL) isReloadable;
+- (void) reloadAfterEviction;
 #endif
 
 @end
 
 
 static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *outFormat, GLenum *outInternalFormat, GLenum *outType);
+static size_t MipLevelOffset(uint32_t width, uint32_t height, uint8_t components, GLenum compressedFormat, unsigned level);
 
 
 @implementation OOConcreteTexture
@@ -120,7 +138,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 		anisotropy:(float)anisotropy
 		   lodBias:(GLfloat)lodBias
 {
-	OOTextureLoader *loader = [OOTextureLoader loaderWithPath:path options:options];
+	OOTextureLoader *loader = [OOTextureLoader loaderWithPath:path options:options allowCompression:(options & kOOTextureAllowCompression) != 0];
 	if (loader == nil)
 	{
 		[self release];
@@ -150,12 +168,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 	
 	if (_loaded)
 	{
-		if (_textureName != 0)
-		{
-			OO_ENTER_OPENGL();
-			OOGL(glDeleteTextures(1, &_textureName));
-			_textureName = 0;
-		}
+		[self deleteTextureName];
 		free(_bytes);
 		_bytes = NULL;
 	}
@@ -167,6 +180,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 #endif
 	
 	DESTROY(_loader);
+	DESTROY(_diskCacheKey);
 	
 #ifndef NDEBUG
 	DESTROY(_name);
@@ -191,6 +205,12 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 			stateDesc = @"LOAD ERROR";
 		}
 	}
+#if OOTEXTURE_RELOADABLE
+	else if (_evicted)
+	{
+		stateDesc = (_loader != nil) ? @"reloading" : @"evicted";
+	}
+#endif
 	else
 	{
 		stateDesc = @"loading";
@@ -248,7 +268,21 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 {
 	OO_ENTER_OPENGL();
 	
-	if (EXPECT_NOT(!_loaded))  [self setUpTexture];
+	_lastUsedFrame = OOTextureCurrentFrame();
+	
+	if (EXPECT_NOT(!_loaded))
+	{
+#if OOTEXTURE_RELOADABLE
+		if (_evicted && _loader == nil)  [self reloadAfterEviction];
+#endif
+		if (gOOTextureInfo.streamingEnabled && gOOTextureInfo.applyWithoutWaiting && _loader != nil && ![_loader isReady])
+		{
+			// Draw without the texture rather than stall until it's loaded.
+			[OOTexture applyNone];
+			return;
+		}
+		[self setUpTexture];
+	}
 	else if (EXPECT_NOT(!_uploaded))  [self uploadTexture];
 	else  OOGL(glBindTexture([self glTextureTarget], _textureName));
 	
@@ -278,7 +312,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 
 - (NSSize)dimensions
 {
-	[self ensureFinishedLoading];
+	[self ensureDimensionsKnown];
 	
 	return NSMakeSize(_width, _height);
 }
@@ -286,7 +320,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 
 - (NSSize) originalDimensions
 {
-	[self ensureFinishedLoading];
+	[self ensureDimensionsKnown];
 	
 	return NSMakeSize(_originalWidth, _originalHeight);
 }
@@ -294,7 +328,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 
 - (BOOL) isMipMapped
 {
-	[self ensureFinishedLoading];
+	[self ensureDimensionsKnown];
 	
 	return _mipLevels != 0;
 }
@@ -306,7 +340,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 	
 	OOPixMap				px = kOONullPixMap;
 	
-	if (_bytes != NULL)
+	if (_bytes != NULL && _compressedFormat == 0)
 	{
 		// If possible, just copy our existing buffer.
 		px = OOMakePixMap(_bytes, _width, _height, _format, 0, 0);
@@ -421,8 +455,21 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 {
 	OOPixMap		pm;
 	
+#if OOTEXTURE_RELOADABLE
+	if (_evicted && _loader == nil)  [self reloadAfterEviction];
+#endif
+	
+	_compressedFormat = 0;
+	_compressOnUpload = NO;
+	DESTROY(_diskCacheKey);
+	
 	// This will block until loading is completed, if necessary.
-	if ([_loader getResult:&pm format:&_format originalWidth:&_originalWidth originalHeight:&_originalHeight])
+	if ([_loader getCompressedResult:&_bytes compressedFormat:&_compressedFormat width:&_width height:&_height originalWidth:&_originalWidth originalHeight:&_originalHeight])
+	{
+		_format = kOOTextureDataRGBA;
+		[self uploadTexture];
+	}
+	else if ([_loader getResult:&pm format:&_format originalWidth:&_originalWidth originalHeight:&_originalHeight])
 	{
 		_bytes = pm.pixels;
 		_width = pm.width;
@@ -445,6 +492,12 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 		}
 #endif
 		
+		if ([_loader shouldCompressOnUpload])
+		{
+			_compressOnUpload = YES;
+			_diskCacheKey = [[_loader diskCacheKey] copy];
+		}
+		
 		[self uploadTexture];
 	}
 	else
@@ -455,11 +508,25 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 	}
 	
 	_loaded = YES;
+#if OOTEXTURE_RELOADABLE
+	_evicted = NO;
+#endif
 	
+	if (_loader != nil)  _loadTime = [_loader loadTime];
 	DESTROY(_loader);
 }
 
 
+- (void)ensureDimensionsKnown
+{
+#if OOTEXTURE_RELOADABLE
+	// An evicted texture keeps its dimensions, so there's no need to wait for it to reload.
+	if (_evicted)  return;
+#endif
+	[self ensureFinishedLoading];
+}
+
+
 - (void) uploadTexture
 {
 	GLint					filter;
@@ -520,6 +587,9 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 		{
 			[self uploadTextureDataWithMipMap:mipMap format:_format];
 			OOLog(@"texture.upload", @"Uploaded texture %u (%ux%u pixels, %@)", _textureName, _width, _height, _key);
+#if OO_TEXTURE_COMPRESSION
+			if (_baseLevel == 0)  [self storeCompressedTexture];
+#endif
 		}
 #if OO_TEXTURE_CUBE_MAP
 		else if (texTarget == GL_TEXTURE_CUBE_MAP)
@@ -537,7 +607,8 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 		_uploaded = YES;
 		
 #if OOTEXTURE_RELOADABLE
-		if ([self isReloadable])
+		// A streaming texture still needs its data for the remaining mip levels.
+		if ([self isReloadable] && _baseLevel == 0)
 		{
 			free(_bytes);
 			_bytes = NULL;
@@ -560,11 +631,45 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 	
 	if (!DecodeFormat(format, _options, &glFormat, &internalFormat, &type))  return;
 	
+	if (mipMap && gOOTextureInfo.streamingEnabled && gOOTextureInfo.textureMaxLevelAvailable)
+	{
+		/*	Upload the levels no bigger than kStreamingInitialSize now, and
+			leave the rest to -refineStreamedTexture.
+		*/
+		unsigned levelCount = 0, firstLevel = 0;
+		for (; 0 < w && 0 < h; w >>= 1, h >>= 1)
+		{
+			if (MAX(w, h) > kStreamingInitialSize)  firstLevel++;
+			levelCount++;
+		}
+		firstLevel = MIN(firstLevel, levelCount - 1);
+		
+		if (firstLevel != 0)
+		{
+			for (level = firstLevel; level < levelCount; level++)
+			{
+				w = _width >> level;
+				h = _height >> level;
+				bytes = (char *)_bytes + MipLevelOffset(_width, _height, components, _compressedFormat, level);
+				[self uploadMipLevel:level width:w height:h bytes:bytes];
+			}
+			
+			_mipLevels = levelCount - 1;
+			_baseLevel = firstLevel;
+			OOGL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _mipLevels));
+			OOGL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, _baseLevel));
+			OOTextureSetStreaming(self, YES);
+			return;
+		}
+		
+		w = _width;
+		h = _height;
+	}
+	
 	while (0 < w && 0 < h)
 	{
-		OOGL(glTexImage2D(GL_TEXTURE_2D, level++, internalFormat, w, h, 0, glFormat, type, bytes));
+		bytes += [self uploadMipLevel:level++ width:w height:h bytes:bytes];
 		if (!mipMap)  return;
-		bytes += w * components * h;
 		w >>= 1;
 		h >>= 1;
 	}
@@ -603,6 +708,7 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 		while (0 < w)
 		{
 			OOGL(glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, level++, internalFormat, w, w, 0, glFormat, type, bytes));
+			[self noteUploadedBytes:w * w * components];
 			if (!mipMap)  break;
 			bytes += w * w * components;
 			w >>= 1;
@@ -629,11 +735,8 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 {
 	if (_loaded && _uploaded && _valid)
 	{
-		OO_ENTER_OPENGL();
-		
 		_uploaded = NO;
-		OOGL(glDeleteTextures(1, &_textureName));
-		_textureName = 0;
+		[self deleteTextureName];
 		
 #if OOTEXTURE_RELOADABLE
 		if ([self isReloadable])
@@ -646,11 +749,206 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 			_uploaded = NO;
 			_valid = NO;
 			
-			_loader = [[OOTextureLoader loaderWithPath:_path options:_options] retain];
+			_loader = [[OOTextureLoader loaderWithPath:_path options:_options allowCompression:(_options & kOOTextureAllowCompression) != 0] retain];
+		}
+#endif
+	}
+}
+
+
+- (size_t) residentBytes
+{
+	return _residentBytes;
+}
+
+
+- (uint32_t) lastUsedFrame
+{
+	return _lastUsedFrame;
+}
+
+
+- (OOTimeDelta) loadTime
+{
+	return _loadTime;
+}
+
+
+- (size_t) refineStreamedTexture
+{
+	if (_baseLevel == 0 || !_uploaded || _bytes == NULL)  return 0;
+	
+	OO_ENTER_OPENGL();
+	
+	uint8_t components = OOTextureComponentsForFormat(_format);
+	
+	unsigned level = _baseLevel - 1;
+	uint32_t w = _width >> level, h = _height >> level;
+	char *bytes = (char *)_bytes + MipLevelOffset(_width, _height, components, _compressedFormat, level);
+	
+	OOGL(glBindTexture(GL_TEXTURE_2D, _textureName));
+	size_t size = [self uploadMipLevel:level width:w height:h bytes:bytes];
+	OOGL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level));
+	
+	_baseLevel = level;
+	
+	if (_baseLevel == 0)
+	{
+		OOTextureSetStreaming(self, NO);
+#if OO_TEXTURE_COMPRESSION
+		[self storeCompressedTexture];
+#endif
+#if OOTEXTURE_RELOADABLE
+		if ([self isReloadable])
+		{
+			free(_bytes);
+			_bytes = NULL;
 		}
 #endif
 	}
+	
+	return size;
+}
+
+
+- (BOOL) evictFromGPU
+{
+#if OOTEXTURE_RELOADABLE
+	if (!_loaded || !_uploaded || !_valid || ![self isReloadable])  return NO;
+	
+	OOLog(@"texture.evict.texture", @"Evicting texture %@", self);
+	
+	[self deleteTextureName];
+	free(_bytes);
+	_bytes = NULL;
+	_loaded = NO;
+	_uploaded = NO;
+	_valid = NO;
+	_evicted = YES;
+	
+	return YES;
+#else
+	return NO;
+#endif
+}
+
+
+// Upload one level of a 2D texture, returning the size of its data in _bytes.
+- (size_t) uploadMipLevel:(unsigned)level width:(uint32_t)w height:(uint32_t)h bytes:(const char *)bytes
+{
+	OO_ENTER_OPENGL();
+	
+	size_t size = OOTextureMipLevelSize(w, h, OOTextureComponentsForFormat(_format), _compressedFormat);
+	
+#if OO_TEXTURE_COMPRESSION
+	if (_compressedFormat != 0)
+	{
+		OOGL(glCompressedTexImage2DARB(GL_TEXTURE_2D, level, _compressedFormat, w, h, 0, size, bytes));
+		[self noteUploadedBytes:size];
+		return size;
+	}
+#endif
+	
+	GLenum glFormat = 0, internalFormat = 0, type = 0;
+	if (!DecodeFormat(_format, _options, &glFormat, &internalFormat, &type))  return size;
+	
+	size_t residentSize = size;
+#if OO_TEXTURE_COMPRESSION
+	if (_compressOnUpload)
+	{
+		internalFormat = kOOTextureCompressedFormat;
+		residentSize = OOTextureMipLevelSize(w, h, 0, kOOTextureCompressedFormat);
+	}
+#endif
+	
+	OOGL(glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, glFormat, type, bytes));
+	[self noteUploadedBytes:residentSize];
+	
+	return size;
+}
+
+
+- (void) noteUploadedBytes:(size_t)size
+{
+	_residentBytes += size;
+	OOTextureAdjustResidentBytes(size);
+}
+
+
+- (void) deleteTextureName
+{
+	if (_textureName != 0)
+	{
+		OO_ENTER_OPENGL();
+		OOGL(glDeleteTextures(1, &_textureName));
+		_textureName = 0;
+	}
+	
+	OOTextureAdjustResidentBytes(-(long long)_residentBytes);
+	_residentBytes = 0;
+	_baseLevel = 0;
+	OOTextureSetStreaming(self, NO);
+}
+
+
+#if OO_TEXTURE_COMPRESSION
+/*	Read back the texture the driver compressed on upload, and cache it. The
+	texture must be bound and fully uploaded.
+*/
+- (void) storeCompressedTexture
+{
+	if (!_compressOnUpload || _diskCacheKey == nil)  return;
+	
+	NSString *key = [_diskCacheKey autorelease];
+	_diskCacheKey = nil;
+	
+	OOTextureDiskCache *cache = [OOTextureDiskCache sharedTextureDiskCache];
+	if (cache == nil)  return;
+	
+	OO_ENTER_OPENGL();
+	
+	// Check that the driver has compressed every level as expected.
+	size_t totalSize = 0;
+	unsigned level;
+	for (level = 0; level <= _mipLevels; level++)
+	{
+		GLint compressed = GL_FALSE, size = 0;
+		OOGL(glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_ARB, &compressed));
+		OOGL(glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE_ARB, &size));
+		
+		if (!compressed || (size_t)size != OOTextureMipLevelSize(_width >> level, _height >> level, 0, kOOTextureCompressedFormat))
+		{
+			OOLog(@"texture.cache.compress.failed", @"Texture %@ was not compressed as expected, and will not be cached.", self);
+			return;
+		}
+		totalSize += size;
+	}
+	
+	char *data = malloc(totalSize);
+	if (EXPECT_NOT(data == NULL))  return;
+	
+	char *next = data;
+	for (level = 0; level <= _mipLevels; level++)
+	{
+		OOGL(glGetCompressedTexImageARB(GL_TEXTURE_2D, level, next));
+		next += OOTextureMipLevelSize(_width >> level, _height >> level, 0, kOOTextureCompressedFormat);
+	}
+	
+	OOTextureDiskCacheInfo info =
+	{
+		.width = _width,
+		.height = _height,
+		.originalWidth = _originalWidth,
+		.originalHeight = _originalHeight,
+		.format = kOOTextureDataRGBA,
+		.compressedFormat = kOOTextureCompressedFormat,
+		.mipMapped = YES,
+		.isCubeMap = NO,
+		.dataSize = totalSize
+	};
+	[cache storeDataAsynchronously:data info:&info forKey:key];
 }
+#endif
 
 
 #if OOTEXTURE_RELOADABLE
@@ -660,6 +958,13 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 	return _path != nil;
 }
 
+
+- (void) reloadAfterEviction
+{
+	OOLog(@"texture.reload", @"Reloading evicted texture %@", self);
+	_loader = [[OOTextureLoader loaderWithPath:_path options:_options allowCompression:(_options & kOOTextureAllowCompression) != 0] retain];
+}
+
 #endif
 
 @end
@@ -702,3 +1007,17 @@ static BOOL DecodeFormat(OOTextureDataFormat format, uint32_t options, GLenum *o
 			return NO;
 	}
 }
+
+
+// Offset of a mip level in a chain laid out as by OOGenerateMipMaps(), or as cached in compressed form.
+static size_t MipLevelOffset(uint32_t width, uint32_t height, uint8_t components, GLenum compressedFormat, unsigned level)
+{
+	size_t offset = 0;
+	while (level-- > 0)
+	{
+		offset += OOTextureMipLevelSize(width, height, components, compressedFormat);
+		width >>= 1;
+		height >>= 1;
+	}
+	return offset;
+}
@@ -58,6 +58,21 @@ NSString * const kOOMaterialParallaxBias					= @"parallax_bias";
 NSString * const kOOMaterialShininess						= @"shininess";
 
 
+/*	Colour maps may be block-compressed when uploaded, unless their specifiers
+	say otherwise. Normal maps, and textures of custom shader materials, are
+	only compressed if they ask for it, since they may hold data which
+	doesn't survive compression.
+*/
+static NSDictionary *ColorMapSpecifier(NSDictionary *specifier)
+{
+	if (specifier == nil || [specifier objectForKey:@"allow_compression"] != nil)  return specifier;
+	
+	NSMutableDictionary *result = [NSMutableDictionary dictionaryWithDictionary:specifier];
+	[result setObject:[NSNumber numberWithBool:YES] forKey:@"allow_compression"];
+	return result;
+}
+
+
 @implementation NSDictionary (OOMateralProperties)
 
 - (OOColor *) oo_diffuseColor
@@ -133,7 +148,7 @@ NSString * const kOOMaterialShininess						= @"shininess";
 
 - (NSDictionary *) oo_diffuseMapSpecifierWithDefaultName:(NSString *)name
 {
-	return [self oo_textureSpecifierForKey:kOOMaterialDiffuseMapName defaultName:name];
+	return ColorMapSpecifier([self oo_textureSpecifierForKey:kOOMaterialDiffuseMapName defaultName:name]);
 }
 
 
@@ -141,7 +156,7 @@ NSString * const kOOMaterialShininess						= @"shininess";
 {
 	// Can't use -oo_shininess for reasons of recursion.
 	if ([self oo_intForKey:kOOMaterialShininess defaultValue:-1] == 0)  return nil;
-	return [self oo_textureSpecifierForKey:kOOMaterialSpecularMapName defaultName:nil];
+	return ColorMapSpecifier([self oo_textureSpecifierForKey:kOOMaterialSpecularMapName defaultName:nil]);
 }
 
 
@@ -160,20 +175,20 @@ NSString * const kOOMaterialShininess						= @"shininess";
 
 - (NSDictionary *) oo_emissionMapSpecifier
 {
-	return [self oo_textureSpecifierForKey:kOOMaterialEmissionMapName defaultName:nil];
+	return ColorMapSpecifier([self oo_textureSpecifierForKey:kOOMaterialEmissionMapName defaultName:nil]);
 }
 
 
 - (NSDictionary *) oo_illuminationMapSpecifier
 {
-	return [self oo_textureSpecifierForKey:kOOMaterialIlluminationMapName defaultName:nil];
+	return ColorMapSpecifier([self oo_textureSpecifierForKey:kOOMaterialIlluminationMapName defaultName:nil]);
 }
 
 
 - (NSDictionary *) oo_emissionAndIlluminationMapSpecifier
 {
 	if ([self oo_emissionMapSpecifier] != nil || [self oo_illuminationMapSpecifier] != nil)  return nil;
-	return [self oo_textureSpecifierForKey:kOOMaterialEmissionAndIlluminationMapName defaultName:nil];
+	return ColorMapSpecifier([self oo_textureSpecifierForKey:kOOMaterialEmissionAndIlluminationMapName defaultName:nil]);
 }
 
 
@@ -0,0 +1,59 @@
+/*
+
+OOPlanetTextureCache.h
+
+Disk cache for the output of OOPlanetTextureGenerator, so that revisiting a
+system (in the same session or a later one) reads its planet textures from a
+file instead of generating them again.
+
+Each entry is a single file holding the RGBA maps produced by one run of the
+generator: the diffuse map, followed by the normal map and atmosphere if they
+were generated. Entries are keyed by a string which must describe every
+parameter the maps depend on, including the generator version; the key is
+stored in the file and checked on load, so hash collisions are harmless.
+
+The total size of the cache is limited by the user default
+"planet-texture-cache-size", in megabytes (default 256; 0 disables the
+cache). Storage and eviction are handled by OOLRUFileCache.
+
+The cache may be used from any thread, but +sharedPlanetTextureCache must
+first be called on the main thread.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOLRUFileCache.h"
+
+
+@interface OOPlanetTextureCache: OOLRUFileCache
+
+// Returns nil if the cache is disabled or its folder can't be created.
++ (id) sharedPlanetTextureCache;
+
+/*	Fill buffers[0] to buffers[count - 1], each of which must hold
+	4 * width * height bytes, from the entry for key. Returns NO, leaving the
+	buffers in an unspecified state, if there is no matching entry.
+*/
+- (BOOL) loadMapsForKey:(NSString *)key width:(unsigned)width height:(unsigned)height buffers:(uint8_t **)buffers count:(unsigned)count;
+
+- (void) storeMapsForKey:(NSString *)key width:(unsigned)width height:(unsigned)height buffers:(uint8_t **)buffers count:(unsigned)count;
+
+@end
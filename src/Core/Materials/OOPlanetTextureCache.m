@@ -0,0 +1,160 @@
+/*
+
+OOPlanetTextureCache.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOPlanetTextureCache.h"
+
+
+static NSString * const kOOPlanetTextureCacheFolder = @"Planet Textures";
+static NSString * const kOOPlanetTextureCacheExtension = @"ooplanet";
+
+
+enum
+{
+	kPlanetTextureCacheMagic		= 0x4F4F5054,	// 'OOPT'
+	kPlanetTextureCacheEndianTag	= 0x01020304,
+	kPlanetTextureCacheAlignment	= 16,
+	kPlanetTextureCacheMaxMaps		= 3,
+	kDefaultCacheSizeMegabytes		= 256
+};
+
+
+/*	File layout: header, key (UTF-8, not terminated), padding to
+	kPlanetTextureCacheAlignment, then mapCount maps of 4 * width * height
+	bytes each. The file is written in native byte order; a file from a
+	machine of the other endianness simply fails to match.
+*/
+typedef struct
+{
+	uint32_t			magic;
+	uint32_t			endianTag;
+	uint32_t			width;
+	uint32_t			height;
+	uint32_t			mapCount;
+	uint32_t			keyLength;
+} OOPlanetTextureCacheHeader;
+
+
+static OOPlanetTextureCache *sSingleton = nil;
+
+
+OOINLINE size_t MapOffset(size_t keyLength)
+{
+	return (sizeof (OOPlanetTextureCacheHeader) + keyLength + kPlanetTextureCacheAlignment - 1) & ~(size_t)(kPlanetTextureCacheAlignment - 1);
+}
+
+
+@implementation OOPlanetTextureCache
+
++ (id) sharedPlanetTextureCache
+{
+	static BOOL inited = NO;
+	
+	if (!inited)
+	{
+		inited = YES;
+		sSingleton = [[self alloc] initWithFolderName:kOOPlanetTextureCacheFolder
+											extension:kOOPlanetTextureCacheExtension
+										 sizeLimitKey:@"planet-texture-cache-size"
+								 defaultSizeLimitInMB:kDefaultCacheSizeMegabytes];
+	}
+	
+	return sSingleton;
+}
+
+
+- (BOOL) loadMapsForKey:(NSString *)key width:(unsigned)width height:(unsigned)height buffers:(uint8_t **)buffers count:(unsigned)count
+{
+	NSParameterAssert(key != nil && buffers != NULL && count <= kPlanetTextureCacheMaxMaps);
+	
+	NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+	size_t keyLength = [keyData length];
+	size_t mapSize = 4 * (size_t)width * height;
+	size_t mapOffset = MapOffset(keyLength);
+	
+	NSData *data = [self mappedEntryForKey:key];
+	if (data == nil || [data length] != mapOffset + count * mapSize)  return NO;
+	
+	const OOPlanetTextureCacheHeader *header = [data bytes];
+	if (header->magic != kPlanetTextureCacheMagic ||
+		header->endianTag != kPlanetTextureCacheEndianTag ||
+		header->width != width ||
+		header->height != height ||
+		header->mapCount != count ||
+		header->keyLength != keyLength ||
+		memcmp(header + 1, [keyData bytes], keyLength) != 0)
+	{
+		return NO;
+	}
+	
+	const uint8_t *maps = (const uint8_t *)[data bytes] + mapOffset;
+	unsigned i;
+	for (i = 0; i < count; i++)
+	{
+		memcpy(buffers[i], maps + i * mapSize, mapSize);
+	}
+	
+	[self touchEntryForKey:key];
+	return YES;
+}
+
+
+- (void) storeMapsForKey:(NSString *)key width:(unsigned)width height:(unsigned)height buffers:(uint8_t **)buffers count:(unsigned)count
+{
+	NSParameterAssert(key != nil && buffers != NULL && count <= kPlanetTextureCacheMaxMaps);
+	
+	NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+	size_t keyLength = [keyData length];
+	size_t mapSize = 4 * (size_t)width * height;
+	size_t mapOffset = MapOffset(keyLength);
+	unsigned long long fileSize = mapOffset + count * mapSize;
+	
+	// Don't build an entry OOLRUFileCache would refuse.
+	if (fileSize > [self sizeLimit] / 2)  return;
+	
+	NSMutableData *data = [[NSMutableData alloc] initWithCapacity:fileSize];
+	OOPlanetTextureCacheHeader header =
+	{
+		.magic = kPlanetTextureCacheMagic,
+		.endianTag = kPlanetTextureCacheEndianTag,
+		.width = width,
+		.height = height,
+		.mapCount = count,
+		.keyLength = keyLength
+	};
+	[data appendBytes:&header length:sizeof header];
+	[data appendData:keyData];
+	[data setLength:mapOffset];
+	
+	unsigned i;
+	for (i = 0; i < count; i++)
+	{
+		[data appendBytes:buffers[i] length:mapSize];
+	}
+	
+	[self storeEntry:data forKey:key];
+	[data release];
+}
+
+@end
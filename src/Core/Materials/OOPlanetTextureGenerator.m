@@ -42,6 +42,8 @@
 #import "OOColor.h"
 #import "OOTexture.h"
 #import "Universe.h"
+#import "OOAsyncWorkManager.h"
+#import "OOPlanetTextureCache.h"
 #endif
 
 #if DEBUG_DUMP
@@ -57,13 +59,44 @@
 
 enum
 {
-	kRandomBufferSize		= 128
+	kRandomBufferSize		= 128,
+	
+	/*	Each pass over the texture is split into bands of this many rows,
+		which are generated in parallel. Every pixel is calculated exactly as
+		it would be serially, so the result doesn't depend on the banding.
+	*/
+	kRowsPerBand			= 16,
+	
+	/*	Part of the key for the disk cache. Increment this whenever a change
+		to the generator changes its output.
+	*/
+	kPlanetTextureGeneratorVersion	= 1
 };
 
 
+/*	State shared by the bands of the colour pass, which fills the diffuse,
+	normal and atmosphere maps from the q buffer.
+*/
+typedef struct
+{
+	OOPlanetTextureGeneratorInfo	*info;
+	uint8_t							*buffer;
+	uint8_t							*nBuffer;
+	uint8_t							*aBuffer;
+	float							poleValue;
+	float							seaBias;
+	float							paleClouds;
+	float							normalScale;
+	FloatRGBA						cloudColor;
+} OOPlanetColorPassContext;
+
+
 @interface OOPlanetTextureGenerator (Private)
 
 - (NSString *) cacheKeyForType:(NSString *)type;
+#ifndef TEXGEN_TEST_RIG
+- (NSString *) diskCacheKey;
+#endif
 - (OOTextureGenerator *) normalMapGenerator;	// Must be called before generator is enqueued for rendering.
 - (OOTextureGenerator *) atmosphereGenerator;	// Must be called before generator is enqueued for rendering.
 
@@ -115,6 +148,10 @@ static BOOL FillFBMBuffer(OOPlanetTextureGeneratorInfo *info);
 static float QFactor(float *accbuffer, int x, int y, unsigned width, float polar_y_value, float bias, float polar_y);
 static float GetQ(float *qbuffer, unsigned x, unsigned y, unsigned width, unsigned height, unsigned widthMask, unsigned heightMask);
 
+static void RunBands(unsigned height, OOAsyncBatchFunction function, void *context);
+static void QPassBand(void *context, OOUInteger band);
+static void ColorPassBand(void *context, OOUInteger band);
+
 static FloatRGB Blend(float fraction, FloatRGB a, FloatRGB b);
 static void SetMixConstants(OOPlanetTextureGeneratorInfo *info, float temperatureFraction);
 static FloatRGBA CloudMix(OOPlanetTextureGeneratorInfo *info, float q, float nearPole);
@@ -174,6 +211,9 @@ enum
 		{
 			_planetScale = kPlanetScaleFullDetail;
 		}
+		
+		// Set up the disk cache on the main thread, before it's used by the generator thread.
+		[OOPlanetTextureCache sharedPlanetTextureCache];
 #else
 		_planetScale = kPlanetScale4096x4096;
 #endif
@@ -313,6 +353,17 @@ enum
 }
 
 
+#ifndef TEXGEN_TEST_RIG
+- (NSString *) diskCacheKey
+{
+	// The atmosphere's cache key doesn't cover the cloud parameters, so they're added here.
+	return [NSString stringWithFormat:@"%@\nv%u/%f,%f/%f,%f,%f", [self cacheKey], kPlanetTextureGeneratorVersion,
+			_info.cloudAlpha, _info.cloudFraction,
+			_info.cloudColor.r, _info.cloudColor.g, _info.cloudColor.b];
+}
+#endif
+
+
 - (OOTextureGenerator *) normalMapGenerator
 {
 	if (_nMapGenerator == nil)
@@ -368,9 +419,9 @@ enum
 	BOOL generateNormalMap = (_nMapGenerator != nil);
 	BOOL generateAtmosphere = (_atmoGenerator != nil);
 	
-	uint8_t		*buffer = NULL, *px = NULL;
-	uint8_t		*nBuffer = NULL, *npx = NULL;
-	uint8_t		*aBuffer = NULL, *apx = NULL;
+	uint8_t		*buffer = NULL;
+	uint8_t		*nBuffer = NULL;
+	uint8_t		*aBuffer = NULL;
 	float		*randomBuffer = NULL;
 	
 	height = _info.height = 1 << (_planetScale + kPlanetScaleOffset);
@@ -381,31 +432,57 @@ enum
 	
 	buffer = malloc(4 * width * height);
 	FAIL_IF_NULL(buffer);
-	px = buffer;
 	
 	if (generateNormalMap)
 	{
 		nBuffer = malloc(4 * width * height);
 		FAIL_IF_NULL(nBuffer);
-		npx = nBuffer;
 	}
 	
 	if (generateAtmosphere)
 	{
 		aBuffer = malloc(4 * width * height);
 		FAIL_IF_NULL(aBuffer);
-		apx = aBuffer;
 	}
 	
+#ifndef TEXGEN_TEST_RIG
+	OOPlanetTextureCache *diskCache = [OOPlanetTextureCache sharedPlanetTextureCache];
+	NSString *diskCacheKey = nil;
+	uint8_t *maps[3] = { buffer };
+	unsigned mapCount = 1;
+	if (generateNormalMap)  maps[mapCount++] = nBuffer;
+	if (generateAtmosphere)  maps[mapCount++] = aBuffer;
+	
+	if (diskCache != nil)
+	{
+		diskCacheKey = [self diskCacheKey];
+		if ([diskCache loadMapsForKey:diskCacheKey width:width height:height buffers:maps count:mapCount])
+		{
+			OOLog(@"planetTex.temp", @"Loaded generator %@ from disk cache", self);
+			success = YES;
+			format = kOOTextureDataRGBA;
+			goto END;
+		}
+	}
+#endif
+	
 	FAIL_IF(!FillFBMBuffer(&_info));
 #if DEBUG_DUMP_RAW
 	[self dumpNoiseBuffer:_info.fbmBuffer];
 #endif
 	
-	//TODO: sort out CloudMix
-	float paleClouds = (_info.cloudFraction * _info.fbmBuffer[0] < 1.0f - _info.cloudFraction) ? 0.0f : 1.0f;
-	float poleValue = (_info.landFraction > 0.5f) ? 0.5f * _info.landFraction : 0.0f;
-	float seaBias = _info.landFraction - 1.0f;
+	OOPlanetColorPassContext passContext =
+	{
+		.info = &_info,
+		.buffer = buffer,
+		.nBuffer = nBuffer,
+		.aBuffer = aBuffer,
+		.poleValue = (_info.landFraction > 0.5f) ? 0.5f * _info.landFraction : 0.0f,
+		.seaBias = _info.landFraction - 1.0f,
+		//TODO: sort out CloudMix
+		.paleClouds = (_info.cloudFraction * _info.fbmBuffer[0] < 1.0f - _info.cloudFraction) ? 0.0f : 1.0f,
+		.cloudColor = (FloatRGBA){ _info.cloudColor.r, _info.cloudColor.g, _info.cloudColor.b, 1.0f }
+	};
 	
 	/*	The system key 'polar_sea_colour' was used as 'paleSeaColour'.
 		The generated texture had presumably iceberg covered shallows.
@@ -415,114 +492,26 @@ enum
 		-- Kaks
 	*/
 	_info.paleSeaColor = Blend(0.45f, _info.polarSeaColor, Blend(0.7f, _info.seaColor, _info.landColor));
-	float normalScale = 1 << _planetScale;
-	if (!generateNormalMap)  normalScale *= 3.0f;
+	passContext.normalScale = 1 << _planetScale;
+	if (!generateNormalMap)  passContext.normalScale *= 3.0f;
 	
 	// Deep sea colour: slightly darkened so the sea isn't just a uniform colour.
 	_info.deepSeaColor = Blend(0.80f, _info.seaColor, (FloatRGB){ 0, 0, 0 });
 	
-	unsigned x, y;
-	FloatRGBA color;
-	FloatRGBA cloudColor = (FloatRGBA){_info.cloudColor.r, _info.cloudColor.g, _info.cloudColor.b, 1.0f};
-	Vector norm;
-	float q, yN, yS, yW, yE, nearPole;
-	GLfloat shade;
-	float rHeight = 1.0f / height;
-	float fy, fHeight = height;
 	// The second parameter is the temperature fraction. Most favourable: 1.0f,  little ice. Most unfavourable: 0.0f, frozen planet. TODO: make it dependent on ranrot / planetinfo key...
 	SetMixConstants(&_info, 0.95f);	// no need to recalculate them inside each loop!
 	
 	// first pass, calculate q.
 	_info.qBuffer = malloc(width * height * sizeof (float));
 	FAIL_IF_NULL(_info.qBuffer);
+	RunBands(height, QPassBand, &passContext);
 	
-	for (y = 0, fy = 0.0f; y < height; y++, fy++)
-	{
-		nearPole = (2.0f * fy - fHeight) * rHeight;
-		nearPole *= nearPole;
-		
-		for (x = 0; x < width; x++)
-		{
-			_info.qBuffer[y * width + x] = QFactor(_info.fbmBuffer, x, y, width, poleValue, seaBias, nearPole);
-		}
-	}
+	// second pass, use q. Each band reads the q values of its neighbouring rows, so this must wait for the first pass.
+	RunBands(height, ColorPassBand, &passContext);
 	
-	// second pass, use q.
-	float cloudAlpha = _info.cloudAlpha;
-	float cloudFraction = _info.cloudFraction;
-	unsigned widthMask = width - 1;
-	unsigned heightMask = height - 1;
-	
-	for (y = 0, fy = 0.0f; y < height; y++, fy++)
-	{
-		nearPole = (2.0f * fy - fHeight) * rHeight;
-		nearPole *= nearPole;
-		
-		for (x = 0; x < width; x++)
-		{
-			q = _info.qBuffer[y * width + x];	// no need to use GetQ, x and y are always within bounds.
-			yN = GetQ(_info.qBuffer, x, y - 1, width, height, widthMask, heightMask);	// recalculates x & y if they go out of bounds.
-			yS = GetQ(_info.qBuffer, x, y + 1, width, height, widthMask, heightMask);
-			yW = GetQ(_info.qBuffer, x - 1, y, width, height, widthMask, heightMask);
-			yE = GetQ(_info.qBuffer, x + 1, y, width, height, widthMask, heightMask);
-			
-			color = PlanetMix(&_info, q, nearPole);
-			
-			norm = vector_normal(make_vector(normalScale * (yW - yE), normalScale * (yS - yN), 1.0f));
-			if (generateNormalMap)
-			{
-				shade = 1.0f;
-				
-				// Flatten in the sea.
-				norm = OOVectorInterpolate(norm, kBasisZVector, color.a);
-				
-				// Put norm in normal map, scaled from [-1..1] to [0..255].
-				*npx++ = 127.5f * (norm.y + 1.0f);
-				*npx++ = 127.5f * (-norm.x + 1.0f);
-				*npx++ = 127.5f * (norm.z + 1.0f);
-				
-				*npx++ = 255.0f * color.a;	// Specular channel.
-			}
-			else
-			{
-				//	Terrain shading - lambertian lighting from straight above.
-				shade = norm.z;
-				
-				/*	We don't want terrain shading in the sea. The alpha channel
-					of color is a measure of "seaishness" for the specular map,
-					so we can recycle that to avoid branching.
-					-- Ahruman
-				*/
-				shade += color.a - color.a * shade;	// equivalent to - but slightly faster than - previous implementation.
-			}
-			
-			*px++ = 255.0f * color.r * shade;
-			*px++ = 255.0f * color.g * shade;
-			*px++ = 255.0f * color.b * shade;
-			
-			*px++ = 0;	// FIXME: light map goes here.
-			
-			if (generateAtmosphere)
-			{
-				//TODO: sort out CloudMix
-				if (NO) 
-				{
-					q = QFactor(_info.fbmBuffer, x, y, width, paleClouds, cloudFraction, nearPole);
-					color = CloudMix(&_info, q, nearPole);
-				}
-				else
-				{
-					q = _info.fbmBuffer[y * width + x];
-					q *= q;
-					color = cloudColor;
-				}
-				*apx++ = 255.0f * color.r;
-				*apx++ = 255.0f * color.g;
-				*apx++ = 255.0f * color.b;
-				*apx++ = 255.0f * cloudAlpha * q;
-			}
-		}
-	}
+#ifndef TEXGEN_TEST_RIG
+	if (diskCache != nil)  [diskCache storeMapsForKey:diskCacheKey width:width height:height buffers:maps count:mapCount];
+#endif
 	
 	success = YES;
 	format = kOOTextureDataRGBA;
@@ -1062,51 +1051,109 @@ static void FillRandomBuffer(float *randomBuffer, RANROTSeed seed)
 }
 
 
-static void AddNoise(OOPlanetTextureGeneratorInfo *info, float *randomBuffer, float octave, unsigned octaveMask, float scale, float *qxBuffer, int *ixBuffer)
+/*	Per-octave noise parameters. The column lookups depend only on x, so they
+	are worked out once per octave and shared by all bands.
+*/
+typedef struct
 {
-	unsigned	x, y;
-	unsigned	width = info->width, height = info->height;
-	int			ix, jx, iy, jy;
+	float							rr;
+	unsigned						octaveMask;
+	float							scale;
+	const int						*ixBuffer;
+	const int						*jxBuffer;
+	const float						*qxBuffer;
+} OOPlanetNoiseOctave;
+
+
+typedef struct
+{
+	OOPlanetTextureGeneratorInfo	*info;
+	const float						*randomBuffer;
+	unsigned						octaveCount;
+	OOPlanetNoiseOctave				*octaves;
+} OOPlanetNoiseContext;
+
+
+static void SetUpNoiseOctave(OOPlanetNoiseOctave *octaveInfo, unsigned width, float octave, unsigned octaveMask, float scale, int *ixBuffer, int *jxBuffer, float *qxBuffer)
+{
+	unsigned	x;
+	int			ix, jx;
 	float		rr = octave / width;
-	float		fx, fy, qx, qy, rix, rjx, rfinal;
-	float		*dst = info->fbmBuffer;
+	float		fx, qx;
+	
+	for (fx = 0, x = 0; x < width; fx++, x++)
+	{
+		qx = fx * rr;
+		ix = fast_floor(qx);
+		qx -= ix;
+		ix &= (kRandomBufferSize - 1);
+		jx = (ix + 1) & octaveMask;
+		jx &= (kRandomBufferSize - 1);
+		ixBuffer[x] = ix;
+		jxBuffer[x] = jx;
+		qxBuffer[x] = Hermite(qx);
+	}
+	
+	octaveInfo->rr = rr;
+	octaveInfo->octaveMask = octaveMask;
+	octaveInfo->scale = scale;
+	octaveInfo->ixBuffer = ixBuffer;
+	octaveInfo->jxBuffer = jxBuffer;
+	octaveInfo->qxBuffer = qxBuffer;
+}
+
+
+static void AddNoiseToRow(float *dst, const float *randomBuffer, const OOPlanetNoiseOctave *octave, unsigned width, float fy)
+{
+	unsigned	x;
+	int			iy, jy;
+	float		qy, rix, rjx;
+	float		scale = octave->scale;
+	
+	qy = fy * octave->rr;
+	iy = fast_floor(qy);
+	jy = (iy + 1) & octave->octaveMask;
+	qy = Hermite(qy - iy);
+	iy &= (kRandomBufferSize - 1);
+	jy &= (kRandomBufferSize - 1);
+	
+	/*	No branches or loop-carried dependencies, so the compiler is free to
+		vectorise this; the arithmetic for each pixel is unchanged.
+	*/
+	const float *iRow = randomBuffer + iy * kRandomBufferSize;
+	const float *jRow = randomBuffer + jy * kRandomBufferSize;
+	const int *ixBuffer = octave->ixBuffer;
+	const int *jxBuffer = octave->jxBuffer;
+	const float *qxBuffer = octave->qxBuffer;
 	
-	for (fy = 0, y = 0; y < height; fy++, y++)
+	for (x = 0; x < width; x++)
 	{
-		qy = fy * rr;
-		iy = fast_floor(qy);
-		jy = (iy + 1) & octaveMask;
-		qy = Hermite(qy - iy);
-		iy &= (kRandomBufferSize - 1);
-		jy &= (kRandomBufferSize - 1);
+		int ix = ixBuffer[x], jx = jxBuffer[x];
+		float qx = qxBuffer[x];
 		
-		for (fx = 0, x = 0; x < width; fx++, x++)
+		rix = Lerp(iRow[ix], iRow[jx], qx);
+		rjx = Lerp(jRow[ix], jRow[jx], qx);
+		dst[x] += scale * Lerp(rix, rjx, qy);
+	}
+}
+
+
+static void NoiseBand(void *context, OOUInteger band)
+{
+	OOPlanetNoiseContext *noise = context;
+	OOPlanetTextureGeneratorInfo *info = noise->info;
+	unsigned width = info->width;
+	unsigned yStart = band * kRowsPerBand;
+	unsigned yEnd = MIN(yStart + kRowsPerBand, info->height);
+	unsigned i, y;
+	float fy;
+	
+	// Octaves are added in the same order as when the whole buffer was done one octave at a time.
+	for (i = 0; i < noise->octaveCount; i++)
+	{
+		for (y = yStart, fy = y; y < yEnd; y++, fy++)
 		{
-			if (y == 0)
-			{
-				// first pass: initialise buffers.
-				qx = fx * rr;
-				ix = fast_floor(qx);
-				qx -= ix;
-				ix &= (kRandomBufferSize - 1);
-				ixBuffer[x] = ix;
-				qxBuffer[x] = Hermite(qx);
-			}
-			else
-			{
-				// later passes: grab the stored values.
-				ix = ixBuffer[x];
-				qx = qxBuffer[x];
-			}
-			
-			jx = (ix + 1) & octaveMask;
-			jx &= (kRandomBufferSize - 1);
-			
-			rix = Lerp(randomBuffer[iy * kRandomBufferSize + ix], randomBuffer[iy * kRandomBufferSize + jx], qx);
-			rjx = Lerp(randomBuffer[jy * kRandomBufferSize + ix], randomBuffer[jy * kRandomBufferSize + jx], qx);
-			rfinal = Lerp(rix, rjx, qy);
-			
-			*dst++ += scale * rfinal;
+			AddNoiseToRow(info->fbmBuffer + y * width, noise->randomBuffer, &noise->octaves[i], width, fy);
 		}
 	}
 }
@@ -1114,35 +1161,48 @@ static void AddNoise(OOPlanetTextureGeneratorInfo *info, float *randomBuffer, fl
 
 static BOOL GenerateFBMNoise(OOPlanetTextureGeneratorInfo *info)
 {
+	unsigned height = info->height;
+	unsigned width = info->width;
+	unsigned octaveMask = 8 * kPlanetAspectRatio;
+	unsigned octaveCount = 0;
+	
+	while ((octaveMask << octaveCount) < height)  octaveCount++;
+	
 	// Allocate the temporary buffers we need in one fell swoop, to avoid administrative overhead.
 	size_t randomBufferSize = kRandomBufferSize * kRandomBufferSize * sizeof (float);
-	size_t qxBufferSize = info->width * sizeof (float);
-	size_t ixBufferSize = info->width * sizeof (int);
-	char *sharedBuffer = malloc(randomBufferSize + qxBufferSize + ixBufferSize);
+	size_t octaveInfoSize = octaveCount * sizeof (OOPlanetNoiseOctave);
+	size_t columnBufferSize = width * (sizeof (int) * 2 + sizeof (float));
+	char *sharedBuffer = malloc(randomBufferSize + octaveInfoSize + octaveCount * columnBufferSize);
 	if (sharedBuffer == NULL)  return NO;
 	
 	float *randomBuffer = (float *)sharedBuffer;
-	float *qxBuffer = (float *)(sharedBuffer + randomBufferSize);
-	int *ixBuffer = (int *)(sharedBuffer + randomBufferSize + qxBufferSize);
+	OOPlanetNoiseOctave *octaves = (OOPlanetNoiseOctave *)(sharedBuffer + randomBufferSize);
+	char *columnBuffers = sharedBuffer + randomBufferSize + octaveInfoSize;
 	
 	// Get us some value noise.
 	FillRandomBuffer(randomBuffer, info->seed);
 	
 	// Generate basic fBM noise.
-	unsigned height = info->height;
-	unsigned octaveMask = 8 * kPlanetAspectRatio;
 	float octave = octaveMask;
 	octaveMask -= 1;
 	float scale = 0.5f;
+	unsigned i;
 	
-	while ((octaveMask + 1) < height)
+	for (i = 0; i < octaveCount; i++)
 	{
-		AddNoise(info, randomBuffer, octave, octaveMask, scale, qxBuffer, ixBuffer);
+		int *ixBuffer = (int *)(columnBuffers + i * columnBufferSize);
+		int *jxBuffer = ixBuffer + width;
+		float *qxBuffer = (float *)(jxBuffer + width);
+		SetUpNoiseOctave(&octaves[i], width, octave, octaveMask, scale, ixBuffer, jxBuffer, qxBuffer);
+		
 		octave *= 2.0f;
 		octaveMask = (octaveMask << 1) | 1;
 		scale *= 0.5f;
 	}
 	
+	OOPlanetNoiseContext context = { info, randomBuffer, octaveCount, octaves };
+	RunBands(height, NoiseBand, &context);
+	
 	FREE(sharedBuffer);
 	return YES;
 }
@@ -1179,6 +1239,142 @@ static float GetQ(float *qbuffer, unsigned x, unsigned y, unsigned width, unsign
 }
 
 
+static void RunBands(unsigned height, OOAsyncBatchFunction function, void *context)
+{
+	OOUInteger bandCount = (height + kRowsPerBand - 1) / kRowsPerBand;
+	
+#ifndef TEXGEN_TEST_RIG
+	[[OOAsyncWorkManager sharedAsyncWorkManager] performBatches:bandCount withFunction:function context:context];
+#else
+	OOUInteger band;
+	for (band = 0; band < bandCount; band++)  function(context, band);
+#endif
+}
+
+
+static void QPassBand(void *context, OOUInteger band)
+{
+	OOPlanetColorPassContext *pass = context;
+	OOPlanetTextureGeneratorInfo *info = pass->info;
+	unsigned x, y;
+	unsigned width = info->width, height = info->height;
+	unsigned yEnd = MIN((band + 1) * kRowsPerBand, height);
+	float rHeight = 1.0f / height;
+	float fy, fHeight = height;
+	float poleValue = pass->poleValue, seaBias = pass->seaBias;
+	
+	for (y = band * kRowsPerBand, fy = y; y < yEnd; y++, fy++)
+	{
+		float nearPole = (2.0f * fy - fHeight) * rHeight;
+		nearPole *= nearPole;
+		
+		float *qRow = info->qBuffer + y * width;
+		for (x = 0; x < width; x++)
+		{
+			qRow[x] = QFactor(info->fbmBuffer, x, y, width, poleValue, seaBias, nearPole);
+		}
+	}
+}
+
+
+static void ColorPassBand(void *context, OOUInteger band)
+{
+	OOPlanetColorPassContext *pass = context;
+	OOPlanetTextureGeneratorInfo *info = pass->info;
+	unsigned x, y;
+	unsigned width = info->width, height = info->height;
+	unsigned yEnd = MIN((band + 1) * kRowsPerBand, height);
+	BOOL generateNormalMap = (pass->nBuffer != NULL);
+	BOOL generateAtmosphere = (pass->aBuffer != NULL);
+	FloatRGBA color;
+	Vector norm;
+	float q, yN, yS, yW, yE;
+	GLfloat shade;
+	float rHeight = 1.0f / height;
+	float fy, fHeight = height;
+	float normalScale = pass->normalScale;
+	float cloudAlpha = info->cloudAlpha;
+	unsigned widthMask = width - 1;
+	unsigned heightMask = height - 1;
+	float *qBuffer = info->qBuffer;
+	
+	for (y = band * kRowsPerBand, fy = y; y < yEnd; y++, fy++)
+	{
+		float nearPole = (2.0f * fy - fHeight) * rHeight;
+		nearPole *= nearPole;
+		
+		uint8_t *px = pass->buffer + 4 * width * y;
+		uint8_t *npx = generateNormalMap ? pass->nBuffer + 4 * width * y : NULL;
+		uint8_t *apx = generateAtmosphere ? pass->aBuffer + 4 * width * y : NULL;
+		
+		for (x = 0; x < width; x++)
+		{
+			q = qBuffer[y * width + x];	// no need to use GetQ, x and y are always within bounds.
+			yN = GetQ(qBuffer, x, y - 1, width, height, widthMask, heightMask);	// recalculates x & y if they go out of bounds.
+			yS = GetQ(qBuffer, x, y + 1, width, height, widthMask, heightMask);
+			yW = GetQ(qBuffer, x - 1, y, width, height, widthMask, heightMask);
+			yE = GetQ(qBuffer, x + 1, y, width, height, widthMask, heightMask);
+			
+			color = PlanetMix(info, q, nearPole);
+			
+			norm = vector_normal(make_vector(normalScale * (yW - yE), normalScale * (yS - yN), 1.0f));
+			if (generateNormalMap)
+			{
+				shade = 1.0f;
+				
+				// Flatten in the sea.
+				norm = OOVectorInterpolate(norm, kBasisZVector, color.a);
+				
+				// Put norm in normal map, scaled from [-1..1] to [0..255].
+				*npx++ = 127.5f * (norm.y + 1.0f);
+				*npx++ = 127.5f * (-norm.x + 1.0f);
+				*npx++ = 127.5f * (norm.z + 1.0f);
+				
+				*npx++ = 255.0f * color.a;	// Specular channel.
+			}
+			else
+			{
+				//	Terrain shading - lambertian lighting from straight above.
+				shade = norm.z;
+				
+				/*	We don't want terrain shading in the sea. The alpha channel
+					of color is a measure of "seaishness" for the specular map,
+					so we can recycle that to avoid branching.
+					-- Ahruman
+				*/
+				shade += color.a - color.a * shade;	// equivalent to - but slightly faster than - previous implementation.
+			}
+			
+			*px++ = 255.0f * color.r * shade;
+			*px++ = 255.0f * color.g * shade;
+			*px++ = 255.0f * color.b * shade;
+			
+			*px++ = 0;	// FIXME: light map goes here.
+			
+			if (generateAtmosphere)
+			{
+				//TODO: sort out CloudMix
+				if (NO) 
+				{
+					q = QFactor(info->fbmBuffer, x, y, width, pass->paleClouds, info->cloudFraction, nearPole);
+					color = CloudMix(info, q, nearPole);
+				}
+				else
+				{
+					q = info->fbmBuffer[y * width + x];
+					q *= q;
+					color = pass->cloudColor;
+				}
+				*apx++ = 255.0f * color.r;
+				*apx++ = 255.0f * color.g;
+				*apx++ = 255.0f * color.b;
+				*apx++ = 255.0f * cloudAlpha * q;
+			}
+		}
+	}
+}
+
+
 static void SetMixConstants(OOPlanetTextureGeneratorInfo *info, float temperatureFraction)
 {
 	info->mix_hi = 0.66667f * info->landFraction;
@@ -29,6 +29,7 @@ SOFTWARE.
 #import "OOTexture.h"
 #import "OOCollectionExtractors.h"
 #import "OOFunctionAttributes.h"
+#import "OOMaterialSpecifier.h"
 
 
 @implementation OOSingleTextureMaterial
@@ -39,7 +40,7 @@ SOFTWARE.
 	
 	if (configuration != nil)
 	{
-		texSpec = [configuration oo_textureSpecifierForKey:@"diffuse_map" defaultName:name];
+		texSpec = [configuration oo_diffuseMapSpecifierWithDefaultName:name];
 	}
 	else
 	{
@@ -58,6 +58,7 @@ enum
 	kOOTextureNeverScale			= 0x0200UL,	// Don't rescale texture, even if rect textures are not available. This *must not* be used for regular textures, but may be passed to OOTextureLoader when being used for other purposes.
 	kOOTextureAlphaMask				= 0x0400UL,	// Single-channel texture should be GL_ALPHA, not GL_LUMINANCE. No effect for multi-channel textures.
 	kOOTextureAllowCubeMap			= 0x0800UL,
+	kOOTextureAllowCompression		= 0x8000UL,	// Mip-mapped RGBA texture may be block-compressed when uploaded. Only suitable for colour data; normal maps suffer badly.
 	
 	kOOTextureExtractChannelMask	= 0x7000UL,
 	kOOTextureExtractChannelNone	= 0x0000UL,
@@ -81,6 +82,7 @@ enum
 									| kOOTextureNoFNFMessage
 									| kOOTextureNeverScale
 									| kOOTextureAlphaMask
+									| kOOTextureAllowCompression
 									| kOOTextureExtractChannelMask,
 	
 	kOOTextureFlagsAllowedForRectangleTexture =
@@ -150,6 +152,7 @@ typedef enum
 		anisotropy			(real)
 		texture_LOD_bias	(real)
 		extract_channel		(string, one of "r", "g", "b", "a")
+		allow_compression	(boolean)
  */
 + (id) textureWithConfiguration:(id)configuration;
 + (id) textureWithConfiguration:(id)configuration extraOptions:(uint32_t)extraOptions;
@@ -165,12 +168,23 @@ typedef enum
 
 
 /*	Bind the texture to the current texture unit.
-	This will block until loading is completed.
+	This will block until loading is completed, unless texture streaming is
+	enabled and +setApplyWithoutWaiting: has been used to allow a texture
+	which hasn't finished loading to be drawn without, in which case no
+	texture is bound.
 */
 - (void) apply;
 
 + (void) applyNone;
 
+/*	Allow or forbid -apply to skip textures which are still loading. This is
+	set by OOMesh while applying its materials, so that a newly seen ship is
+	drawn untextured for a frame or two rather than stalling the game; other
+	textures, such as the HUD font and GUI backgrounds, are always waited for.
+	Returns the previous setting, so that calls can be nested.
+*/
++ (BOOL) setApplyWithoutWaiting:(BOOL)flag;
+
 /*	Ensure texture is loaded. This is required because setting up textures
 	inside display lists isn't allowed.
 */
@@ -247,6 +261,12 @@ typedef enum
 // Called by OOGraphicsResetManager as necessary.
 + (void) rebindAllTextures;
 
+/*	Called once per frame before drawing: uploads further mip levels of
+	streaming textures, and evicts least recently used textures if the
+	texture memory budget is exceeded.
+*/
++ (void) updateStreamingTextures;
+
 #ifndef NDEBUG
 - (void) setTrace:(BOOL)trace;
 
@@ -75,6 +75,32 @@ static NSMutableSet			*sAllLiveTextures;
 static OOCache				*sRecentTextures;
 
 
+/*	Texture streaming and memory budget (see OOTextureInternal.h):
+	sStreamingTextures holds textures with mip levels still to upload, as
+	NSValues like sAllLiveTextures. sResidentTextureBytes is the total size of
+	all uploaded texture data; when it exceeds sTextureMemoryBudget, textures
+	are evicted from both sAllLiveTextures and sRecentTextures in order of
+	last use. Textures used in the last kMinFramesBeforeEviction frames are
+	never evicted.
+*/
+enum
+{
+	kDefaultTextureMemoryBudget		= 512,		// Megabytes
+	kStreamingUploadBytesPerFrame	= 1 << 20,
+	kMinFramesBeforeEviction		= 2,
+	kFramesBetweenFailedEvictions	= 60
+};
+
+static NSMutableSet			*sStreamingTextures;
+static long long			sResidentTextureBytes;
+static long long			sTextureMemoryBudget;
+static uint32_t				sFrameStamp = 1;
+static uint32_t				sNextEvictionFrame;
+
+
+static NSComparisonResult CompareByLastUse(id a, id b, void *context);
+
+
 static BOOL					sCheckedExtensions;
 OOTextureInfo				gOOTextureInfo;
 
@@ -233,6 +259,7 @@ static NSString *sGlobalTraceContext = nil;
 - (void) dealloc
 {
 	[sAllLiveTextures removeObject:[NSValue valueWithPointer:self]];
+	[sStreamingTextures removeObject:[NSValue valueWithPointer:self]];
 	
 	[super dealloc];
 }
@@ -258,6 +285,14 @@ static NSString *sGlobalTraceContext = nil;
 }
 
 
++ (BOOL) setApplyWithoutWaiting:(BOOL)flag
+{
+	BOOL result = gOOTextureInfo.applyWithoutWaiting;
+	gOOTextureInfo.applyWithoutWaiting = !!flag;
+	return result;
+}
+
+
 - (void)ensureFinishedLoading
 {
 }
@@ -357,6 +392,100 @@ static NSString *sGlobalTraceContext = nil;
 }
 
 
++ (void) updateStreamingTextures
+{
+	sFrameStamp++;
+	
+	// Refine the most recently used streaming textures first, so visible ones sharpen before others.
+	size_t uploaded = 0;
+	while (uploaded < kStreamingUploadBytesPerFrame && [sStreamingTextures count] != 0)
+	{
+		NSEnumerator *textureEnum = nil;
+		NSValue *box = nil;
+		OOTexture *best = nil;
+		for (textureEnum = [sStreamingTextures objectEnumerator]; (box = [textureEnum nextObject]); )
+		{
+			OOTexture *texture = [box pointerValue];
+			if (best == nil || [texture lastUsedFrame] > [best lastUsedFrame])  best = texture;
+		}
+		
+		size_t size = [best refineStreamedTexture];
+		if (size == 0)  OOTextureSetStreaming(best, NO);
+		uploaded += size;
+	}
+	
+	if (sTextureMemoryBudget <= 0 || sResidentTextureBytes <= sTextureMemoryBudget || sFrameStamp < sNextEvictionFrame)  return;
+	
+	// Collect candidates, retained so that dropping them from sRecentTextures can't deallocate them under us.
+	NSMutableArray *candidates = [NSMutableArray array];
+	NSEnumerator *textureEnum = nil;
+	NSValue *box = nil;
+	for (textureEnum = [sAllLiveTextures objectEnumerator]; (box = [textureEnum nextObject]); )
+	{
+		OOTexture *texture = [box pointerValue];
+		if ([texture residentBytes] != 0 && [texture lastUsedFrame] + kMinFramesBeforeEviction < sFrameStamp)
+		{
+			[candidates addObject:texture];
+		}
+	}
+	[candidates sortUsingFunction:CompareByLastUse context:NULL];
+	
+	// Evict down to 90% of the budget, so that this doesn't happen again on the next upload.
+	long long target = sTextureMemoryBudget - sTextureMemoryBudget / 10;
+	OOUInteger i, count = [candidates count], evicted = 0;
+	for (i = 0; i < count && sResidentTextureBytes > target; i++)
+	{
+		OOTexture *texture = [candidates objectAtIndex:i];
+		if ([texture evictFromGPU])
+		{
+			evicted++;
+			NSString *cacheKey = [texture cacheKey];
+			if (cacheKey != nil && [sRecentTextures objectForKey:cacheKey] == texture)
+			{
+				SET_TRACE_CONTEXT(@"evicting from recent textures cache");
+				[sRecentTextures removeObjectForKey:cacheKey];
+				CLEAR_TRACE_CONTEXT();
+			}
+		}
+	}
+	
+	OOLog(@"texture.evict", @"Evicted %lu textures; %lld KiB of textures now resident (budget %lld KiB).", (unsigned long)evicted, sResidentTextureBytes / 1024, sTextureMemoryBudget / 1024);
+	
+	// If everything resident is in use, don't keep looking every frame.
+	if (sResidentTextureBytes > target)  sNextEvictionFrame = sFrameStamp + kFramesBetweenFailedEvictions;
+}
+
+
+- (size_t) residentBytes
+{
+	return 0;
+}
+
+
+- (uint32_t) lastUsedFrame
+{
+	return 0;
+}
+
+
+- (size_t) refineStreamedTexture
+{
+	return 0;
+}
+
+
+- (BOOL) evictFromGPU
+{
+	return NO;
+}
+
+
+- (OOTimeDelta) loadTime
+{
+	return 0.0;
+}
+
+
 #ifndef NDEBUG
 - (void) setTrace:(BOOL)trace
 {
@@ -496,6 +625,11 @@ static NSString *sGlobalTraceContext = nil;
 	
 	gOOTextureInfo.textureMaxLevelAvailable = ver120 || [extMgr haveExtension:@"GL_SGIS_texture_lod"];
 	
+	gOOTextureInfo.streamingEnabled = ![[NSUserDefaults standardUserDefaults] boolForKey:@"disable-texture-streaming"];
+	sTextureMemoryBudget = [[NSUserDefaults standardUserDefaults] oo_longLongForKey:@"texture-memory-budget" defaultValue:kDefaultTextureMemoryBudget] * 1024 * 1024;
+	
+	gOOTextureInfo.textureCompressionAvailable = [extMgr textureCompressionSupported] && ![[NSUserDefaults standardUserDefaults] boolForKey:@"disable-texture-compression"];
+	
 #if GL_EXT_texture_lod_bias
 	if ([[NSUserDefaults standardUserDefaults] oo_boolForKey:@"use-texture-lod-bias" defaultValue:YES])
 	{
@@ -682,6 +816,7 @@ BOOL OOInterpretTextureSpecifier(id specifier, NSString **outName, uint32_t *out
 		if ([specifier oo_boolForKey:@"repeat_s" defaultValue:NO])  options |= kOOTextureRepeatS;
 		if ([specifier oo_boolForKey:@"repeat_t" defaultValue:NO])  options |= kOOTextureRepeatT;
 		if ([specifier oo_boolForKey:@"cube_map" defaultValue:NO])  options |= kOOTextureAllowCubeMap;
+		if ([specifier oo_boolForKey:@"allow_compression" defaultValue:NO])  options |= kOOTextureAllowCompression;
 		anisotropy = [specifier oo_floatForKey:@"anisotropy" defaultValue:kOOTextureDefaultAnisotropy];
 		lodBias = [specifier oo_floatForKey:@"texture_LOD_bias" defaultValue:kOOTextureDefaultLODBias];
 		
@@ -767,3 +902,46 @@ uint32_t OOApplyTetureOptionDefaults(uint32_t options)
 	
 	return options;
 }
+
+
+uint32_t OOTextureCurrentFrame(void)
+{
+	return sFrameStamp;
+}
+
+
+void OOTextureAdjustResidentBytes(long long delta)
+{
+	sResidentTextureBytes += delta;
+}
+
+
+void OOTextureSetStreaming(OOTexture *texture, BOOL streaming)
+{
+	if (texture == nil)  return;
+	
+	if (streaming)
+	{
+		if (EXPECT_NOT(sStreamingTextures == nil))  sStreamingTextures = [[NSMutableSet alloc] init];
+		[sStreamingTextures addObject:[NSValue valueWithPointer:texture]];
+	}
+	else
+	{
+		[sStreamingTextures removeObject:[NSValue valueWithPointer:texture]];
+	}
+}
+
+
+static NSComparisonResult CompareByLastUse(id a, id b, void *context)
+{
+	uint32_t aFrame = [a lastUsedFrame], bFrame = [b lastUsedFrame];
+	
+	if (aFrame < bFrame)  return NSOrderedAscending;
+	if (aFrame > bFrame)  return NSOrderedDescending;
+	
+	// Same age: evict bigger textures first.
+	size_t aSize = [a residentBytes], bSize = [b residentBytes];
+	if (aSize > bSize)  return NSOrderedAscending;
+	if (aSize < bSize)  return NSOrderedDescending;
+	return NSOrderedSame;
+}
@@ -0,0 +1,80 @@
+/*
+
+OOTextureDiskCache.h
+
+Disk cache for loaded textures, so that a texture file is only decoded,
+rescaled and mip-mapped the first time it is used. Later loads read the
+finished data, including any mip-maps, from a single cache file.
+
+Where block-compressed textures are supported, entries for mip-mapped RGBA
+textures hold the compressed data which the OpenGL driver produced when the
+texture was first uploaded, so that later loads skip compression too and
+read about a quarter as much data. Other entries hold the uncompressed data.
+
+Entries are keyed by a string which must describe the source file
+(including its size and modification date) and every setting which affects
+the result; the key is stored in the file and checked on load. The total
+size of the cache is limited by the user default "texture-cache-size", in
+megabytes (default 512; 0 disables the cache). Storage and eviction are
+handled by OOLRUFileCache.
+
+The cache may be used from any thread, but +sharedTextureDiskCache must
+first be called on the main thread.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOLRUFileCache.h"
+
+
+typedef struct OOTextureDiskCacheInfo
+{
+	uint32_t				width;
+	uint32_t				height;
+	uint32_t				originalWidth;
+	uint32_t				originalHeight;
+	uint32_t				format;				// OOTextureDataFormat
+	uint32_t				compressedFormat;	// OpenGL internal format of block-compressed data, or 0.
+	BOOL					mipMapped;
+	BOOL					isCubeMap;
+	size_t					dataSize;
+} OOTextureDiskCacheInfo;
+
+
+@interface OOTextureDiskCache: OOLRUFileCache
+
+// Returns nil if the cache is disabled or its folder can't be created.
++ (id) sharedTextureDiskCache;
+
+/*	Returns the data for key in a buffer allocated with malloc(), which the
+	caller must free(), and fills in *outInfo. Returns NULL if there is no
+	matching entry.
+*/
+- (void *) loadDataForKey:(NSString *)key info:(OOTextureDiskCacheInfo *)outInfo;
+
+- (void) storeData:(const void *)data info:(const OOTextureDiskCacheInfo *)info forKey:(NSString *)key;
+
+/*	Store data on a worker thread. The cache takes ownership of data, which
+	must have been allocated with malloc().
+*/
+- (void) storeDataAsynchronously:(void *)data info:(const OOTextureDiskCacheInfo *)info forKey:(NSString *)key;
+
+@end
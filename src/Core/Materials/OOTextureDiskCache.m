@@ -0,0 +1,247 @@
+/*
+
+OOTextureDiskCache.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOTextureDiskCache.h"
+#import "OOAsyncWorkManager.h"
+
+
+static NSString * const kOOTextureDiskCacheFolder = @"Textures";
+static NSString * const kOOTextureDiskCacheExtension = @"ootexture";
+
+
+enum
+{
+	kTextureDiskCacheMagic			= 0x4F4F5458,	// 'OOTX'
+	kTextureDiskCacheEndianTag		= 0x01020304,
+	kTextureDiskCacheAlignment		= 16,
+	kDefaultCacheSizeMegabytes		= 512
+};
+
+
+enum
+{
+	kTextureDiskCacheMipMapped		= 0x01,
+	kTextureDiskCacheCubeMap		= 0x02
+};
+
+
+/*	File layout: header, key (UTF-8, not terminated), padding to
+	kTextureDiskCacheAlignment, then dataSize bytes of texture data in the
+	form OOConcreteTexture uploads it: level 0 followed by any mip-maps, or
+	the six faces of a cube map. The file is written in native byte order;
+	a file from a machine of the other endianness simply fails to match.
+*/
+typedef struct
+{
+	uint32_t			magic;
+	uint32_t			endianTag;
+	uint32_t			width;
+	uint32_t			height;
+	uint32_t			originalWidth;
+	uint32_t			originalHeight;
+	uint32_t			format;
+	uint32_t			compressedFormat;
+	uint32_t			flags;
+	uint32_t			keyLength;
+	uint64_t			dataSize;
+} OOTextureDiskCacheHeader;
+
+
+@interface OOTextureDiskCacheStoreTask: NSObject <OOAsyncWorkTask>
+{
+@private
+	OOTextureDiskCache			*_cache;
+	void						*_data;
+	OOTextureDiskCacheInfo		_info;
+	NSString					*_key;
+}
+
+- (id) initWithCache:(OOTextureDiskCache *)cache data:(void *)data info:(const OOTextureDiskCacheInfo *)info key:(NSString *)key;
+
+@end
+
+
+static OOTextureDiskCache *sSingleton = nil;
+
+
+OOINLINE size_t DataOffset(size_t keyLength)
+{
+	return (sizeof (OOTextureDiskCacheHeader) + keyLength + kTextureDiskCacheAlignment - 1) & ~(size_t)(kTextureDiskCacheAlignment - 1);
+}
+
+
+@implementation OOTextureDiskCache
+
++ (id) sharedTextureDiskCache
+{
+	static BOOL inited = NO;
+	
+	if (!inited)
+	{
+		inited = YES;
+		sSingleton = [[self alloc] initWithFolderName:kOOTextureDiskCacheFolder
+											extension:kOOTextureDiskCacheExtension
+										 sizeLimitKey:@"texture-cache-size"
+								 defaultSizeLimitInMB:kDefaultCacheSizeMegabytes];
+	}
+	
+	return sSingleton;
+}
+
+
+- (void *) loadDataForKey:(NSString *)key info:(OOTextureDiskCacheInfo *)outInfo
+{
+	NSParameterAssert(key != nil && outInfo != NULL);
+	
+	NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+	size_t keyLength = [keyData length];
+	size_t dataOffset = DataOffset(keyLength);
+	
+	// The entry is mapped rather than read; only the header and key are touched before the data is copied out.
+	NSData *file = [self mappedEntryForKey:key];
+	if (file == nil || [file length] <= dataOffset)  return NULL;
+	
+	const OOTextureDiskCacheHeader *header = [file bytes];
+	if (header->magic != kTextureDiskCacheMagic ||
+		header->endianTag != kTextureDiskCacheEndianTag ||
+		header->keyLength != keyLength ||
+		header->dataSize != [file length] - dataOffset ||
+		memcmp(header + 1, [keyData bytes], keyLength) != 0)
+	{
+		return NULL;
+	}
+	
+	void *result = malloc(header->dataSize);
+	if (result == NULL)  return NULL;
+	
+	memcpy(result, (const uint8_t *)[file bytes] + dataOffset, header->dataSize);
+	
+	*outInfo = (OOTextureDiskCacheInfo)
+	{
+		.width = header->width,
+		.height = header->height,
+		.originalWidth = header->originalWidth,
+		.originalHeight = header->originalHeight,
+		.format = header->format,
+		.compressedFormat = header->compressedFormat,
+		.mipMapped = (header->flags & kTextureDiskCacheMipMapped) != 0,
+		.isCubeMap = (header->flags & kTextureDiskCacheCubeMap) != 0,
+		.dataSize = header->dataSize
+	};
+	
+	[self touchEntryForKey:key];
+	return result;
+}
+
+
+- (void) storeData:(const void *)data info:(const OOTextureDiskCacheInfo *)info forKey:(NSString *)key
+{
+	NSParameterAssert(data != NULL && info != NULL && key != nil);
+	
+	NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+	size_t keyLength = [keyData length];
+	size_t dataOffset = DataOffset(keyLength);
+	unsigned long long fileSize = dataOffset + info->dataSize;
+	
+	// Don't build an entry OOLRUFileCache would refuse.
+	if (fileSize > [self sizeLimit] / 2)  return;
+	
+	NSMutableData *file = [[NSMutableData alloc] initWithCapacity:fileSize];
+	OOTextureDiskCacheHeader header =
+	{
+		.magic = kTextureDiskCacheMagic,
+		.endianTag = kTextureDiskCacheEndianTag,
+		.width = info->width,
+		.height = info->height,
+		.originalWidth = info->originalWidth,
+		.originalHeight = info->originalHeight,
+		.format = info->format,
+		.compressedFormat = info->compressedFormat,
+		.flags = (info->mipMapped ? kTextureDiskCacheMipMapped : 0) | (info->isCubeMap ? kTextureDiskCacheCubeMap : 0),
+		.keyLength = keyLength,
+		.dataSize = info->dataSize
+	};
+	[file appendBytes:&header length:sizeof header];
+	[file appendData:keyData];
+	[file setLength:dataOffset];
+	[file appendBytes:data length:info->dataSize];
+	
+	[self storeEntry:file forKey:key];
+	[file release];
+}
+
+
+- (void) storeDataAsynchronously:(void *)data info:(const OOTextureDiskCacheInfo *)info forKey:(NSString *)key
+{
+	OOTextureDiskCacheStoreTask *task = [[OOTextureDiskCacheStoreTask alloc] initWithCache:self data:data info:info key:key];
+	if (task == nil)
+	{
+		free(data);
+		return;
+	}
+	
+	[[OOAsyncWorkManager sharedAsyncWorkManager] addTask:task priority:kOOAsyncPriorityLow];
+	[task release];
+}
+
+@end
+
+
+@implementation OOTextureDiskCacheStoreTask
+
+- (id) initWithCache:(OOTextureDiskCache *)cache data:(void *)data info:(const OOTextureDiskCacheInfo *)info key:(NSString *)key
+{
+	if ((self = [super init]))
+	{
+		_cache = [cache retain];
+		_data = data;
+		_info = *info;
+		_key = [key copy];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_cache);
+	DESTROY(_key);
+	free(_data);
+	
+	[super dealloc];
+}
+
+
+- (void) performAsyncTask
+{
+	[_cache storeData:_data info:&_info forKey:_key];
+	
+	free(_data);
+	_data = NULL;
+}
+
+@end
+
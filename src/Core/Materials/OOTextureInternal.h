@@ -29,6 +29,7 @@ SOFTWARE.
 
 #import "OOTexture.h"
 #import "OOOpenGLExtensionManager.h"
+#import "OOTypes.h"
 
 
 @interface OOTexture (SubclassInterface)
@@ -65,16 +66,42 @@ SOFTWARE.
 @end
 
 
+/*	Texture streaming: a texture which isn't ready when it's applied is drawn
+	without texture until it is, rather than blocking. Mip-mapped textures
+	upload their smaller levels first and the rest one level at a time from
+	+updateStreamingTextures. Textures which can be reloaded from disk are
+	evicted, least recently used first, when the textures' total size exceeds
+	the "texture-memory-budget" user default (in megabytes).
+*/
+@interface OOTexture (SubclassStreaming)
+
+- (size_t) residentBytes;				// Default: 0
+- (uint32_t) lastUsedFrame;				// Default: 0
+- (size_t) refineStreamedTexture;		// Upload next mip level, returning its size. Default: 0
+- (BOOL) evictFromGPU;					// Default: NO
+- (OOTimeDelta) loadTime;				// Time spent decoding in a worker thread, once loaded. Default: 0
+
+@end
+
+
+uint32_t OOTextureCurrentFrame(void);
+void OOTextureAdjustResidentBytes(long long delta);
+void OOTextureSetStreaming(OOTexture *texture, BOOL streaming);	// Include in refinement by +updateStreamingTextures.
+
+
 typedef struct OOTextureInfo
 {
 	GLfloat					anisotropyScale;
-	unsigned				anisotropyAvailable: 1,
+	unsigned				streamingEnabled: 1,
+							applyWithoutWaiting: 1,
+							anisotropyAvailable: 1,
 							clampToEdgeAvailable: 1,
 							clientStorageAvailable: 1,
 							textureLODBiasAvailable: 1,
 							rectangleTextureAvailable: 1,
 							cubeMapAvailable: 1,
-							textureMaxLevelAvailable: 1;
+							textureMaxLevelAvailable: 1,
+							textureCompressionAvailable: 1;
 } OOTextureInfo;
 
 extern OOTextureInfo gOOTextureInfo;
@@ -110,6 +137,31 @@ extern OOTextureInfo gOOTextureInfo;
 #endif
 #endif
 
+#ifndef GL_TEXTURE_BASE_LEVEL
+#ifdef GL_TEXTURE_BASE_LEVEL_SGIS
+#define GL_TEXTURE_BASE_LEVEL	GL_TEXTURE_BASE_LEVEL_SGIS
+#else
+#define GL_TEXTURE_BASE_LEVEL	0x813C
+#endif
+#endif
+
+
+#if OO_TEXTURE_COMPRESSION
+// Format used for textures compressed on upload and kept in the texture disk cache.
+#define kOOTextureCompressedFormat		GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#endif
+
+
+/*	Size of the data for one mip level. compressedFormat is the OpenGL
+	internal format of block-compressed data, or 0 for uncompressed data.
+*/
+OOINLINE size_t OOTextureMipLevelSize(uint32_t width, uint32_t height, uint8_t components, GLenum compressedFormat)
+{
+	// DXT5, the only compressed format used, takes 16 bytes per 4x4 block.
+	if (compressedFormat != 0)  return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+	return (size_t)width * components * height;
+}
+
 
 #if OO_TEXTURE_CUBE_MAP
 #ifndef GL_TEXTURE_CUBE_MAP
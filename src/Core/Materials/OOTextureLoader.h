@@ -34,6 +34,7 @@ SOFTWARE.
 #import "OOTexture.h"
 #import "OOPixMap.h"
 #import "OOAsyncWorkManager.h"
+#import "OOTypes.h"
 
 
 @interface OOTextureLoader: NSObject <OOAsyncWorkTask>
@@ -49,8 +50,12 @@ SOFTWARE.
 								_allowCubeMap: 1,
 								_isCubeMap: 1,
 								_ready: 1;
+	uint8_t						_allowCompression: 1,
+								_compressOnUpload: 1;
 	uint8_t						_extractChannelIndex;
 	OOTextureDataFormat			_format;
+	GLenum						_compressedFormat;
+	NSString					*_diskCacheKey;
 	
 	void						*_data;
 	uint32_t					_width,
@@ -58,10 +63,17 @@ SOFTWARE.
 								_rowBytes,
 								_originalWidth,
 								_originalHeight;
+	OOTimeDelta					_loadTime;
 }
 
 + (id)loaderWithPath:(NSString *)path options:(uint32_t)options;
 
+/*	As above, but the result may be block-compressed data from the texture
+	disk cache; see -getCompressedResult:.... Only for loaders whose result
+	goes straight to OpenGL.
+*/
++ (id)loaderWithPath:(NSString *)path options:(uint32_t)options allowCompression:(BOOL)allowCompression;
+
 /*	Convenience method to load images not destined for normal texture use.
 	Specifier is a string or a dictionary as with textures. ExtraOptions is
 	ored into the option flags interpreted from the specifier. Folder is the
@@ -80,6 +92,29 @@ SOFTWARE.
 	 originalWidth:(uint32_t *)outWidth
 	originalHeight:(uint32_t *)outHeight;
 
+/*	If the result was loaded in block-compressed form, returns it in the same
+	way as -getResult:..., with its OpenGL internal format instead of a
+	pixmap; the data is a complete mip-map chain of kOOTextureDataRGBA
+	data. Otherwise returns NO, and the result should be fetched with
+	-getResult:....
+*/
+- (BOOL) getCompressedResult:(void **)outData
+			compressedFormat:(GLenum *)outCompressedFormat
+					   width:(uint32_t *)outWidth
+					  height:(uint32_t *)outHeight
+			   originalWidth:(uint32_t *)outOriginalWidth
+			  originalHeight:(uint32_t *)outOriginalHeight;
+
+/*	After the result has been fetched: YES if the texture should be
+	compressed as it is uploaded, and the compressed data read back and
+	stored in the texture disk cache under -diskCacheKey.
+*/
+- (BOOL) shouldCompressOnUpload;
+- (NSString *) diskCacheKey;
+
+// Real time spent loading in the worker thread, in seconds; valid once ready.
+- (OOTimeDelta) loadTime;
+
 /*	Hopefully-unique string for texture loader; analagous, but not identical,
 	to corresponding texture cacheKey.
 */
@@ -37,11 +37,20 @@ SOFTWARE.
 #include <stdlib.h>
 #import "ResourceManager.h"
 #import "OOOpenGLExtensionManager.h"
+#import "OOTextureInternal.h"
+#import "OOTextureDiskCache.h"
+#import "OOProfilingStopwatch.h"
 
 
 #define DUMP_CONVERTED_CUBE_MAPS	0
 
 
+enum
+{
+	kTextureDiskCacheVersion	= 1		// Change when the processing in -applySettings changes.
+};
+
+
 static unsigned				sGLMaxSize;
 static uint32_t				sUserMaxSize;
 static BOOL					sReducedDetail;
@@ -53,6 +62,10 @@ static BOOL					sHaveSetUp = NO;
 
 + (void)setUp;
 
+- (void)setUpDiskCacheKeyAllowingCompression:(BOOL)allowCompression;
+- (BOOL)loadFromDiskCache;
+- (void)storeInDiskCache;
+
 - (void)applySettings;
 - (void)getDesiredWidth:(uint32_t *)outDesiredWidth andHeight:(uint32_t *)outDesiredHeight;
 
@@ -60,9 +73,18 @@ static BOOL					sHaveSetUp = NO;
 @end
 
 
+static size_t TextureDataSize(uint32_t width, uint32_t height, uint8_t components, BOOL mipMapped, BOOL isCubeMap, GLenum compressedFormat);
+
+
 @implementation OOTextureLoader
 
 + (id)loaderWithPath:(NSString *)inPath options:(uint32_t)options
+{
+	return [self loaderWithPath:inPath options:options allowCompression:NO];
+}
+
+
++ (id)loaderWithPath:(NSString *)inPath options:(uint32_t)options allowCompression:(BOOL)allowCompression
 {
 	NSString				*extension = nil;
 	id						result = nil;
@@ -86,6 +108,7 @@ static BOOL					sHaveSetUp = NO;
 	
 	if (result != nil)
 	{
+		[result setUpDiskCacheKeyAllowingCompression:allowCompression];
 		if (![[OOAsyncWorkManager sharedAsyncWorkManager] addTask:result priority:kOOAsyncPriorityMedium])  result = nil;
 	}
 	
@@ -173,6 +196,7 @@ static BOOL					sHaveSetUp = NO;
 	_path = NULL;
 	free(_data);
 	_data = NULL;
+	DESTROY(_diskCacheKey);
 	
 	[super dealloc];
 }
@@ -230,7 +254,7 @@ static BOOL					sHaveSetUp = NO;
 	{
 		[[OOAsyncWorkManager sharedAsyncWorkManager] waitForTaskToComplete:self];
 	}
-	if (_data == NULL)  OK = NO;
+	if (_data == NULL || _compressedFormat != 0)  OK = NO;
 	
 	if (OK)
 	{
@@ -252,6 +276,51 @@ static BOOL					sHaveSetUp = NO;
 }
 
 
+- (BOOL) getCompressedResult:(void **)outData
+			compressedFormat:(GLenum *)outCompressedFormat
+					   width:(uint32_t *)outWidth
+					  height:(uint32_t *)outHeight
+			   originalWidth:(uint32_t *)outOriginalWidth
+			  originalHeight:(uint32_t *)outOriginalHeight
+{
+	NSParameterAssert(outData != NULL && outCompressedFormat != NULL && outWidth != NULL && outHeight != NULL);
+	
+	if (!_ready)
+	{
+		[[OOAsyncWorkManager sharedAsyncWorkManager] waitForTaskToComplete:self];
+	}
+	if (_data == NULL || _compressedFormat == 0)  return NO;
+	
+	*outData = _data;
+	_data = NULL;
+	*outCompressedFormat = _compressedFormat;
+	*outWidth = _width;
+	*outHeight = _height;
+	if (outOriginalWidth != NULL)  *outOriginalWidth = _originalWidth;
+	if (outOriginalHeight != NULL)  *outOriginalHeight = _originalHeight;
+	
+	return YES;
+}
+
+
+- (BOOL) shouldCompressOnUpload
+{
+	return _compressOnUpload;
+}
+
+
+- (NSString *) diskCacheKey
+{
+	return _diskCacheKey;
+}
+
+
+- (OOTimeDelta) loadTime
+{
+	return _loadTime;
+}
+
+
 - (NSString *) cacheKey
 {
 	return [NSString stringWithFormat:@"%@:0x%.4X", [[self path] lastPathComponent], _options];
@@ -278,30 +347,57 @@ static BOOL					sHaveSetUp = NO;
 	sUserMaxSize = OORoundUpToPowerOf2(sUserMaxSize);
 	sUserMaxSize = MAX(sUserMaxSize, 64U);
 	
+	// Must be set up on the main thread.
+	[OOTextureDiskCache sharedTextureDiskCache];
 	
 	sHaveSetUp = YES;
 }
 
 
+- (void)setUpDiskCacheKeyAllowingCompression:(BOOL)allowCompression
+{
+	if ([OOTextureDiskCache sharedTextureDiskCache] == nil)  return;
+	
+	NSDictionary *attributes = [[NSFileManager defaultManager] fileAttributesAtPath:_path traverseLink:YES];
+	if (attributes == nil)  return;
+	
+	_allowCompression = allowCompression && gOOTextureInfo.textureCompressionAvailable;
+	
+	// The key must change whenever the file, or anything which affects what is done to it, does.
+	_diskCacheKey = [[NSString alloc] initWithFormat:@"%u:%@:%llu:%.3f:0x%.8X:%u:%u:%u:%u:%u",
+					 kTextureDiskCacheVersion, _path, [attributes fileSize], [[attributes fileModificationDate] timeIntervalSince1970],
+					 _options, sGLMaxSize, sUserMaxSize, sReducedDetail, OOCubeMapsAvailable(), _allowCompression];
+}
+
+
 /*** Methods performed on the loader thread. ***/
 
 - (void)performAsyncTask
 {
+	OOHighResTimeValue startTime = OOGetHighResTime();
+	
 	NS_DURING
 		OOLog(@"texture.load.asyncLoad", @"Loading texture %@", [_path lastPathComponent]);
 		
-		[self loadTexture];
-		
-		// Catch an error I've seen but not diagnosed yet.
-		if (_data != NULL && OOTextureComponentsForFormat(_format) == 0)
+		if (![self loadFromDiskCache])
 		{
-			OOLog(@"texture.load.failed.internalError", @"Texture loader internal error for %@: data is non-null but data format is invalid (%u).", _path, _format);
-			free(_data);
-			_data = NULL;
+			[self loadTexture];
+			
+			// Catch an error I've seen but not diagnosed yet.
+			if (_data != NULL && OOTextureComponentsForFormat(_format) == 0)
+			{
+				OOLog(@"texture.load.failed.internalError", @"Texture loader internal error for %@: data is non-null but data format is invalid (%u).", _path, _format);
+				free(_data);
+				_data = NULL;
+			}
+			
+			if (_data != NULL)
+			{
+				[self applySettings];
+				[self storeInDiskCache];
+			}
 		}
 		
-		if (_data != NULL)  [self applySettings];
-		
 		OOLog(@"texture.load.asyncLoad.done", @"Loading complete.");
 	NS_HANDLER
 		OOLog(@"texture.load.asyncLoad.exception", @"***** Exception loading texture %@: %@ (%@).", _path, [localException name], [localException reason]);
@@ -313,6 +409,90 @@ static BOOL					sHaveSetUp = NO;
 			_data = NULL;
 		}
 	NS_ENDHANDLER
+	
+	OOHighResTimeValue endTime = OOGetHighResTime();
+	_loadTime = OOHighResTimeDeltaInSeconds(startTime, endTime);
+	OODisposeHighResTime(startTime);
+	OODisposeHighResTime(endTime);
+}
+
+
+- (BOOL)loadFromDiskCache
+{
+	if (_diskCacheKey == nil)  return NO;
+	
+	OOTextureDiskCacheInfo info;
+	void *data = [[OOTextureDiskCache sharedTextureDiskCache] loadDataForKey:_diskCacheKey info:&info];
+	if (data == NULL)  return NO;
+	
+	// Check that the entry is something the upload code can handle.
+	OOTextureDataFormat format = info.format;
+	uint8_t components = OOTextureComponentsForFormat(format);
+	BOOL OK = components != 0 && info.width != 0 && info.height != 0;
+	if (OK && info.compressedFormat != 0)
+	{
+#if OO_TEXTURE_COMPRESSION
+		OK = _allowCompression && info.compressedFormat == kOOTextureCompressedFormat && format == kOOTextureDataRGBA && info.mipMapped && !info.isCubeMap;
+#else
+		OK = NO;
+#endif
+	}
+	if (OK)  OK = info.dataSize == TextureDataSize(info.width, info.height, components, info.mipMapped, info.isCubeMap, info.compressedFormat);
+	
+	if (!OK)
+	{
+		OOLog(@"texture.load.cached.invalid", @"Ignoring invalid texture cache entry for %@.", [_path lastPathComponent]);
+		free(data);
+		return NO;
+	}
+	
+	_data = data;
+	_format = format;
+	_compressedFormat = info.compressedFormat;
+	_width = info.width;
+	_height = info.height;
+	_rowBytes = _width * components;
+	_originalWidth = info.originalWidth;
+	_originalHeight = info.originalHeight;
+	_generateMipMaps = info.mipMapped;
+	_isCubeMap = info.isCubeMap;
+	
+	OOLog(@"texture.load.cached", @"Loaded texture %@ from texture cache.", [_path lastPathComponent]);
+	return YES;
+}
+
+
+- (void)storeInDiskCache
+{
+	if (_diskCacheKey == nil || _data == NULL)  return;
+	
+	uint8_t components = OOTextureComponentsForFormat(_format);
+	if (_rowBytes != _width * components)  return;
+	
+#if OO_TEXTURE_COMPRESSION
+	if (_allowCompression && _generateMipMaps && !_isCubeMap && _format == kOOTextureDataRGBA)
+	{
+		/*	Leave it to OOConcreteTexture to have the driver compress it, and
+			cache the compressed result.
+		*/
+		_compressOnUpload = YES;
+		return;
+	}
+#endif
+	
+	OOTextureDiskCacheInfo info =
+	{
+		.width = _width,
+		.height = _height,
+		.originalWidth = _originalWidth,
+		.originalHeight = _originalHeight,
+		.format = _format,
+		.compressedFormat = 0,
+		.mipMapped = _generateMipMaps,
+		.isCubeMap = _isCubeMap,
+		.dataSize = TextureDataSize(_width, _height, components, _generateMipMaps, _isCubeMap, 0)
+	};
+	[[OOTextureDiskCache sharedTextureDiskCache] storeData:_data info:&info forKey:_diskCacheKey];
 }
 
 
@@ -520,3 +700,26 @@ static BOOL					sHaveSetUp = NO;
 }
 
 @end
+
+
+// Size of texture data laid out as OOConcreteTexture expects it.
+static size_t TextureDataSize(uint32_t width, uint32_t height, uint8_t components, BOOL mipMapped, BOOL isCubeMap, GLenum compressedFormat)
+{
+	if (isCubeMap)
+	{
+		// Width is the size of one side; see -generateMipMapsForCubeMap.
+		size_t sideSize = width * width * components;
+		if (mipMapped)  sideSize = ((sideSize * 4 / 3) + 15) & ~15;
+		return sideSize * 6;
+	}
+	
+	size_t size = 0;
+	do
+	{
+		size += OOTextureMipLevelSize(width, height, components, compressedFormat);
+		width >>= 1;
+		height >>= 1;
+	} while (mipMapped && 0 < width && 0 < height);
+	
+	return size;
+}
@@ -0,0 +1,71 @@
+/*
+
+OOTexturePreloader.h
+
+Loads the textures used by ship materials at startup, so that the first
+sight of each ship type doesn't stall while its textures are decoded.
+
+The material keys of each ship's mesh, which the ship registry has already
+preloaded, are looked up in the ship's materials and shaders entries in the
+same way as the material creators do, and each texture they name is
+requested through +[OOTexture textureWithConfiguration:], so that the
+textures end up in the texture caches under the keys later requests will
+use. Textures are requested in batches of a few per CPU, so that their
+loaders decode, scale and mip-map them in parallel on the worker threads;
+the batch is then waited for and uploaded in full before the next one is
+started, so no more than one batch of decoded data is held at once.
+
+The total size of preloaded textures in video memory is limited by the
+user default "texture-preload-limit", in megabytes (default 128; 0
+disables preloading). The preloader retains the textures it loaded until
+it is released, since the recently-used texture cache only keeps the last
+few; they may still be evicted from video memory like any other texture.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOTypes.h"
+
+@class OOShipRegistry;
+
+
+@interface OOTexturePreloader: NSObject
+{
+@private
+	NSMutableArray			*_textures;
+	unsigned long long		_preloadedBytes;
+	OOTimeDelta				_elapsedTime;
+	OOTimeDelta				_totalLoadTime;
+}
+
+// Load the textures of the ships in registry. Must be called on the main thread.
+- (void) preloadTexturesForShipRegistry:(OOShipRegistry *)registry;
+
+// Let go of the preloaded textures, e.g. before the texture caches are cleared.
+- (void) releaseTextures;
+
+- (OOUInteger) textureCount;
+- (unsigned long long) preloadedBytes;
+- (OOTimeDelta) elapsedTime;		// Real time taken by the last preload.
+- (OOTimeDelta) totalLoadTime;		// Sum of the textures' load times in worker threads.
+
+@end
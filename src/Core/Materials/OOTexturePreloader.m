@@ -0,0 +1,261 @@
+/*
+
+OOTexturePreloader.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOTexturePreloader.h"
+#import "OOTextureInternal.h"
+#import "OOMaterialSpecifier.h"
+#import "OOShaderMaterial.h"
+#import "OOShipRegistry.h"
+#import "OOMesh.h"
+#import "OOCollectionExtractors.h"
+#import "OOProfilingStopwatch.h"
+#import "OOCPUInfo.h"
+#import "Universe.h"
+
+
+enum
+{
+	kDefaultPreloadLimitMegabytes	= 128,
+	kTexturesPerCPU					= 2,
+	kMinBatchSize					= 4,
+	kSlowestTexturesReported		= 5
+};
+
+
+static void AddMaterialTextures(NSMutableSet *specifiers, NSString *name, NSDictionary *configuration);
+static NSComparisonResult CompareByLoadTime(id a, id b, void *context);
+
+
+@implementation OOTexturePreloader
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_textures = [[NSMutableArray alloc] init];
+		if (_textures == nil)
+		{
+			[self release];
+			return nil;
+		}
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_textures);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%u textures, %llu KiB", [_textures count], _preloadedBytes / 1024];
+}
+
+
+- (void) preloadTexturesForShipRegistry:(OOShipRegistry *)registry
+{
+	long long limit = [[NSUserDefaults standardUserDefaults] oo_longLongForKey:@"texture-preload-limit" defaultValue:kDefaultPreloadLimitMegabytes];
+	if (limit <= 0 || registry == nil)  return;
+	limit *= 1024 * 1024;
+	
+	OOProfilingStopwatch	*stopwatch = [OOProfilingStopwatch stopwatch];
+	NSMutableSet			*specifiers = [NSMutableSet set];
+	NSEnumerator			*keyEnum = nil;
+	NSString				*key = nil;
+	BOOL					useShaders = [UNIVERSE useShaders];
+	
+	/*	Find every texture the ships' materials use, as the material creators
+		would. The meshes have been preloaded into the mesh cache, so their
+		material keys are at hand; a key without a materials or shaders entry
+		uses the texture of the same name.
+	*/
+	for (keyEnum = [[registry shipKeys] objectEnumerator]; (key = [keyEnum nextObject]); )
+	{
+		NSDictionary *shipInfo = [registry shipInfoForKey:key];
+		NSDictionary *materials = [shipInfo oo_dictionaryForKey:@"materials"];
+		NSDictionary *shaders = useShaders ? [shipInfo oo_dictionaryForKey:@"shaders"] : nil;
+		NSArray *meshKeys = [OOMesh materialKeysForCachedMeshWithName:[shipInfo oo_stringForKey:@"model"] smooth:[shipInfo oo_boolForKey:@"smooth"]];
+		NSEnumerator *nameEnum = nil;
+		NSString *name = nil;
+		
+		if (meshKeys != nil)
+		{
+			for (nameEnum = [meshKeys objectEnumerator]; (name = [nameEnum nextObject]); )
+			{
+				if ([name isEqualToString:@"_oo_placeholder_material"])  continue;
+				
+				NSDictionary *configuration = [shaders oo_dictionaryForKey:name];
+				if (configuration == nil)  configuration = [materials oo_dictionaryForKey:name];
+				if (configuration == nil)  configuration = [NSDictionary dictionary];
+				AddMaterialTextures(specifiers, name, configuration);
+			}
+		}
+		else
+		{
+			// The mesh couldn't be cached; fall back on the material entries.
+			for (nameEnum = [shaders keyEnumerator]; (name = [nameEnum nextObject]); )
+			{
+				AddMaterialTextures(specifiers, name, [shaders oo_dictionaryForKey:name]);
+			}
+			for (nameEnum = [materials keyEnumerator]; (name = [nameEnum nextObject]); )
+			{
+				if ([shaders oo_dictionaryForKey:name] == nil)  AddMaterialTextures(specifiers, name, [materials oo_dictionaryForKey:name]);
+			}
+		}
+	}
+	
+	NSArray *pending = [specifiers allObjects];
+	OOUInteger i, count = [pending count];
+	OOUInteger batchSize = MAX(OOCPUCount() * kTexturesPerCPU, (unsigned)kMinBatchSize);
+	
+	for (i = 0; i < count && _preloadedBytes < (unsigned long long)limit; )
+	{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSMutableArray *batch = [NSMutableArray arrayWithCapacity:batchSize];
+		OOUInteger j;
+		
+		// Start loaders for the whole batch, so that they run in parallel...
+		for (; i < count && [batch count] < batchSize; i++)
+		{
+			OOTexture *texture = [OOTexture textureWithConfiguration:[pending objectAtIndex:i] extraOptions:kOOTextureNoFNFMessage];
+			if (texture != nil && [_textures indexOfObjectIdenticalTo:texture] == NSNotFound && [batch indexOfObjectIdenticalTo:texture] == NSNotFound)
+			{
+				[batch addObject:texture];
+			}
+		}
+		
+		// ...then wait for each and upload it.
+		for (j = 0; j < [batch count]; j++)
+		{
+			OOTexture *texture = [batch objectAtIndex:j];
+			OOTimeDelta start = [stopwatch currentTime];
+			[texture ensureFinishedLoading];
+			OOTimeDelta wait = [stopwatch currentTime] - start;
+			
+			/*	With texture streaming, only the small mip levels have been
+				uploaded, and the texture holds on to its decoded data until
+				the rest are. Upload them now, so the data is released.
+			*/
+			while ([texture refineStreamedTexture] != 0)  {}
+			
+			NSSize dimensions = [texture dimensions];
+			_preloadedBytes += [texture residentBytes];
+			_totalLoadTime += [texture loadTime];
+			
+			OOLog(@"texture.preload.time", @"Preloaded %@ (%u x %u) - load %.1f ms, waited %.1f ms.", [texture cacheKey], (unsigned)dimensions.width, (unsigned)dimensions.height, [texture loadTime] * 1000.0, wait * 1000.0);
+		}
+		
+		[_textures addObjectsFromArray:batch];
+		[pool release];
+	}
+	
+	_elapsedTime = [stopwatch currentTime];
+	
+	if ([_textures count] != 0)
+	{
+		NSArray *slowest = [_textures sortedArrayUsingFunction:CompareByLoadTime context:NULL];
+		NSMutableArray *slowestDescriptions = [NSMutableArray array];
+		for (i = 0; i < kSlowestTexturesReported && i < [slowest count]; i++)
+		{
+			OOTexture *texture = [slowest objectAtIndex:i];
+			[slowestDescriptions addObject:[NSString stringWithFormat:@"%@ (%.1f ms)", [texture cacheKey], [texture loadTime] * 1000.0]];
+		}
+		
+		OOLog(@"texture.preload.done", @"Preloaded %u of %u ship textures (%llu KiB) in %.1f ms; %.1f ms of loading in worker threads. Slowest: %@.", [_textures count], count, _preloadedBytes / 1024, _elapsedTime * 1000.0, _totalLoadTime * 1000.0, [slowestDescriptions componentsJoinedByString:@", "]);
+	}
+}
+
+
+- (void) releaseTextures
+{
+	[_textures removeAllObjects];
+	_preloadedBytes = 0;
+}
+
+
+- (OOUInteger) textureCount
+{
+	return [_textures count];
+}
+
+
+- (unsigned long long) preloadedBytes
+{
+	return _preloadedBytes;
+}
+
+
+- (OOTimeDelta) elapsedTime
+{
+	return _elapsedTime;
+}
+
+
+- (OOTimeDelta) totalLoadTime
+{
+	return _totalLoadTime;
+}
+
+@end
+
+
+static void AddMaterialTextures(NSMutableSet *specifiers, NSString *name, NSDictionary *configuration)
+{
+	if (configuration == nil)  return;
+
+#if OO_SHADERS
+	if ([OOShaderMaterial configurationDictionarySpecifiesShaderMaterial:configuration])
+	{
+		NSArray *textures = [configuration oo_arrayForKey:@"textures"];
+		if (textures != nil)  [specifiers addObjectsFromArray:textures];
+		return;
+	}
+#endif
+
+	id specifier = nil;
+	if ((specifier = [configuration oo_diffuseMapSpecifierWithDefaultName:name]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_specularMapSpecifier]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_normalMapSpecifier]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_normalAndParallaxMapSpecifier]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_emissionMapSpecifier]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_illuminationMapSpecifier]))  [specifiers addObject:specifier];
+	if ((specifier = [configuration oo_emissionAndIlluminationMapSpecifier]))  [specifiers addObject:specifier];
+}
+
+
+static NSComparisonResult CompareByLoadTime(id a, id b, void *context)
+{
+	// Slowest first.
+	OOTimeDelta aTime = [a loadTime], bTime = [b loadTime];
+	if (aTime > bTime)  return NSOrderedAscending;
+	if (aTime < bTime)  return NSOrderedDescending;
+	return NSOrderedSame;
+}
@@ -40,6 +40,13 @@ MA 02110-1301, USA.
 + (id)stringWithContentsOfUnicodeFile:(NSString *)path;
 
 
+/*	+stringWithUnicodeData:
+	
+	As above, for data already in memory (or memory-mapped).
+*/
++ (id)stringWithUnicodeData:(NSData *)data;
+
+
 /*	+stringWithUTF16String:
 	
 	Takes a NUL-terminated native-endian UTF-16 string.
@@ -59,6 +66,13 @@ MA 02110-1301, USA.
 */
 - (uint32_t) oo_hash;
 
+/*	- oo_hash64
+	64-bit FNV-1a hash of the UTF-8 representation, also consistent across
+	platforms and versions. Used where a short collision-resistant name is
+	needed for an arbitrary string, such as cache file names.
+*/
+- (uint64_t) oo_hash64;
+
 @end
 
 
@@ -31,14 +31,25 @@ MA 02110-1301, USA.
 + (id)stringWithContentsOfUnicodeFile:(NSString *)path
 {
 	id				result = nil;
-	BOOL			OK = YES;
 	NSData			*data = nil;
+	
+	data = [[NSData alloc] initWithContentsOfFile:path];
+	result = [self stringWithUnicodeData:data];
+	
+	[data release];
+	return result;
+}
+
+
++ (id)stringWithUnicodeData:(NSData *)data
+{
+	id				result = nil;
+	BOOL			OK = YES;
 	const uint8_t	*bytes = NULL;
 	size_t			length = 0;
 	const uint8_t	*effectiveBytes = NULL;
 	size_t			effectiveLength = 0;
 	
-	data = [[NSData alloc] initWithContentsOfFile:path];
 	if (data == nil) OK = NO;
 	
 	if (OK)
@@ -67,7 +78,7 @@ MA 02110-1301, USA.
 		{
 			// File starts with UTF-8 BOM; skip it.
 			effectiveBytes = bytes + 3;
-			effectiveLength = length + 3;
+			effectiveLength = length - 3;
 		}
 		else
 		{
@@ -85,7 +96,6 @@ MA 02110-1301, USA.
 		result = [[[NSString alloc] initWithBytes:effectiveBytes length:effectiveLength encoding:NSISOLatin1StringEncoding] autorelease];
 	}
 	
-	[data release];
 	return result;
 }
 
@@ -148,6 +158,21 @@ MA 02110-1301, USA.
 	return hash;
 }
 
+
+- (uint64_t) oo_hash64
+{
+	NSData *data = [self dataUsingEncoding:NSUTF8StringEncoding];
+	const uint8_t *bytes = [data bytes];
+	OOUInteger i, length = [data length];
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
 @end
 
 
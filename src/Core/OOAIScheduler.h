@@ -0,0 +1,88 @@
+/*
+
+OOAIScheduler.h
+
+Decides which ship AIs think in each frame.
+
+During the entity update pass, Universe hands each ship's AI to
+-queueAIIfDue:atTime:, which queues it if its next think time has come. After
+the pass, -runQueuedAIsAtTime: lets queued AIs think in order of due time
+(ties in entity order) until the frame's AI time budget is used up, so a
+crowd of AIs falling due together is spread over several frames rather than
+causing a spike. A minimum number of AIs think in every frame, so a
+small budget slows AIs down rather than stopping them.
+
+The first time an AI is found due, it is given a phase offset of up to one
+think interval instead of thinking immediately. The offset is derived from
+its owner's universal ID, so ships spawned together (groups, station
+launches) fall out of step in a reproducible way.
+
+The budget is set by the "ai-think-budget" user default, in milliseconds
+(default 2; 0 or less for no limit).
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOTypes.h"
+
+@class AI, OOPriorityQueue;
+
+
+typedef struct OOAISchedulerFrameStats
+{
+	OOUInteger				queued;			// AIs which became due this frame.
+	OOUInteger				phased;			// New AIs given a phase offset this frame.
+	OOUInteger				thinks;			// AIs which thought this frame.
+	OOUInteger				deferred;		// AIs left queued at the end of the frame.
+	OOTimeDelta				thinkTime;		// Real time spent thinking, in seconds.
+	OOTimeDelta				maxLateness;	// Largest game time between an AI falling due and thinking.
+} OOAISchedulerFrameStats;
+
+
+@interface OOAIScheduler: NSObject
+{
+@private
+	OOPriorityQueue			*_queue;
+	OOUInteger				_sequence;
+	OOTimeDelta				_budget;
+	
+	OOAISchedulerFrameStats	_currentFrame;
+	OOAISchedulerFrameStats	_lastFrame;
+	
+	unsigned long long		_totalThinks;
+	unsigned long long		_framesOverBudget;
+}
+
+- (void) queueAIIfDue:(AI *)ai atTime:(OOTimeAbsolute)now;
+- (void) runQueuedAIsAtTime:(OOTimeAbsolute)now;
+
+// Drop all queued AIs, e.g. when the universe is reset.
+- (void) removeAllAIs;
+
+- (OOTimeDelta) budget;
+- (void) setBudget:(OOTimeDelta)budget;	// In seconds; 0 for no limit.
+
+- (OOAISchedulerFrameStats) lastFrameStats;
+- (unsigned long long) totalThinks;
+- (unsigned long long) framesOverBudget;
+
+@end
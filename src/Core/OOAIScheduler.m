@@ -0,0 +1,248 @@
+/*
+
+OOAIScheduler.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOAIScheduler.h"
+#import "AI.h"
+#import "ShipEntity.h"
+#import "OOPriorityQueue.h"
+#import "OOProfilingStopwatch.h"
+#import "OOCollectionExtractors.h"
+
+
+#define kDefaultBudgetMilliseconds		2.0
+
+
+enum
+{
+	kMinThinksPerFrame			= 8
+};
+
+
+/*	OOAIThinkRequest: queue entry for an AI which is due to think. The due
+	time is captured when the AI is queued, since the AI's own next think time
+	may be changed while it is in the queue.
+*/
+@interface OOAIThinkRequest: NSObject
+{
+@public
+	AI						*ai;
+	OOTimeAbsolute			dueTime;
+	OOUInteger				sequence;
+}
+
+- (id) initWithAI:(AI *)inAI dueTime:(OOTimeAbsolute)inDueTime sequence:(OOUInteger)inSequence;
+
+- (NSComparisonResult) compareByDueTime:(OOAIThinkRequest *)other;
+
+@end
+
+
+OOINLINE BOOL IsDue(OOTimeAbsolute thinkTime, OOTimeAbsolute now)
+{
+	return now > thinkTime || thinkTime == 0.0;
+}
+
+
+@implementation OOAIScheduler
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_queue = [[OOPriorityQueue alloc] initWithComparator:@selector(compareByDueTime:)];
+		if (_queue == nil)
+		{
+			[self release];
+			return nil;
+		}
+		
+		double budget = [[NSUserDefaults standardUserDefaults] oo_doubleForKey:@"ai-think-budget" defaultValue:kDefaultBudgetMilliseconds];
+		[self setBudget:budget * 0.001];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	[self removeAllAIs];
+	DESTROY(_queue);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%u queued, last frame: %u thinks in %g ms", [_queue count], _lastFrame.thinks, _lastFrame.thinkTime * 1000.0];
+}
+
+
+- (void) queueAIIfDue:(AI *)ai atTime:(OOTimeAbsolute)now
+{
+	if (ai == nil || [ai isQueuedToThink])  return;
+	
+	OOTimeAbsolute thinkTime = [ai nextThinkTime];
+	if (!IsDue(thinkTime, now))  return;
+	
+	if (![ai hasThinkPhase])
+	{
+		// Fibonacci hashing spreads consecutive IDs evenly over the interval.
+		uint32_t hash = (uint32_t)[[ai owner] universalID] * 2654435761U;
+		[ai setHasThinkPhase:YES];
+		[ai setNextThinkTime:now + [ai thinkTimeInterval] * (hash >> 22) / 1024.0];
+		_currentFrame.phased++;
+		return;
+	}
+	
+	OOAIThinkRequest *request = [[OOAIThinkRequest alloc] initWithAI:ai dueTime:thinkTime sequence:_sequence++];
+	[_queue addObject:request];
+	[request release];
+	
+	[ai setQueuedToThink:YES];
+	_currentFrame.queued++;
+}
+
+
+- (void) runQueuedAIsAtTime:(OOTimeAbsolute)now
+{
+	OOProfilingStopwatch	*stopwatch = [OOProfilingStopwatch stopwatch];
+	OOAIThinkRequest		*request = nil;
+	OOTimeDelta				elapsed = 0.0;
+	
+	while ((request = [_queue peekAtNextObject]))
+	{
+		if (_budget > 0.0 && _currentFrame.thinks >= kMinThinksPerFrame && elapsed >= _budget)  break;
+		
+		[[request retain] autorelease];
+		[_queue removeNextObject];
+		
+		AI *ai = request->ai;
+		[ai setQueuedToThink:NO];
+		
+		// Skip AIs which have been put off (e.g. by pauseAI:) since they were queued; they will be queued again when due.
+		if (!IsDue([ai nextThinkTime], now))  continue;
+		
+		OOTimeDelta lateness = now - request->dueTime;
+		if (request->dueTime != 0.0 && lateness > _currentFrame.maxLateness)  _currentFrame.maxLateness = lateness;
+		
+		[ai setNextThinkTime:now + [ai thinkTimeInterval]];
+		[ai think];
+		
+		_currentFrame.thinks++;
+		elapsed = [stopwatch currentTime];
+	}
+	
+	_currentFrame.deferred = [_queue count];
+	_currentFrame.thinkTime = elapsed;
+	
+	_totalThinks += _currentFrame.thinks;
+	if (_currentFrame.deferred != 0)  _framesOverBudget++;
+	
+	_lastFrame = _currentFrame;
+	_currentFrame = (OOAISchedulerFrameStats){ 0 };
+}
+
+
+- (void) removeAllAIs
+{
+	OOAIThinkRequest *request = nil;
+	
+	while ((request = [_queue peekAtNextObject]))
+	{
+		[request->ai setQueuedToThink:NO];
+		[_queue removeNextObject];
+	}
+}
+
+
+- (OOTimeDelta) budget
+{
+	return _budget;
+}
+
+
+- (void) setBudget:(OOTimeDelta)budget
+{
+	_budget = fmax(budget, 0.0);
+}
+
+
+- (OOAISchedulerFrameStats) lastFrameStats
+{
+	return _lastFrame;
+}
+
+
+- (unsigned long long) totalThinks
+{
+	return _totalThinks;
+}
+
+
+- (unsigned long long) framesOverBudget
+{
+	return _framesOverBudget;
+}
+
+@end
+
+
+@implementation OOAIThinkRequest
+
+- (id) initWithAI:(AI *)inAI dueTime:(OOTimeAbsolute)inDueTime sequence:(OOUInteger)inSequence
+{
+	if ((self = [super init]))
+	{
+		ai = [inAI retain];
+		dueTime = inDueTime;
+		sequence = inSequence;
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(ai);
+	
+	[super dealloc];
+}
+
+
+- (NSComparisonResult) compareByDueTime:(OOAIThinkRequest *)other
+{
+	if (dueTime < other->dueTime)  return NSOrderedAscending;
+	if (dueTime > other->dueTime)  return NSOrderedDescending;
+	
+	// Same due time: keep entity update order.
+	if (sequence < other->sequence)  return NSOrderedAscending;
+	if (sequence > other->sequence)  return NSOrderedDescending;
+	return NSOrderedSame;
+}
+
+@end
@@ -7,6 +7,11 @@ OOAsyncQueue is used to pass messages (in the form of arbitrary objects)
 between threads. It is many-to-many capable, i.e. it is safe to send messages
 from any number of threads and to read messages from any number of threads.
 
+Where the compiler provides atomic compare-and-swap, the queue is a bounded
+lock-free ring buffer; a lock is only taken by a reader which finds the queue
+empty and has to sleep, and by a writer waking it. -enqueue: waits if the ring
+is full. Otherwise, the queue is a linked list protected by a lock.
+
 
 Copyright (C) 2007-2011 Jens Ayton
 
@@ -33,14 +38,34 @@ SOFTWARE.
 #import <Foundation/Foundation.h>
 
 
+#ifndef OOASYNCQUEUE_LOCK_FREE
+#if (__SIZEOF_POINTER__ == 8 && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_8)) || (__SIZEOF_POINTER__ == 4 && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4))
+#define OOASYNCQUEUE_LOCK_FREE		1
+#else
+#define OOASYNCQUEUE_LOCK_FREE		0
+#endif
+#endif
+
+
 @interface OOAsyncQueue: NSObject
 {
+#if OOASYNCQUEUE_LOCK_FREE
+	struct OOAsyncQueueCell		*_cells;
+	uintptr_t					_mask;
+	volatile uintptr_t			_enqueuePos;
+	uint8_t						_padding[64 - sizeof (uintptr_t)];	// Keep readers and writers off each other's cache line.
+	volatile uintptr_t			_dequeuePos;
+	
+	NSConditionLock				*_sleepLock;
+	volatile uintptr_t			_sleepers;
+#else
 	NSConditionLock				*_lock;
 	struct OOAsyncQueueElement	*_head,
 								*_tail,
 								*_pool;
 	unsigned					_elemCount,
 								_poolCount;
+#endif
 }
 
 - (BOOL)enqueue:(id)object;	// Returns NO on failure, or if object is nil.
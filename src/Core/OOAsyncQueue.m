@@ -34,6 +34,292 @@ SOFTWARE.
 #import "NSThreadOOExtensions.h"
 #include <stdlib.h>
 
+#if !OOLITE_WINDOWS
+#include <unistd.h>
+#endif
+
+
+#if OOASYNCQUEUE_LOCK_FREE
+
+/*	Bounded multi-producer/multi-consumer ring, after Dmitry Vyukov's design.
+	Each cell has a sequence number which says whose turn it is: a cell at
+	position pos is free for the writer claiming pos when its sequence is pos,
+	and holds data for the reader claiming pos when its sequence is pos + 1.
+	Writers and readers claim positions with compare-and-swap, so neither
+	waits for the other except when the ring is full or empty.
+*/
+
+enum
+{
+	kConditionNoData		= 1,
+	kConditionQueuedData
+};
+
+
+enum
+{
+	kQueueCapacity			= 4096,	// Must be a power of two.
+	kSpinsBeforeSleeping	= 100,
+	kFullWaitMicroseconds	= 500
+};
+
+
+typedef struct OOAsyncQueueCell OOAsyncQueueCell;
+struct OOAsyncQueueCell
+{
+	volatile uintptr_t	sequence;
+	id					object;
+};
+
+
+OOINLINE BOOL CompareAndSwap(volatile uintptr_t *value, uintptr_t oldValue, uintptr_t newValue)
+{
+	return __sync_bool_compare_and_swap(value, oldValue, newValue);
+}
+
+
+OOINLINE void MemoryBarrier(void)
+{
+	__sync_synchronize();
+}
+
+
+static void WaitForSpace(void);
+
+
+@interface OOAsyncQueue (OOPrivate)
+
+- (BOOL)tryEnqueue:(id)object;
+- (id)tryDequeueRetained;
+
+@end
+
+
+@implementation OOAsyncQueue
+
+- (id)init
+{
+	self = [super init];
+	if (self != nil)
+	{
+		_cells = malloc(kQueueCapacity * sizeof *_cells);
+		_sleepLock = [[NSConditionLock alloc] initWithCondition:kConditionNoData];
+		[_sleepLock ooSetName:@"OOAsyncQueue lock"];
+		if (_cells == NULL || _sleepLock == nil)
+		{
+			[self release];
+			return nil;
+		}
+		
+		uintptr_t i;
+		for (i = 0; i < kQueueCapacity; i++)
+		{
+			_cells[i].sequence = i;
+			_cells[i].object = nil;
+		}
+		_mask = kQueueCapacity - 1;
+		MemoryBarrier();
+	}
+	
+	return self;
+}
+
+
+- (void)dealloc
+{
+	if (_cells != NULL)
+	{
+		if (![self empty])
+		{
+			OOLogWARN(@"asyncQueue.nonEmpty", @"%@ deallocated while non-empty, flushing.", self);
+			[self emptyQueue];
+		}
+		free(_cells);
+	}
+	[_sleepLock release];
+	
+	[super dealloc];
+}
+
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{%u elements}", [self class], self, [self count]];
+}
+
+
+- (BOOL)enqueue:(id)object
+{
+	if (EXPECT_NOT(object == nil))  return NO;
+	
+	[object retain];
+	while (![self tryEnqueue:object])
+	{
+		WaitForSpace();
+	}
+	
+	// The barrier in -tryEnqueue: orders the sleeper check after the write, pairing with the one in -dequeue.
+	if (_sleepers != 0)
+	{
+		[_sleepLock lock];
+		[_sleepLock unlockWithCondition:kConditionQueuedData];
+	}
+	
+	return YES;
+}
+
+
+- (id)dequeue
+{
+	id			result = nil;
+	unsigned	spins;
+	
+	for (;;)
+	{
+		for (spins = 0; spins < kSpinsBeforeSleeping; spins++)
+		{
+			result = [self tryDequeueRetained];
+			if (result != nil)  return [result autorelease];
+		}
+		
+		/*	Register as a sleeper, then look again. A writer either sees
+			the sleeper count and signals, or wrote before we looked.
+		*/
+		[_sleepLock lock];
+		__sync_fetch_and_add(&_sleepers, 1);
+		result = [self tryDequeueRetained];
+		if (result == nil)
+		{
+			// Writers can only set the condition while we don't hold the lock, so this can't hide a signal.
+			[_sleepLock unlockWithCondition:kConditionNoData];
+			[_sleepLock lockWhenCondition:kConditionQueuedData];
+		}
+		__sync_fetch_and_sub(&_sleepers, 1);
+		
+		// Pass the wakeup on if there may be more data for other sleepers.
+		[_sleepLock unlockWithCondition:[self empty] ? kConditionNoData : kConditionQueuedData];
+		
+		if (result != nil)  return [result autorelease];
+	}
+}
+
+
+- (id)tryDequeue
+{
+	return [[self tryDequeueRetained] autorelease];
+}
+
+
+- (BOOL)empty
+{
+	return [self count] == 0;
+}
+
+
+- (unsigned)count
+{
+	uintptr_t dequeuePos = _dequeuePos;
+	uintptr_t enqueuePos = _enqueuePos;
+	
+	// Positions are read separately, so the difference can briefly be "negative".
+	intptr_t difference = (intptr_t)(enqueuePos - dequeuePos);
+	return (difference > 0) ? (unsigned)difference : 0;
+}
+
+
+- (void)emptyQueue
+{
+	id object = nil;
+	while ((object = [self tryDequeueRetained]))
+	{
+		[object release];
+	}
+}
+
+@end
+
+
+@implementation OOAsyncQueue (OOPrivate)
+
+// Takes ownership of a retained object if it returns YES.
+- (BOOL)tryEnqueue:(id)object
+{
+	OOAsyncQueueCell	*cell = NULL;
+	uintptr_t			pos = _enqueuePos;
+	
+	for (;;)
+	{
+		cell = &_cells[pos & _mask];
+		intptr_t difference = (intptr_t)(cell->sequence - pos);
+		
+		if (difference == 0)
+		{
+			if (CompareAndSwap(&_enqueuePos, pos, pos + 1))  break;
+		}
+		else if (difference < 0)
+		{
+			// The reader from one lap ago hasn't finished with this cell: full.
+			return NO;
+		}
+		
+		pos = _enqueuePos;
+	}
+	
+	cell->object = object;
+	MemoryBarrier();
+	cell->sequence = pos + 1;
+	MemoryBarrier();
+	
+	return YES;
+}
+
+
+// Returns a retained object, or nil if the queue is empty.
+- (id)tryDequeueRetained
+{
+	OOAsyncQueueCell	*cell = NULL;
+	uintptr_t			pos = _dequeuePos;
+	
+	for (;;)
+	{
+		cell = &_cells[pos & _mask];
+		intptr_t difference = (intptr_t)(cell->sequence - (pos + 1));
+		
+		if (difference == 0)
+		{
+			if (CompareAndSwap(&_dequeuePos, pos, pos + 1))  break;
+		}
+		else if (difference < 0)
+		{
+			// The writer for this position hasn't finished (or started): empty.
+			return nil;
+		}
+		
+		pos = _dequeuePos;
+	}
+	
+	id result = cell->object;
+	cell->object = nil;
+	MemoryBarrier();
+	cell->sequence = pos + _mask + 1;
+	
+	return result;
+}
+
+@end
+
+
+static void WaitForSpace(void)
+{
+	// Readers don't signal when they make space; a full queue means they're well behind anyway.
+#if OOLITE_WINDOWS
+	Sleep(1);
+#else
+	usleep(kFullWaitMicroseconds);
+#endif
+}
+
+#else	// !OOASYNCQUEUE_LOCK_FREE
 
 enum
 {
@@ -201,7 +487,7 @@ FAIL:
 
 - (BOOL)empty
 {
-	return _head != NULL;
+	return _head == NULL;
 }
 
 
@@ -300,3 +586,5 @@ FAIL:
 }
 
 @end
+
+#endif	// OOASYNCQUEUE_LOCK_FREE
@@ -4,6 +4,11 @@ OOAsyncWorkManager.h
 
 Simple thread pool/work unit manager.
 
+Tasks are started in order of priority: a high priority task is started before
+any queued medium or low priority task, whenever it was queued. Background
+work should be queued at low priority; the default work manager never lets
+low priority tasks occupy all of its worker threads.
+
 
 Copyright (C) 2009-2011 Jens Ayton
 
@@ -43,6 +48,9 @@ typedef enum
 } OOAsyncWorkPriority;
 
 
+typedef void (*OOAsyncBatchFunction)(void *context, OOUInteger batch);
+
+
 @interface OOAsyncWorkManager: NSObject
 
 + (id) sharedAsyncWorkManager;
@@ -62,6 +70,26 @@ typedef enum
 */
 - (void) waitForTaskToComplete:(id<OOAsyncWorkTask>)task;
 
+/*	Call function(context, batch) for each batch from 0 to count - 1, spread
+	across the worker threads and the calling thread, and return when all
+	batches are done. Batches may run in any order and must not depend on each
+	other.
+	
+	The calling thread runs any batches that no worker thread has started, so
+	this may be used from within a task without risk of deadlock. May be
+	called from any thread.
+*/
+- (void) performBatches:(OOUInteger)count withFunction:(OOAsyncBatchFunction)function context:(void *)context;
+
+/*	Queue statistics, or nil if the work manager doesn't keep any. The
+	dictionary has an entry for each priority ("low", "medium", "high"), each
+	holding "queued" (tasks waiting now), "started" (tasks started so far),
+	and "averageLatency" and "maxLatency" (time from queuing to starting, in
+	seconds); and also "threadCount", and "steals" (tasks a worker thread
+	took from another thread's queue).
+*/
+- (NSDictionary *) statistics;
+
 @end
 
 
@@ -50,6 +50,37 @@ static OOAsyncWorkManager *sSingleton = nil;
 @end
 
 
+enum
+{
+	kBatchJobRunning		= 1,
+	kBatchJobComplete
+};
+
+
+/*	OOAsyncBatchJob: one call to -performBatches:withFunction:context:. The
+	calling thread and any worker threads which pick up the job take batches
+	until none are left; the calling thread then waits for batches still being
+	run elsewhere. Workers which only get to the job after that find nothing
+	to do.
+*/
+@interface OOAsyncBatchJob: NSObject <OOAsyncWorkTask>
+{
+@private
+	OOAsyncBatchFunction	_function;
+	void					*_context;
+	OOUInteger				_count;
+	OOUInteger				_next, _completed;
+	NSConditionLock			*_lock;
+}
+
+- (id) initWithCount:(OOUInteger)count function:(OOAsyncBatchFunction)function context:(void *)context;
+
+- (void) runBatches;
+- (void) waitUntilComplete;
+
+@end
+
+
 /*	OOAsyncWorkManagerInternal: shared superclass of our two implementations,
 	which implements shared functionality but is not itself concrete.
 */
@@ -69,17 +100,87 @@ static OOAsyncWorkManager *sSingleton = nil;
 @end
 
 
-#if !OO_HAVE_NSOPERATION
+enum
+{
+	kPriorityCount			= kOOAsyncPriorityHigh + 1
+};
+
+
+typedef struct
+{
+	id<OOAsyncWorkTask>		task;
+	NSTimeInterval			queuedTime;
+} OOAsyncWorkItem;
+
+
+/*	Storage for a deque. When a deque grows, its old buffer is kept on the
+	retired list rather than freed, since a thread stealing from the deque may
+	still be reading it. The work manager is never deallocated, and each
+	buffer is twice the size of the last, so this wastes little.
+*/
+typedef struct OOAsyncWorkBuffer OOAsyncWorkBuffer;
+struct OOAsyncWorkBuffer
+{
+	OOUInteger				mask;		// Capacity - 1; capacity is a power of two.
+	OOAsyncWorkBuffer		*retired;
+	OOAsyncWorkItem			items[];
+};
+
+
+/*	Lock-free deque of tasks of one priority, after Chase and Lev. Tasks are
+	pushed at the bottom and taken from the top, so each deque is FIFO.
+	Positions only ever increase, and index the buffer modulo its capacity.
+	
+	Any thread may take a task, claiming it by advancing top with compare-and-
+	swap. Tasks are added by whichever thread calls -addTask:priority:, not by
+	the worker which owns the deque, so pushes are serialized by pushLock, a
+	spin lock which is only contended when two threads add tasks to the same
+	worker's queue at once.
+*/
+typedef struct
+{
+	OOAsyncWorkBuffer * volatile buffer;
+	volatile OOUInteger		top;
+	volatile OOUInteger		bottom;
+	volatile int			pushLock;
+} OOAsyncWorkDeque;
+
+
+/*	OOAsyncWorker: one worker thread's queues and statistics. The queues may be
+	used by any thread. The statistics are only written by the worker's own
+	thread.
+*/
+typedef struct
+{
+	OOAsyncWorkDeque		deques[kPriorityCount];
+	
+	unsigned long long		started[kPriorityCount];
+	NSTimeInterval			totalLatency[kPriorityCount];
+	NSTimeInterval			maxLatency[kPriorityCount];
+	unsigned long long		steals;
+} OOAsyncWorker;
+
+
 @interface OOManualDispatchAsyncWorkManager: OOAsyncWorkManagerInternal
 {
 @private
-	OOAsyncQueue			*_taskQueue;
+	OOAsyncWorker			*_workers;
+	OOUInteger				_workerCount;
+	OOUInteger				_nextWorker;
+	
+	/*	_scheduleLock guards the counts of queued tasks and running low
+		priority tasks; its condition is kWorkAvailable when an idle worker
+		could take a task.
+	*/
+	NSConditionLock			*_scheduleLock;
+	OOUInteger				_queuedCount[kPriorityCount];
+	OOUInteger				_runningLowPriority;
+	OOUInteger				_lowPriorityLimit;
 }
 
-- (void) queueTask:(NSNumber *)threadNumber;
+- (void) runWorker:(NSNumber *)workerIndex;
 
 @end
-#endif
 
 
 @interface OOOperationQueueAsyncWorkManager: OOAsyncWorkManagerInternal
@@ -105,18 +206,19 @@ static void InitAsyncWorkManager(void)
 {
 	NSCAssert(sSingleton == nil, @"Async Work Manager singleton not nil in one-time init");
 	
-#if !OO_HAVE_NSOPERATION
-	if ([OOOperationQueueAsyncWorkManager canBeUsed])
-	{
-		sSingleton = [[OOOperationQueueAsyncWorkManager alloc] init];
-	}
-	if (sSingleton == nil)
+	if (![[NSUserDefaults standardUserDefaults] boolForKey:@"disable-work-stealing-work-manager"])
 	{
 		sSingleton = [[OOManualDispatchAsyncWorkManager alloc] init];
 	}
+	
+#if !OO_HAVE_NSOPERATION
+	if (sSingleton == nil && [OOOperationQueueAsyncWorkManager canBeUsed])
 #else
-	sSingleton = [[OOOperationQueueAsyncWorkManager alloc] init];
+	if (sSingleton == nil)
 #endif
+	{
+		sSingleton = [[OOOperationQueueAsyncWorkManager alloc] init];
+	}
 	
 	if (sSingleton == nil)
 	{
@@ -215,6 +317,118 @@ static void InitAsyncWorkManager(void)
 	[NSException raise:NSInternalInconsistencyException format:@"%s called.", __PRETTY_FUNCTION__];
 }
 
+
+- (void) performBatches:(OOUInteger)count withFunction:(OOAsyncBatchFunction)function context:(void *)context
+{
+	NSParameterAssert(function != NULL);
+	
+	OOUInteger i, helpers = MIN((OOUInteger)OOCPUCount(), count) - 1;
+	OOAsyncBatchJob *job = nil;
+	
+	if (count > 1 && helpers > 0)
+	{
+		job = [[OOAsyncBatchJob alloc] initWithCount:count function:function context:context];
+	}
+	if (job == nil)
+	{
+		for (i = 0; i < count; i++)  function(context, i);
+		return;
+	}
+	
+	for (i = 0; i < helpers; i++)
+	{
+		if (![self addTask:job priority:kOOAsyncPriorityHigh])  break;
+	}
+	
+	[job waitUntilComplete];
+	[job release];
+}
+
+
+- (NSDictionary *) statistics
+{
+	return nil;
+}
+
+@end
+
+
+@implementation OOAsyncBatchJob
+
+- (id) initWithCount:(OOUInteger)count function:(OOAsyncBatchFunction)function context:(void *)context
+{
+	if ((self = [super init]))
+	{
+		_lock = [[NSConditionLock alloc] initWithCondition:(count != 0) ? kBatchJobRunning : kBatchJobComplete];
+		if (_lock == nil)
+		{
+			[self release];
+			return nil;
+		}
+		[_lock ooSetName:@"OOAsyncBatchJob lock"];
+		
+		_function = function;
+		_context = context;
+		_count = count;
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	[_lock release];
+	
+	[super dealloc];
+}
+
+
+- (void) runBatches
+{
+	for (;;)
+	{
+		[_lock lock];
+		if (_next == _count)
+		{
+			[_lock unlock];
+			break;
+		}
+		OOUInteger batch = _next++;
+		[_lock unlock];
+		
+		NS_DURING
+			_function(_context, batch);
+		NS_HANDLER
+			OOLog(kOOLogException, @"***** Exception in batch %lu of %@: %@ : %@ *****", (unsigned long)batch, self, [localException name], [localException reason]);
+		NS_ENDHANDLER
+		
+		[_lock lock];
+		_completed++;
+		[_lock unlockWithCondition:(_completed == _count) ? kBatchJobComplete : kBatchJobRunning];
+	}
+}
+
+
+- (void) waitUntilComplete
+{
+	[self runBatches];
+	[_lock lockWhenCondition:kBatchJobComplete];
+	[_lock unlock];
+}
+
+
+- (void) performAsyncTask
+{
+	[self runBatches];
+}
+
+
+- (void) completeAsyncTask
+{
+	// Nothing to do, but the work manager only forgets about tasks which implement this.
+}
+
 @end
 
 
@@ -314,74 +528,153 @@ static void InitAsyncWorkManager(void)
 
 /******* OOManualDispatchAsyncWorkManager - manual thread management *******/
 
+/*	Each worker thread has its own queue for each priority. New tasks are
+	dealt out to the workers in turn; a worker takes tasks from its own queue
+	first, and steals from the others when its own is empty. Higher priority
+	tasks are always started before lower priority ones, and low priority
+	tasks may not occupy every worker, so that urgent work (such as a texture
+	needed for the next frame) is never stuck behind a burst of background
+	work. Running tasks are not interrupted.
+	
+	The thread count is set by the "async-work-thread-count" user default;
+	by default, there is one thread per CPU, but at least two.
+*/
+
 enum
 {
-	kMaxWorkThreads			= 8
+	kMinWorkThreads			= 2,
+	kInitialDequeCapacity	= 16
 };
 
 
-#if !OO_HAVE_NSOPERATION
+enum
+{
+	kNoWorkAvailable		= 1,
+	kWorkAvailable
+};
+
+
+static NSString * const kPriorityNames[kPriorityCount] = { @"low", @"medium", @"high" };
+
+
+static BOOL DequePush(OOAsyncWorkDeque *deque, id<OOAsyncWorkTask> task, NSTimeInterval queuedTime);
+static BOOL DequeTake(OOAsyncWorkDeque *deque, OOAsyncWorkItem *outItem);
+
+
+@interface OOManualDispatchAsyncWorkManager (Private)
+
+- (OOAsyncWorkPriority) reserveTask;
+- (void) takeTaskWithPriority:(OOAsyncWorkPriority)priority forWorker:(OOUInteger)workerIndex item:(OOAsyncWorkItem *)outItem;
+- (void) finishTaskWithPriority:(OOAsyncWorkPriority)priority;
+- (int) scheduleCondition;
+
+@end
+
+
 @implementation OOManualDispatchAsyncWorkManager
 
 - (id) init
 {
 	if ((self = [super init]))
 	{
-		// Set up work queue.
-		_taskQueue = [[OOAsyncQueue alloc] init];
-		if (_taskQueue == nil)
+		_scheduleLock = [[NSConditionLock alloc] initWithCondition:kNoWorkAvailable];
+		if (_scheduleLock == nil)
+		{
+			[self release];
+			return nil;
+		}
+		[_scheduleLock ooSetName:@"OOAsyncWorkManager schedule lock"];
+		
+		long long threadCount = [[NSUserDefaults standardUserDefaults] oo_longLongForKey:@"async-work-thread-count" defaultValue:0];
+		if (threadCount <= 0)  threadCount = OOCPUCount();
+		_workerCount = MAX(threadCount, (long long)kMinWorkThreads);
+		
+		// Low priority tasks may use all but one worker.
+		_lowPriorityLimit = _workerCount - 1;
+		
+		_workers = calloc(_workerCount, sizeof *_workers);
+		if (_workers == NULL)
 		{
 			[self release];
 			return nil;
 		}
 		
 		// Set up loading threads.
-		OOUInteger threadCount, threadNumber = 1;
-#if OO_DEBUG
-		threadCount = kMaxWorkThreads;
-#else
-		threadCount = MIN(OOCPUCount(), (unsigned)kMaxWorkThreads);
-#endif
-		do
+		OOUInteger i;
+		for (i = 0; i < _workerCount; i++)
 		{
-			[NSThread detachNewThreadSelector:@selector(queueTask:) toTarget:self withObject:[NSNumber numberWithInt:threadNumber++]];
-		}  while (--threadCount > 0);
+			[NSThread detachNewThreadSelector:@selector(runWorker:) toTarget:self withObject:[NSNumber numberWithUnsignedLong:i]];
+		}
 	}
 	
 	return self;
 }
 
 
+- (NSString *) descriptionComponents
+{
+	NSMutableString *result = [NSMutableString stringWithFormat:@"%lu threads, queued:", (unsigned long)_workerCount];
+	OOUInteger priority;
+	for (priority = kPriorityCount; priority-- > 0; )
+	{
+		[result appendFormat:@" %lu %@", (unsigned long)_queuedCount[priority], kPriorityNames[priority]];
+	}
+	return result;
+}
+
+
 - (BOOL) addTask:(id<OOAsyncWorkTask>)task priority:(OOAsyncWorkPriority)priority
 {
 	if (EXPECT_NOT(task == nil))  return NO;
+	if (EXPECT_NOT(priority >= kPriorityCount))  priority = kOOAsyncPriorityMedium;
+	
+	// The task must be in a queue before it's counted, so that a worker which reserves it is sure to find it.
+	OOAsyncWorker *worker = &_workers[__sync_fetch_and_add(&_nextWorker, 1) % _workerCount];
+	
+	if (EXPECT_NOT(!DequePush(&worker->deques[priority], task, [NSDate timeIntervalSinceReferenceDate])))  return NO;
 	
 	[super noteTaskQueued:task];
 	
-	// Priority is ignored.
-	return [_taskQueue enqueue:task];
+	[_scheduleLock lock];
+	_queuedCount[priority]++;
+	[_scheduleLock unlockWithCondition:[self scheduleCondition]];
+	
+	return YES;
 }
 
 
-- (void) queueTask:(NSNumber *)threadNumber
+- (void) runWorker:(NSNumber *)workerIndexObj
 {
 	NSAutoreleasePool			*rootPool = nil, *pool = nil;
+	OOUInteger					workerIndex = [workerIndexObj unsignedLongValue];
+	OOAsyncWorker				*worker = &_workers[workerIndex];
+	OOAsyncWorkItem				item;
 	
 	rootPool = [[NSAutoreleasePool alloc] init];
 	
 	[NSThread setThreadPriority:0.5];
-	[NSThread ooSetCurrentThreadName:[NSString stringWithFormat:@"OOAsyncWorkManager thread %@", threadNumber]];
+	[NSThread ooSetCurrentThreadName:[NSString stringWithFormat:@"OOAsyncWorkManager thread %lu", (unsigned long)workerIndex + 1]];
 	
 	for (;;)
 	{
 		pool = [[NSAutoreleasePool alloc] init];
 		
-		id<OOAsyncWorkTask> task = [_taskQueue dequeue];
+		OOAsyncWorkPriority priority = [self reserveTask];
+		[self takeTaskWithPriority:priority forWorker:workerIndex item:&item];
+		
+		NSTimeInterval latency = [NSDate timeIntervalSinceReferenceDate] - item.queuedTime;
+		worker->started[priority]++;
+		worker->totalLatency[priority] += latency;
+		if (latency > worker->maxLatency[priority])  worker->maxLatency[priority] = latency;
+		
 		NS_DURING
-			[task performAsyncTask];
+			[item.task performAsyncTask];
 		NS_HANDLER
 		NS_ENDHANDLER
-		[self queueResult:task];
+		[self queueResult:item.task];
+		[item.task release];
+		
+		[self finishTaskWithPriority:priority];
 		
 		[pool release];
 	}
@@ -389,8 +682,205 @@ enum
 	[rootPool release];
 }
 
+
+- (NSDictionary *) statistics
+{
+	NSMutableDictionary		*result = [NSMutableDictionary dictionary];
+	unsigned long long		started[kPriorityCount] = { 0 }, steals = 0;
+	NSTimeInterval			totalLatency[kPriorityCount] = { 0 }, maxLatency[kPriorityCount] = { 0 };
+	OOUInteger				i, priority;
+	
+	// Read without locking; the numbers may be slightly out of step with each other.
+	for (i = 0; i < _workerCount; i++)
+	{
+		for (priority = 0; priority < kPriorityCount; priority++)
+		{
+			started[priority] += _workers[i].started[priority];
+			totalLatency[priority] += _workers[i].totalLatency[priority];
+			maxLatency[priority] = fmax(maxLatency[priority], _workers[i].maxLatency[priority]);
+		}
+		steals += _workers[i].steals;
+	}
+	
+	for (priority = 0; priority < kPriorityCount; priority++)
+	{
+		NSDictionary *priorityStats = [NSDictionary dictionaryWithObjectsAndKeys:
+									   [NSNumber numberWithUnsignedLong:_queuedCount[priority]], @"queued",
+									   [NSNumber numberWithUnsignedLongLong:started[priority]], @"started",
+									   [NSNumber numberWithDouble:(started[priority] != 0) ? totalLatency[priority] / started[priority] : 0.0], @"averageLatency",
+									   [NSNumber numberWithDouble:maxLatency[priority]], @"maxLatency",
+									   nil];
+		[result setObject:priorityStats forKey:kPriorityNames[priority]];
+	}
+	
+	[result setObject:[NSNumber numberWithUnsignedLong:_workerCount] forKey:@"threadCount"];
+	[result setObject:[NSNumber numberWithUnsignedLongLong:steals] forKey:@"steals"];
+	
+	return result;
+}
+
 @end
-#endif
+
+
+@implementation OOManualDispatchAsyncWorkManager (Private)
+
+/*	Wait until there is a task this worker may start, and claim it by taking
+	it out of the counts. The task itself is fetched afterwards, so that
+	_scheduleLock is never held while a queue lock is taken.
+*/
+- (OOAsyncWorkPriority) reserveTask
+{
+	OOAsyncWorkPriority priority = kOOAsyncPriorityHigh;
+	
+	[_scheduleLock lockWhenCondition:kWorkAvailable];
+	
+	for (;;)
+	{
+		if (_queuedCount[priority] != 0 && (priority != kOOAsyncPriorityLow || _runningLowPriority < _lowPriorityLimit))  break;
+		NSAssert(priority != kOOAsyncPriorityLow, @"OOAsyncWorkManager schedule condition inconsistent with counts.");
+		priority--;
+	}
+	
+	_queuedCount[priority]--;
+	if (priority == kOOAsyncPriorityLow)  _runningLowPriority++;
+	
+	[_scheduleLock unlockWithCondition:[self scheduleCondition]];
+	
+	return priority;
+}
+
+
+- (void) takeTaskWithPriority:(OOAsyncWorkPriority)priority forWorker:(OOUInteger)workerIndex item:(OOAsyncWorkItem *)outItem
+{
+	/*	Every reserved task is in some queue, but another worker may take it
+		from the queue we look in first, leaving its own task for us; so keep
+		going round until one turns up. Giving up would strand the task, since
+		its count has already been taken. There are never more reservations
+		than queued tasks, so a sweep only comes up empty if other workers took
+		tasks from queues we had already looked at, and there is one left for
+		us; this never waits for another thread to do anything.
+	*/
+	OOUInteger i;
+	for (;;)
+	{
+		for (i = 0; i < _workerCount; i++)
+		{
+			OOAsyncWorker *victim = &_workers[(workerIndex + i) % _workerCount];
+			
+			if (DequeTake(&victim->deques[priority], outItem))
+			{
+				if (i != 0)  _workers[workerIndex].steals++;
+				return;
+			}
+		}
+	}
+}
+
+
+- (void) finishTaskWithPriority:(OOAsyncWorkPriority)priority
+{
+	if (priority != kOOAsyncPriorityLow)  return;
+	
+	[_scheduleLock lock];
+	_runningLowPriority--;
+	[_scheduleLock unlockWithCondition:[self scheduleCondition]];
+}
+
+
+// Must be called with _scheduleLock held.
+- (int) scheduleCondition
+{
+	if (_queuedCount[kOOAsyncPriorityHigh] != 0 || _queuedCount[kOOAsyncPriorityMedium] != 0)  return kWorkAvailable;
+	if (_queuedCount[kOOAsyncPriorityLow] != 0 && _runningLowPriority < _lowPriorityLimit)  return kWorkAvailable;
+	return kNoWorkAvailable;
+}
+
+@end
+
+
+static BOOL DequeGrow(OOAsyncWorkDeque *deque, OOUInteger top, OOUInteger bottom)
+{
+	OOAsyncWorkBuffer *buffer = deque->buffer;
+	OOUInteger newCapacity = (buffer != NULL) ? (buffer->mask + 1) * 2 : kInitialDequeCapacity;
+	OOAsyncWorkBuffer *newBuffer = malloc(sizeof *newBuffer + newCapacity * sizeof newBuffer->items[0]);
+	if (EXPECT_NOT(newBuffer == NULL))  return NO;
+	
+	newBuffer->mask = newCapacity - 1;
+	newBuffer->retired = buffer;
+	
+	OOUInteger i;
+	for (i = top; i != bottom; i++)
+	{
+		newBuffer->items[i & newBuffer->mask] = buffer->items[i & buffer->mask];
+	}
+	
+	// The copied items must be visible before the buffer is.
+	__sync_synchronize();
+	deque->buffer = newBuffer;
+	
+	return YES;
+}
+
+
+static BOOL DequePush(OOAsyncWorkDeque *deque, id<OOAsyncWorkTask> task, NSTimeInterval queuedTime)
+{
+	while (!__sync_bool_compare_and_swap(&deque->pushLock, 0, 1))  {}
+	
+	/*	top may be stale, but only ever increases, so the deque may look
+		fuller than it is but never emptier.
+	*/
+	OOUInteger bottom = deque->bottom;
+	OOUInteger top = deque->top;
+	BOOL OK = YES;
+	
+	if (deque->buffer == NULL || bottom - top > deque->buffer->mask)
+	{
+		OK = DequeGrow(deque, top, bottom);
+	}
+	
+	if (EXPECT(OK))
+	{
+		OOAsyncWorkBuffer *buffer = deque->buffer;
+		OOAsyncWorkItem *item = &buffer->items[bottom & buffer->mask];
+		item->task = [task retain];
+		item->queuedTime = queuedTime;
+		
+		// The item must be visible before bottom says it's there.
+		__sync_synchronize();
+		deque->bottom = bottom + 1;
+	}
+	
+	__sync_lock_release(&deque->pushLock);
+	
+	return OK;
+}
+
+
+static BOOL DequeTake(OOAsyncWorkDeque *deque, OOAsyncWorkItem *outItem)
+{
+	for (;;)
+	{
+		OOUInteger top = deque->top;
+		__sync_synchronize();
+		OOUInteger bottom = deque->bottom;
+		if (top == bottom)  return NO;
+		
+		/*	Read the buffer after bottom, so that it is at least as new as
+			the buffer the item at top was pushed into. Older buffers are never
+			freed, and an item's slot is only reused once top has passed it.
+		*/
+		__sync_synchronize();
+		OOAsyncWorkBuffer *buffer = deque->buffer;
+		OOAsyncWorkItem item = buffer->items[top & buffer->mask];
+		
+		// If another thread got there first, try again with the next item.
+		if (__sync_bool_compare_and_swap(&deque->top, top, top + 1))
+		{
+			*outItem = item;
+			return YES;
+		}
+	}
+}
 
 
 /******* OOOperationQueueAsyncWorkManager - dispatch through NSOperationQueue if available *******/
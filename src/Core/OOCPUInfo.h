@@ -37,6 +37,13 @@ void OOCPUInfoInit(void);
 unsigned OOCPUCount(void);
 
 
+/*	Vector instruction sets supported by the CPU at runtime, for code which
+	has vectorised paths (currently OOTextureScaling.m). Whether such a path
+	was compiled in is up to the code using it.
+*/
+BOOL OOCPUHasSSE2(void);
+
+
 /*	Set up OOLITE_BIG_ENDIAN and OOLITE_LITTLE_ENDIAN macros. Exactly one must
 	be non-zero. If you're porting Oolite to a middle-endian platform, you'll
 	need to work out what to do with endian-sensitive stuff -- currently, that
@@ -31,6 +31,10 @@ MA 02110-1301, USA.
 #include <unistd.h>
 #endif
 
+#if defined(__i386__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#endif
+
 
 #if 0
 // Confirm settings
@@ -52,6 +56,7 @@ static BOOL				sInited = NO;
 
 
 static unsigned			sNumberOfCPUs = 0;	// Yes, really 0.
+static BOOL				sHasSSE2 = NO;
 
 
 void OOCPUInfoInit(void)
@@ -104,6 +109,14 @@ void OOCPUInfoInit(void)
 	#warning Do not know how to find number of CPUs on this architecture.
 #endif	// OS selection
 	
+	// Check for vector units
+#if defined(__x86_64__) || defined(__amd64__)
+	sHasSSE2 = YES;		// Part of the x86-64 baseline.
+#elif defined(__i386__) && (defined(__GNUC__) || defined(__clang__))
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))  sHasSSE2 = (edx & bit_SSE2) != 0;
+#endif
+	
 	sInited = YES;
 }
 
@@ -113,3 +126,10 @@ unsigned OOCPUCount(void)
 	if (!sInited)  OOCPUInfoInit();
 	return (sNumberOfCPUs != 0) ? sNumberOfCPUs : 1;
 }
+
+
+BOOL OOCPUHasSSE2(void)
+{
+	if (!sInited)  OOCPUInfoInit();
+	return sHasSSE2;
+}
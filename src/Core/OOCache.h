@@ -14,6 +14,11 @@ If auto-pruning is on, the cache will pruned to 80% of the prune threshold
 whenever the prune threshold is exceeded. If auto-pruning is off, the cache
 can be pruned to the prune threshold by explicitly calling -prune.
 
+OOCaches are not thread-safe unless created with -initWithShardCount:, which
+splits the cache into independently locked parts so it can be shared with
+worker threads. Pruning is then done per part, so it is only approximately
+least-recently-used.
+
 While OOCacheManager-managed caches must have string keys and property list
 values, OOCaches used directly may have any keys allowable for a mutable
 dictionary (that is, keys should conform to <NSCopying> and values may be
@@ -58,13 +63,16 @@ enum
 {
 @private
 	struct OOCacheImpl		*cache;
+	unsigned				shardCount;
 	unsigned				pruneThreshold;
 	BOOL					autoPrune;
 	BOOL					dirty;
 }
 
 - (id)init;
+- (id)initWithShardCount:(unsigned)shardCount;	// Thread-safe; shardCount is rounded up to a power of two, at most 64.
 - (id)initWithPList:(id)pList;
+- (id)initWithPList:(id)pList shardCount:(unsigned)shardCount;
 - (id)pListRepresentation;
 
 - (id)objectForKey:(id)key;
@@ -79,6 +87,9 @@ enum
 
 - (void)prune;
 
+- (unsigned)count;
+- (unsigned)shardCount;
+
 - (BOOL)dirty;
 - (void)markClean;
 
@@ -40,43 +40,21 @@ MA 02110-1301, USA.
 	maintain an age-sorted list could be used.
 	
 	I chose instead to implement a custom scheme from scratch. It uses two
-	parallel data structures: a doubly-linked list sorted by age, and a splay
-	tree to implement insertion/deletion. The implementation is largely
-	procedural C. Deserialization, pruning and modification tracking is done
-	in the ObjC class; everything else is done in C functions.
-	
-	A SPLAY TREE is a type of semi-balanced binary search tree with certain
-	useful properties:
-	  * Simplicity. All look-up and restructuring operations are based on a
-		single operation, splaying, which brings the node with the desired key
-		(or the node whose key is "left" of the desired key, if there is no
-		exact match) to the root, while maintaining the binary search tree
-		invariant. Splaying itself is sufficient for look-up; insertion and
-		deletion work by splaying and then manipulating at the root.
-	  * Self-optimization. Because each look-up brings the sought element to
-		the root, often-used elements tend to stay near the top. (Oolite often
-		performs sequences of identical look-ups, for instance when creating
-		an asteroid field, or the racing ring set-up which uses lots of
-		identical ring segments; during combat, missiles, canisters and hull
-		plates will be commonly used.) Also, this means that for a retrieve-
-		attempt/insert sequence, the retrieve attempt will optimize the tree
-		for the insertion.
-	  * Efficiency. In addition to the self-optimization, splay trees have a
-		small code size and no storage overhead for flags.
-		The amortized worst-case cost of splaying (cost averaged over a
-		worst-case sequence of operations) is O(log n); a single worst-case
-		splay is O(n), but that worst-case also improves the balance of the
-		tree, so you can't have two worst cases in a row. Insertion and
-		deletion are also O(log n), consisting of a splay plus an O(1)
-		operation.
-	References for splay trees:
-	  * http://www.cs.cmu.edu/~sleator/papers/self-adjusting.pdf
-		Original research paper.
-	  *	http://www.ibr.cs.tu-bs.de/courses/ss98/audii/applets/BST/SplayTree-Example.html
-		Java applet demonstrating splaying.
-	  * http://www.link.cs.cmu.edu/link/ftp-site/splaying/top-down-splay.c
-		Sample implementation by one of the inventors. The TreeSplay(),
-		TreeInsert() and CacheRemove() functions are based on this.
+	parallel data structures: a doubly-linked list sorted by age, and a hash
+	table to implement look-up, insertion and deletion. The implementation is
+	largely procedural C. Deserialization, pruning and modification tracking is
+	done in the ObjC class; everything else is done in C functions.
+	
+	(Earlier versions used a splay tree instead of the hash table. Splaying
+	made every look-up O(log n) comparisons plus a restructuring of the tree,
+	which was measurably slow for the long string keys used by the texture and
+	mesh caches.)
+	
+	The HASH TABLE uses separate chaining, with a power-of-two number of
+	buckets. Each node caches its key's -hash, so that resizing and chain
+	walks only need -isEqual: when the hashes match. The table doubles when
+	it becomes three-quarters full, and never shrinks. Look-up, insertion and
+	deletion are O(1) on average.
 	
 	The AGE LIST is a doubly-linked list, ordered from oldest to youngest.
 	Whenever an element is retrieved or inserted, it is promoted to the
@@ -85,30 +63,33 @@ MA 02110-1301, USA.
 	
 	if (autoPrune)
 	{
-		PRUNING is batched, handling 20% of the cache at once. This is primarily
-		because deletion somewhat pessimizes the tree (see "Self-optimization"
-		below). It also provides a bit of code coherency. To reduce pruning
-		batches while in flight, pruning is also performed before serialization
-		(which in turn is done, if the cache has changed, whenever the user
-		docks). This has the effect that the number of items in the cache on disk
-		never exceeds 80% of the prune threshold. This is probably not actually
-		poinful, since pruning should be a very small portion of the per-frame run
-		time in any case. Premature optimization and all that jazz.
-		Pruning performs at most 0.2n deletions, and is thus O(n log n).
+		PRUNING is batched, handling 20% of the cache at once. This provides a
+		bit of code coherency, and means the cost of pruning is amortized over
+		several insertions. Pruning performs at most 0.2n deletions, each O(1).
 	}
 	else
 	{
 		PRUNING is performed manually by calling -prune.
 	}
 	
+	SHARDING: a cache created with -initWithShardCount: is split into several
+	independent hash tables and age lists ("shards"), each protected by its own
+	lock. A key always goes to the same shard, so threads working with
+	different keys rarely contend. Each shard is pruned separately to its
+	share of the prune threshold, so the least-recently used elements of the
+	cache as a whole are only approximately the ones removed, and
+	-objectsByAge is only ordered within each shard. Unsharded caches have no
+	locks and must only be used from one thread at a time, as before.
+	
 	If the macro OOCACHE_PERFORM_INTEGRITY_CHECKS is set to a non-zero value,
-	the integrity of the tree and the age list will be checked before and
-	after each high-level operation. This is an inherently O(n) operation.
+	the integrity of the hash table and the age list will be checked before
+	and after each high-level operation. This is an inherently O(n) operation.
 */
 
 
 #import "OOCache.h"
 #import "OOStringParsing.h"
+#import "NSThreadOOExtensions.h"
 
 
 #ifndef OOCACHE_PERFORM_INTEGRITY_CHECKS
@@ -116,13 +97,6 @@ MA 02110-1301, USA.
 #endif
 
 
-// Protocol used internally to squash idiotic warnings in gnu-gcc.
-@protocol OOCacheComparable <NSObject, NSCopying>
-- (NSComparisonResult) compare:(id<OOCacheComparable>)other;
-- (id) copy;
-@end
-
-
 static NSString * const kOOLogCacheIntegrityCheck	= @"dataCache.integrityCheck";
 
 
@@ -130,30 +104,37 @@ typedef struct OOCacheImpl OOCacheImpl;
 typedef struct OOCacheNode OOCacheNode;
 
 
-enum { kCountUnknown = -1UL };
+enum
+{
+	kInitialBucketCount		= 16,
+	kMaxShardCount			= 64
+};
 
 
 static NSString * const kSerializedEntryKeyKey		= @"key";
 static NSString * const kSerializedEntryKeyValue	= @"value";
 
 
-static OOCacheImpl *CacheAllocate(void);
-static void CacheFree(OOCacheImpl *cache);
+static OOCacheImpl *CacheAllocate(unsigned shardCount);
+static void CacheFree(OOCacheImpl *cache, unsigned shardCount);
+static OOCacheImpl *CacheShardForKey(OOCacheImpl *cache, unsigned shardCount, id key, OOUInteger *outHash);
+static void CacheLock(OOCacheImpl *cache);
+static void CacheUnlock(OOCacheImpl *cache);
 
-static BOOL CacheInsert(OOCacheImpl *cache, id key, id value);
-static BOOL CacheRemove(OOCacheImpl *cache, id key);
+static BOOL CacheInsert(OOCacheImpl *cache, id key, OOUInteger hash, id value);
+static BOOL CacheRemove(OOCacheImpl *cache, id key, OOUInteger hash);
 static BOOL CacheRemoveOldest(OOCacheImpl *cache, NSString *logKey);
-static id CacheRetrieve(OOCacheImpl *cache, id key);
+static id CacheRetrieve(OOCacheImpl *cache, id key, OOUInteger hash);
 static unsigned CacheGetCount(OOCacheImpl *cache);
-static NSArray *CacheArrayOfContentsByAge(OOCacheImpl *cache);
-static NSArray *CacheArrayOfNodesByAge(OOCacheImpl *cache);
+static void CacheAppendContentsByAge(OOCacheImpl *cache, NSMutableArray *contents);
+static void CacheAppendNodesByAge(OOCacheImpl *cache, NSMutableArray *nodes);
 static NSString *CacheGetName(OOCacheImpl *cache);
 static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 #if OOCACHE_PERFORM_INTEGRITY_CHECKS
 	static void CacheCheckIntegrity(OOCacheImpl *cache, NSString *context);
 	
-	#define CHECK_INTEGRITY(context)	CacheCheckIntegrity(cache, (context))
+	#define CHECK_INTEGRITY(context)	do { unsigned i_; for (i_ = 0; i_ < shardCount; i_++)  { CacheLock(&cache[i_]); CacheCheckIntegrity(&cache[i_], (context)); CacheUnlock(&cache[i_]); } } while (0)
 #else
 	#define CHECK_INTEGRITY(context)	do {} while (0)
 #endif
@@ -162,6 +143,7 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 @interface OOCache (Private)
 
 - (void)loadFromArray:(NSArray *)inArray;
+- (void)pruneShard:(OOCacheImpl *)shard;
 
 @end
 
@@ -172,7 +154,7 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 - (void)dealloc
 {
 	CHECK_INTEGRITY(@"dealloc");
-	CacheFree(cache);
+	CacheFree(cache, shardCount);
 	
 	[super dealloc];
 }
@@ -180,7 +162,7 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 - (NSString *)description
 {
-	return [NSString stringWithFormat:@"<%@ %p>{\"%@\", %u elements, prune threshold=%u, auto-prune=%s dirty=%s}", [self class], self, [self name], CacheGetCount(cache), pruneThreshold, autoPrune ? "yes" : "no", dirty ? "yes" : "no"];
+	return [NSString stringWithFormat:@"<%@ %p>{\"%@\", %u elements, %u shards, prune threshold=%u, auto-prune=%s dirty=%s}", [self class], self, [self name], [self count], shardCount, pruneThreshold, autoPrune ? "yes" : "no", dirty ? "yes" : "no"];
 }
 
 
@@ -190,7 +172,19 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 }
 
 
+- (id)initWithShardCount:(unsigned)count
+{
+	return [self initWithPList:nil shardCount:count];
+}
+
+
 - (id)initWithPList:(id)pList
+{
+	return [self initWithPList:pList shardCount:0];
+}
+
+
+- (id)initWithPList:(id)pList shardCount:(unsigned)count
 {
 	BOOL					OK = YES;
 	
@@ -199,21 +193,31 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 	
 	if (OK)
 	{
-		cache = CacheAllocate();
+		// A shard count of zero means a single, unlocked shard.
+		if (count == 0)  shardCount = 1;
+		else
+		{
+			// Round up to a power of two, so a shard can be picked by masking.
+			count = MIN(count, (unsigned)kMaxShardCount);
+			for (shardCount = 1; shardCount < count; shardCount *= 2) {}
+		}
+		
+		cache = CacheAllocate(count != 0 ? shardCount : 0);
 		if (cache == NULL) OK = NO;
 	}
 	
-	if (pList != nil)
-	{
-		if (OK) OK = [pList isKindOfClass:[NSArray class]];
-		if (OK) [self loadFromArray:pList];
-	}
 	if (OK)
 	{
 		pruneThreshold = kOOCacheDefaultPruneThreshold;
 		autoPrune = YES;
 	}
 	
+	if (pList != nil)
+	{
+		if (OK) OK = [pList isKindOfClass:[NSArray class]];
+		if (OK) [self loadFromArray:pList];
+	}
+	
 	if (!OK)
 	{
 		[self release];
@@ -226,36 +230,60 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 - (id)pListRepresentation
 {
-	return CacheArrayOfNodesByAge(cache);
+	NSMutableArray			*result = nil;
+	unsigned				i;
+	
+	result = [NSMutableArray arrayWithCapacity:[self count]];
+	for (i = 0; i < shardCount; i++)
+	{
+		CacheLock(&cache[i]);
+		CacheAppendNodesByAge(&cache[i], result);
+		CacheUnlock(&cache[i]);
+	}
 	
-	return nil;
+	return [result count] != 0 ? result : nil;
 }
 
 
 - (id)objectForKey:(id)key
 {
+	OOCacheImpl				*shard = NULL;
+	OOUInteger				hash;
 	id						result = nil;
 	
+	if (key == nil)  return nil;
+	
 	CHECK_INTEGRITY(@"objectForKey: before");
 	
-	result = CacheRetrieve(cache, key);
+	shard = CacheShardForKey(cache, shardCount, key, &hash);
+	CacheLock(shard);
+	result = [CacheRetrieve(shard, key, hash) retain];
+	CacheUnlock(shard);
 	// Note: while reordering the age list technically makes the cache dirty, it's not worth rewriting it just for that, so we don't flag it.
 	
 	CHECK_INTEGRITY(@"objectForKey: after");
 	
-	return [[result retain] autorelease];
+	return [result autorelease];
 }
 
 
 - (void)setObject:inObject forKey:(id)key
 {
+	OOCacheImpl				*shard = NULL;
+	OOUInteger				hash;
+	
+	if (key == nil || inObject == nil)  return;
+	
 	CHECK_INTEGRITY(@"setObject:forKey: before");
 	
-	if (CacheInsert(cache, key, inObject))
+	shard = CacheShardForKey(cache, shardCount, key, &hash);
+	CacheLock(shard);
+	if (CacheInsert(shard, key, hash, inObject))
 	{
 		dirty = YES;
-		if (autoPrune)  [self prune];
+		if (autoPrune)  [self pruneShard:shard];
 	}
+	CacheUnlock(shard);
 	
 	CHECK_INTEGRITY(@"setObject:forKey: after");
 }
@@ -263,9 +291,17 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 - (void)removeObjectForKey:(id)key
 {
+	OOCacheImpl				*shard = NULL;
+	OOUInteger				hash;
+	
+	if (key == nil)  return;
+	
 	CHECK_INTEGRITY(@"removeObjectForKey: before");
 	
-	if (CacheRemove(cache, key)) dirty = YES;
+	shard = CacheShardForKey(cache, shardCount, key, &hash);
+	CacheLock(shard);
+	if (CacheRemove(shard, key, hash)) dirty = YES;
+	CacheUnlock(shard);
 	
 	CHECK_INTEGRITY(@"removeObjectForKey: after");
 }
@@ -307,25 +343,35 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 - (void)prune
 {
-	unsigned				pruneCount;
-	unsigned				desiredCount;
-	unsigned				count;
-	
-	// Order of operations is to ensure rounding down.
-	if (autoPrune)  desiredCount = (pruneThreshold * 4) / 5;
-	else  desiredCount = pruneThreshold;
-	
-	if (pruneThreshold == kOOCacheNoPrune || (count = CacheGetCount(cache)) <= pruneThreshold)  return;
-	
-	pruneCount = count - desiredCount;
+	unsigned				i;
 	
-	NSString *logKey = [NSString stringWithFormat:@"dataCache.prune.%@", CacheGetName(cache)];
-	OOLog(logKey, @"Pruning cache \"%@\" - removing %u entries", CacheGetName(cache), pruneCount);
-	OOLogIndentIf(logKey);
+	for (i = 0; i < shardCount; i++)
+	{
+		CacheLock(&cache[i]);
+		[self pruneShard:&cache[i]];
+		CacheUnlock(&cache[i]);
+	}
+}
+
+
+- (unsigned)count
+{
+	unsigned				i, count = 0;
 	
-	while (pruneCount--)  CacheRemoveOldest(cache, logKey);
+	for (i = 0; i < shardCount; i++)
+	{
+		CacheLock(&cache[i]);
+		count += CacheGetCount(&cache[i]);
+		CacheUnlock(&cache[i]);
+	}
 	
-	OOLogOutdentIf(logKey);
+	return count;
+}
+
+
+- (unsigned)shardCount
+{
+	return shardCount;
 }
 
 
@@ -343,19 +389,37 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 - (NSString *)name
 {
-	return CacheGetName(cache);
+	return CacheGetName(&cache[0]);
 }
 
 
 - (void)setName:(NSString *)name
 {
-	CacheSetName(cache, name);
+	unsigned				i;
+	
+	for (i = 0; i < shardCount; i++)
+	{
+		CacheLock(&cache[i]);
+		CacheSetName(&cache[i], name);
+		CacheUnlock(&cache[i]);
+	}
 }
 
 
 - (NSArray *) objectsByAge
 {
-	return CacheArrayOfContentsByAge(cache);
+	NSMutableArray			*result = nil;
+	unsigned				i;
+	
+	result = [NSMutableArray arrayWithCapacity:[self count]];
+	for (i = 0; i < shardCount; i++)
+	{
+		CacheLock(&cache[i]);
+		CacheAppendContentsByAge(&cache[i], result);
+		CacheUnlock(&cache[i]);
+	}
+	
+	return [result count] != 0 ? result : nil;
 }
 
 @end
@@ -386,6 +450,37 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 	}
 }
 
+
+// Must be called with the shard's lock held.
+- (void)pruneShard:(OOCacheImpl *)shard
+{
+	unsigned				pruneCount;
+	unsigned				threshold;
+	unsigned				desiredCount;
+	unsigned				count;
+	
+	if (pruneThreshold == kOOCacheNoPrune)  return;
+	
+	// Each shard gets an equal share of the threshold.
+	threshold = (pruneThreshold + shardCount - 1) / shardCount;
+	
+	// Order of operations is to ensure rounding down.
+	if (autoPrune)  desiredCount = (threshold * 4) / 5;
+	else  desiredCount = threshold;
+	
+	if ((count = CacheGetCount(shard)) <= threshold)  return;
+	
+	pruneCount = count - desiredCount;
+	
+	NSString *logKey = [NSString stringWithFormat:@"dataCache.prune.%@", CacheGetName(shard)];
+	OOLog(logKey, @"Pruning cache \"%@\" - removing %u entries", CacheGetName(shard), pruneCount);
+	OOLogIndentIf(logKey);
+	
+	while (pruneCount--)  CacheRemoveOldest(shard, logKey);
+	
+	OOLogOutdentIf(logKey);
+}
+
 @end
 
 
@@ -393,45 +488,49 @@ static void CacheSetName(OOCacheImpl *cache, NSString *name);
 
 struct OOCacheImpl
 {
-	// Splay tree root
-	OOCacheNode				*root;
+	// Hash table
+	OOCacheNode				**buckets;
+	OOUInteger				bucketMask;
 	
 	// Ends of age list
 	OOCacheNode				*oldest, *youngest;
 	
 	unsigned				count;
 	NSString				*name;
+	
+	// Only for sharded caches.
+	NSLock					*lock;
 };
 
 
 struct OOCacheNode
 {
 	// Payload
-	id<OOCacheComparable>	key;
+	id						key;
 	id						value;
 	
-	// Splay tree
-	OOCacheNode				*leftChild, *rightChild;
+	// Hash table
+	OOUInteger				hash;
+	OOCacheNode				*next;
 	
 	// Age list
 	OOCacheNode				*younger, *older;
 };
 
-static OOCacheNode *CacheNodeAllocate(id<OOCacheComparable> key, id value);
+static OOCacheNode *CacheNodeAllocate(id key, OOUInteger hash, id value);
 static void CacheNodeFree(OOCacheImpl *cache, OOCacheNode *node);
-static id CacheNodeGetValue(OOCacheNode *node);
 static void CacheNodeSetValue(OOCacheNode *node, id value);
 
 #if OOCACHE_PERFORM_INTEGRITY_CHECKS
 static NSString *CacheNodeGetDescription(OOCacheNode *node);
 #endif
 
-static OOCacheNode *TreeSplay(OOCacheNode **root, id<OOCacheComparable> key);
-static OOCacheNode *TreeInsert(OOCacheImpl *cache, id<OOCacheComparable> key, id value);
+OOINLINE OOUInteger HashMix(OOUInteger hash);
+static OOCacheNode **HashFind(OOCacheImpl *cache, id key, OOUInteger hash);
+static BOOL HashGrow(OOCacheImpl *cache);
 
 #if OOCACHE_PERFORM_INTEGRITY_CHECKS
-static unsigned TreeCountNodes(OOCacheNode *node);
-static OOCacheNode *TreeCheckIntegrity(OOCacheImpl *cache, OOCacheNode *node, OOCacheNode *expectedParent, NSString *context);
+static void HashCheckIntegrity(OOCacheImpl *cache, NSString *context);
 #endif
 
 static void AgeListMakeYoungest(OOCacheImpl *cache, OOCacheNode *node);
@@ -444,56 +543,115 @@ static void AgeListCheckIntegrity(OOCacheImpl *cache, NSString *context);
 
 /***** CacheImpl functions *****/
 
-static OOCacheImpl *CacheAllocate(void)
+// CacheAllocate(): allocate an array of shards; lockedShards is 0 for a single unlocked shard.
+static OOCacheImpl *CacheAllocate(unsigned lockedShards)
 {
-	return calloc(sizeof (OOCacheImpl), 1);
+	OOCacheImpl			*cache = NULL;
+	unsigned			i, count = MAX(lockedShards, 1U);
+	
+	cache = calloc(sizeof (OOCacheImpl), count);
+	if (cache == NULL)  return NULL;
+	
+	for (i = 0; i < count; i++)
+	{
+		cache[i].buckets = calloc(sizeof (OOCacheNode *), kInitialBucketCount);
+		cache[i].bucketMask = kInitialBucketCount - 1;
+		if (lockedShards != 0)
+		{
+			cache[i].lock = [[NSLock alloc] init];
+			[cache[i].lock ooSetName:@"OOCache shard lock"];
+		}
+		
+		if (cache[i].buckets == NULL || (lockedShards != 0 && cache[i].lock == nil))
+		{
+			CacheFree(cache, i + 1);
+			return NULL;
+		}
+	}
+	
+	return cache;
 }
 
 
-static void CacheFree(OOCacheImpl *cache)
+static void CacheFree(OOCacheImpl *cache, unsigned shardCount)
 {
+	unsigned			i;
+	
 	if (cache == NULL) return;
 	
-	CacheNodeFree(cache, cache->root);
-	[cache->name autorelease];
+	for (i = 0; i < shardCount; i++)
+	{
+		while (cache[i].oldest != NULL)  CacheRemove(&cache[i], cache[i].oldest->key, cache[i].oldest->hash);
+		free(cache[i].buckets);
+		[cache[i].name autorelease];
+		[cache[i].lock release];
+	}
 	free(cache);
 }
 
 
-static BOOL CacheInsert(OOCacheImpl *cache, id key, id value)
+static OOCacheImpl *CacheShardForKey(OOCacheImpl *cache, unsigned shardCount, id key, OOUInteger *outHash)
 {
+	OOUInteger			hash = HashMix([key hash]);
+	
+	*outHash = hash;
+	// Use the high bits, since the low bits pick the bucket.
+	return &cache[(hash >> 24) & (shardCount - 1)];
+}
+
+
+static void CacheLock(OOCacheImpl *cache)
+{
+	if (cache->lock != nil)  [cache->lock lock];
+}
+
+
+static void CacheUnlock(OOCacheImpl *cache)
+{
+	if (cache->lock != nil)  [cache->lock unlock];
+}
+
+
+static BOOL CacheInsert(OOCacheImpl *cache, id key, OOUInteger hash, id value)
+{
+	OOCacheNode				**slot = NULL;
 	OOCacheNode				*node = NULL;
 	
 	if (cache == NULL || key == nil || value == nil) return NO;
 	
-	node = TreeInsert(cache, key, value);
-	if (node != NULL)
+	slot = HashFind(cache, key, hash);
+	if (*slot != NULL)
 	{
-		AgeListMakeYoungest(cache, node);
-		return YES;
+		// Key already exists, reuse its node
+		node = *slot;
+		CacheNodeSetValue(node, value);
 	}
-	else  return NO;
+	else
+	{
+		node = CacheNodeAllocate(key, hash, value);
+		if (node == NULL)  return NO;
+		*slot = node;
+		++cache->count;
+		
+		if (cache->count > (cache->bucketMask + 1) / 4 * 3)  HashGrow(cache);
+	}
+	
+	AgeListMakeYoungest(cache, node);
+	return YES;
 }
 
 
-static BOOL CacheRemove(OOCacheImpl *cache, id key)
+static BOOL CacheRemove(OOCacheImpl *cache, id key, OOUInteger hash)
 {
-	OOCacheNode				*node = NULL, *newRoot = NULL;
+	OOCacheNode				**slot = NULL;
+	OOCacheNode				*node = NULL;
 	
-	node = TreeSplay(&cache->root, key);
+	slot = HashFind(cache, key, hash);
+	node = *slot;
 	if (node != NULL)
 	{
-		if (node->leftChild == NULL)  newRoot = node->rightChild;
-		else
-		{
-			newRoot = node->leftChild;
-			TreeSplay(&newRoot, key);
-			newRoot->rightChild = node->rightChild;
-		}
-		node->leftChild = NULL;
-		node->rightChild = NULL;
-		
-		cache->root = newRoot;
+		*slot = node->next;
+		node->next = NULL;
 		--cache->count;
 		
 		AgeListRemove(cache, node);
@@ -507,62 +665,46 @@ static BOOL CacheRemove(OOCacheImpl *cache, id key)
 
 static BOOL CacheRemoveOldest(OOCacheImpl *cache, NSString *logKey)
 {
-	// This could be more efficient, but does it need to be?
 	if (cache == NULL || cache->oldest == NULL) return NO;
 	
 	OOLog(logKey, @"Pruning cache \"%@\": removing %@", cache->name, cache->oldest->key);
-	return CacheRemove(cache, cache->oldest->key);
+	return CacheRemove(cache, cache->oldest->key, cache->oldest->hash);
 }
 
 
-static id CacheRetrieve(OOCacheImpl *cache, id key)
+static id CacheRetrieve(OOCacheImpl *cache, id key, OOUInteger hash)
 {
 	OOCacheNode			*node = NULL;
-	id					result = nil;
 	
-	if (cache == NULL || key == NULL) return nil;
+	if (cache == NULL || key == nil) return nil;
 	
-	node = TreeSplay(&cache->root, key);
-	if (node != NULL)
-	{
-		result = CacheNodeGetValue(node);
-		AgeListMakeYoungest(cache, node);
-	}
-	return result;
+	node = *HashFind(cache, key, hash);
+	if (node == NULL)  return nil;
+	
+	AgeListMakeYoungest(cache, node);
+	return node->value;
 }
 
 
-static NSArray *CacheArrayOfContentsByAge(OOCacheImpl *cache)
+static void CacheAppendContentsByAge(OOCacheImpl *cache, NSMutableArray *contents)
 {
 	OOCacheNode			*node = NULL;
-	NSMutableArray		*result = nil;
-	
-	if (cache == NULL || cache->count == 0) return nil;
-	
-	result = [NSMutableArray arrayWithCapacity:cache->count];
 	
 	for (node = cache->youngest; node != NULL; node = node->older)
 	{
-		[result addObject:node->value];
+		[contents addObject:node->value];
 	}
-	return result;
 }
 
 
-static NSArray *CacheArrayOfNodesByAge(OOCacheImpl *cache)
+static void CacheAppendNodesByAge(OOCacheImpl *cache, NSMutableArray *nodes)
 {
 	OOCacheNode			*node = NULL;
-	NSMutableArray		*result = nil;
-	
-	if (cache == NULL || cache->count == 0) return nil;
-	
-	result = [NSMutableArray arrayWithCapacity:cache->count];
 	
 	for (node = cache->oldest; node != NULL; node = node->younger)
 	{
-		[result addObject:[NSDictionary dictionaryWithObjectsAndKeys:node->key, kSerializedEntryKeyKey, node->value, kSerializedEntryKeyValue, nil]];
+		[nodes addObject:[NSDictionary dictionaryWithObjectsAndKeys:node->key, kSerializedEntryKeyKey, node->value, kSerializedEntryKeyValue, nil]];
 	}
-	return result;
 }
 
 
@@ -588,18 +730,7 @@ static unsigned CacheGetCount(OOCacheImpl *cache)
 
 static void CacheCheckIntegrity(OOCacheImpl *cache, NSString *context)
 {
-	unsigned			trueCount;
-	
-	cache->root = TreeCheckIntegrity(cache, cache->root, NULL, context);
-	
-	trueCount = TreeCountNodes(cache->root);
-	if (kCountUnknown == cache->count)  cache->count = trueCount;
-	else if (cache->count != trueCount)
-	{
-		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): count is %u, but should be %u.", context, cache->name, cache->count, trueCount);
-		cache->count = trueCount;
-	}
-	
+	HashCheckIntegrity(cache, context);
 	AgeListCheckIntegrity(cache, context);
 }
 
@@ -609,7 +740,7 @@ static void CacheCheckIntegrity(OOCacheImpl *cache, NSString *context)
 /***** CacheNode functions *****/
 
 // CacheNodeAllocate(): create a cache node for a key, value pair, without inserting it in the structures.
-static OOCacheNode *CacheNodeAllocate(id<OOCacheComparable> key, id value)
+static OOCacheNode *CacheNodeAllocate(id key, OOUInteger hash, id value)
 {
 	OOCacheNode			*result = NULL;
 	
@@ -620,13 +751,14 @@ static OOCacheNode *CacheNodeAllocate(id<OOCacheComparable> key, id value)
 	{
 		result->key = [key copy];
 		result->value = [value retain];
+		result->hash = hash;
 	}
 	
 	return result;
 }
 
 
-// CacheNodeFree(): recursively delete a cache node and its children in the splay tree. To delete an individual node, first clear its child pointers.
+// CacheNodeFree(): delete a cache node which has been removed from the hash table.
 static void CacheNodeFree(OOCacheImpl *cache, OOCacheNode *node)
 {
 	id key, value;
@@ -643,29 +775,18 @@ static void CacheNodeFree(OOCacheImpl *cache, OOCacheNode *node)
 	node->value = nil;
 	[value release];
 	
-	CacheNodeFree(cache, node->leftChild);
-	CacheNodeFree(cache, node->rightChild);
-	
 	free(node);
 }
 
 
-// CacheNodeGetValue(): retrieve the value of a cache node
-static id CacheNodeGetValue(OOCacheNode *node)
-{
-	if (node == NULL) return nil;
-	
-	return node->value;
-}
-
-
 // CacheNodeSetValue(): change the value of a cache node (as when setObject:forKey: is called for an existing key).
 static void CacheNodeSetValue(OOCacheNode *node, id value)
 {
 	if (node == NULL) return;
 	
+	[value retain];
 	[node->value release];
-	node->value = [value retain];
+	node->value = value;
 }
 
 
@@ -680,208 +801,97 @@ static NSString *CacheNodeGetDescription(OOCacheNode *node)
 #endif	// OOCACHE_PERFORM_INTEGRITY_CHECKS
 
 
-/***** Tree functions *****/
+/***** Hash table functions *****/
 
-/*	TreeSplay()
-	This is the fundamental operation of a splay tree. It searches for a node
-	with a given key, and rebalances the tree so that the found node becomes
-	the root. If no match is found, the node moved to the root is the one that
-	would have been found before the target, and will thus be a neighbour of
-	the target if the key is subsequently inserted.
+/*	HashMix()
+	Spread the bits of a -hash value, since Foundation's hashes are often
+	poorly distributed in the low bits, which pick the bucket.
 */
-static OOCacheNode *TreeSplay(OOCacheNode **root, id<OOCacheComparable> key)
+OOINLINE OOUInteger HashMix(OOUInteger hash)
 {
-	NSComparisonResult		order;
-	OOCacheNode				N = { .leftChild = NULL, .rightChild = NULL };
-	OOCacheNode				*node = NULL, *temp = NULL, *l = &N, *r = &N;
-	BOOL					exact = NO;
-	
-	if (root == NULL || *root == NULL || key == nil) return NULL;
-	
-	node = *root;
+	uint32_t h = (uint32_t)hash ^ (uint32_t)((uint64_t)hash >> 32);
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+
+
+/*	HashFind()
+	Returns the link pointing to the node with the given key, or the link at
+	the end of its bucket's chain (pointing to NULL) if there is none, so that
+	the result can be used both for retrieval and for insertion or removal.
+*/
+static OOCacheNode **HashFind(OOCacheImpl *cache, id key, OOUInteger hash)
+{
+	OOCacheNode			**slot = &cache->buckets[hash & cache->bucketMask];
 	
-	for (;;)
+	while (*slot != NULL)
 	{
-		order = [key compare:node->key];
-		if (order == NSOrderedAscending)
-		{
-			// Closest match is in left subtree
-			if (node->leftChild == NULL) break;
-			if ([key compare:node->leftChild->key] == NSOrderedAscending)
-			{
-				// Rotate right
-				temp = node->leftChild;
-				node->leftChild = temp->rightChild;
-				temp->rightChild = node;
-				node = temp;
-				if (node->leftChild == NULL) break;
-			}
-			// Link right
-			r->leftChild = node;
-			r = node;
-			node = node->leftChild;
-		}
-		else if (order == NSOrderedDescending)
-		{
-			// Closest match is in right subtree
-			if (node->rightChild == NULL) break;
-			if ([key compare:node->rightChild->key] == NSOrderedDescending)
-			{
-				// Rotate left
-				temp = node->rightChild;
-				node->rightChild = temp->leftChild;
-				temp->leftChild = node;
-				node = temp;
-				if (node->rightChild == NULL) break;
-			}
-			// Link left
-			l->rightChild = node;
-			l = node;
-			node = node->rightChild;
-		}
-		else
-		{
-			// Found exact match
-			exact = YES;
-			break;
-		}
+		if ((*slot)->hash == hash && ((*slot)->key == key || [(*slot)->key isEqual:key]))  break;
+		slot = &(*slot)->next;
 	}
 	
-	// Assemble
-	l->rightChild = node->leftChild;
-	r->leftChild = node->rightChild;
-	node->leftChild = N.rightChild;
-	node->rightChild = N.leftChild;
-	
-	*root = node;
-	return exact ? node : NULL;
+	return slot;
 }
 
 
-static OOCacheNode *TreeInsert(OOCacheImpl *cache, id<OOCacheComparable> key, id value)
+static BOOL HashGrow(OOCacheImpl *cache)
 {
-	OOCacheNode				*closest = NULL,
-							*node = NULL;
-	NSComparisonResult		order;
+	OOCacheNode			**newBuckets = NULL;
+	OOCacheNode			*node = NULL, *next = NULL;
+	OOUInteger			i, newMask;
 	
-	if (cache == NULL || key == nil || value == nil) return NULL;
+	newMask = cache->bucketMask * 2 + 1;
+	newBuckets = calloc(sizeof (OOCacheNode *), newMask + 1);
+	if (newBuckets == NULL)  return NO;	// Longer chains, but still correct.
 	
-	if (cache->root == NULL)
-	{
-		node = CacheNodeAllocate(key, value);
-		cache->root = node;
-		cache->count = 1;
-	}
-	else
+	for (i = 0; i <= cache->bucketMask; i++)
 	{
-		node = TreeSplay(&cache->root, key);
-		if (node != NULL)
+		for (node = cache->buckets[i]; node != NULL; node = next)
 		{
-			// Exact match: key already exists, reuse its node
-			CacheNodeSetValue(node, value);
-		}
-		else
-		{
-			closest = cache->root;
-			node = CacheNodeAllocate(key, value);
-			order = [key compare:closest->key];
-			
-			if (order == NSOrderedAscending)
-			{
-				// Insert to left
-				node->leftChild = closest->leftChild;
-				node->rightChild = closest;
-				closest->leftChild = NULL;
-				cache->root = node;
-				++cache->count;
-			}
-			else if (order == NSOrderedDescending)
-			{
-				// Insert to right
-				node->rightChild = closest->rightChild;
-				node->leftChild = closest;
-				closest->rightChild = NULL;
-				cache->root = node;
-				++cache->count;
-			}
-			else
-			{
-				// Key already exists, which we should have caught above
-				OOLog(@"dataCache.inconsistency", @"%s() internal inconsistency for cache \"%@\", insertion failed.", __PRETTY_FUNCTION__, cache->name);
-				CacheNodeFree(cache, node);
-				return NULL;
-			}
+			next = node->next;
+			node->next = newBuckets[node->hash & newMask];
+			newBuckets[node->hash & newMask] = node;
 		}
 	}
 	
-	return node;
+	free(cache->buckets);
+	cache->buckets = newBuckets;
+	cache->bucketMask = newMask;
+	return YES;
 }
 
 
 #if OOCACHE_PERFORM_INTEGRITY_CHECKS
-static unsigned TreeCountNodes(OOCacheNode *node)
+static void HashCheckIntegrity(OOCacheImpl *cache, NSString *context)
 {
-	if (node == NULL) return 0;
-	return 1 + TreeCountNodes(node->leftChild) + TreeCountNodes(node->rightChild);
-}
-
-
-// TreeCheckIntegrity(): verify the links and contents of a (sub-)tree. If successful, returns the root of the subtree (which could theoretically be changed), otherwise returns NULL.
-static OOCacheNode *TreeCheckIntegrity(OOCacheImpl *cache, OOCacheNode *node, OOCacheNode *expectedParent, NSString *context)
-{
-	NSComparisonResult		order;
-	BOOL					OK = YES;
-	
-	if (node == NULL) return NULL;
-	
-	if (OK && node->key == nil)
-	{
-		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node \"%@\" has nil key; deleting subtree.", context, cache->name, CacheNodeGetDescription(node));
-		OK = NO;
-	}
+	OOCacheNode			*node = NULL;
+	OOUInteger			i;
+	unsigned			trueCount = 0;
 	
-	if (OK && node->value == nil)
-	{
-		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node \"%@\" has nil value, deleting.", context, cache->name, CacheNodeGetDescription(node));
-		OK = NO;
-	}	
-	if (OK && node->leftChild != NULL)
+	for (i = 0; i <= cache->bucketMask; i++)
 	{
-		order = [node->key compare:node->leftChild->key];
-		if (order != NSOrderedDescending)
-		{
-			OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node %@'s left child %@ is not correctly ordered. Deleting subtree.", context, cache->name, CacheNodeGetDescription(node), CacheNodeGetDescription(node->leftChild));
-			CacheNodeFree(cache, node->leftChild);
-			node->leftChild = nil;
-			cache->count = kCountUnknown;
-		}
-		else
+		for (node = cache->buckets[i]; node != NULL; node = node->next)
 		{
-			node->leftChild = TreeCheckIntegrity(cache, node->leftChild, node, context);
-		}
-	}
-	if (node->rightChild != NULL)
-	{
-		order = [node->key compare:node->rightChild->key];
-		if (order != NSOrderedAscending)
-		{
-			OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node \"%@\"'s right child \"%@\" is not correctly ordered. Deleting subtree.", context, cache->name, CacheNodeGetDescription(node), CacheNodeGetDescription(node->rightChild));
-			CacheNodeFree(cache, node->rightChild);
-			node->rightChild = nil;
-			cache->count = kCountUnknown;
-		}
-		else
-		{
-			node->rightChild = TreeCheckIntegrity(cache, node->rightChild, node, context);
+			trueCount++;
+			if ((node->hash & cache->bucketMask) != i)
+			{
+				OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node %@ is in bucket %lu, but should be in bucket %lu.", context, cache->name, CacheNodeGetDescription(node), (unsigned long)i, (unsigned long)(node->hash & cache->bucketMask));
+			}
+			if (node->key == nil || node->value == nil)
+			{
+				OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): node %@ has nil key or value.", context, cache->name, CacheNodeGetDescription(node));
+			}
 		}
 	}
 	
-	if (OK)  return node;
-	else
+	if (cache->count != trueCount)
 	{
-		cache->count = kCountUnknown;
-		CacheNodeFree(cache, node);
-		return NULL;
+		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): count is %u, but should be %u.", context, cache->name, cache->count, trueCount);
+		cache->count = trueCount;
 	}
 }
 #endif	// OOCACHE_PERFORM_INTEGRITY_CHECKS
@@ -902,7 +912,7 @@ static void AgeListMakeYoungest(OOCacheImpl *cache, OOCacheNode *node)
 }
 
 
-// AgeListRemove(): remove a cache node from the age-sorted tree. Does not affect its position in the splay tree.
+// AgeListRemove(): remove a cache node from the age-sorted list. Does not remove it from the hash table.
 static void AgeListRemove(OOCacheImpl *cache, OOCacheNode *node)
 {
 	OOCacheNode			*younger = NULL;
@@ -951,13 +961,8 @@ static void AgeListCheckIntegrity(OOCacheImpl *cache, NSString *context)
 	
 	if (seenCount != cache->count)
 	{
-		// This is especially bad since this function is called just after verifying that the count field reflects the number of objects in the tree.
-		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): expected %u nodes, found %u. Cannot repair; clearing cache.", context, cache->name, cache->count, seenCount);
-		cache->count = 0;
-		CacheNodeFree(cache, cache->root);
-		cache->root = NULL;
-		cache->youngest = NULL;
-		cache->oldest = NULL;
+		// This is especially bad since this function is called just after verifying that the count field reflects the number of objects in the hash table.
+		OOLog(kOOLogCacheIntegrityCheck, @"Integrity check (%@ for \"%@\"): expected %u nodes, found %u. Cannot repair.", context, cache->name, cache->count, seenCount);
 		return;
 	}
 	
@@ -973,35 +978,13 @@ static void AgeListCheckIntegrity(OOCacheImpl *cache, NSString *context)
 
 #if DEBUG_GRAPHVIZ
 
-/*	NOTE: enabling AGE_LIST can result in graph rendering times of many hours,
-	because determining paths for non-constraint arcs is NP-hard. In particular,
-	I gave up on rendering a dump of a fairly minimal cache manager after
-	three and a half hours. Individual caches were fine.
-*/
-#define AGE_LIST 0
-
 @implementation OOCache (DebugGraphViz)
 
-- (void) appendNodesFromSubTree:(OOCacheNode *)subTree toString:(NSMutableString *)ioString
-{
-	[ioString appendFormat:@"\tn%p [label=\"<f0> | <f1> %@ | <f2>\"];\n", subTree, EscapedGraphVizString([subTree->key description])];
-	
-	if (subTree->leftChild != NULL)
-	{
-		[self appendNodesFromSubTree:subTree->leftChild toString:ioString];
-		[ioString appendFormat:@"\tn%p:f0 -> n%p:f1;\n", subTree, subTree->leftChild];
-	}
-	if (subTree->rightChild != NULL)
-	{
-		[self appendNodesFromSubTree:subTree->rightChild toString:ioString];
-		[ioString appendFormat:@"\tn%p:f2 -> n%p:f1;\n", subTree, subTree->rightChild];
-	}
-}
-
-
 - (NSString *) generateGraphVizBodyWithRootNamed:(NSString *)rootName
 {
 	NSMutableString			*result = nil;
+	OOCacheNode				*node = NULL;
+	unsigned				i;
 	
 	result = [NSMutableString string];
 	
@@ -1011,24 +994,24 @@ static void AgeListCheckIntegrity(OOCacheImpl *cache, NSString *context)
 	
 	if (cache == NULL)  return result;
 	
-	// Cache
-	[self appendNodesFromSubTree:cache->root toString:result];
-	
-	// Arc from cache object to root node
-	[result appendString:@"\tedge [color=black constraint=true];\n"];
-	[result appendFormat:@"\t%@ -> n%p:f1;\n", rootName, cache->root];
-	
-#if AGE_LIST
-	OOCacheNode				*node = NULL;
-	// Arcs representing age list
-	[result appendString:@"\t\n\t// Age-sorted list in blue\n\tedge [color=blue constraint=false];\n"];
-	node = cache->oldest;
-	while (node->younger != NULL)
+	// Each shard's age list, from the cache object via the youngest node.
+	for (i = 0; i < shardCount; i++)
 	{
-		[result appendFormat:@"\tn%p:f2 -> n%p:f0;\n", node, node->younger];
-		node = node->younger;
+		CacheLock(&cache[i]);
+		
+		for (node = cache[i].youngest; node != NULL; node = node->older)
+		{
+			[result appendFormat:@"\tn%p [label=\"<f0> | <f1> %@ | <f2>\"];\n", node, EscapedGraphVizString([node->key description])];
+		}
+		
+		if (cache[i].youngest != NULL)  [result appendFormat:@"\t%@ -> n%p:f1;\n", rootName, cache[i].youngest];
+		for (node = cache[i].youngest; node != NULL && node->older != NULL; node = node->older)
+		{
+			[result appendFormat:@"\tn%p:f2 -> n%p:f0;\n", node, node->older];
+		}
+		
+		CacheUnlock(&cache[i]);
 	}
-#endif
 	
 	return result;
 }
@@ -1077,4 +1060,3 @@ static void AgeListCheckIntegrity(OOCacheImpl *cache, NSString *context)
 
 @end
 #endif
-
@@ -9,6 +9,12 @@ The cache manager stores arbitrary property lists in separate namespaces
 different verison of Oolite, or if it was created on a system with a different
 byte sex.
 
+Each cache is stored in a folder of its own files: a snapshot of its
+contents, and a log to which changed and removed entries are appended when
+the cache is flushed. A cache's log is folded into a new snapshot once it
+has more records than the cache has entries. A small manifest lists the
+caches; the caches themselves are only read when first used.
+
 Oolite
 Copyright (C) 2004-2011 Giles C Williams and contributors
 
@@ -35,10 +41,15 @@ MA 02110-1301, USA.
 @interface OOCacheManager: NSObject
 {
 @private
-	NSMutableDictionary		*_caches;
+	NSMutableDictionary		*_caches;			// Loaded caches only.
+	NSMutableDictionary		*_segments;			// Manifest information for every cache.
+	NSMutableDictionary		*_changes;			// Cache name -> key -> new value or NSNull, since last flush.
+	NSMutableSet			*_rewrites;			// Caches to write in full at next flush.
+	NSMutableArray			*_deletions;		// Segment files of cleared caches.
 	id						_scheduledWrite;
 	BOOL					_permitWrites;
 	BOOL					_dirty;
+	BOOL					_removeAll;
 }
 
 + (id)sharedCache;
@@ -46,11 +57,22 @@ MA 02110-1301, USA.
 - (id)objectForKey:(NSString *)inKey inCache:(NSString *)inCacheKey;
 - (void)setObject:(id)inElement forKey:(NSString *)inKey inCache:(NSString *)inCacheKey;
 - (void)removeObjectForKey:(NSString *)inKey inCache:(NSString *)inCacheKey;
+- (NSArray *)keysInCache:(NSString *)inCacheKey;
 - (void)clearCache:(NSString *)inCacheKey;
 - (void)clearAllCaches;
+- (void)clearAllCachesExcept:(NSArray *)cacheKeys;
 - (void) reloadAllCaches;
 
 - (void)setAllowCacheWrites:(BOOL)flag;
+- (BOOL)allowCacheWrites;
+
+/*	Path of a folder for caches which are stored as separate files rather than
+	in the property list, such as binary meshes. Files in it should be listed
+	in a property list cache, so that they are ignored once the cache is
+	cleared. Returns nil if the folder does not exist and inCreate is NO, or if
+	it can't be created.
+*/
+- (NSString *)pathForFileCacheNamed:(NSString *)inName create:(BOOL)inCreate;
 
 - (void)flush;
 - (void)finishOngoingFlush;	// Wait for flush to complete. Does nothing if async flushing is disabled.
@@ -46,6 +46,7 @@ MA 02110-1301, USA.
 #endif
 #if PROFILE_WRITES
 #import "OOProfilingStopwatch.h"
+#import "NSStringOOExtensions.h"
 #endif
 
 
@@ -60,6 +61,7 @@ static NSString * const kOOLogDataCacheSetSuccess			= @"dataCache.set.success";
 static NSString * const kOOLogDataCacheSetFailed			= @"dataCache.set.failed";
 static NSString * const kOOLogDataCacheRemoveSuccess		= @"dataCache.remove.success";
 static NSString * const kOOLogDataCacheClearSuccess			= @"dataCache.clear.success";
+static NSString * const kOOLogDataCacheLoadSegment			= @"dataCache.loadSegment";
 static NSString * const kOOLogDataCacheParamError			= @"general.error.parameterError.OOCacheManager";
 static NSString * const kOOLogDataCacheBuildPathError		= @"dataCache.write.buildPath.failed";
 static NSString * const kOOLogDataCacheSerializationError	= @"dataCache.write.serialize.failed";
@@ -69,17 +71,55 @@ static NSString * const kCacheKeyEndianTag					= @"endian tag";
 static NSString * const kCacheKeyFormatVersion				= @"format version";
 static NSString * const kCacheKeyCaches						= @"caches";
 
+// Per-cache information in the manifest.
+static NSString * const kSegmentKeyGeneration				= @"generation";
+static NSString * const kSegmentKeyLogRecords				= @"log records";
+static NSString * const kSegmentKeyEntries					= @"entries";
+
+// Snapshot files.
+static NSString * const kSnapshotKeyGeneration				= @"generation";
+static NSString * const kSnapshotKeyEntries					= @"entries";
+
+// Write plans, handed from the main thread to the writer.
+static NSString * const kPlanKeyFolder						= @"folder";
+static NSString * const kPlanKeyRemoveAll					= @"remove all";
+static NSString * const kPlanKeyDeletions					= @"deletions";
+static NSString * const kPlanKeySnapshots					= @"snapshots";
+static NSString * const kPlanKeyAppends						= @"appends";
+static NSString * const kPlanKeyObsolete					= @"obsolete";
+static NSString * const kPlanKeyManifest					= @"manifest";
+static NSString * const kPlanKeyFileName					= @"file name";
+static NSString * const kPlanKeyCacheName					= @"cache name";
+static NSString * const kPlanKeyGeneration					= @"generation";
+static NSString * const kPlanKeyContents					= @"contents";
+
+static NSString * const kManifestFileName					= @"Manifest.plist";
+
 
 enum
 {
 	kEndianTagValue			= 0x0123456789ABCDEFULL,
-	kFormatVersionValue		= 200
+	kFormatVersionValue		= 300,
+	
+	/*	A cache's log is folded into a new snapshot once it holds more records
+		than the cache has entries, but never for fewer than this many.
+	*/
+	kMinCompactionRecords	= 64
 };
 
 
 static OOCacheManager *sSingleton = nil;
 
 
+static NSString *SegmentBaseName(NSString *cacheName);
+static NSString *SnapshotFileName(NSString *cacheName);
+static NSString *LogFileName(NSString *cacheName, unsigned generation);
+static NSData *PropertyListData(id plist);
+static id PropertyListFromData(NSData *data, NSString **outError);
+static OOUInteger ReplayLog(NSData *log, NSMutableDictionary *cache, BOOL *outComplete);
+static BOOL AppendToFile(NSString *path, NSData *data);
+
+
 @interface OOCacheManager (Private)
 
 - (void)loadCache;
@@ -88,11 +128,15 @@ static OOCacheManager *sSingleton = nil;
 - (BOOL)dirty;
 - (void)markClean;
 
-- (NSDictionary *)loadDict;
-- (BOOL)writeDict:(NSDictionary *)inDict;
-
-- (void)buildCachesFromDictionary:(NSDictionary *)inDict;
-- (NSDictionary *)dictionaryOfCaches;
+- (NSDictionary *)loadManifest;
+- (NSMutableDictionary *)cacheNamed:(NSString *)inCacheKey create:(BOOL)inCreate;
+- (NSMutableDictionary *)loadSegmentForCache:(NSString *)inCacheKey info:(NSMutableDictionary *)ioInfo;
+- (NSDictionary *)writePlan;
+- (BOOL)performWritePlan:(NSDictionary *)inPlan failedCaches:(NSMutableDictionary *)outFailed;
+- (void)writeDidFailForCaches:(NSDictionary *)inFailed;
+#if WRITE_ASYNC
+- (void)asyncWriteDidComplete:(id)inWriter failedCaches:(NSDictionary *)inFailed;
+#endif
 
 - (BOOL)directoryExists:(NSString *)inPath create:(BOOL)inCreate;
 
@@ -102,6 +146,8 @@ static OOCacheManager *sSingleton = nil;
 @interface OOCacheManager (PlatformSpecific)
 
 - (NSString *)cachePathCreatingIfNecessary:(BOOL)inCreate;
+- (NSString *)segmentFolderPathCreatingIfNecessary:(BOOL)inCreate;
+- (NSString *)fileCacheFolderPathCreatingIfNecessary:(BOOL)inCreate;
 
 @end
 
@@ -110,10 +156,11 @@ static OOCacheManager *sSingleton = nil;
 @interface OOAsyncCacheWriter: NSObject <OOAsyncWorkTask>
 {
 @private
-	NSDictionary			*_cacheContents;
+	NSDictionary			*_writePlan;
+	NSMutableDictionary		*_failedCaches;
 }
 
-- (id) initWithCacheContents:(NSDictionary *)cacheContents;
+- (id) initWithWritePlan:(NSDictionary *)writePlan;
 
 @end
 #endif
@@ -143,7 +190,7 @@ static OOCacheManager *sSingleton = nil;
 
 - (NSString *)description
 {
-	return [NSString stringWithFormat:@"<%@ %p>{dirty=%s}", [self class], self, [self dirty] ? "yes" : "no"];
+	return [NSString stringWithFormat:@"<%@ %p>{dirty=%s, %u of %u caches loaded}", [self class], self, [self dirty] ? "yes" : "no", [_caches count], [_segments count]];
 }
 
 
@@ -166,7 +213,7 @@ static OOCacheManager *sSingleton = nil;
 	
 	NSParameterAssert(inKey != nil && inCacheKey != nil);
 	
-	cache = [_caches objectForKey:inCacheKey];
+	cache = [self cacheNamed:inCacheKey create:NO];
 	if (cache != nil)
 	{
 		result = [cache objectForKey:inKey];
@@ -197,19 +244,24 @@ static OOCacheManager *sSingleton = nil;
 	
 	if (EXPECT_NOT(_caches == nil))  return;
 	
-	cache = [_caches objectForKey:inCacheKey];
+	cache = [self cacheNamed:inCacheKey create:YES];
 	if (cache == nil)
 	{
-		cache = [NSMutableDictionary dictionary];
-		if (cache == nil)
-		{
-			OODebugLog(kOOLogDataCacheSetFailed, @"Failed to create cache for key \"%@\".", inCacheKey);
-			return;
-		}
-		[_caches setObject:cache forKey:inCacheKey];
+		OODebugLog(kOOLogDataCacheSetFailed, @"Failed to create cache for key \"%@\".", inCacheKey);
+		return;
 	}
 	
 	[cache setObject:inObject forKey:inKey];
+	if (![_rewrites containsObject:inCacheKey])
+	{
+		NSMutableDictionary *changes = [_changes objectForKey:inCacheKey];
+		if (changes == nil)
+		{
+			changes = [NSMutableDictionary dictionary];
+			[_changes setObject:changes forKey:inCacheKey];
+		}
+		[changes setObject:inObject forKey:inKey];
+	}
 	_dirty = YES;
 	OODebugLog(kOOLogDataCacheSetSuccess, @"Updated entry %@ in cache \"%@\".", inKey, inCacheKey);
 }
@@ -221,12 +273,22 @@ static OOCacheManager *sSingleton = nil;
 	
 	NSParameterAssert(inKey != nil && inCacheKey != nil);
 	
-	cache = [_caches objectForKey:inCacheKey];
+	cache = [self cacheNamed:inCacheKey create:NO];
 	if (cache != nil)
 	{
 		if (nil != [cache objectForKey:inKey])
 		{
 			[cache removeObjectForKey:inKey];
+			if (![_rewrites containsObject:inCacheKey])
+			{
+				NSMutableDictionary *changes = [_changes objectForKey:inCacheKey];
+				if (changes == nil)
+				{
+					changes = [NSMutableDictionary dictionary];
+					[_changes setObject:changes forKey:inCacheKey];
+				}
+				[changes setObject:[NSNull null] forKey:inKey];
+			}
 			_dirty = YES;
 			OODebugLog(kOOLogDataCacheRemoveSuccess, @"Removed entry keyed %@ from cache \"%@\".", inKey, inCacheKey);
 		}
@@ -242,13 +304,36 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
+- (NSArray *)keysInCache:(NSString *)inCacheKey
+{
+	NSParameterAssert(inCacheKey != nil);
+	
+	return [[self cacheNamed:inCacheKey create:NO] allKeys];
+}
+
+
 - (void)clearCache:(NSString *)inCacheKey
 {
+	NSDictionary			*info = nil;
+	unsigned				generation;
+	
 	NSParameterAssert(inCacheKey != nil);
 	
-	if (nil != [_caches objectForKey:inCacheKey])
+	info = [_segments objectForKey:inCacheKey];
+	if (info != nil)
 	{
+		// Generation 0 means the cache has never been written.
+		generation = [info oo_unsignedIntForKey:kSegmentKeyGeneration];
+		if (generation != 0)
+		{
+			[_deletions addObject:SnapshotFileName(inCacheKey)];
+			[_deletions addObject:LogFileName(inCacheKey, generation)];
+		}
+		
+		[_segments removeObjectForKey:inCacheKey];
 		[_caches removeObjectForKey:inCacheKey];
+		[_changes removeObjectForKey:inCacheKey];
+		[_rewrites removeObject:inCacheKey];
 		_dirty = YES;
 		OODebugLog(kOOLogDataCacheClearSuccess, @"Cleared cache \"%@\".", inCacheKey);
 	}
@@ -261,15 +346,31 @@ static OOCacheManager *sSingleton = nil;
 
 - (void)clearAllCaches
 {
-	[self clear];
-	_caches = [[NSMutableDictionary alloc] init];
+	[_caches removeAllObjects];
+	[_segments removeAllObjects];
+	[_changes removeAllObjects];
+	[_rewrites removeAllObjects];
+	[_deletions removeAllObjects];
+	_removeAll = YES;
 	_dirty = YES;
 }
 
 
+- (void)clearAllCachesExcept:(NSArray *)cacheKeys
+{
+	NSEnumerator			*keyEnum = nil;
+	NSString				*key = nil;
+	
+	for (keyEnum = [[_segments allKeys] objectEnumerator]; (key = [keyEnum nextObject]); )
+	{
+		if (![cacheKeys containsObject:key])  [self clearCache:key];
+	}
+}
+
+
 - (void) reloadAllCaches
 {
-	[self clear];
+	[self finishOngoingFlush];
 	[self loadCache];
 }
 
@@ -278,8 +379,9 @@ static OOCacheManager *sSingleton = nil;
 {
 	if (_permitWrites && [self dirty] && _scheduledWrite == nil)
 	{
-		[self write];
+		// Marked clean first, so that a failed write can mark it dirty again.
 		[self markClean];
+		[self write];
 	}
 }
 
@@ -297,6 +399,27 @@ static OOCacheManager *sSingleton = nil;
 	_permitWrites = (flag != NO);
 }
 
+
+- (BOOL)allowCacheWrites
+{
+	return _permitWrites;
+}
+
+
+- (NSString *)pathForFileCacheNamed:(NSString *)inName create:(BOOL)inCreate
+{
+	NSString			*path = nil;
+	
+	NSParameterAssert(inName != nil);
+	
+	path = [self fileCacheFolderPathCreatingIfNecessary:inCreate];
+	if (path == nil)  return nil;
+	path = [path stringByAppendingPathComponent:inName];
+	if (![self directoryExists:path create:inCreate])  return nil;
+	
+	return path;
+}
+
 @end
 
 
@@ -304,33 +427,49 @@ static OOCacheManager *sSingleton = nil;
 
 - (void)loadCache
 {
-	NSDictionary			*cache = nil;
+	NSDictionary			*manifest = nil;
+	NSDictionary			*segments = nil;
 	NSString				*cacheVersion = nil;
 	NSString				*ooliteVersion = nil;
 	NSData					*endianTag = nil;
 	NSNumber				*formatVersion = nil;
+	NSString				*legacyPath = nil;
+	NSString				*key = nil;
 	BOOL					accept = YES;
 	uint64_t				endianTagValue = 0;
 	
 	ooliteVersion = [[[NSBundle mainBundle] infoDictionary] objectForKey:@"CFBundleVersion"];
 	
 	[self clear];
+	_caches = [[NSMutableDictionary alloc] init];
+	_segments = [[NSMutableDictionary alloc] init];
+	_changes = [[NSMutableDictionary alloc] init];
+	_rewrites = [[NSMutableSet alloc] init];
+	_deletions = [[NSMutableArray alloc] init];
 	
-	cache = [self loadDict];
-	if (cache != nil)
+	// Caches from before the segmented format are in a single file, which is no longer needed.
+	legacyPath = [self cachePathCreatingIfNecessary:NO];
+	if (legacyPath != nil && [[NSFileManager defaultManager] fileExistsAtPath:legacyPath])
+	{
+		[[NSFileManager defaultManager] removeFileAtPath:legacyPath handler:nil];
+		OOLog(@"dataCache.removedOld", @"Removed old-format data cache %@.", legacyPath);
+	}
+	
+	manifest = [self loadManifest];
+	if (manifest != nil)
 	{
 		// We have a cache
 		OOLog(kOOLogDataCacheFound, @"Found data cache.");
 		OOLogIndentIf(kOOLogDataCacheFound);
 		
-		cacheVersion = [cache objectForKey:kCacheKeyVersion];
+		cacheVersion = [manifest objectForKey:kCacheKeyVersion];
 		if (![cacheVersion isEqual:ooliteVersion])
 		{
 			OOLog(kOOLogDataCacheRebuild, @"Data cache version (%@) does not match Oolite version (%@), rebuilding cache.", cacheVersion, ooliteVersion);
 			accept = NO;
 		}
 		
-		formatVersion = [cache objectForKey:kCacheKeyFormatVersion];
+		formatVersion = [manifest objectForKey:kCacheKeyFormatVersion];
 		if (accept && [formatVersion unsignedIntValue] != kFormatVersionValue)
 		{
 			OOLog(kOOLogDataCacheRebuild, @"Data cache format (%@) is not supported format (%u), rebuilding cache.", formatVersion, kFormatVersionValue);
@@ -339,7 +478,7 @@ static OOCacheManager *sSingleton = nil;
 		
 		if (accept)
 		{
-			endianTag = [cache objectForKey:kCacheKeyEndianTag];
+			endianTag = [manifest objectForKey:kCacheKeyEndianTag];
 			if (![endianTag isKindOfClass:[NSData class]] || [endianTag length] != sizeof endianTagValue)
 			{
 				OOLog(kOOLogDataCacheRebuild, @"Data cache endian tag is invalid, rebuilding cache.");
@@ -358,8 +497,18 @@ static OOCacheManager *sSingleton = nil;
 		
 		if (accept)
 		{
-			// We have a cache, and it's the right format.
-			[self buildCachesFromDictionary:[cache objectForKey:kCacheKeyCaches]];
+			// We have a cache, and it's the right format. Caches are read when they're first used.
+			segments = [manifest oo_dictionaryForKey:kCacheKeyCaches];
+			foreachkey (key, segments)
+			{
+				NSDictionary *info = [segments oo_dictionaryForKey:key];
+				if (info != nil)  [_segments setObject:[NSMutableDictionary dictionaryWithDictionary:info] forKey:key];
+			}
+		}
+		else
+		{
+			// Get rid of the old segments on the next write.
+			_removeAll = YES;
 		}
 		
 		OOLogOutdentIf(kOOLogDataCacheFound);
@@ -368,22 +517,16 @@ static OOCacheManager *sSingleton = nil;
 	{
 		// No cache
 		OOLog(kOOLogDataCacheNotFound, @"No data cache found, starting from scratch.");
+		_removeAll = YES;
 	}
 	
-	// If loading failed, or there was a version or endianness conflict
-	if (_caches == nil) _caches = [[NSMutableDictionary alloc] init];
 	[self markClean];
 }
 
 
 - (void)write
 {
-	NSMutableDictionary		*newCache = nil;
-	NSString				*ooliteVersion = nil;
-	NSData					*endianTag = nil;
-	NSNumber				*formatVersion = nil;
-	NSDictionary			*pListRep = nil;
-	uint64_t				endianTagValue = kEndianTagValue;
+	NSDictionary			*plan = nil;
 	
 	if (_caches == nil) return;
 	if (_scheduledWrite != nil)  return;
@@ -398,30 +541,19 @@ static OOCacheManager *sSingleton = nil;
 	OOLog(@"dataCache.willWrite", @"About to write cache.");
 #endif
 	
-	ooliteVersion = [[[NSBundle mainBundle] infoDictionary] objectForKey:@"CFBundleVersion"];
-	endianTag = [NSData dataWithBytes:&endianTagValue length:sizeof endianTagValue];
-	formatVersion = [NSNumber numberWithUnsignedInt:kFormatVersionValue];
-	
-	pListRep = [self dictionaryOfCaches];
-	if (ooliteVersion == nil || endianTag == nil || formatVersion == nil || pListRep == nil)
+	plan = [self writePlan];
+	if (plan == nil)
 	{
 		OOLog(@"dataCache.cantWrite", @"Failed to write data cache -- prerequisites not fulfilled. %@",@"This is an internal error, please report it.");
 		return;
 	}
 	
-	newCache = [NSMutableDictionary dictionaryWithCapacity:4];
-	[newCache setObject:ooliteVersion forKey:kCacheKeyVersion];
-	[newCache setObject:formatVersion forKey:kCacheKeyFormatVersion];
-	[newCache setObject:endianTag forKey:kCacheKeyEndianTag];
-	[newCache setObject:pListRep forKey:kCacheKeyCaches];
-	
 #if PROFILE_WRITES && !WRITE_ASYNC
 	OOTimeDelta prepareT = [stopwatch reset];
 #endif
 	
 #if WRITE_ASYNC
-	NSDictionary *cacheData = newCache;
-	_scheduledWrite = [[OOAsyncCacheWriter alloc] initWithCacheContents:cacheData];
+	_scheduledWrite = [[OOAsyncCacheWriter alloc] initWithWritePlan:plan];
 	
 #if PROFILE_WRITES
 	OOTimeDelta endT = [stopwatch reset];
@@ -434,14 +566,15 @@ static OOCacheManager *sSingleton = nil;
 	OOLog(@"dataCache.profile", @"Time to prepare cache data: %g seconds.", prepareT);
 #endif
 	
-	if ([self writeDict:newCache])
+	NSMutableDictionary *failed = [NSMutableDictionary dictionary];
+	if ([self performWritePlan:plan failedCaches:failed])
 	{
 		[self markClean];
-		OOLog(kOOLogDataCacheWriteSuccess, @"Wrote data cache.");
 	}
 	else
 	{
 		OOLog(kOOLogDataCacheWriteFailed, @"Failed to write data cache.");
+		[self writeDidFailForCaches:failed];
 	}
 #endif
 }
@@ -449,8 +582,12 @@ static OOCacheManager *sSingleton = nil;
 
 - (void)clear
 {
-	[_caches release];
-	_caches = nil;
+	DESTROY(_caches);
+	DESTROY(_segments);
+	DESTROY(_changes);
+	DESTROY(_rewrites);
+	DESTROY(_deletions);
+	_removeAll = NO;
 }
 
 
@@ -466,24 +603,22 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
-- (NSDictionary *)loadDict
+- (NSDictionary *)loadManifest
 {
 	NSString			*path = nil;
 	NSData				*data = nil;
 	NSString			*errorString = nil;
 	id					contents = nil;
 	
-	path = [self cachePathCreatingIfNecessary:NO];
+	path = [self segmentFolderPathCreatingIfNecessary:NO];
 	if (path == nil) return nil;
+	path = [path stringByAppendingPathComponent:kManifestFileName];
 	
 	NS_DURING
 		data = [NSData dataWithContentsOfFile:path];
 		if (data == nil)  NS_VALUERETURN(nil, NSDictionary *);
 		
-		contents = [NSPropertyListSerialization propertyListFromData:data
-													mutabilityOption:NSPropertyListImmutable
-															  format:NULL
-													errorDescription:&errorString];
+		contents = PropertyListFromData(data, &errorString);
 	NS_HANDLER
 		errorString = [localException reason];
 		contents = nil;
@@ -492,9 +627,6 @@ static OOCacheManager *sSingleton = nil;
 	if (errorString != nil)
 	{
 		OOLog(@"dataCache.badData", @"Could not read data cache: %@", errorString);
-#if OOLITE_RELEASE_PLIST_ERROR_STRINGS
-		[errorString release];
-#endif
 		return nil;
 	}
 	if (![contents isKindOfClass:[NSDictionary class]])  return nil;
@@ -503,79 +635,341 @@ static OOCacheManager *sSingleton = nil;
 }
 
 
-- (BOOL)writeDict:(NSDictionary *)inDict
+/*	Loaded contents of a cache, reading it from disk on first use. If inCreate
+	is YES, a cache which doesn't exist yet is created, and will be written in
+	full on the next flush.
+*/
+- (NSMutableDictionary *)cacheNamed:(NSString *)inCacheKey create:(BOOL)inCreate
 {
-	NSString			*path = nil;
-	NSData				*plist = nil;
-	NSString			*errorDesc = nil;
+	NSMutableDictionary		*cache = nil;
+	NSMutableDictionary		*info = nil;
+	
+	cache = [_caches objectForKey:inCacheKey];
+	if (cache != nil)  return cache;
+	
+	info = [_segments objectForKey:inCacheKey];
+	if (info != nil)
+	{
+		cache = [self loadSegmentForCache:inCacheKey info:info];
+		if (cache == nil)
+		{
+			// Unreadable; start it again.
+			cache = [NSMutableDictionary dictionary];
+			[info setObject:[NSNumber numberWithUnsignedInt:0] forKey:kSegmentKeyLogRecords];
+			[_rewrites addObject:inCacheKey];
+			_dirty = YES;
+		}
+	}
+	else if (inCreate && _segments != nil)
+	{
+		cache = [NSMutableDictionary dictionary];
+		info = [NSMutableDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInt:0] forKey:kSegmentKeyGeneration];
+		[_segments setObject:info forKey:inCacheKey];
+		[_rewrites addObject:inCacheKey];
+		_dirty = YES;
+	}
 	
-	path = [self cachePathCreatingIfNecessary:YES];
-	if (path == nil) return NO;	
+	if (cache != nil)  [_caches setObject:cache forKey:inCacheKey];
+	return cache;
+}
+
+
+- (NSMutableDictionary *)loadSegmentForCache:(NSString *)inCacheKey info:(NSMutableDictionary *)ioInfo
+{
+	NSString				*folder = nil;
+	NSData					*data = nil;
+	NSDictionary			*snapshot = nil;
+	NSDictionary			*entries = nil;
+	NSMutableDictionary		*cache = nil;
+	NSString				*errorString = nil;
+	unsigned				generation;
+	OOUInteger				records = 0;
+	BOOL					complete = YES;
+	
+	folder = [self segmentFolderPathCreatingIfNecessary:NO];
+	if (folder == nil)  return nil;
+	
+	data = [NSData dataWithContentsOfMappedFile:[folder stringByAppendingPathComponent:SnapshotFileName(inCacheKey)]];
+	if (data != nil)  snapshot = PropertyListFromData(data, &errorString);
+	if (![snapshot isKindOfClass:[NSDictionary class]])
+	{
+		OOLog(@"dataCache.badData", @"Could not read data cache \"%@\": %@", inCacheKey, errorString ?: (NSString *)@"missing or invalid snapshot");
+		return nil;
+	}
+	
+	entries = [snapshot oo_dictionaryForKey:kSnapshotKeyEntries];
+	generation = [snapshot oo_unsignedIntForKey:kSnapshotKeyGeneration];
+	if (entries == nil || generation == 0)
+	{
+		OOLog(@"dataCache.badData", @"Could not read data cache \"%@\": %@", inCacheKey, @"invalid snapshot");
+		return nil;
+	}
+	cache = [NSMutableDictionary dictionaryWithDictionary:entries];
+	
+	// Changes since the snapshot was written. The log is named after the snapshot's generation, so a stale log is never applied.
+	data = [NSData dataWithContentsOfMappedFile:[folder stringByAppendingPathComponent:LogFileName(inCacheKey, generation)]];
+	if (data != nil)  records = ReplayLog(data, cache, &complete);
+	if (!complete)
+	{
+		/*	Anything appended after a damaged record would never be read back,
+			so fold what could be read into a new snapshot at the next flush.
+		*/
+		OOLog(@"dataCache.badData", @"Data cache \"%@\" log is damaged after %u records; the cache will be rewritten.", inCacheKey, records);
+		[_rewrites addObject:inCacheKey];
+		_dirty = YES;
+	}
+	
+	[ioInfo setObject:[NSNumber numberWithUnsignedInt:generation] forKey:kSegmentKeyGeneration];
+	[ioInfo setObject:[NSNumber numberWithUnsignedInt:records] forKey:kSegmentKeyLogRecords];
+	[ioInfo setObject:[NSNumber numberWithUnsignedInt:[cache count]] forKey:kSegmentKeyEntries];
+	
+	OOLog(kOOLogDataCacheLoadSegment, @"Loaded data cache \"%@\": %u entries, %u log records.", inCacheKey, [cache count], records);
+	return cache;
+}
+
+
+/*	Work out what needs writing, and reset the change tracking (a write which
+	fails puts the caches concerned back with -writeDidFailForCaches:). Caches which
+	were created, cleared or read back unsuccessfully are written in full, as
+	are those whose logs have grown too long; otherwise, the changed entries
+	are appended to their logs. Caches which haven't been loaded haven't
+	changed, and aren't touched.
+*/
+- (NSDictionary *)writePlan
+{
+	NSString				*folder = nil;
+	NSString				*ooliteVersion = nil;
+	NSData					*endianTag = nil;
+	NSNumber				*formatVersion = nil;
+	NSMutableArray			*snapshots = nil;
+	NSMutableArray			*appends = nil;
+	NSMutableDictionary		*manifest = nil;
+	NSDictionary			*plan = nil;
+	NSString				*name = nil;
+	NSString				*key = nil;
+	uint64_t				endianTagValue = kEndianTagValue;
+	
+	folder = [self segmentFolderPathCreatingIfNecessary:YES];
+	ooliteVersion = [[[NSBundle mainBundle] infoDictionary] objectForKey:@"CFBundleVersion"];
+	endianTag = [NSData dataWithBytes:&endianTagValue length:sizeof endianTagValue];
+	formatVersion = [NSNumber numberWithUnsignedInt:kFormatVersionValue];
+	if (folder == nil || ooliteVersion == nil || endianTag == nil || formatVersion == nil)  return nil;
+	
+	snapshots = [NSMutableArray array];
+	appends = [NSMutableArray array];
+	
+	foreachkey (name, _caches)
+	{
+		NSDictionary *cache = [_caches objectForKey:name];
+		NSDictionary *changes = [_changes objectForKey:name];
+		NSMutableDictionary *info = [_segments objectForKey:name];
+		unsigned generation = [info oo_unsignedIntForKey:kSegmentKeyGeneration];
+		unsigned records = [info oo_unsignedIntForKey:kSegmentKeyLogRecords] + [changes count];
+		
+		if ([_rewrites containsObject:name] || generation == 0 || records > MAX([cache count], (unsigned)kMinCompactionRecords))
+		{
+			// The log the new snapshot supersedes, if any, is deleted once the snapshot is written.
+			NSMutableDictionary *item = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+										 name, kPlanKeyCacheName,
+										 [NSNumber numberWithUnsignedInt:generation], kPlanKeyGeneration,
+										 SnapshotFileName(name), kPlanKeyFileName,
+										 nil];
+			if (generation != 0)  [item setObject:LogFileName(name, generation) forKey:kPlanKeyObsolete];
+			generation++;
+			records = 0;
+			
+			NSDictionary *contents = [NSDictionary dictionaryWithObjectsAndKeys:
+									  [NSNumber numberWithUnsignedInt:generation], kSnapshotKeyGeneration,
+									  [OODeepCopy(cache) autorelease], kSnapshotKeyEntries,
+									  nil];
+			[item setObject:contents forKey:kPlanKeyContents];
+			[snapshots addObject:item];
+		}
+		else if ([changes count] != 0)
+		{
+			// Each record is [key, value] for a changed entry, or [key] for a removed one.
+			NSMutableArray *log = [NSMutableArray arrayWithCapacity:[changes count]];
+			foreachkey (key, changes)
+			{
+				id value = [changes objectForKey:key];
+				if (value == [NSNull null])  [log addObject:[NSArray arrayWithObject:key]];
+				else  [log addObject:[NSArray arrayWithObjects:key, [OODeepCopy(value) autorelease], nil]];
+			}
+			[appends addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+								name, kPlanKeyCacheName,
+								[NSNumber numberWithUnsignedInt:generation], kPlanKeyGeneration,
+								LogFileName(name, generation), kPlanKeyFileName,
+								log, kPlanKeyContents,
+								nil]];
+		}
+		
+		[info setObject:[NSNumber numberWithUnsignedInt:generation] forKey:kSegmentKeyGeneration];
+		[info setObject:[NSNumber numberWithUnsignedInt:records] forKey:kSegmentKeyLogRecords];
+		[info setObject:[NSNumber numberWithUnsignedInt:[cache count]] forKey:kSegmentKeyEntries];
+	}
+	
+	manifest = [NSMutableDictionary dictionaryWithCapacity:4];
+	[manifest setObject:ooliteVersion forKey:kCacheKeyVersion];
+	[manifest setObject:formatVersion forKey:kCacheKeyFormatVersion];
+	[manifest setObject:endianTag forKey:kCacheKeyEndianTag];
+	[manifest setObject:[OODeepCopy(_segments) autorelease] forKey:kCacheKeyCaches];
+	
+	plan = [NSDictionary dictionaryWithObjectsAndKeys:
+			folder, kPlanKeyFolder,
+			[NSNumber numberWithBool:_removeAll], kPlanKeyRemoveAll,
+			[NSArray arrayWithArray:_deletions], kPlanKeyDeletions,
+			snapshots, kPlanKeySnapshots,
+			appends, kPlanKeyAppends,
+			manifest, kPlanKeyManifest,
+			nil];
+	
+	[_changes removeAllObjects];
+	[_rewrites removeAllObjects];
+	[_deletions removeAllObjects];
+	_removeAll = NO;
+	
+	return plan;
+}
+
+
+/*	Carry out a write plan. This may be called on a worker thread, and only
+	uses the plan. The manifest is written last, and snapshots are replaced
+	atomically before the logs they supersede are deleted, so an interrupted
+	write loses at most the latest changes. A log is only deleted if its
+	snapshot was written. Each cache which could not be written is added to
+	outFailed, with the generation which is still on disk.
+*/
+- (BOOL)performWritePlan:(NSDictionary *)inPlan failedCaches:(NSMutableDictionary *)outFailed
+{
+	NSFileManager			*fmgr = [NSFileManager defaultManager];
+	NSString				*folder = [inPlan objectForKey:kPlanKeyFolder];
+	NSEnumerator			*itemEnum = nil;
+	id						item = nil;
+	NSData					*data = nil;
+	BOOL					result = YES;
+	unsigned long long		bytesWritten = 0;
+	unsigned				filesWritten = 0;
 	
 #if PROFILE_WRITES
 	OOProfilingStopwatch *stopwatch = [OOProfilingStopwatch stopwatch];
 #endif
 	
-	plist = [NSPropertyListSerialization dataFromPropertyList:inDict format:CACHE_PLIST_FORMAT errorDescription:&errorDesc];
-	if (plist == nil)
+	if ([inPlan oo_boolForKey:kPlanKeyRemoveAll])
 	{
-#if OOLITE_RELEASE_PLIST_ERROR_STRINGS
-		[errorDesc autorelease];
-#endif
-		OOLog(kOOLogDataCacheSerializationError, @"Could not convert data cache to property list data: %@", errorDesc);
-		return NO;
+		for (itemEnum = [[fmgr directoryContentsAtPath:folder] objectEnumerator]; (item = [itemEnum nextObject]); )
+		{
+			[fmgr removeFileAtPath:[folder stringByAppendingPathComponent:item] handler:nil];
+		}
+	}
+	for (itemEnum = [[inPlan oo_arrayForKey:kPlanKeyDeletions] objectEnumerator]; (item = [itemEnum nextObject]); )
+	{
+		[fmgr removeFileAtPath:[folder stringByAppendingPathComponent:item] handler:nil];
 	}
 	
-#if PROFILE_WRITES
-	OOTimeDelta serializeT = [stopwatch reset];
-#endif
+	for (itemEnum = [[inPlan oo_arrayForKey:kPlanKeySnapshots] objectEnumerator]; (item = [itemEnum nextObject]); )
+	{
+		data = PropertyListData([item objectForKey:kPlanKeyContents]);
+		if (data != nil && [data writeToFile:[folder stringByAppendingPathComponent:[item objectForKey:kPlanKeyFileName]] atomically:YES])
+		{
+			bytesWritten += [data length];
+			filesWritten++;
+			
+			NSString *obsolete = [item objectForKey:kPlanKeyObsolete];
+			if (obsolete != nil)  [fmgr removeFileAtPath:[folder stringByAppendingPathComponent:obsolete] handler:nil];
+		}
+		else
+		{
+			[outFailed setObject:[item objectForKey:kPlanKeyGeneration] forKey:[item objectForKey:kPlanKeyCacheName]];
+			result = NO;
+		}
+	}
 	
-	BOOL result = [plist writeToFile:path atomically:NO];
+	for (itemEnum = [[inPlan oo_arrayForKey:kPlanKeyAppends] objectEnumerator]; (item = [itemEnum nextObject]); )
+	{
+		NSMutableData *records = [NSMutableData data];
+		NSEnumerator *recordEnum = nil;
+		id record = nil;
+		
+		for (recordEnum = [[item objectForKey:kPlanKeyContents] objectEnumerator]; (record = [recordEnum nextObject]); )
+		{
+			data = PropertyListData(record);
+			if (data == nil)  continue;
+			uint32_t length = [data length];
+			[records appendBytes:&length length:sizeof length];
+			[records appendData:data];
+		}
+		
+		if (AppendToFile([folder stringByAppendingPathComponent:[item objectForKey:kPlanKeyFileName]], records))
+		{
+			bytesWritten += [records length];
+			filesWritten++;
+		}
+		else
+		{
+			[outFailed setObject:[item objectForKey:kPlanKeyGeneration] forKey:[item objectForKey:kPlanKeyCacheName]];
+			result = NO;
+		}
+	}
 	
-#if PROFILE_WRITES
-	OOTimeDelta writeT = [stopwatch reset];
+	// If a segment failed, leave the old manifest; it'll be rebuilt on the next run if it doesn't match.
+	if (result)
+	{
+		data = PropertyListData([inPlan objectForKey:kPlanKeyManifest]);
+		result = data != nil && [data writeToFile:[folder stringByAppendingPathComponent:kManifestFileName] atomically:YES];
+		bytesWritten += [data length];
+	}
 	
-	OOLog(@"dataCache.profile", @"Time to serialize cache: %g seconds. Time to write data: %g seconds.", serializeT, writeT);
+#if PROFILE_WRITES
+	OOLog(@"dataCache.profile", @"Time to serialize and write cache: %g seconds.", [stopwatch reset]);
 #endif
 	
-#if WRITE_ASYNC
-	DESTROY(_scheduledWrite);
-#endif
+	if (result)  OOLog(kOOLogDataCacheWriteSuccess, @"Wrote data cache (%llu bytes to %u segment files).", bytesWritten, filesWritten);
+	
 	return result;
 }
 
 
-- (void)buildCachesFromDictionary:(NSDictionary *)inDict
+/*	Called on the main thread after a write. Changes to the caches which
+	failed were dropped when the plan was made, so they are written in full
+	at the next flush, starting over from the generation still on disk.
+*/
+- (void)writeDidFailForCaches:(NSDictionary *)inFailed
 {
-	NSEnumerator				*keyEnum = nil;
-	id							key = nil;
-	id							value = nil;
-	NSMutableDictionary			*cache = nil;
-	
-	if (inDict == nil ) return;
+	NSString				*name = nil;
 	
-	[_caches release];
-	_caches = [[NSMutableDictionary alloc] initWithCapacity:[inDict count]];
-	
-	for (keyEnum = [inDict keyEnumerator]; (key = [keyEnum nextObject]); )
+	foreachkey (name, inFailed)
 	{
-		value = [inDict oo_dictionaryForKey:key];
-		if (value != nil)
+		NSMutableDictionary *info = [_segments objectForKey:name];
+		unsigned generation = [inFailed oo_unsignedIntForKey:name];
+		
+		if (info != nil)
 		{
-			cache = [NSMutableDictionary dictionaryWithDictionary:value];
-			if (cache != nil)
-			{
-				[_caches setObject:cache forKey:key];
-			}
+			[info setObject:[NSNumber numberWithUnsignedInt:generation] forKey:kSegmentKeyGeneration];
+			[_rewrites addObject:name];
+			_dirty = YES;
+		}
+		else if (generation != 0)
+		{
+			// Cleared since the plan was made, with the generation that was never written.
+			[_deletions addObject:LogFileName(name, generation)];
+			_dirty = YES;
 		}
 	}
 }
 
 
-- (NSDictionary *)dictionaryOfCaches
+#if WRITE_ASYNC
+- (void)asyncWriteDidComplete:(id)inWriter failedCaches:(NSDictionary *)inFailed
 {
-	return OODeepCopy(_caches);
+	NSAssert(inWriter == _scheduledWrite, @"Unexpected data cache writer.");
+	
+	// The writer may be completing inside -finishOngoingFlush, so don't free it out from under the work manager.
+	[_scheduledWrite autorelease];
+	_scheduledWrite = nil;
+	
+	[self writeDidFailForCaches:inFailed];
 }
+#endif
 
 
 - (BOOL)directoryExists:(NSString *)inPath create:(BOOL)inCreate
@@ -614,8 +1008,10 @@ static OOCacheManager *sSingleton = nil;
 {
 	NSString			*cachePath = nil;
 	
-	/*	Construct the path for the cache file, which is:
+	/*	Construct the path for the old single-file cache, which is:
 			~/Library/Caches/org.aegidian.oolite/Data Cache.plist
+		The segments now live in a folder next to it, which is used to
+		delete it.
 		In addition to generally being the right place to put caches,
 		~/Library/Caches has the particular advantage of not being indexed by
 		Spotlight or, in future, backed up by Time Machine.
@@ -629,13 +1025,34 @@ static OOCacheManager *sSingleton = nil;
 	return cachePath;
 }
 
+
+- (NSString *)segmentFolderPathCreatingIfNecessary:(BOOL)inCreate
+{
+	NSString			*cachePath = nil;
+	
+	// ~/Library/Caches/org.aegidian.oolite/Data Cache/
+	cachePath = [[self cachePathCreatingIfNecessary:inCreate] stringByDeletingLastPathComponent];
+	if (cachePath == nil)  return nil;
+	cachePath = [cachePath stringByAppendingPathComponent:@"Data Cache"];
+	if (![self directoryExists:cachePath create:inCreate]) return nil;
+	
+	return cachePath;
+}
+
+
+- (NSString *)fileCacheFolderPathCreatingIfNecessary:(BOOL)inCreate
+{
+	// ~/Library/Caches/org.aegidian.oolite/, alongside Data Cache.
+	return [[self cachePathCreatingIfNecessary:inCreate] stringByDeletingLastPathComponent];
+}
+
 #else
 
 - (NSString *)cachePathCreatingIfNecessary:(BOOL)inCreate
 {
 	NSString			*cachePath = nil;
 	
-	/*	Construct the path for the cache file, which is:
+	/*	Construct the path for the old single-file cache, which is:
 			~/GNUstep/Library/Caches/Oolite-cache.plist
 		
 		FIXME: we shouldn't be hard-coding ~/GNUstep/. Does
@@ -653,6 +1070,34 @@ static OOCacheManager *sSingleton = nil;
 	return cachePath;
 }
 
+
+- (NSString *)segmentFolderPathCreatingIfNecessary:(BOOL)inCreate
+{
+	NSString			*cachePath = nil;
+	
+	// ~/GNUstep/Library/Caches/Oolite-data-cache/
+	cachePath = [[self cachePathCreatingIfNecessary:inCreate] stringByDeletingLastPathComponent];
+	if (cachePath == nil)  return nil;
+	cachePath = [cachePath stringByAppendingPathComponent:@"Oolite-data-cache"];
+	if (![self directoryExists:cachePath create:inCreate]) return nil;
+	
+	return cachePath;
+}
+
+
+- (NSString *)fileCacheFolderPathCreatingIfNecessary:(BOOL)inCreate
+{
+	NSString			*cachePath = nil;
+	
+	// ~/GNUstep/Library/Caches/Oolite-caches/, alongside Oolite-data-cache.
+	cachePath = [[self cachePathCreatingIfNecessary:inCreate] stringByDeletingLastPathComponent];
+	if (cachePath == nil)  return nil;
+	cachePath = [cachePath stringByAppendingPathComponent:@"Oolite-caches"];
+	if (![self directoryExists:cachePath create:inCreate]) return nil;
+	
+	return cachePath;
+}
+
 #endif
 
 @end
@@ -711,12 +1156,13 @@ static OOCacheManager *sSingleton = nil;
 #if WRITE_ASYNC
 @implementation OOAsyncCacheWriter
 
-- (id) initWithCacheContents:(NSDictionary *)cacheContents
+- (id) initWithWritePlan:(NSDictionary *)writePlan
 {
 	if ((self = [super init]))
 	{
-		_cacheContents = [cacheContents copy];
-		if (_cacheContents == nil)
+		_writePlan = [writePlan copy];
+		_failedCaches = [[NSMutableDictionary alloc] init];
+		if (_writePlan == nil || _failedCaches == nil)
 		{
 			[self release];
 			self = nil;
@@ -729,7 +1175,8 @@ static OOCacheManager *sSingleton = nil;
 
 - (void) dealloc
 {
-	DESTROY(_cacheContents);
+	DESTROY(_writePlan);
+	DESTROY(_failedCaches);
 	
 	[super dealloc];
 }
@@ -737,22 +1184,133 @@ static OOCacheManager *sSingleton = nil;
 
 - (void) performAsyncTask
 {
-	if ([[OOCacheManager sharedCache] writeDict:_cacheContents])
-	{
-		OOLog(kOOLogDataCacheWriteSuccess, @"Wrote data cache.");
-	}
-	else
+	if (![[OOCacheManager sharedCache] performWritePlan:_writePlan failedCaches:_failedCaches])
 	{
 		OOLog(kOOLogDataCacheWriteFailed, @"Failed to write data cache.");
 	}
-	DESTROY(_cacheContents);
+	DESTROY(_writePlan);
 }
 
 
 - (void) completeAsyncTask
 {
-	// Don't need to do anything, but this needs to be here so we can wait on it.
+	[[OOCacheManager sharedCache] asyncWriteDidComplete:self failedCaches:_failedCaches];
 }
 
 @end
 #endif	// WRITE_ASYNC
+
+
+// File names are derived from a hash of the cache name, which may contain anything.
+static NSString *SegmentBaseName(NSString *cacheName)
+{
+	return [NSString stringWithFormat:@"%016llx", (unsigned long long)[cacheName oo_hash64]];
+}
+
+
+static NSString *SnapshotFileName(NSString *cacheName)
+{
+	return [SegmentBaseName(cacheName) stringByAppendingString:@".plist"];
+}
+
+
+static NSString *LogFileName(NSString *cacheName, unsigned generation)
+{
+	return [NSString stringWithFormat:@"%@-%u.log", SegmentBaseName(cacheName), generation];
+}
+
+
+static NSData *PropertyListData(id plist)
+{
+	NSString			*errorDesc = nil;
+	NSData				*data = nil;
+	
+	data = [NSPropertyListSerialization dataFromPropertyList:plist format:CACHE_PLIST_FORMAT errorDescription:&errorDesc];
+	if (data == nil)
+	{
+#if OOLITE_RELEASE_PLIST_ERROR_STRINGS
+		[errorDesc autorelease];
+#endif
+		OOLog(kOOLogDataCacheSerializationError, @"Could not convert data cache to property list data: %@", errorDesc);
+	}
+	
+	return data;
+}
+
+
+static id PropertyListFromData(NSData *data, NSString **outError)
+{
+	NSString			*errorString = nil;
+	id					result = nil;
+	
+	result = [NSPropertyListSerialization propertyListFromData:data
+											  mutabilityOption:NSPropertyListImmutable
+														format:NULL
+											  errorDescription:&errorString];
+#if OOLITE_RELEASE_PLIST_ERROR_STRINGS
+	[errorString autorelease];
+#endif
+	if (outError != NULL)  *outError = errorString;
+	
+	return result;
+}
+
+
+/*	Apply a log of length-prefixed records to a cache. A truncated or
+	unreadable record, as left by an interrupted write, ends the log;
+	*outComplete is set to NO if this happens.
+*/
+static OOUInteger ReplayLog(NSData *log, NSMutableDictionary *cache, BOOL *outComplete)
+{
+	const uint8_t		*bytes = [log bytes];
+	OOUInteger			offset = 0, length = [log length], count = 0;
+	uint32_t			recordLength;
+	
+	*outComplete = NO;
+	while (offset != length)
+	{
+		if (length - offset < sizeof recordLength)  return count;
+		memcpy(&recordLength, bytes + offset, sizeof recordLength);
+		offset += sizeof recordLength;
+		if (recordLength > length - offset)  return count;
+		
+		NSData *recordData = [NSData dataWithBytesNoCopy:(void *)(bytes + offset) length:recordLength freeWhenDone:NO];
+		offset += recordLength;
+		
+		NSArray *record = PropertyListFromData(recordData, NULL);
+		if (![record isKindOfClass:[NSArray class]] || [record count] == 0 || [record count] > 2)  return count;
+		
+		NSString *key = [record objectAtIndex:0];
+		if ([record count] == 2)  [cache setObject:[record objectAtIndex:1] forKey:key];
+		else  [cache removeObjectForKey:key];
+		count++;
+	}
+	
+	*outComplete = YES;
+	return count;
+}
+
+
+static BOOL AppendToFile(NSString *path, NSData *data)
+{
+	NSFileHandle		*handle = nil;
+	BOOL				result = YES;
+	
+	if (![[NSFileManager defaultManager] fileExistsAtPath:path])
+	{
+		return [data writeToFile:path atomically:NO];
+	}
+	
+	handle = [NSFileHandle fileHandleForUpdatingAtPath:path];
+	if (handle == nil)  return NO;
+	
+	NS_DURING
+		[handle seekToEndOfFile];
+		[handle writeData:data];
+	NS_HANDLER
+		result = NO;
+	NS_ENDHANDLER
+	
+	[handle closeFile];
+	return result;
+}
@@ -0,0 +1,86 @@
+/*
+
+OOCollisionBroadPhase.h
+
+A collision broad phase finds the pairs of entities which are close enough
+that they may be colliding (or should raise a proximity alert), so that the
+expensive tests in CollisionRegion only need to be run on those pairs.
+
+Two implementations are provided:
+  * "sweep": the original z/y/x sorted-list filter (-[Universe
+    filterSortedLists]), kept as the reference implementation. Within each
+    cluster of overlapping entities it reports every pair, so it degrades to
+    O(n^2) in busy areas such as asteroid fields.
+  * "grid": a hashed uniform grid, which reports exactly the pairs whose
+    interaction boxes overlap in roughly O(n).
+
+An entity's interaction box is a cube of half-size 2 * collision_radius
+centred on its position; this is the same extent used by the sweep (see the
+note at the top of -filterSortedLists). After a pass, collisionTestFilter is
+NO for exactly those entities which appear in at least one candidate pair.
+
+The implementation is selected with the "collision-broad-phase" user default.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+@class Entity;
+
+
+typedef struct OOCollisionCandidatePair
+{
+	Entity					*a;
+	Entity					*b;
+} OOCollisionCandidatePair;
+
+
+#define kOOCollisionBroadPhaseSweep		@"sweep"
+#define kOOCollisionBroadPhaseGrid		@"grid"
+
+
+@interface OOCollisionBroadPhase: NSObject
+{
+@protected
+	OOCollisionCandidatePair	*_pairs;
+	OOUInteger					_pairCount,
+								_pairCapacity;
+}
+
+/*	Returns a new broad phase of the named type, or nil for an unknown name.
+	If name is nil, the "collision-broad-phase" user default is used, falling
+	back to the hashed grid.
+*/
++ (id) broadPhaseNamed:(NSString *)name;
+
+- (NSString *) name;
+
+/*	Rebuild the candidate pair list for the given entities (normally
+	UNIVERSE->sortedEntities). Entities which return NO from -canCollide are
+	never reported. Pointers returned by -pairs are valid until the next call.
+*/
+- (void) findCandidatePairsForEntities:(Entity **)entities count:(OOUInteger)count;
+
+- (OOUInteger) pairCount;
+- (OOCollisionCandidatePair *) pairs;
+
+@end
@@ -0,0 +1,469 @@
+/*
+
+OOCollisionBroadPhase.m
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCollisionBroadPhase.h"
+#import "Universe.h"
+#import "Entity.h"
+#import "OOCollectionExtractors.h"
+
+#if OO_DEBUG
+#import "PlayerEntity.h"
+#import "OOProfilingStopwatch.h"
+#endif
+
+
+// Grid cells are sized from the mean interaction box of the collidable entities, within these limits.
+#define kMinGridCellSize		256.0f
+#define kMaxGridCellSize		8192.0f
+#define kMinGridSlotCount		64
+
+
+@interface OOSweepCollisionBroadPhase: OOCollisionBroadPhase
+@end
+
+
+typedef struct
+{
+	Entity					*entity;
+	Vector					min, max;
+	BOOL					isLarge;
+} GridBox;
+
+
+typedef struct
+{
+	int32_t					x, y, z;
+	uint32_t				box;
+	int32_t					next;
+} GridEntry;
+
+
+@interface OOGridCollisionBroadPhase: OOCollisionBroadPhase
+{
+@private
+	GridBox					*_boxes;
+	OOUInteger				_boxCount, _boxCapacity;
+
+	GridEntry				*_entries;
+	OOUInteger				_entryCount, _entryCapacity;
+
+	int32_t					*_slots;
+	OOUInteger				_slotCount;
+
+	uint32_t				*_large;
+	OOUInteger				_largeCount, _largeCapacity;
+}
+
+@end
+
+
+static void *GrowBuffer(void *buffer, OOUInteger *capacity, OOUInteger minCapacity, size_t elementSize);
+
+
+@interface OOCollisionBroadPhase (Private)
+
+- (void) growPairBuffer;
+
+@end
+
+
+// Append a pair, growing the pair buffer if necessary. For use in subclass methods only.
+#define ADD_PAIR(A, B)  do { \
+	if (EXPECT_NOT(_pairCount == _pairCapacity))  [self growPairBuffer]; \
+	_pairs[_pairCount].a = (A); \
+	_pairs[_pairCount].b = (B); \
+	_pairCount++; \
+} while (0)
+
+
+@implementation OOCollisionBroadPhase
+
++ (id) broadPhaseNamed:(NSString *)name
+{
+	if (name == nil)
+	{
+		name = [[NSUserDefaults standardUserDefaults] oo_stringForKey:@"collision-broad-phase" defaultValue:kOOCollisionBroadPhaseGrid];
+	}
+
+	if ([name isEqualToString:kOOCollisionBroadPhaseGrid])  return [[[OOGridCollisionBroadPhase alloc] init] autorelease];
+	if ([name isEqualToString:kOOCollisionBroadPhaseSweep])  return [[[OOSweepCollisionBroadPhase alloc] init] autorelease];
+
+	OOLog(@"collision.broadPhase.unknown", @"Unknown collision broad phase \"%@\".", name);
+	return nil;
+}
+
+
+- (void) dealloc
+{
+	free(_pairs);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%@, %lu pairs", [self name], (unsigned long)_pairCount];
+}
+
+
+- (NSString *) name
+{
+	OOLogGenericSubclassResponsibility();
+	return nil;
+}
+
+
+- (void) findCandidatePairsForEntities:(Entity **)entities count:(OOUInteger)count
+{
+	OOLogGenericSubclassResponsibility();
+}
+
+
+- (OOUInteger) pairCount
+{
+	return _pairCount;
+}
+
+
+- (OOCollisionCandidatePair *) pairs
+{
+	return _pairs;
+}
+
+
+- (void) growPairBuffer
+{
+	_pairs = GrowBuffer(_pairs, &_pairCapacity, _pairCount + 1, sizeof *_pairs);
+}
+
+@end
+
+
+@implementation OOSweepCollisionBroadPhase
+
+- (NSString *) name
+{
+	return kOOCollisionBroadPhaseSweep;
+}
+
+
+- (void) findCandidatePairsForEntities:(Entity **)entities count:(OOUInteger)count
+{
+	OOUInteger				i;
+	Entity					*e1 = nil, *e2 = nil;
+
+	/*	The sweep works on the universe's x/y/z linked lists, which cover the
+		same entities as sortedEntities. It leaves each cluster of overlapping
+		entities chained together through collision_chain; every entity is a
+		candidate against everything after it in its chain.
+	*/
+	[UNIVERSE filterSortedLists];
+
+	_pairCount = 0;
+	for (i = 0; i < count; i++)
+	{
+		e1 = entities[i];
+		if (e1->collisionTestFilter)  continue;
+
+		for (e2 = e1->collision_chain; e2 != nil; e2 = e2->collision_chain)
+		{
+			ADD_PAIR(e1, e2);
+		}
+	}
+}
+
+@end
+
+
+OOINLINE int32_t GridCoord(GLfloat v, GLfloat invCellSize)
+{
+	return (int32_t)floorf(v * invCellSize);
+}
+
+
+OOINLINE uint32_t GridHash(int32_t x, int32_t y, int32_t z)
+{
+	return ((uint32_t)x * 73856093U) ^ ((uint32_t)y * 19349663U) ^ ((uint32_t)z * 83492791U);
+}
+
+
+OOINLINE BOOL GridBoxesOverlap(const GridBox *a, const GridBox *b)
+{
+	return	a->min.x < b->max.x && b->min.x < a->max.x &&
+			a->min.y < b->max.y && b->min.y < a->max.y &&
+			a->min.z < b->max.z && b->min.z < a->max.z;
+}
+
+
+@implementation OOGridCollisionBroadPhase
+
+- (void) dealloc
+{
+	free(_boxes);
+	free(_entries);
+	free(_slots);
+	free(_large);
+
+	[super dealloc];
+}
+
+
+- (NSString *) name
+{
+	return kOOCollisionBroadPhaseGrid;
+}
+
+
+- (void) findCandidatePairsForEntities:(Entity **)entities count:(OOUInteger)count
+{
+	OOUInteger				i, j;
+	GLfloat					extentSum = 0.0f, cellSize, invCellSize, h;
+	Entity					*e = nil;
+	GridBox					*box = nil;
+
+	_pairCount = 0;
+	_boxCount = 0;
+	_entryCount = 0;
+	_largeCount = 0;
+
+	// Gather interaction boxes of collidable entities.
+	if (_boxCapacity < count)  _boxes = GrowBuffer(_boxes, &_boxCapacity, count, sizeof *_boxes);
+	for (i = 0; i < count; i++)
+	{
+		e = entities[i];
+		e->collisionTestFilter = YES;
+		if (![e canCollide])  continue;
+
+		h = 2.0f * e->collision_radius;
+		box = &_boxes[_boxCount++];
+		box->entity = e;
+		box->min = make_vector(e->position.x - h, e->position.y - h, e->position.z - h);
+		box->max = make_vector(e->position.x + h, e->position.y + h, e->position.z + h);
+		box->isLarge = NO;
+		extentSum += fminf(2.0f * h, kMaxGridCellSize);	// Don't let planets dominate the cell size.
+	}
+	if (_boxCount < 2)  return;
+
+	cellSize = OOClamp_0_max_f(2.0f * extentSum / _boxCount - kMinGridCellSize, kMaxGridCellSize - kMinGridCellSize) + kMinGridCellSize;
+	invCellSize = 1.0f / cellSize;
+
+	/*	Insert each box into every cell it touches. Since a box is no larger
+		than a cell, that is at most two cells per axis. Boxes too big for
+		that (stations, planets, the sun) are handled separately below.
+	*/
+	for (i = 0; i < _boxCount; i++)
+	{
+		box = &_boxes[i];
+		if (box->max.x - box->min.x > cellSize)
+		{
+			box->isLarge = YES;
+			if (_largeCount == _largeCapacity)  _large = GrowBuffer(_large, &_largeCapacity, _largeCount + 1, sizeof *_large);
+			_large[_largeCount++] = i;
+			continue;
+		}
+
+		int32_t x0 = GridCoord(box->min.x, invCellSize), x1 = GridCoord(box->max.x, invCellSize);
+		int32_t y0 = GridCoord(box->min.y, invCellSize), y1 = GridCoord(box->max.y, invCellSize);
+		int32_t z0 = GridCoord(box->min.z, invCellSize), z1 = GridCoord(box->max.z, invCellSize);
+		int32_t x, y, z;
+
+		if (_entryCapacity < _entryCount + 8)  _entries = GrowBuffer(_entries, &_entryCapacity, _entryCount + 8, sizeof *_entries);
+		for (x = x0; x <= x1; x++)  for (y = y0; y <= y1; y++)  for (z = z0; z <= z1; z++)
+		{
+			GridEntry *entry = &_entries[_entryCount++];
+			entry->x = x;
+			entry->y = y;
+			entry->z = z;
+			entry->box = i;
+		}
+	}
+
+	// Hash cells into a power-of-two slot table, chaining entries that share a slot.
+	OOUInteger slotCount = kMinGridSlotCount;
+	while (slotCount < _entryCount * 2)  slotCount <<= 1;
+	if (slotCount > _slotCount)
+	{
+		free(_slots);
+		_slots = malloc(slotCount * sizeof *_slots);
+		if (EXPECT_NOT(_slots == NULL))  [NSException raise:NSMallocException format:@"Failed to allocate collision grid."];
+		_slotCount = slotCount;
+	}
+	uint32_t mask = slotCount - 1;
+	memset(_slots, 0xFF, slotCount * sizeof *_slots);
+
+	for (i = 0; i < _entryCount; i++)
+	{
+		GridEntry *entry = &_entries[i];
+		uint32_t slot = GridHash(entry->x, entry->y, entry->z) & mask;
+		entry->next = _slots[slot];
+		_slots[slot] = i;
+	}
+
+	/*	Within each cell, test every pair of boxes. A pair sharing several
+		cells is only reported by the cell containing the minimum corner of
+		the boxes' intersection, so each pair is reported exactly once.
+	*/
+	for (i = 0; i < slotCount; i++)
+	{
+		int32_t ei, ej;
+		for (ei = _slots[i]; ei >= 0; ei = _entries[ei].next)
+		{
+			GridEntry *entryA = &_entries[ei];
+			GridBox *boxA = &_boxes[entryA->box];
+
+			for (ej = entryA->next; ej >= 0; ej = _entries[ej].next)
+			{
+				GridEntry *entryB = &_entries[ej];
+				if (entryA->x != entryB->x || entryA->y != entryB->y || entryA->z != entryB->z)  continue;
+
+				GridBox *boxB = &_boxes[entryB->box];
+				if (!GridBoxesOverlap(boxA, boxB))  continue;
+
+				if (GridCoord(fmaxf(boxA->min.x, boxB->min.x), invCellSize) != entryA->x ||
+					GridCoord(fmaxf(boxA->min.y, boxB->min.y), invCellSize) != entryA->y ||
+					GridCoord(fmaxf(boxA->min.z, boxB->min.z), invCellSize) != entryA->z)  continue;
+
+				// Report in input order, as the sweep does.
+				if (entryA->box < entryB->box)  ADD_PAIR(boxA->entity, boxB->entity);
+				else  ADD_PAIR(boxB->entity, boxA->entity);
+			}
+		}
+	}
+
+	// Large boxes are few, so they are simply tested against everything.
+	for (i = 0; i < _largeCount; i++)
+	{
+		uint32_t li = _large[i];
+		GridBox *boxA = &_boxes[li];
+
+		for (j = 0; j < _boxCount; j++)
+		{
+			GridBox *boxB = &_boxes[j];
+			if (j == li || (boxB->isLarge && j < li))  continue;
+			if (!GridBoxesOverlap(boxA, boxB))  continue;
+
+			if (li < j)  ADD_PAIR(boxA->entity, boxB->entity);
+			else  ADD_PAIR(boxB->entity, boxA->entity);
+		}
+	}
+
+	for (i = 0; i < _pairCount; i++)
+	{
+		_pairs[i].a->collisionTestFilter = NO;
+		_pairs[i].b->collisionTestFilter = NO;
+	}
+}
+
+@end
+
+
+static void *GrowBuffer(void *buffer, OOUInteger *capacity, OOUInteger minCapacity, size_t elementSize)
+{
+	OOUInteger newCapacity = *capacity;
+	if (newCapacity < 32)  newCapacity = 32;
+	while (newCapacity < minCapacity)  newCapacity *= 2;
+
+	void *newBuffer = realloc(buffer, newCapacity * elementSize);
+	if (EXPECT_NOT(newBuffer == NULL))
+	{
+		[NSException raise:NSMallocException format:@"Failed to grow collision broad phase buffer to %lu elements.", (unsigned long)newCapacity];
+	}
+
+	*capacity = newCapacity;
+	return newBuffer;
+}
+
+
+#if OO_DEBUG
+
+OOINLINE BOOL InteractionBoxesOverlap(Entity *a, Entity *b)
+{
+	GLfloat r = 2.0f * (a->collision_radius + b->collision_radius);
+	return	fabsf(a->position.x - b->position.x) < r &&
+			fabsf(a->position.y - b->position.y) < r &&
+			fabsf(a->position.z - b->position.z) < r;
+}
+
+
+@implementation PlayerEntity (OOCollisionBroadPhaseBenchmark)
+
+// :setM broadPhaseBench PS.callObjC("benchmarkCollisionBroadPhase:", PARAM)
+// :broadPhaseBench 1000
+
+- (NSString *) benchmarkCollisionBroadPhase:(NSString *)countString
+{
+	enum { kIterations = 20 };
+
+	int				count = [countString intValue];
+	if (count <= 0)  count = 1000;
+	if (count > 2000)  count = 2000;
+
+	// A dense asteroid field a little way ahead of the player.
+	Vector			centre = vector_add([self position], vector_multiply_scalar([self forwardVector], 25000.0f));
+	NSArray			*rocks = [UNIVERSE addShipsAt:centre withRole:@"asteroid" quantity:count withinRadius:10000.0f asGroup:NO];
+	NSMutableString	*result = [NSMutableString stringWithFormat:@"%lu asteroids, %u entities:", (unsigned long)[rocks count], UNIVERSE->n_entities];
+	OOUInteger		overlapCount[2] = { 0, 0 };
+	unsigned		i, pass, iter;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		OOCollisionBroadPhase *broadPhase = [OOCollisionBroadPhase broadPhaseNamed:pass == 0 ? kOOCollisionBroadPhaseSweep : kOOCollisionBroadPhaseGrid];
+		OOProfilingStopwatch *stopwatch = [OOProfilingStopwatch stopwatch];
+
+		for (iter = 0; iter < kIterations; iter++)
+		{
+			[broadPhase findCandidatePairsForEntities:UNIVERSE->sortedEntities count:UNIVERSE->n_entities];
+		}
+		OOTimeDelta time = [stopwatch reset];
+
+		// Only pairs with overlapping interaction boxes matter; the two implementations must agree on those.
+		OOCollisionCandidatePair *pairs = [broadPhase pairs];
+		for (i = 0; i < [broadPhase pairCount]; i++)
+		{
+			if (InteractionBoxesOverlap(pairs[i].a, pairs[i].b))  overlapCount[pass]++;
+		}
+
+		[result appendFormat:@"\n%6@: %8.3f ms/pass, %lu candidate pairs, %lu overlapping", [broadPhase name], time * 1000.0 / kIterations, (unsigned long)[broadPhase pairCount], (unsigned long)overlapCount[pass]];
+	}
+
+	if (overlapCount[0] != overlapCount[1])  [result appendString:@"\n*** MISMATCH: implementations disagree on overlapping pairs. ***"];
+
+	for (i = 0; i < [rocks count]; i++)
+	{
+		[UNIVERSE removeEntity:[rocks objectAtIndex:i]];
+	}
+
+	return result;
+}
+
+
+- (void) setCollisionBroadPhaseNamed:(NSString *)name
+{
+	[UNIVERSE setCollisionBroadPhase:[OOCollisionBroadPhase broadPhaseNamed:name]];
+}
+
+@end
+
+#endif
@@ -0,0 +1,46 @@
+/*
+
+OOConcurrentEntityUpdater.h
+
+Runs -update: for a set of entities which return YES from
+-canUpdateConcurrently, spreading them across the async work manager's
+threads and the calling thread. The call returns once every entity has been
+updated; -completeConcurrentUpdate is not called, since it must be done on
+the main thread in a deterministic order (Universe does this as part of its
+update merge step).
+
+Small sets are updated on the calling thread, as is everything if the
+"concurrent-entity-update" user default is NO.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOTypes.h"
+
+@class Entity;
+
+
+@interface OOConcurrentEntityUpdater: NSObject
+
++ (void) updateEntities:(Entity **)entities count:(OOUInteger)count delta:(OOTimeDelta)delta_t;
+
+@end
@@ -0,0 +1,104 @@
+/*
+
+OOConcurrentEntityUpdater.m
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOConcurrentEntityUpdater.h"
+#import "OOAsyncWorkManager.h"
+#import "OOCPUInfo.h"
+#import "OOCollectionExtractors.h"
+#import "Entity.h"
+
+
+enum
+{
+	kMinConcurrentEntityCount	= 64,	// Below this, dispatch costs more than it saves.
+	kMinBatchSize				= 16,
+	kBatchesPerThread			= 4		// Smooths out uneven batches and late-starting threads.
+};
+
+
+typedef struct
+{
+	Entity					**entities;
+	OOUInteger				count;
+	OOUInteger				batchSize;
+	OOTimeDelta				delta;
+} ConcurrentUpdateContext;
+
+
+static void UpdateEntityBatch(void *context, OOUInteger batch);
+
+
+@implementation OOConcurrentEntityUpdater
+
+static BOOL			sEnabled;
+static unsigned		sThreadCount;
+
+
++ (void) initialize
+{
+	if (self == [OOConcurrentEntityUpdater class])
+	{
+		sEnabled = [[NSUserDefaults standardUserDefaults] oo_boolForKey:@"concurrent-entity-update" defaultValue:YES];
+		sThreadCount = OOCPUCount();
+	}
+}
+
+
++ (void) updateEntities:(Entity **)entities count:(OOUInteger)count delta:(OOTimeDelta)delta_t
+{
+	OOUInteger				i;
+	
+	if (!sEnabled || sThreadCount < 2 || count < kMinConcurrentEntityCount)
+	{
+		for (i = 0; i < count; i++)  [entities[i] update:delta_t];
+		return;
+	}
+	
+	OOUInteger batchSize = MAX((OOUInteger)kMinBatchSize, count / (sThreadCount * kBatchesPerThread));
+	ConcurrentUpdateContext context = { entities, count, batchSize, delta_t };
+	[[OOAsyncWorkManager sharedAsyncWorkManager] performBatches:(count + batchSize - 1) / batchSize
+												   withFunction:UpdateEntityBatch
+														context:&context];
+}
+
+@end
+
+
+static void UpdateEntityBatch(void *context, OOUInteger batch)
+{
+	ConcurrentUpdateContext *update = context;
+	volatile OOUInteger i = batch * update->batchSize;
+	OOUInteger end = MIN(i + update->batchSize, update->count);
+	
+	// One entity's exception shouldn't stop the rest of its batch from being updated.
+	while (i < end)
+	{
+		NS_DURING
+			for (; i < end; i++)  [update->entities[i] update:update->delta];
+		NS_HANDLER
+			OOLog(kOOLogException, @"***** Exception during concurrent update of %@: %@ : %@ *****", update->entities[i], [localException name], [localException reason]);
+			i++;
+		NS_ENDHANDLER
+	}
+}
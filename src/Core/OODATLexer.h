@@ -0,0 +1,69 @@
+/*
+
+OODATLexer.h
+
+Tokenizer for .dat model files, used by OOMesh.
+
+The file is read in a single pass over its bytes, without building any
+intermediate strings. Tokens are separated by whitespace or commas, and
+everything from a # or // to the end of the line is ignored. Numbers are
+parsed without reference to the current locale. Keywords are matched without
+regard to case.
+
+The read methods skip any separators before the next token; if the token is
+not of the requested type, they return NO and leave it in place. The line
+number is that of the last token read or, after a failed read, of the token
+which could not be read.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+
+@interface OODATLexer: NSObject
+{
+@private
+	NSData					*_data;
+	const char				*_cursor;
+	const char				*_end;
+	unsigned				_lineNumber;
+}
+
+- (id) initWithPath:(NSString *)path;
+
+- (unsigned) lineNumber;
+- (BOOL) atEnd;
+
+- (BOOL) readKeyword:(const char *)keyword;
+- (BOOL) readInteger:(int *)outInteger;
+- (BOOL) readReal:(float *)outReal;
+
+/*	The bytes of the next token. The pointer remains valid for the lifetime
+	of the lexer, and the token is not NUL-terminated.
+*/
+- (BOOL) readToken:(const char **)outBytes length:(size_t *)outLength;
+- (BOOL) readString:(NSString **)outString;
+
+//	The rest of the current line, or the next non-blank line if the current one is blank, without trailing whitespace.
+- (BOOL) readLine:(NSString **)outString;
+
+@end
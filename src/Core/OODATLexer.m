@@ -0,0 +1,458 @@
+/*
+
+OODATLexer.m
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OODATLexer.h"
+#import "NSStringOOExtensions.h"
+
+
+// Powers of ten which can be represented exactly as floats.
+static const double kExactPowersOfTen[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
+enum
+{
+	kMaxExactPowerOfTen			= sizeof kExactPowersOfTen / sizeof *kExactPowersOfTen - 1,
+	kMaxExactMantissa			= 1 << 24,	// All integers up to this are exact floats.
+	kMaxMantissaDigits			= 19,	// Fits in a uint64_t.
+	kMaxExponent				= 9999,	// Well beyond the range of double; keeps the exponent arithmetic from overflowing.
+	kStrtofBufferSize			= 64
+};
+
+
+OOINLINE BOOL IsLineBreak(char c)
+{
+	return c == '\n' || c == '\r';
+}
+
+
+OOINLINE BOOL IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\v' || c == '\f' || IsLineBreak(c);
+}
+
+
+OOINLINE BOOL IsDigit(char c)
+{
+	return '0' <= c && c <= '9';
+}
+
+
+OOINLINE char ASCIIToUpper(char c)
+{
+	return ('a' <= c && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+
+OOINLINE BOOL IsCommentStart(const char *cursor, const char *end)
+{
+	return *cursor == '#' || (*cursor == '/' && cursor + 1 < end && cursor[1] == '/');
+}
+
+
+OOINLINE BOOL IsTokenEnd(const char *cursor, const char *end)
+{
+	return cursor == end || IsSpace(*cursor) || *cursor == ',' || IsCommentStart(cursor, end);
+}
+
+
+/*	Parse the digits and decimal point from digits to end, followed by an
+	exponent, with strtof(). The number is rewritten as an integer with an
+	exponent, so the locale's decimal point doesn't matter.
+*/
+static BOOL ParseRealWithStrtof(const char *digits, const char *end, int exponent, float *outReal)
+{
+	char		stackBuffer[kStrtofBufferSize];
+	size_t		size = end - digits + 16;	// Room for "e", the exponent and a NUL.
+	char		*buffer = (size <= sizeof stackBuffer) ? stackBuffer : malloc(size);
+	char		*out = buffer;
+	BOOL		inFraction = NO;
+
+	if (buffer == NULL)  return NO;
+
+	for (; digits < end; digits++)
+	{
+		if (*digits == '.')  inFraction = YES;
+		else
+		{
+			*out++ = *digits;
+			if (inFraction)  exponent--;
+		}
+	}
+	snprintf(out, size - (out - buffer), "e%d", exponent);
+
+	*outReal = strtof(buffer, NULL);
+
+	if (buffer != stackBuffer)  free(buffer);
+	return YES;
+}
+
+
+@interface OODATLexer (Private)
+
+- (void) skipSeparators;
+- (const char *) endOfToken;
+
+@end
+
+
+@implementation OODATLexer
+
+- (id) initWithPath:(NSString *)path
+{
+	if ((self = [super init]))
+	{
+		_data = [[NSData alloc] initWithContentsOfMappedFile:path];
+		if (_data == nil)
+		{
+			[self release];
+			return nil;
+		}
+
+		const unsigned char *bytes = [_data bytes];
+		size_t length = [_data length];
+
+		if (length >= 2 && ((bytes[0] == 0xFE && bytes[1] == 0xFF) || (bytes[0] == 0xFF && bytes[1] == 0xFE)))
+		{
+			// UTF-16, as accepted by the old string-based loader; convert it up front.
+			NSString *string = [NSString stringWithContentsOfUnicodeFile:path];
+			[_data release];
+			_data = [[string dataUsingEncoding:NSUTF8StringEncoding] retain];
+			if (_data == nil)
+			{
+				[self release];
+				return nil;
+			}
+			bytes = [_data bytes];
+			length = [_data length];
+		}
+		else if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+		{
+			// UTF-8 byte order mark.
+			bytes += 3;
+			length -= 3;
+		}
+
+		_cursor = (const char *)bytes;
+		_end = _cursor + length;
+		_lineNumber = 1;
+	}
+
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_data);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"line %u", _lineNumber];
+}
+
+
+- (unsigned) lineNumber
+{
+	return _lineNumber;
+}
+
+
+- (BOOL) atEnd
+{
+	[self skipSeparators];
+	return _cursor == _end;
+}
+
+
+- (BOOL) readKeyword:(const char *)keyword
+{
+	NSParameterAssert(keyword != NULL);
+
+	[self skipSeparators];
+	const char *tokenEnd = [self endOfToken];
+	size_t length = strlen(keyword);
+
+	if ((size_t)(tokenEnd - _cursor) != length)  return NO;
+
+	size_t i;
+	for (i = 0; i < length; i++)
+	{
+		if (ASCIIToUpper(_cursor[i]) != ASCIIToUpper(keyword[i]))  return NO;
+	}
+
+	_cursor = tokenEnd;
+	return YES;
+}
+
+
+- (BOOL) readInteger:(int *)outInteger
+{
+	NSParameterAssert(outInteger != NULL);
+
+	[self skipSeparators];
+
+	const char *cursor = _cursor;
+	BOOL negative = NO;
+	if (cursor < _end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = (*cursor == '-');
+		cursor++;
+	}
+	if (cursor == _end || !IsDigit(*cursor))  return NO;
+
+	long long value = 0;
+	do
+	{
+		value = value * 10 + (*cursor++ - '0');
+		if (value > (long long)INT_MAX + 1)  return NO;
+	}
+	while (cursor < _end && IsDigit(*cursor));
+
+	if (negative)  value = -value;
+	if (value > INT_MAX || !IsTokenEnd(cursor, _end))  return NO;
+
+	*outInteger = (int)value;
+	_cursor = cursor;
+	return YES;
+}
+
+
+- (BOOL) readReal:(float *)outReal
+{
+	NSParameterAssert(outReal != NULL);
+
+	[self skipSeparators];
+
+	/*	Accumulate up to kMaxMantissaDigits significant digits in an integer
+		and track the decimal exponent separately. Model files are mostly
+		short numbers like 12.5 or -0.375, whose mantissa and power of ten
+		are both exact floats; one double multiplication or division of those
+		rounds to the same float as strtof() would, since double has more
+		than twice float's precision. Anything else is handed to strtof().
+	*/
+	const char *cursor = _cursor;
+	BOOL negative = NO;
+	if (cursor < _end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = (*cursor == '-');
+		cursor++;
+	}
+
+	const char *digitsStart = cursor;
+	uint64_t mantissa = 0;
+	unsigned mantissaDigits = 0;
+	int exponent = 0;
+	BOOL haveDigits = NO;
+	BOOL truncated = NO;
+
+	for (; cursor < _end && IsDigit(*cursor); cursor++)
+	{
+		haveDigits = YES;
+		if (mantissaDigits < kMaxMantissaDigits)
+		{
+			mantissa = mantissa * 10 + (*cursor - '0');
+			if (mantissa != 0)  mantissaDigits++;
+		}
+		else
+		{
+			exponent++;
+			truncated = YES;
+		}
+	}
+
+	if (cursor < _end && *cursor == '.')
+	{
+		for (cursor++; cursor < _end && IsDigit(*cursor); cursor++)
+		{
+			haveDigits = YES;
+			if (mantissaDigits < kMaxMantissaDigits)
+			{
+				mantissa = mantissa * 10 + (*cursor - '0');
+				if (mantissa != 0)  mantissaDigits++;
+				exponent--;
+			}
+			else
+			{
+				truncated = YES;
+			}
+		}
+	}
+
+	if (!haveDigits)  return NO;
+
+	const char *digitsEnd = cursor;
+	int explicitExponent = 0;
+
+	if (cursor < _end && (*cursor == 'e' || *cursor == 'E'))
+	{
+		const char *exponentStart = cursor++;
+		BOOL negativeExponent = NO;
+		if (cursor < _end && (*cursor == '-' || *cursor == '+'))
+		{
+			negativeExponent = (*cursor == '-');
+			cursor++;
+		}
+
+		if (cursor < _end && IsDigit(*cursor))
+		{
+			for (; cursor < _end && IsDigit(*cursor); cursor++)
+			{
+				if (explicitExponent < kMaxExponent)  explicitExponent = explicitExponent * 10 + (*cursor - '0');
+			}
+			if (negativeExponent)  explicitExponent = -explicitExponent;
+			exponent += explicitExponent;
+		}
+		else
+		{
+			// Not an exponent after all, so not a number either.
+			cursor = exponentStart;
+		}
+	}
+
+	if (!IsTokenEnd(cursor, _end))  return NO;
+
+	float value;
+	if (mantissa == 0)
+	{
+		value = 0.0f;
+	}
+	else if (!truncated && mantissa <= kMaxExactMantissa && -kMaxExactPowerOfTen <= exponent && exponent <= kMaxExactPowerOfTen)
+	{
+		if (exponent >= 0)  value = (double)mantissa * kExactPowersOfTen[exponent];
+		else  value = (double)mantissa / kExactPowersOfTen[-exponent];
+	}
+	else if (!ParseRealWithStrtof(digitsStart, digitsEnd, explicitExponent, &value))
+	{
+		return NO;
+	}
+
+	*outReal = negative ? -value : value;
+	_cursor = cursor;
+	return YES;
+}
+
+
+- (BOOL) readToken:(const char **)outBytes length:(size_t *)outLength
+{
+	NSParameterAssert(outBytes != NULL && outLength != NULL);
+
+	[self skipSeparators];
+	if (_cursor == _end)  return NO;
+
+	const char *tokenEnd = [self endOfToken];
+	*outBytes = _cursor;
+	*outLength = tokenEnd - _cursor;
+	_cursor = tokenEnd;
+	return YES;
+}
+
+
+- (BOOL) readString:(NSString **)outString
+{
+	NSParameterAssert(outString != NULL);
+
+	const char *bytes = NULL;
+	size_t length = 0;
+	if (![self readToken:&bytes length:&length])  return NO;
+
+	*outString = [[[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding] autorelease];
+	return *outString != nil;
+}
+
+
+- (BOOL) readLine:(NSString **)outString
+{
+	NSParameterAssert(outString != NULL);
+
+	[self skipSeparators];
+	if (_cursor == _end)  return NO;
+
+	// Commas and comments still count as separators, as they did when the file was preprocessed.
+	const char *start = _cursor;
+	const char *end = start;
+	while (end < _end && !IsLineBreak(*end) && !IsCommentStart(end, _end))  end++;
+	_cursor = end;
+
+	while (end > start && (IsSpace(end[-1]) || end[-1] == ','))  end--;
+
+	NSString *line = [[[NSString alloc] initWithBytes:start length:end - start encoding:NSUTF8StringEncoding] autorelease];
+	*outString = [line stringByReplacingOccurrencesOfString:@"," withString:@" "];
+	return *outString != nil;
+}
+
+@end
+
+
+@implementation OODATLexer (Private)
+
+- (void) skipSeparators
+{
+	const char *cursor = _cursor;
+	const char *end = _end;
+
+	while (cursor < end)
+	{
+		char c = *cursor;
+		if (c == '\n')
+		{
+			_lineNumber++;
+			cursor++;
+		}
+		else if (c == '\r')
+		{
+			// Lone CR for old Mac line endings; CRLF is counted at the LF.
+			if (cursor + 1 == end || cursor[1] != '\n')  _lineNumber++;
+			cursor++;
+		}
+		else if (IsSpace(c) || c == ',')
+		{
+			cursor++;
+		}
+		else if (IsCommentStart(cursor, end))
+		{
+			while (cursor < end && !IsLineBreak(*cursor))  cursor++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	_cursor = cursor;
+}
+
+
+- (const char *) endOfToken
+{
+	const char *cursor = _cursor;
+	while (!IsTokenEnd(cursor, _end))  cursor++;
+	return cursor;
+}
+
+@end
@@ -0,0 +1,93 @@
+/*
+
+OOEntitySpatialIndex.h
+
+Spatial index used by Universe to answer ranged and nearest-entity queries
+(-findEntitiesMatchingPredicate:..., -nearestEntityMatchingPredicate:... and
+everything built on them) without scanning every entity in the system.
+
+Entities are hashed into a uniform grid by position. Entities whose collision
+radius is too large for the grid (planets, suns and the like) are kept in a
+separate list which is included in every query. The index is rebuilt by
+Universe once per frame and whenever entities are added or removed; in
+between, entities are refitted individually after they update or are moved
+with -setPosition:.
+
+Queries return candidates only: a superset of the entities within range,
+sorted in sortedEntities (distance-from-player) order. Callers must still do
+an exact range test on the live position.
+
+The index also keeps a count of ships in each scan class, so that whole-system
+scan class counts are O(1).
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOMaths.h"
+
+@class Entity;
+
+#ifndef OO_SCANCLASS_TYPE
+#define OO_SCANCLASS_TYPE
+typedef enum OOScanClass OOScanClass;
+#endif
+
+
+@interface OOEntitySpatialIndex: NSObject
+{
+@private
+	struct OOEntitySpatialIndexSlot	*_slots;
+	OOUInteger				_slotCount, _slotCapacity;
+
+	int32_t					*_cellHeads;
+	uint32_t				*_cellStamps;
+	uint32_t				_cellMask;
+	uint32_t				_stamp;
+
+	int32_t					*_lookup;
+	uint32_t				_lookupMask;
+
+	int32_t					*_oversized;
+	OOUInteger				_oversizedCount;
+
+	GLfloat					_maxGriddedRadius;
+
+	unsigned				*_shipScanClassCounts;
+}
+
+- (void) rebuildWithEntities:(Entity **)entities count:(OOUInteger)count;
+
+/*	Update the cell and scan class of one entity after it has moved or changed
+	scan class. Entities which are not in the index are ignored.
+*/
+- (void) refitEntity:(Entity *)entity;
+
+/*	Returns a malloced array of every indexed entity which may lie within
+	radius (plus its own collision radius) of point, in sortedEntities order;
+	the caller must free() it. Returns NULL if the query covers so much of the
+	grid that a linear scan would be cheaper.
+*/
+- (Entity **) copyCandidatesNear:(Vector)point radius:(GLfloat)radius count:(OOUInteger *)outCount;
+
+- (unsigned) countShipsWithScanClass:(OOScanClass)scanClass;
+
+@end
@@ -0,0 +1,389 @@
+/*
+
+OOEntitySpatialIndex.m
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOEntitySpatialIndex.h"
+#import "Entity.h"
+
+
+/*	Cells are large compared to ships, but small compared to the distances
+	between planets, stations and the witchpoint; a scanner-range query
+	touches a few dozen cells at most. Anything with a collision radius of more than
+	half a cell goes in the oversized list.
+*/
+#define kCellSize				32768.0
+#define kMaxGriddedRadius		16384.0f
+#define kMaxCellCoordinate		(1 << 30)
+#define kMinTableSize			64
+#define kNoSlot					(-1)
+
+
+enum
+{
+#define ENTRY(label, value) kScanClassOrdinal_##label,
+	#include "OOScanClass.tbl"
+#undef ENTRY
+	kScanClassOrdinalCount
+};
+
+
+struct OOEntitySpatialIndexSlot
+{
+	Entity					*entity;
+	int32_t					next, prev;
+	uint32_t				cell;
+	uint8_t					scanClassOrdinal;
+	BOOL					isShip;
+	BOOL					oversized;
+};
+typedef struct OOEntitySpatialIndexSlot Slot;
+
+
+static unsigned ScanClassOrdinal(OOScanClass scanClass);
+OOINLINE int32_t CellCoordinate(double value);
+OOINLINE uint32_t CellHash(int32_t x, int32_t y, int32_t z);
+OOINLINE uint32_t PointerHash(Entity *entity);
+static OOUInteger TableSizeForCount(OOUInteger count);
+static int CompareZeroIndex(const void *a, const void *b);
+
+
+@interface OOEntitySpatialIndex (Private)
+
+- (int32_t) slotForEntity:(Entity *)entity;
+- (uint32_t) cellForPosition:(Vector)position;
+- (void) linkSlot:(int32_t)slot toCell:(uint32_t)cell;
+- (void) unlinkSlot:(int32_t)slot;
+
+@end
+
+
+@implementation OOEntitySpatialIndex
+
+- (id) init
+{
+	if ((self = [super init]))
+	{
+		_shipScanClassCounts = calloc(kScanClassOrdinalCount, sizeof *_shipScanClassCounts);
+		if (_shipScanClassCounts == NULL)
+		{
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+
+- (void) dealloc
+{
+	free(_slots);
+	free(_cellHeads);
+	free(_cellStamps);
+	free(_lookup);
+	free(_oversized);
+	free(_shipScanClassCounts);
+
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%lu entities (%lu oversized), %u cells", (unsigned long)_slotCount, (unsigned long)_oversizedCount, _cellMask + 1];
+}
+
+
+- (void) rebuildWithEntities:(Entity **)entities count:(OOUInteger)count
+{
+	OOUInteger			i;
+	OOUInteger			tableSize = TableSizeForCount(count);
+
+	if (count > _slotCapacity)
+	{
+		OOUInteger newCapacity = MAX(_slotCapacity * 2, count);
+		_slots = realloc(_slots, newCapacity * sizeof *_slots);
+		_oversized = realloc(_oversized, newCapacity * sizeof *_oversized);
+		if (_slots == NULL || _oversized == NULL)
+		{
+			[NSException raise:NSMallocException format:@"Failed to allocate entity spatial index."];
+		}
+		_slotCapacity = newCapacity;
+	}
+
+	if (tableSize != _cellMask + 1 || _cellHeads == NULL)
+	{
+		free(_cellHeads);
+		free(_cellStamps);
+		free(_lookup);
+		_cellHeads = malloc(tableSize * sizeof *_cellHeads);
+		_cellStamps = calloc(tableSize, sizeof *_cellStamps);
+		_lookup = malloc(tableSize * 2 * sizeof *_lookup);
+		if (_cellHeads == NULL || _cellStamps == NULL || _lookup == NULL)
+		{
+			[NSException raise:NSMallocException format:@"Failed to allocate entity spatial index."];
+		}
+		_cellMask = tableSize - 1;
+		_lookupMask = tableSize * 2 - 1;
+		_stamp = 0;
+	}
+
+	memset(_cellHeads, 0xFF, (_cellMask + 1) * sizeof *_cellHeads);	// kNoSlot
+	memset(_lookup, 0xFF, (_lookupMask + 1) * sizeof *_lookup);
+	memset(_shipScanClassCounts, 0, kScanClassOrdinalCount * sizeof *_shipScanClassCounts);
+	_oversizedCount = 0;
+	_maxGriddedRadius = 0.0f;
+	_slotCount = count;
+
+	for (i = 0; i < count; i++)
+	{
+		Entity *entity = entities[i];
+		Slot *slot = &_slots[i];
+
+		slot->entity = entity;
+		slot->scanClassOrdinal = ScanClassOrdinal([entity scanClass]);
+		slot->isShip = [entity isShip];
+		if (slot->isShip)  _shipScanClassCounts[slot->scanClassOrdinal]++;
+
+		uint32_t probe = PointerHash(entity) & _lookupMask;
+		while (_lookup[probe] != kNoSlot)  probe = (probe + 1) & _lookupMask;
+		_lookup[probe] = i;
+
+		GLfloat radius = entity->collision_radius;
+		if (radius > kMaxGriddedRadius || !isfinite(radius))
+		{
+			slot->oversized = YES;
+			slot->next = slot->prev = kNoSlot;
+			_oversized[_oversizedCount++] = i;
+		}
+		else
+		{
+			slot->oversized = NO;
+			if (radius > _maxGriddedRadius)  _maxGriddedRadius = radius;
+			[self linkSlot:i toCell:[self cellForPosition:entity->position]];
+		}
+	}
+}
+
+
+- (void) refitEntity:(Entity *)entity
+{
+	int32_t				index = [self slotForEntity:entity];
+	if (index == kNoSlot)  return;
+
+	Slot *slot = &_slots[index];
+
+	if (slot->isShip)
+	{
+		unsigned ordinal = ScanClassOrdinal([entity scanClass]);
+		if (ordinal != slot->scanClassOrdinal)
+		{
+			_shipScanClassCounts[slot->scanClassOrdinal]--;
+			_shipScanClassCounts[ordinal]++;
+			slot->scanClassOrdinal = ordinal;
+		}
+	}
+
+	if (!slot->oversized)
+	{
+		// Growing past kMaxGriddedRadius only makes queries look further afield.
+		GLfloat radius = entity->collision_radius;
+		if (radius > _maxGriddedRadius)  _maxGriddedRadius = radius;
+
+		uint32_t cell = [self cellForPosition:entity->position];
+		if (cell != slot->cell)
+		{
+			[self unlinkSlot:index];
+			[self linkSlot:index toCell:cell];
+		}
+	}
+}
+
+
+- (Entity **) copyCandidatesNear:(Vector)point radius:(GLfloat)radius count:(OOUInteger *)outCount
+{
+	NSParameterAssert(outCount != NULL);
+
+	if (_cellHeads == NULL || !(radius >= 0.0f))  return NULL;
+
+	double pad = (double)radius + _maxGriddedRadius;
+	if (!isfinite(pad))  return NULL;
+
+	int32_t minX = CellCoordinate(point.x - pad), maxX = CellCoordinate(point.x + pad);
+	int32_t minY = CellCoordinate(point.y - pad), maxY = CellCoordinate(point.y + pad);
+	int32_t minZ = CellCoordinate(point.z - pad), maxZ = CellCoordinate(point.z + pad);
+
+	double cellCount = ((double)maxX - minX + 1) * ((double)maxY - minY + 1) * ((double)maxZ - minZ + 1);
+	if (cellCount > _cellMask + 1)  return NULL;
+
+	Entity **result = malloc((_slotCount + 1) * sizeof *result);
+	if (result == NULL)  return NULL;
+	OOUInteger count = 0;
+
+	// Several cells may share a hash bucket; the stamps stop a bucket being visited twice.
+	if (++_stamp == 0)
+	{
+		memset(_cellStamps, 0, (_cellMask + 1) * sizeof *_cellStamps);
+		_stamp = 1;
+	}
+
+	int32_t x, y, z;
+	for (z = minZ; z <= maxZ; z++)
+	{
+		for (y = minY; y <= maxY; y++)
+		{
+			for (x = minX; x <= maxX; x++)
+			{
+				uint32_t cell = CellHash(x, y, z) & _cellMask;
+				if (_cellStamps[cell] == _stamp)  continue;
+				_cellStamps[cell] = _stamp;
+
+				int32_t index;
+				for (index = _cellHeads[cell]; index != kNoSlot; index = _slots[index].next)
+				{
+					result[count++] = _slots[index].entity;
+				}
+			}
+		}
+	}
+
+	OOUInteger i;
+	for (i = 0; i < _oversizedCount; i++)
+	{
+		result[count++] = _slots[_oversized[i]].entity;
+	}
+
+	qsort(result, count, sizeof *result, CompareZeroIndex);
+
+	*outCount = count;
+	return result;
+}
+
+
+- (unsigned) countShipsWithScanClass:(OOScanClass)scanClass
+{
+	return _shipScanClassCounts[ScanClassOrdinal(scanClass)];
+}
+
+@end
+
+
+@implementation OOEntitySpatialIndex (Private)
+
+- (int32_t) slotForEntity:(Entity *)entity
+{
+	if (_lookup == NULL || entity == nil)  return kNoSlot;
+
+	uint32_t probe = PointerHash(entity) & _lookupMask;
+	int32_t index;
+	while ((index = _lookup[probe]) != kNoSlot)
+	{
+		if (_slots[index].entity == entity)  return index;
+		probe = (probe + 1) & _lookupMask;
+	}
+	return kNoSlot;
+}
+
+
+- (uint32_t) cellForPosition:(Vector)position
+{
+	return CellHash(CellCoordinate(position.x), CellCoordinate(position.y), CellCoordinate(position.z)) & _cellMask;
+}
+
+
+- (void) linkSlot:(int32_t)index toCell:(uint32_t)cell
+{
+	Slot *slot = &_slots[index];
+	int32_t head = _cellHeads[cell];
+
+	slot->cell = cell;
+	slot->prev = kNoSlot;
+	slot->next = head;
+	if (head != kNoSlot)  _slots[head].prev = index;
+	_cellHeads[cell] = index;
+}
+
+
+- (void) unlinkSlot:(int32_t)index
+{
+	Slot *slot = &_slots[index];
+
+	if (slot->prev != kNoSlot)  _slots[slot->prev].next = slot->next;
+	else  _cellHeads[slot->cell] = slot->next;
+	if (slot->next != kNoSlot)  _slots[slot->next].prev = slot->prev;
+}
+
+@end
+
+
+static unsigned ScanClassOrdinal(OOScanClass scanClass)
+{
+	switch (scanClass)
+	{
+#define ENTRY(label, value) case label: return kScanClassOrdinal_##label;
+		#include "OOScanClass.tbl"
+#undef ENTRY
+	}
+
+	return kScanClassOrdinal_CLASS_NOT_SET;
+}
+
+
+OOINLINE int32_t CellCoordinate(double value)
+{
+	double cell = floor(value * (1.0 / kCellSize));
+
+	// Also catches NaN, which would otherwise be undefined when converted.
+	if (!(cell > -kMaxCellCoordinate))  return -kMaxCellCoordinate;
+	if (cell > kMaxCellCoordinate)  return kMaxCellCoordinate;
+	return (int32_t)cell;
+}
+
+
+OOINLINE uint32_t CellHash(int32_t x, int32_t y, int32_t z)
+{
+	return ((uint32_t)x * 73856093U) ^ ((uint32_t)y * 19349663U) ^ ((uint32_t)z * 83492791U);
+}
+
+
+OOINLINE uint32_t PointerHash(Entity *entity)
+{
+	uintptr_t bits = (uintptr_t)entity;
+	return (uint32_t)((bits >> 4) ^ (bits >> 20)) * 2654435761U;
+}
+
+
+static OOUInteger TableSizeForCount(OOUInteger count)
+{
+	OOUInteger size = kMinTableSize;
+	while (size < count * 2)  size *= 2;
+	return size;
+}
+
+
+static int CompareZeroIndex(const void *a, const void *b)
+{
+	int za = (*(Entity * const *)a)->zero_index;
+	int zb = (*(Entity * const *)b)->zero_index;
+
+	return (za > zb) - (za < zb);
+}
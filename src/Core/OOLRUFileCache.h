@@ -0,0 +1,84 @@
+/*
+
+OOLRUFileCache.h
+
+Base class for caches which keep each entry in a file of its own in a folder
+under the cache folder, such as OOPlanetTextureCache and OOTextureDiskCache.
+
+Entries are keyed by strings. The file for an entry is named after a hash of
+its key, so subclasses must store the key in the entry and check it on load;
+hash collisions are then harmless. The format of the entries is up to the
+subclass, which reads them with -mappedEntryForKey: and writes them with
+-storeEntry:forKey:. OOMesh uses an instance directly for its cache files.
+
+The total size of the files is limited by a user default, in megabytes (0
+disables the cache). When a new entry takes the cache over its limit, the
+least recently used entries are deleted; subclasses call -touchEntryForKey:
+whenever an entry is used.
+
+All methods are thread-safe, but instances must be created on the main
+thread.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+
+@interface OOLRUFileCache: NSObject
+{
+@private
+	NSString				*_folder;
+	NSString				*_extension;
+	unsigned long long		_sizeLimit;
+	unsigned long long		_totalSize;
+	NSLock					*_lock;
+	NSFileManager			*_fileManager;
+}
+
+/*	folderName is the name of the folder in the cache folder, and extension
+	the file name extension of entries. The size limit is read from the user
+	default sizeLimitKey. Returns nil if the cache is disabled or its folder
+	can't be created.
+*/
+- (id) initWithFolderName:(NSString *)folderName
+				extension:(NSString *)extension
+			 sizeLimitKey:(NSString *)sizeLimitKey
+	 defaultSizeLimitInMB:(unsigned)defaultMegabytes;
+
+- (unsigned long long) sizeLimit;
+
+/*	The contents of the file for key, mapped into memory where possible, or
+	nil if there is none. The contents may belong to another key with the
+	same hash.
+*/
+- (NSData *) mappedEntryForKey:(NSString *)key;
+
+// Mark the entry for key as recently used.
+- (void) touchEntryForKey:(NSString *)key;
+
+/*	Write data as the entry for key, replacing any existing entry. Does
+	nothing if cache writes are disabled, or if the entry would take up more
+	than half the cache.
+*/
+- (void) storeEntry:(NSData *)data forKey:(NSString *)key;
+
+@end
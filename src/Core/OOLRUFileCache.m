@@ -0,0 +1,223 @@
+/*
+
+OOLRUFileCache.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOLRUFileCache.h"
+#import "OOCacheManager.h"
+#import "OOCollectionExtractors.h"
+#import "NSThreadOOExtensions.h"
+#import "NSStringOOExtensions.h"
+#import <sys/time.h>
+
+
+@interface OOLRUFileCache (Private)
+
+- (NSString *) pathForKey:(NSString *)key;
+
+// Must be called with _lock held.
+- (void) trimToSize:(unsigned long long)sizeLimit;
+
+@end
+
+
+@implementation OOLRUFileCache
+
+- (id) initWithFolderName:(NSString *)folderName
+				extension:(NSString *)extension
+			 sizeLimitKey:(NSString *)sizeLimitKey
+	 defaultSizeLimitInMB:(unsigned)defaultMegabytes
+{
+	NSParameterAssert(folderName != nil && extension != nil && sizeLimitKey != nil);
+	
+	if ((self = [super init]))
+	{
+		long long megabytes = [[NSUserDefaults standardUserDefaults] oo_longLongForKey:sizeLimitKey defaultValue:defaultMegabytes];
+		if (megabytes <= 0)
+		{
+			[self release];
+			return nil;
+		}
+		
+		_folder = [[[OOCacheManager sharedCache] pathForFileCacheNamed:folderName create:YES] copy];
+		if (_folder == nil)
+		{
+			OOLog(@"cache.file.unavailable", @"Could not create cache folder \"%@\"; its contents will not be cached.", folderName);
+			[self release];
+			return nil;
+		}
+		
+		_extension = [extension copy];
+		_sizeLimit = megabytes * 1024 * 1024;
+		_lock = [[NSLock alloc] init];
+		[_lock ooSetName:[NSString stringWithFormat:@"%@ lock", [self class]]];
+		
+		// The shared file manager may not be used off the main thread.
+		_fileManager = [[NSFileManager alloc] init];
+		
+		if (_lock == nil || _fileManager == nil)
+		{
+			[self release];
+			return nil;
+		}
+		
+		// Establishes _totalSize; the limit may also have been lowered since the last run.
+		[_lock lock];
+		[self trimToSize:_sizeLimit];
+		[_lock unlock];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_folder);
+	DESTROY(_extension);
+	DESTROY(_lock);
+	DESTROY(_fileManager);
+	
+	[super dealloc];
+}
+
+
+- (unsigned long long) sizeLimit
+{
+	return _sizeLimit;
+}
+
+
+- (NSData *) mappedEntryForKey:(NSString *)key
+{
+	/*	No lock is needed: entries are replaced by renaming and evicted by
+		unlinking, so a mapping always sees a complete file.
+	*/
+	return [[[NSData alloc] initWithContentsOfMappedFile:[self pathForKey:key]] autorelease];
+}
+
+
+- (void) touchEntryForKey:(NSString *)key
+{
+	utimes([[self pathForKey:key] fileSystemRepresentation], NULL);
+}
+
+
+- (void) storeEntry:(NSData *)data forKey:(NSString *)key
+{
+	NSParameterAssert(data != nil && key != nil);
+	
+	if (![[OOCacheManager sharedCache] allowCacheWrites])  return;
+	
+	// An entry which would push everything else out isn't worth keeping.
+	unsigned long long fileSize = [data length];
+	if (fileSize > _sizeLimit / 2)  return;
+	
+	NSString *path = [self pathForKey:key];
+	
+	[_lock lock];
+	
+	// Keep the running total in step without rescanning the folder for each store.
+	NSDictionary *oldAttributes = [_fileManager fileAttributesAtPath:path traverseLink:NO];
+	if (oldAttributes != nil)
+	{
+		unsigned long long oldSize = [oldAttributes fileSize];
+		_totalSize = (_totalSize > oldSize) ? _totalSize - oldSize : 0;
+	}
+	
+	if ([data writeToFile:path atomically:YES])
+	{
+		_totalSize += fileSize;
+		if (_totalSize > _sizeLimit)  [self trimToSize:_sizeLimit];
+	}
+	else
+	{
+		OOLog(@"cache.file.write.failed", @"Could not write cache file %@.", path);
+	}
+	
+	[_lock unlock];
+}
+
+@end
+
+
+@implementation OOLRUFileCache (Private)
+
+- (NSString *) pathForKey:(NSString *)key
+{
+	NSString *fileName = [NSString stringWithFormat:@"%016llx.%@", (unsigned long long)[key oo_hash64], _extension];
+	return [_folder stringByAppendingPathComponent:fileName];
+}
+
+
+static NSComparisonResult CompareModificationDates(id a, id b, void *context)
+{
+	return [[a objectForKey:NSFileModificationDate] compare:[b objectForKey:NSFileModificationDate]];
+}
+
+
+- (void) trimToSize:(unsigned long long)sizeLimit
+{
+	NSMutableArray *entries = [NSMutableArray array];
+	unsigned long long totalSize = 0;
+	NSEnumerator *fileEnum = nil;
+	NSString *fileName = nil;
+	
+	for (fileEnum = [[_fileManager directoryContentsAtPath:_folder] objectEnumerator]; (fileName = [fileEnum nextObject]); )
+	{
+		if (![[fileName pathExtension] isEqualToString:_extension])  continue;
+		
+		NSString *path = [_folder stringByAppendingPathComponent:fileName];
+		NSDictionary *attributes = [_fileManager fileAttributesAtPath:path traverseLink:NO];
+		if (attributes == nil)  continue;
+		
+		totalSize += [attributes fileSize];
+		[entries addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+							path, @"path",
+							[NSNumber numberWithUnsignedLongLong:[attributes fileSize]], NSFileSize,
+							[attributes fileModificationDate], NSFileModificationDate,
+							nil]];
+	}
+	
+	if (totalSize > sizeLimit)
+	{
+		// Oldest first.
+		[entries sortUsingFunction:CompareModificationDates context:NULL];
+		
+		NSEnumerator *entryEnum = nil;
+		NSDictionary *entry = nil;
+		for (entryEnum = [entries objectEnumerator]; totalSize > sizeLimit && (entry = [entryEnum nextObject]); )
+		{
+			NSString *path = [entry objectForKey:@"path"];
+			if ([_fileManager removeFileAtPath:path handler:nil])
+			{
+				totalSize -= [entry oo_unsignedLongLongForKey:NSFileSize];
+				OOLog(@"cache.file.evict", @"Removed cache file %@.", path);
+			}
+		}
+	}
+	
+	_totalSize = totalSize;
+}
+
+@end
@@ -91,7 +91,8 @@ typedef struct
 @private
 	uint8_t					_normalMode: 2,
 							brokenInRender: 1,
-							listsReady: 1;
+							listsReady: 1,
+							preloadOnly: 1;
 	
 	OOMeshMaterialCount		materialCount;
 	OOMeshVertexCount		vertexCount;
@@ -170,6 +171,29 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object;
 @end
 
 
+/*	Support for warming the mesh and octree caches on worker threads.
+	
+	A mesh created with -initForPreloadingWithName:path:smooth: has its
+	geometry and collision octree, but no materials. Creating it does not use
+	OOCacheManager, ResourceManager or the graphics reset manager, so it may be
+	created and released on any thread. It is only good for passing to
+	+cachePreloadedMesh:smooth:, which like +isCachedWithName:smooth: and
+	+materialKeysForCachedMeshWithName:smooth: must be called on the main
+	thread.
+*/
+@interface OOMesh (Preloading)
+
++ (BOOL) isCachedWithName:(NSString *)name smooth:(BOOL)smooth;
+
+// The material keys of a cached mesh, or nil if it isn't cached.
++ (NSArray *) materialKeysForCachedMeshWithName:(NSString *)name smooth:(BOOL)smooth;
+
+- (id) initForPreloadingWithName:(NSString *)name path:(NSString *)path smooth:(BOOL)smooth;
++ (void) cachePreloadedMesh:(OOMesh *)mesh smooth:(BOOL)smooth;
+
+@end
+
+
 #import "OOCacheManager.h"
 @interface OOCacheManager (Octree)
 
@@ -44,18 +44,23 @@ MA 02110-1301, USA.
 #import "OOMaterialConvenienceCreators.h"
 #import "OOBasicMaterial.h"
 #import "OOCollectionExtractors.h"
+#import "OODATLexer.h"
 #import "OOOpenGLExtensionManager.h"
 #import "OOGraphicsResetManager.h"
 #import "OODebugGLDrawing.h"
 #import "OOShaderMaterial.h"
+#import "OOTexture.h"
 #import "OOMacroOpenGL.h"
 #import "OOProfilingStopwatch.h"
 #import "OODebugFlags.h"
 #import "NSObjectOOExtensions.h"
+#import "NSThreadOOExtensions.h"
+#import "OOLRUFileCache.h"
 
 #import "OOJavaScriptEngine.h"
 
 
+
 // If set, collision octree depth varies depending on the size of the mesh.
 #define ADAPTIVE_OCTREE_DEPTH		1
 
@@ -131,6 +136,80 @@ static OOUInteger VFRGetCount(VertexFaceRef *vfr);
 static OOUInteger VFRGetFaceAtIndex(VertexFaceRef *vfr, OOUInteger index);
 
 
+/*	Mesh cache files
+	Each loaded mesh is written to a binary file in the mesh cache folder,
+	which is an OOLRUFileCache limited by the user default "mesh-cache-size",
+	in megabytes (default 128; 0 disables it). When the mesh is loaded again
+	the file is mapped into memory and the vertex, face and vertex array
+	buffers point straight into it, so no parsing or set-up is needed. The
+	files use native byte order and structure layout, which the header checks,
+	and hold their cache key, which is checked on load. The OOMesh data cache
+	records a stamp for each mesh which must match the header, so files are
+	ignored once the data cache entry has been dropped.
+*/
+enum
+{
+	kMeshCacheFormatVersion		= 2,
+	kMeshCacheEndianTag			= 0x01020304,
+	kMeshCacheAlignment			= 16,
+	kMeshCacheDefaultSize		= 128		// Megabytes.
+};
+
+
+enum
+{
+	kMeshCacheVertices,
+	kMeshCacheNormals,
+	kMeshCacheTangents,
+	kMeshCacheFaces,
+	kMeshCacheIndexArray,
+	kMeshCacheTextureUVArray,
+	kMeshCacheVertexArray,
+	kMeshCacheNormalArray,
+	kMeshCacheTangentArray,
+	kMeshCacheMaterialKeys,		// NUL-terminated UTF-8 strings.
+	kMeshCacheKey,				// UTF-8, not terminated.
+	
+	kMeshCacheSectionCount
+};
+
+
+typedef struct
+{
+	char					magic[8];
+	uint32_t				endianTag;
+	uint32_t				formatVersion;
+	uint64_t				stamp;
+	
+	uint32_t				vectorSize;
+	uint32_t				faceSize;
+	uint32_t				vertexCount;
+	uint32_t				faceCount;
+	uint32_t				vertexArrayCount;
+	uint8_t					normalMode;
+	uint8_t					materialCount;
+	uint8_t					padding[2];
+	
+	uint32_t				triangleRange[kOOMeshMaxMaterials][2];	// location, length
+	uint32_t				sectionOffset[kMeshCacheSectionCount];
+	uint32_t				sectionLength[kMeshCacheSectionCount];
+} OOMeshCacheHeader;
+
+
+static const char kMeshCacheMagic[8] = { 'O', 'O', 'M', 'E', 'S', 'H', '\r', '\n' };
+
+static NSString * const kOOCacheMeshes = @"OOMesh";
+static NSString * const kOOCacheOctrees = @"octrees";
+
+OOINLINE NSString *MeshCacheKey(NSString *name, OOMeshNormalMode normalMode)
+{
+	return [NSString stringWithFormat:@"%@:%u", name, normalMode];
+}
+
+static void AppendMeshCacheSection(NSMutableData *data, OOMeshCacheHeader *header, unsigned section, const void *bytes, size_t length);
+static const void *GetMeshCacheSection(NSData *data, const OOMeshCacheHeader *header, unsigned section, size_t expectedLength);
+
+
 @interface OOMesh (Private) <NSMutableCopying, OOGraphicsResetClient>
 
 - (id)initWithName:(NSString *)name
@@ -142,6 +221,7 @@ materialDictionary:(NSDictionary *)materialDict
 shaderBindingTarget:(id<OOWeakReferenceSupport>)object;
 
 - (BOOL) loadData:(NSString *)filename;
+- (BOOL) loadDataFromPath:(NSString *)path name:(NSString *)filename;
 - (void) checkNormalsAndAdjustWinding;
 - (void) generateFaceTangents;
 - (void) calculateVertexNormalsAndTangentsWithFaceRefs:(VertexFaceRef *)faceRefs;
@@ -149,8 +229,8 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object;
 
 - (void) deleteDisplayLists;
 
-- (NSDictionary*) modelData;
-- (BOOL) setModelFromModelData:(NSDictionary*) dict name:(NSString *)fileName;
+- (NSData *) cacheDataWithKey:(NSString *)cacheKey;
+- (BOOL) setModelFromCacheData:(NSData *)data name:(NSString *)fileName;
 
 - (void) getNormal:(Vector *)outNormal andTangent:(Vector *)outTangent forVertex:(OOMeshVertexCount)v_index inSmoothGroup:(OOMeshSmoothGroup)smoothGroup;
 
@@ -167,6 +247,7 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object;
 // Manage set of objects we need to hang on to, particularly NSDatas owning buffers.
 - (void) setRetainedObject:(id)object forKey:(NSString *)key;
 - (void *) allocateBytesWithSize:(size_t)size count:(OOUInteger)count key:(NSString *)key;
+- (void *) copyOfBytes:(const void *)bytes size:(size_t)size count:(OOUInteger)count key:(NSString *)key;
 
 // Allocate all per-vertex/per-face buffers.
 - (BOOL) allocateVertexBuffersWithCount:(OOUInteger)count;
@@ -181,8 +262,9 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object;
 
 @interface OOCacheManager (OOMesh)
 
-+ (NSDictionary *)meshDataForName:(NSString *)inShipName;
-+ (void)setMeshData:(NSDictionary *)inData forName:(NSString *)inShipName;
++ (NSData *)meshDataForName:(NSString *)inShipName;
++ (BOOL)hasMeshDataForName:(NSString *)inShipName;
++ (void)setMeshData:(NSData *)inData forName:(NSString *)inShipName;
 
 @end
 
@@ -230,8 +312,29 @@ static BOOL IsPerVertexNormalMode(OOMeshNormalMode mode)
 }
 
 
+// Protects the last stamp used by -cacheDataWithKey:, which may be called on any thread.
+static NSLock *sCacheStampLock = nil;
+
+static OOLRUFileCache *sMeshFileCache = nil;
+
+
 @implementation OOMesh
 
++ (void) initialize
+{
+	if (self == [OOMesh class])
+	{
+		sCacheStampLock = [[NSLock alloc] init];
+		[sCacheStampLock ooSetName:@"OOMesh cache stamp lock"];
+		
+		sMeshFileCache = [[OOLRUFileCache alloc] initWithFolderName:@"Meshes"
+														  extension:@"oomesh"
+													   sizeLimitKey:@"mesh-cache-size"
+											   defaultSizeLimitInMB:kMeshCacheDefaultSize];
+	}
+}
+
+
 + (id)meshWithName:(NSString *)name
 		  cacheKey:(NSString *)cacheKey
 materialDictionary:(NSDictionary *)materialDict
@@ -292,7 +395,8 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)object
 		DESTROY(materialKeys[i]);
 	}
 	
-	[[OOGraphicsResetManager sharedManager] unregisterClient:self];
+	// Preloading meshes may be released on other threads, and are never registered.
+	if (!preloadOnly)  [[OOGraphicsResetManager sharedManager] unregisterClient:self];
 	
 	DESTROY(_retainedObjects);
 	
@@ -424,16 +528,16 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 	OOGL(glEnableClientState(GL_TEXTURE_COORD_ARRAY));
 #endif
 	
+	/*	Textures are not loaded up front: with texture streaming, a texture
+		which isn't ready yet is left out until it is, instead of stalling
+		the frame; without it, -apply waits for it anyway.
+	*/
+	BOOL applyWithoutWaiting = [OOTexture setApplyWithoutWaiting:YES];
+	
 	NS_DURING
 		if (!listsReady)
 		{
 			OOGL(displayList0 = glGenLists(materialCount));
-			
-			// Ensure all textures are loaded
-			for (ti = 0; ti < materialCount; ti++)
-			{
-				[materials[ti] ensureFinishedLoading];
-			}
 		}
 		
 		for (ti = 0; ti < materialCount; ti++)
@@ -475,7 +579,9 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 		
 		listsReady = YES;
 		brokenInRender = NO;
+		[OOTexture setApplyWithoutWaiting:applyWithoutWaiting];
 	NS_HANDLER
+		[OOTexture setApplyWithoutWaiting:applyWithoutWaiting];
 		if (!brokenInRender)
 		{
 			OOLog(kOOLogException, @"***** %s for %@ encountered exception: %@ : %@ *****", __PRETTY_FUNCTION__, self, [localException name], [localException reason]);
@@ -815,6 +921,103 @@ static NSString *NormalModeDescription(OOMeshNormalMode mode)
 @end
 
 
+@implementation OOMesh (Preloading)
+
++ (BOOL) isCachedWithName:(NSString *)name smooth:(BOOL)smooth
+{
+	if (name == nil)  return NO;
+	
+	// A cached mesh may have been rejected as invalid when it was last loaded, so this isn't definitive.
+	OOMeshNormalMode normalMode = smooth ? kNormalModeSmooth : kNormalModePerFace;
+	return [OOCacheManager hasMeshDataForName:MeshCacheKey(name, normalMode)] &&
+		   [[OOCacheManager sharedCache] objectForKey:name inCache:kOOCacheOctrees] != nil;
+}
+
+
++ (NSArray *) materialKeysForCachedMeshWithName:(NSString *)name smooth:(BOOL)smooth
+{
+	if (name == nil)  return nil;
+	
+	OOMeshNormalMode normalMode = smooth ? kNormalModeSmooth : kNormalModePerFace;
+	NSData *data = [OOCacheManager meshDataForName:MeshCacheKey(name, normalMode)];
+	if (data == nil)  return nil;
+	
+	// Only the header and key section are checked; -setModelFromCacheData:name: checks the rest when the mesh is used.
+	const OOMeshCacheHeader *header = [data bytes];
+	if (memcmp(header->magic, kMeshCacheMagic, sizeof header->magic) != 0 ||
+		header->endianTag != kMeshCacheEndianTag ||
+		header->formatVersion != kMeshCacheFormatVersion ||
+		header->materialCount > kOOMeshMaxMaterials)
+	{
+		return nil;
+	}
+	
+	size_t keyLength = header->sectionLength[kMeshCacheMaterialKeys];
+	const char *keyBytes = GetMeshCacheSection(data, header, kMeshCacheMaterialKeys, keyLength);
+	if (keyBytes == NULL && keyLength != 0)  return nil;
+	
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:header->materialCount];
+	unsigned i;
+	for (i = 0; i != header->materialCount; ++i)
+	{
+		const char *end = memchr(keyBytes, '\0', keyLength);
+		if (end == NULL)  return nil;
+		
+		NSString *key = [NSString stringWithUTF8String:keyBytes];
+		if (key == nil)  return nil;
+		[result addObject:key];
+		
+		keyLength -= end + 1 - keyBytes;
+		keyBytes = end + 1;
+	}
+	
+	return result;
+}
+
+
+- (id) initForPreloadingWithName:(NSString *)name path:(NSString *)path smooth:(BOOL)smooth
+{
+	if ((self = [super init]))
+	{
+		preloadOnly = YES;
+		_normalMode = smooth ? kNormalModeSmooth : kNormalModePerFace;
+		
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		BOOL OK = [self loadDataFromPath:path name:name];
+		if (OK)
+		{
+			[self calculateBoundingVolumes];
+			baseFile = [name copy];
+			octree = [[[self geometry] findOctreeToDepth:[self octreeDepth]] retain];
+		}
+		[pool release];
+		
+		if (!OK)
+		{
+			[self release];
+			return nil;
+		}
+	}
+	
+	return self;
+}
+
+
++ (void) cachePreloadedMesh:(OOMesh *)mesh smooth:(BOOL)smooth
+{
+	NSParameterAssert(mesh == nil || mesh->preloadOnly);
+	
+	if (mesh == nil)  return;
+	
+	OOMeshNormalMode normalMode = smooth ? kNormalModeSmooth : kNormalModePerFace;
+	NSString *cacheKey = MeshCacheKey(mesh->baseFile, normalMode);
+	[OOCacheManager setMeshData:[mesh cacheDataWithKey:cacheKey] forName:cacheKey];
+	[OOCacheManager setOctree:mesh->octree forModel:mesh->baseFile];
+}
+
+@end
+
+
 @implementation OOMesh (Private)
 
 - (id)initWithName:(NSString *)name
@@ -932,164 +1135,180 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 }
 
 
-- (NSDictionary *)modelData
+- (NSData *) cacheDataWithKey:(NSString *)cacheKey
 {
 	OOJS_PROFILE_ENTER
 	
-	NSNumber			*vertCnt = nil,
-						*faceCnt = nil;
-	NSData				*vertData = nil,
-						*normData = nil,
-						*tanData = nil,
-						*faceData = nil;
-	NSArray				*mtlKeys = nil;
-	NSNumber			*normMode = nil;
+	OOMeshCacheHeader	header;
+	NSMutableData		*data = nil;
+	NSMutableData		*keyData = nil;
+	NSData				*cacheKeyData = [cacheKey dataUsingEncoding:NSUTF8StringEncoding];
+	static uint64_t		sLastStamp = 0;
+	uint64_t			stamp;
+	unsigned			i;
 	
 	BOOL includeNormals = IsPerVertexNormalMode(_normalMode);
-	
-	// Prepare cache data elements.
-	vertCnt = [NSNumber numberWithUnsignedInt:vertexCount];
-	faceCnt = [NSNumber numberWithUnsignedInt:faceCount];
-	
-	vertData = [_retainedObjects objectForKey:@"vertices"];
-	faceData = [_retainedObjects objectForKey:@"faces"];
-	if (includeNormals)
-	{
-		normData = [_retainedObjects objectForKey:@"normals"];
-		tanData = [_retainedObjects objectForKey:@"tangents"];
-	}
-	
-	if (materialCount != 0)
-	{
-		mtlKeys = [NSArray arrayWithObjects:materialKeys count:materialCount];
-	}
-	else
-	{
-		mtlKeys = [NSArray array];
-	}
-	normMode = [NSNumber numberWithUnsignedChar:_normalMode];
-	
-	// Ensure we have all the required data elements.
-	if (vertCnt == nil ||
-		faceCnt == nil ||
-		vertData == nil ||
-		faceData == nil ||
-		mtlKeys == nil ||
-		normMode == nil)
+	if (_vertices == NULL || _faces == NULL || _displayLists.indexArray == NULL)  return nil;
+	if (includeNormals && (_normals == NULL || _tangents == NULL))  return nil;
+	if (cacheKeyData == nil)  return nil;
+	
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, kMeshCacheMagic, sizeof header.magic);
+	header.endianTag = kMeshCacheEndianTag;
+	header.formatVersion = kMeshCacheFormatVersion;
+	header.vectorSize = sizeof (Vector);
+	header.faceSize = sizeof (OOMeshFace);
+	header.vertexCount = vertexCount;
+	header.faceCount = faceCount;
+	header.vertexArrayCount = _displayLists.count;
+	header.normalMode = _normalMode;
+	header.materialCount = materialCount;
+	
+	// Any value will do as long as it's different each time a file is written.
+	stamp = (uint64_t)([NSDate timeIntervalSinceReferenceDate] * 1000000.0);
+	[sCacheStampLock lock];
+	if (stamp <= sLastStamp)  stamp = sLastStamp + 1;
+	sLastStamp = stamp;
+	[sCacheStampLock unlock];
+	header.stamp = stamp;
+	
+	keyData = [NSMutableData data];
+	for (i = 0; i != materialCount; ++i)
 	{
-		return nil;
+		const char *key = [materialKeys[i] UTF8String];
+		if (key == NULL)  return nil;
+		[keyData appendBytes:key length:strlen(key) + 1];
+		
+		header.triangleRange[i][0] = triangle_range[i].location;
+		header.triangleRange[i][1] = triangle_range[i].length;
 	}
 	
+	data = [NSMutableData dataWithLength:sizeof header];
+	AppendMeshCacheSection(data, &header, kMeshCacheVertices, _vertices, sizeof *_vertices * vertexCount);
 	if (includeNormals)
 	{
-		if (normData == nil || tanData == nil)  return nil;
-	}
-	
-	// All OK; stick 'em in a dictionary.
-	return [NSDictionary dictionaryWithObjectsAndKeys:
-						vertCnt, @"vertex count",
-						vertData, @"vertex data",
-						faceCnt, @"face count",
-						faceData, @"face data",
-						mtlKeys, @"material keys",
-						normMode, @"normal mode",
-						/*	NOTE: order matters. Since normData and tanData
-							are last, if they're nil the dictionary will be
-							built without them, which is desired behaviour.
-						*/
-						normData, @"normal data",
-						tanData, @"tangent data",
-						nil];
+		AppendMeshCacheSection(data, &header, kMeshCacheNormals, _normals, sizeof *_normals * vertexCount);
+		AppendMeshCacheSection(data, &header, kMeshCacheTangents, _tangents, sizeof *_tangents * vertexCount);
+	}
+	AppendMeshCacheSection(data, &header, kMeshCacheFaces, _faces, sizeof *_faces * faceCount);
+	AppendMeshCacheSection(data, &header, kMeshCacheIndexArray, _displayLists.indexArray, sizeof *_displayLists.indexArray * _displayLists.count);
+	AppendMeshCacheSection(data, &header, kMeshCacheTextureUVArray, _displayLists.textureUVArray, sizeof *_displayLists.textureUVArray * 2 * _displayLists.count);
+	AppendMeshCacheSection(data, &header, kMeshCacheVertexArray, _displayLists.vertexArray, sizeof *_displayLists.vertexArray * _displayLists.count);
+	AppendMeshCacheSection(data, &header, kMeshCacheNormalArray, _displayLists.normalArray, sizeof *_displayLists.normalArray * _displayLists.count);
+	AppendMeshCacheSection(data, &header, kMeshCacheTangentArray, _displayLists.tangentArray, sizeof *_displayLists.tangentArray * _displayLists.count);
+	AppendMeshCacheSection(data, &header, kMeshCacheMaterialKeys, [keyData bytes], [keyData length]);
+	AppendMeshCacheSection(data, &header, kMeshCacheKey, [cacheKeyData bytes], [cacheKeyData length]);
+	
+	[data replaceBytesInRange:NSMakeRange(0, sizeof header) withBytes:&header];
+	return data;
 	
 	OOJS_PROFILE_EXIT
 }
 
 
-- (BOOL)setModelFromModelData:(NSDictionary *)dict name:(NSString *)fileName
+- (BOOL) setModelFromCacheData:(NSData *)data name:(NSString *)fileName
 {
 	OOJS_PROFILE_ENTER
 	
-	NSData				*vertData = nil,
-						*normData = nil,
-						*tanData = nil,
-						*faceData = nil;
-	NSArray				*mtlKeys = nil;
-	NSString			*key = nil;
-	unsigned			i;
-	
-	if (dict == nil || ![dict isKindOfClass:[NSDictionary class]])  return NO;
-	
-	vertexCount = [dict oo_unsignedIntForKey:@"vertex count"];
-	faceCount = [dict oo_unsignedIntForKey:@"face count"];
-	
-	if (vertexCount == 0 || faceCount == 0)  return NO;
-	
-	// Read data elements from dictionary.
-	vertData = [dict oo_dataForKey:@"vertex data"];
-	faceData = [dict oo_dataForKey:@"face data"];
+	const OOMeshCacheHeader	*header = NULL;
+	NSString				*keys[kOOMeshMaxMaterials] = { nil };
+	unsigned				i;
+	BOOL					OK = YES;
 	
-	mtlKeys = [dict oo_arrayForKey:@"material keys"];
-	_normalMode = [dict oo_unsignedCharForKey:@"normal mode"];
-	BOOL includeNormals = IsPerVertexNormalMode(_normalMode);
+	if ([data length] < sizeof *header)  return NO;
+	header = [data bytes];
 	
-	// Ensure we have all the required data elements.
-	if (vertData == nil ||
-		faceData == nil ||
-		mtlKeys == nil)
+	if (memcmp(header->magic, kMeshCacheMagic, sizeof header->magic) != 0 ||
+		header->endianTag != kMeshCacheEndianTag ||
+		header->formatVersion != kMeshCacheFormatVersion ||
+		header->vectorSize != sizeof (Vector) ||
+		header->faceSize != sizeof (OOMeshFace))
 	{
-		OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
+		OOLog(@"mesh.load.error.badCacheData", @"Ignoring cache data for mesh \"%@\" in an unsupported format.", fileName);
 		return NO;
 	}
 	
-	if (includeNormals)
+	OOMeshNormalMode normalMode = header->normalMode;
+	BOOL includeNormals = IsPerVertexNormalMode(normalMode);
+	OOMeshVertexCount vCount = header->vertexCount;
+	OOMeshFaceCount fCount = header->faceCount;
+	GLuint aCount = header->vertexArrayCount;
+	OOMeshMaterialCount mCount = header->materialCount;
+	
+	if (normalMode > kNormalModeExplicit || vCount == 0 || fCount == 0 || aCount > fCount * 3 || mCount > kOOMeshMaxMaterials)  OK = NO;
+	
+	const void *vertices = NULL, *normals = NULL, *tangents = NULL, *faces = NULL;
+	const void *indexArray = NULL, *textureUVArray = NULL, *vertexArray = NULL, *normalArray = NULL, *tangentArray = NULL;
+	const char *keyBytes = NULL;
+	size_t keyLength = 0;
+	if (OK)
 	{
-		normData = [dict oo_dataForKey:@"normal data"];
-		tanData = [dict oo_dataForKey:@"tangent data"];
-		if (normData == nil || tanData == nil)
+		vertices = GetMeshCacheSection(data, header, kMeshCacheVertices, sizeof (Vector) * vCount);
+		faces = GetMeshCacheSection(data, header, kMeshCacheFaces, sizeof (OOMeshFace) * fCount);
+		indexArray = GetMeshCacheSection(data, header, kMeshCacheIndexArray, sizeof (GLint) * aCount);
+		textureUVArray = GetMeshCacheSection(data, header, kMeshCacheTextureUVArray, sizeof (GLfloat) * 2 * aCount);
+		vertexArray = GetMeshCacheSection(data, header, kMeshCacheVertexArray, sizeof (Vector) * aCount);
+		normalArray = GetMeshCacheSection(data, header, kMeshCacheNormalArray, sizeof (Vector) * aCount);
+		tangentArray = GetMeshCacheSection(data, header, kMeshCacheTangentArray, sizeof (Vector) * aCount);
+		
+		OK = vertices != NULL && faces != NULL && indexArray != NULL && textureUVArray != NULL && vertexArray != NULL && normalArray != NULL && tangentArray != NULL;
+		if (OK && includeNormals)
 		{
-			OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad normal/tangent cache data for mesh \"%@\".", fileName);
-			return NO;
+			normals = GetMeshCacheSection(data, header, kMeshCacheNormals, sizeof (Vector) * vCount);
+			tangents = GetMeshCacheSection(data, header, kMeshCacheTangents, sizeof (Vector) * vCount);
+			OK = normals != NULL && tangents != NULL;
 		}
+		
+		keyLength = header->sectionLength[kMeshCacheMaterialKeys];
+		keyBytes = GetMeshCacheSection(data, header, kMeshCacheMaterialKeys, keyLength);
+		if (keyBytes == NULL && keyLength != 0)  OK = NO;
 	}
 	
-	// Ensure data objects are of correct size.
-	if ([vertData length] != sizeof *_vertices * vertexCount)  return NO;
-	if ([faceData length] != sizeof *_faces * faceCount)  return NO;
-	if (includeNormals)
+	// Material keys and the triangle ranges which use them.
+	for (i = 0; OK && i != mCount; ++i)
 	{
-		if ([normData length] != sizeof *_normals * vertexCount)  return NO;
-		if ([tanData length] != sizeof *_tangents * vertexCount)  return NO;
+		const char *end = memchr(keyBytes, '\0', keyLength);
+		if (end == NULL)  OK = NO;
+		else
+		{
+			keys[i] = [NSString stringWithUTF8String:keyBytes];
+			keyLength -= end + 1 - keyBytes;
+			keyBytes = end + 1;
+			
+			uint32_t location = header->triangleRange[i][0], length = header->triangleRange[i][1];
+			if (keys[i] == nil || location > aCount || length > aCount - location)  OK = NO;
+		}
 	}
 	
-	// Retain data.
-	_vertices = (Vector *)[vertData bytes];
-	[self setRetainedObject:vertData forKey:@"vertices"];
-	_faces = (OOMeshFace *)[faceData bytes];
-	[self setRetainedObject:faceData forKey:@"faces"];
-	if (includeNormals)
-	{
-		_normals = (Vector *)[normData bytes];
-		[self setRetainedObject:normData forKey:@"normals"];
-		_tangents = (Vector *)[tanData bytes];
-		[self setRetainedObject:tanData forKey:@"tangents"];
-	}
-	else
+	if (!OK)
 	{
-		_normals = NULL;
-		_tangents = NULL;
+		OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
+		return NO;
 	}
 	
-	// Copy material keys.
-	materialCount = [mtlKeys count];
+	// Everything checks out; use the data in place.
+	[self setRetainedObject:data forKey:@"cacheData"];
+	
+	_normalMode = normalMode;
+	vertexCount = vCount;
+	faceCount = fCount;
+	_vertices = (Vector *)vertices;
+	_normals = (Vector *)normals;
+	_tangents = (Vector *)tangents;
+	_faces = (OOMeshFace *)faces;
+	
+	_displayLists.indexArray = (GLint *)indexArray;
+	_displayLists.textureUVArray = (GLfloat *)textureUVArray;
+	_displayLists.vertexArray = (Vector *)vertexArray;
+	_displayLists.normalArray = (Vector *)normalArray;
+	_displayLists.tangentArray = (Vector *)tangentArray;
+	_displayLists.count = aCount;
+	
+	materialCount = mCount;
 	for (i = 0; i != materialCount; ++i)
 	{
-		key = [mtlKeys oo_stringAtIndex:i];
-		if (key != nil)  materialKeys[i] = [key copy];
-		else
-		{
-			OOLog(@"mesh.load.error.badCacheData", @"Ignoring bad cache data for mesh \"%@\".", fileName);
-			return NO;
-		}
+		materialKeys[i] = [keys[i] copy];
+		triangle_range[i] = NSMakeRange(header->triangleRange[i][0], header->triangleRange[i][1]);
 	}
 	
 	return YES;
@@ -1102,20 +1321,15 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 {
 	OOJS_PROFILE_ENTER
 	
-	NSScanner			*scanner;
-	NSDictionary		*cacheData = nil;
-	BOOL				failFlag = NO;
-	NSString			*failString = @"***** ";
-	unsigned			i, j;
-	NSMutableDictionary	*texFileName2Idx = nil;
+	NSData				*cacheData = nil;
 	NSString			*cacheKey = nil;
 	BOOL				using_preloaded = NO;
 	
-	cacheKey = [NSString stringWithFormat:@"%@:%u", filename, _normalMode];
+	cacheKey = MeshCacheKey(filename, _normalMode);
 	cacheData = [OOCacheManager meshDataForName:cacheKey];
 	if (cacheData != nil)
 	{
-		if ([self setModelFromModelData:cacheData name:filename])
+		if ([self setModelFromCacheData:cacheData name:filename])
 		{
 			using_preloaded = YES;
 			PROFILE(@"loaded from cache");
@@ -1127,452 +1341,415 @@ shaderBindingTarget:(id<OOWeakReferenceSupport>)target
 	{
 		OOLog(@"mesh.load.uncached", @"Mesh \"%@\" is not in cache, loading.", filename);
 		
-		NSCharacterSet	*whitespaceCharSet = [NSCharacterSet whitespaceCharacterSet];
-		NSCharacterSet	*whitespaceAndNewlineCharSet = [NSCharacterSet whitespaceAndNewlineCharacterSet];
-#if OOLITE_LEOPARD
-		NSCharacterSet	*newlineCharSet = [NSCharacterSet newlineCharacterSet];
-#else
-		static NSCharacterSet *newlineCharSet = nil;
-		if (newlineCharSet == nil)
-		{
-			NSMutableCharacterSet *temp = [[whitespaceAndNewlineCharSet mutableCopy] autorelease];
-			[temp formIntersectionWithCharacterSet:[whitespaceCharSet invertedSet]];
-			newlineCharSet = [temp copy];
-		}
-#endif
-		
-		texFileName2Idx = [NSMutableDictionary dictionary];
+		NSString *path = [ResourceManager pathForFileNamed:filename inFolder:@"Models"];
+		if (![self loadDataFromPath:path name:filename])  return NO;
 		
+		// save the resulting data for possible reuse
+		[OOCacheManager setMeshData:[self cacheDataWithKey:cacheKey] forName:cacheKey];
+		PROFILE(@"saved to cache");
+	}
+	
+	[self calculateBoundingVolumes];
+	PROFILE(@"finished calculateBoundingVolumes");
+	
+	return YES;
+	
+	OOJS_PROFILE_EXIT
+}
+
+
+- (BOOL) loadDataFromPath:(NSString *)path name:(NSString *)filename
+{
+	OOJS_PROFILE_ENTER
+	
+	BOOL				failFlag = NO;
+	NSString			*failString = @"***** ";
+	unsigned			i, j;
+	
+	OODATLexer *lexer = nil;
+	if (path != nil)  lexer = [[[OODATLexer alloc] initWithPath:path] autorelease];
+	if (lexer == nil)
+	{
+		// Model not found
+		OOLog(kOOLogMeshDataNotFound, @"***** ERROR: could not find %@", filename);
+		return NO;
+	}
+	
+	PROFILE(@"finished preprocessing");
+	
+	// get number of vertices
+	if ([lexer readKeyword:"NVERTS"])
+	{
+		int n_v;
+		if ([lexer readInteger:&n_v] && n_v >= 0)
+			vertexCount = n_v;
+		else
 		{
-			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-			NSString *data = [ResourceManager stringFromFilesNamed:filename inFolder:@"Models" cache:NO];
-			if (data == nil)
-			{
-				// Model not found
-				OOLog(kOOLogMeshDataNotFound, @"***** ERROR: could not find %@", filename);
-				return NO;
-			}
-			
-			// strip out comments and commas between values
-			NSMutableArray *lines = [NSMutableArray arrayWithArray:[data componentsSeparatedByString:@"\n"]];
-			for (i = 0; i < [lines count]; i++)
-			{
-				NSString *line = [lines objectAtIndex:i];
-				NSArray *parts;
-				//
-				// comments
-				//
-				parts = [line componentsSeparatedByString:@"#"];
-				line = [parts objectAtIndex:0];
-				parts = [line componentsSeparatedByString:@"//"];
-				line = [parts objectAtIndex:0];
-				//
-				// commas
-				//
-				line = [[line componentsSeparatedByString:@","] componentsJoinedByString:@" "];
-				//
-				[lines replaceObjectAtIndex:i withObject:line];
-			}
-			
-			data = [lines componentsJoinedByString:@"\n"];
-			scanner = [NSScanner scannerWithString:data];
-			
-			[scanner retain];
-			[pool release];
-			[scanner autorelease];
+			failFlag = YES;
+			failString = [NSString stringWithFormat:@"%@Failed to read value of NVERTS at line %u\n", failString, [lexer lineNumber]];
 		}
-		
-		PROFILE(@"finished preprocessing");
-
-		// get number of vertices
-		//
-		[scanner setScanLocation:0];	//reset
-		if ([scanner scanString:@"NVERTS" intoString:NULL])
+	}
+	else
+	{
+		failFlag = YES;
+		failString = [NSString stringWithFormat:@"%@Failed to read NVERTS at line %u\n", failString, [lexer lineNumber]];
+	}
+	
+	if (![self allocateVertexBuffersWithCount:vertexCount])
+	{
+		OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
+		return NO;
+	}
+	
+	// get number of faces
+	if ([lexer readKeyword:"NFACES"])
+	{
+		int n_f;
+		if ([lexer readInteger:&n_f] && n_f >= 0)
 		{
-			int n_v;
-			if ([scanner scanInt:&n_v])
-				vertexCount = n_v;
-			else
-			{
-				failFlag = YES;
-				failString = [NSString stringWithFormat:@"%@Failed to read value of NVERTS\n",failString];
-			}
+			faceCount = n_f;
 		}
 		else
 		{
 			failFlag = YES;
-			failString = [NSString stringWithFormat:@"%@Failed to read NVERTS\n",failString];
+			failString = [NSString stringWithFormat:@"%@Failed to read value of NFACES at line %u\n", failString, [lexer lineNumber]];
 		}
-		
-		if (![self allocateVertexBuffersWithCount:vertexCount])
+	}
+	else
+	{
+		failFlag = YES;
+		failString = [NSString stringWithFormat:@"%@Failed to read NFACES at line %u\n", failString, [lexer lineNumber]];
+	}
+	
+	// Allocate face->vertex table.
+	size_t faceRefSize = sizeof (VertexFaceRef) * vertexCount;
+	VertexFaceRef *faceRefs = calloc(1, faceRefSize);
+	if (faceRefs != NULL)
+	{
+		// use an NSData to effectively autorelease it.
+		NSData *faceRefHolder = [NSData dataWithBytesNoCopy:faceRefs length:faceRefSize freeWhenDone:YES];
+		if (faceRefHolder == nil)
 		{
-			OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
-			return NO;
+			free(faceRefs);
+			faceRefs = NULL;
 		}
-		
-		// get number of faces
-		if ([scanner scanString:@"NFACES" intoString:NULL])
+	}
+	
+	if (faceRefs == NULL || ![self allocateFaceBuffersWithCount:faceCount])
+	{
+		OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices, %u faces).", filename, vertexCount, faceCount);
+		return NO;
+	}
+	
+	// get vertex data
+	if ([lexer readKeyword:"VERTEX"])
+	{
+		for (j = 0; j < vertexCount && !failFlag; j++)
 		{
-			int n_f;
-			if ([scanner scanInt:&n_f])
+			float x, y, z;
+			if ([lexer readReal:&x] && [lexer readReal:&y] && [lexer readReal:&z])
 			{
-				faceCount = n_f;
+				_vertices[j] = make_vector(x, y, z);
 			}
 			else
 			{
 				failFlag = YES;
-				failString = [NSString stringWithFormat:@"%@Failed to read value of NFACES\n",failString];
+				failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@ at line %u\n", failString, j, @"VERTEX", [lexer lineNumber]];
 			}
 		}
-		else
-		{
-			failFlag = YES;
-			failString = [NSString stringWithFormat:@"%@Failed to read NFACES\n",failString];
-		}
-		
-		// Allocate face->vertex table.
-		size_t faceRefSize = sizeof (VertexFaceRef) * vertexCount;
-		VertexFaceRef *faceRefs = calloc(1, faceRefSize);
-		if (faceRefs != NULL)
+	}
+	else
+	{
+		failFlag = YES;
+		failString = [NSString stringWithFormat:@"%@Failed to find VERTEX data at line %u\n", failString, [lexer lineNumber]];
+	}
+	
+	// get face data
+	if ([lexer readKeyword:"FACES"])
+	{
+		for (j = 0; j < faceCount && !failFlag; j++)
 		{
-			// use an NSData to effectively autorelease it.
-			NSData *faceRefHolder = [NSData dataWithBytesNoCopy:faceRefs length:faceRefSize freeWhenDone:YES];
-			if (faceRefHolder == nil)
+			int r, g, b;
+			float nx, ny, nz;
+			int n_v;
+			
+			// colors
+			if ([lexer readInteger:&r] && [lexer readInteger:&g] && [lexer readInteger:&b])
 			{
-				free(faceRefs);
-				faceRefs = NULL;
+				_faces[j].smoothGroup = r;
 			}
-		}
-		
-		if (faceRefs == NULL || ![self allocateFaceBuffersWithCount:faceCount])
-		{
-			OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices, %u faces).", filename, vertexCount, faceCount);
-			return NO;
-		}
-		
-		// get vertex data
-		if ([scanner scanString:@"VERTEX" intoString:NULL])
-		{
-			for (j = 0; j < vertexCount; j++)
+			else
 			{
-				float x, y, z;
-				if (!failFlag)
-				{
-					if (![scanner scanFloat:&x])  failFlag = YES;
-					if (![scanner scanFloat:&y])  failFlag = YES;
-					if (![scanner scanFloat:&z])  failFlag = YES;
-					if (!failFlag)
-					{
-						_vertices[j] = make_vector(x, y, z);
-					}
-					else
-					{
-						failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@\n", failString, j, @"VERTEX"];
-					}
-				}
+				failFlag = YES;
+				failString = [NSString stringWithFormat:@"%@Failed to read a color for face[%d] in FACES at line %u\n", failString, j, [lexer lineNumber]];
+				break;
 			}
-		}
-		else
-		{
-			failFlag = YES;
-			failString = [NSString stringWithFormat:@"%@Failed to find VERTEX data\n",failString];
-		}
-
-		// get face data
-		if ([scanner scanString:@"FACES" intoString:NULL])
-		{
-			for (j = 0; j < faceCount; j++)
+			
+			// normal
+			if ([lexer readReal:&nx] && [lexer readReal:&ny] && [lexer readReal:&nz])
 			{
-				int r, g, b;
-				float nx, ny, nz;
-				int n_v;
-				if (!failFlag)
-				{
-					// colors
-					if (![scanner scanInt:&r])  failFlag = YES;
-					if (![scanner scanInt:&g])  failFlag = YES;
-					if (![scanner scanInt:&b])  failFlag = YES;
-					if (!failFlag)
-					{
-						_faces[j].smoothGroup = r;
-					}
-					else
-					{
-						failString = [NSString stringWithFormat:@"%@Failed to read a color for face[%d] in FACES\n", failString, j];
-					}
-					
-					// normal
-					if (![scanner scanFloat:&nx])  failFlag = YES;
-					if (![scanner scanFloat:&ny])  failFlag = YES;
-					if (![scanner scanFloat:&nz])  failFlag = YES;
-					if (!failFlag)
-					{
-						_faces[j].normal = vector_normal(make_vector(nx, ny, nz));
-					}
-					else
-					{
-						failString = [NSString stringWithFormat:@"%@Failed to read a normal for face[%d] in FACES\n", failString, j];
-					}
-					
-					// vertices
-					if ([scanner scanInt:&n_v])
-					{
-						if (n_v < 3)
-						{
-							failFlag = YES;
-							failString = [NSString stringWithFormat:@"%@Face[%u] has fewer than three vertices.\n", failString];
-						}
-						else if (n_v > 3)
-						{
-							OOLogWARN(@"mesh.load.warning.nonTriangular", @"Face[%u] of %@ has %u vertices specified. Only the first three will be used.", baseFile, n_v);
-							n_v = 3;
-						}
-					}
-					else
-					{
-						failFlag = YES;
-						failString = [NSString stringWithFormat:@"%@Failed to read number of vertices for face[%d] in FACES\n", failString, j];
-					}
-					
-					if (!failFlag)
-					{
-						int vi;
-						for (i = 0; (int)i < n_v; i++)
-						{
-							if ([scanner scanInt:&vi])
-							{
-								_faces[j].vertex[i] = vi;
-								if (faceRefs != NULL)  VFRAddFace(&faceRefs[vi], j);
-							}
-							else
-							{
-								failFlag = YES;
-								failString = [NSString stringWithFormat:@"%@Failed to read vertex[%d] for face[%d] in FACES\n", failString, i, j];
-							}
-						}
-					}
-				}
+				_faces[j].normal = vector_normal(make_vector(nx, ny, nz));
 			}
-		}
-		else
-		{
-			failFlag = YES;
-			failString = [NSString stringWithFormat:@"%@Failed to find FACES data\n",failString];
-		}
-
-		// Get textures data.
-		if ([scanner scanString:@"TEXTURES" intoString:NULL])
-		{
-			for (j = 0; j < faceCount; j++)
+			else
 			{
-				NSString	*materialKey;
-				float	max_x, max_y;
-				float	s, t;
-				if (!failFlag)
-				{
-					// materialKey
-					//
-					[scanner scanCharactersFromSet:whitespaceAndNewlineCharSet intoString:NULL];
-					if (![scanner scanUpToCharactersFromSet:whitespaceCharSet intoString:&materialKey])
-					{
-						failFlag = YES;
-						failString = [NSString stringWithFormat:@"%@Failed to read texture filename for face[%d] in TEXTURES\n", failString, j];
-					}
-					else
-					{
-						NSNumber *index = [texFileName2Idx objectForKey:materialKey];
-						if (index != nil)
-						{
-							_faces[j].materialIndex = [index unsignedIntValue];
-						}
-						else
-						{
-							if (materialCount == kOOMeshMaxMaterials)
-							{
-								OOLog(kOOLogMeshTooManyMaterials, @"***** ERROR: model %@ has too many materials (maximum is %d)", filename, kOOMeshMaxMaterials);
-								return NO;
-							}
-							_faces[j].materialIndex = materialCount;
-							materialKeys[materialCount] = [materialKey retain];
-							index = [NSNumber numberWithUnsignedInt:materialCount];
-							[texFileName2Idx setObject:index forKey:materialKey];
-							++materialCount;
-						}
-					}
-
-					// texture size
-					//
-				   if (!failFlag)
-					{
-						if (![scanner scanFloat:&max_x])  failFlag = YES;
-						if (![scanner scanFloat:&max_y])  failFlag = YES;
-						if (failFlag)
-							failString = [NSString stringWithFormat:@"%@Failed to read texture size for max_x and max_y in face[%d] in TEXTURES\n", failString, j];
-					}
-
-					// vertices
-					//
-					if (!failFlag)
-					{
-						for (i = 0; i < 3; i++)
-						{
-							if (![scanner scanFloat:&s])  failFlag = YES;
-							if (![scanner scanFloat:&t])  failFlag = YES;
-							if (!failFlag)
-							{
-								_faces[j].s[i] = s / max_x;
-								_faces[j].t[i] = t / max_y;
-							}
-							else
-								failString = [NSString stringWithFormat:@"%@Failed to read s t coordinates for vertex[%d] in face[%d] in TEXTURES\n", failString, i, j];
-						}
-					}
-				}
+				failFlag = YES;
+				failString = [NSString stringWithFormat:@"%@Failed to read a normal for face[%d] in FACES at line %u\n", failString, j, [lexer lineNumber]];
+				break;
 			}
-		}
-		else
-		{
-			failFlag = YES;
-			failString = [failString stringByAppendingString:@"Failed to find TEXTURES data (will use placeholder material)\n"];
-			materialKeys[0] = @"_oo_placeholder_material";
-			materialCount = 1;
 			
-			for (j = 0; j < faceCount; j++)
+			// vertices
+			if ([lexer readInteger:&n_v])
 			{
-				_faces[j].materialIndex = 0;
+				if (n_v < 3)
+				{
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Face[%u] has fewer than three vertices at line %u\n", failString, j, [lexer lineNumber]];
+					break;
+				}
+				else if (n_v > 3)
+				{
+					OOLogWARN(@"mesh.load.warning.nonTriangular", @"Face[%u] of %@ has %u vertices specified at line %u. Only the first three will be used.", j, baseFile, n_v, [lexer lineNumber]);
+				}
 			}
-		}
-		
-		if ([scanner scanString:@"NAMES" intoString:NULL])
-		{
-			unsigned int count;
-			if (![scanner scanInt:(int *)&count])
-			{	
+			else
+			{
 				failFlag = YES;
-				failString = [failString stringByAppendingString:@"Expected count after NAMES\n"];
+				failString = [NSString stringWithFormat:@"%@Failed to read number of vertices for face[%d] in FACES at line %u\n", failString, j, [lexer lineNumber]];
+				break;
 			}
-			else
+			
+			int vi;
+			for (i = 0; (int)i < n_v; i++)
 			{
-				for (j = 0; j < count; j++)
+				if (![lexer readInteger:&vi])
 				{
-					NSString *name = nil;
-					[scanner scanCharactersFromSet:whitespaceAndNewlineCharSet intoString:NULL];
-					if (![scanner scanUpToCharactersFromSet:newlineCharSet intoString:&name])
-					{
-						failFlag = YES;
-						failString = [failString stringByAppendingString:@"Expected file name\n"];
-					}
-					else
-					{
-						[self renameTexturesFrom:[NSString stringWithFormat:@"%u", j] to:name];
-					}
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Failed to read vertex[%d] for face[%d] in FACES at line %u\n", failString, i, j, [lexer lineNumber]];
+					break;
+				}
+				if (vi < 0 || (unsigned)vi >= vertexCount)
+				{
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Vertex[%d] for face[%d] in FACES at line %u is out of range (%d)\n", failString, i, j, [lexer lineNumber], vi];
+					break;
+				}
+				if (i < 3)
+				{
+					_faces[j].vertex[i] = vi;
+					VFRAddFace(&faceRefs[vi], j);
 				}
 			}
 		}
+	}
+	else
+	{
+		failFlag = YES;
+		failString = [NSString stringWithFormat:@"%@Failed to find FACES data at line %u\n", failString, [lexer lineNumber]];
+	}
+	
+	// Get textures data.
+	if ([lexer readKeyword:"TEXTURES"])
+	{
+		// Material keys are compared in place in the file buffer, and only turned into strings once each.
+		const char			*keyBytes[kOOMeshMaxMaterials];
+		size_t				keyLengths[kOOMeshMaxMaterials];
+		OOMeshMaterialIndex	lastIndex = 0;
 		
-		BOOL explicitTangents = NO;
-		
-		// Get explicit normals.
-		if ([scanner scanString:@"NORMALS" intoString:NULL])
+		for (j = 0; j < faceCount && !failFlag; j++)
 		{
-			_normalMode = kNormalModeExplicit;
-			if (![self allocateNormalBuffersWithCount:vertexCount])
+			const char	*materialKey = NULL;
+			size_t		materialKeyLength = 0;
+			float		max_x, max_y;
+			float		s, t;
+			
+			// materialKey
+			if (![lexer readToken:&materialKey length:&materialKeyLength])
 			{
-				OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
-				return NO;
+				failFlag = YES;
+				failString = [NSString stringWithFormat:@"%@Failed to read texture filename for face[%d] in TEXTURES at line %u\n", failString, j, [lexer lineNumber]];
+				break;
 			}
 			
-			for (j = 0; j < vertexCount; j++)
+			if (materialCount == 0 || keyLengths[lastIndex] != materialKeyLength || memcmp(keyBytes[lastIndex], materialKey, materialKeyLength) != 0)
 			{
-				float x, y, z;
-				if (!failFlag)
+				for (lastIndex = 0; lastIndex < materialCount; lastIndex++)
 				{
-					if (![scanner scanFloat:&x])  failFlag = YES;
-					if (![scanner scanFloat:&y])  failFlag = YES;
-					if (![scanner scanFloat:&z])  failFlag = YES;
-					if (!failFlag)
+					if (keyLengths[lastIndex] == materialKeyLength && memcmp(keyBytes[lastIndex], materialKey, materialKeyLength) == 0)  break;
+				}
+				
+				if (lastIndex == materialCount)
+				{
+					if (materialCount == kOOMeshMaxMaterials)
 					{
-						_normals[j] = vector_normal(make_vector(x, y, z));
+						OOLog(kOOLogMeshTooManyMaterials, @"***** ERROR: model %@ has too many materials (maximum is %d)", filename, kOOMeshMaxMaterials);
+						return NO;
 					}
-					else
+					
+					NSString *key = [[NSString alloc] initWithBytes:materialKey length:materialKeyLength encoding:NSUTF8StringEncoding];
+					if (key == nil)
 					{
-						failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@\n", failString, j, @"NORMALS"];
+						failFlag = YES;
+						failString = [NSString stringWithFormat:@"%@Texture filename for face[%d] in TEXTURES at line %u is not valid UTF-8\n", failString, j, [lexer lineNumber]];
+						break;
 					}
+					keyBytes[materialCount] = materialKey;
+					keyLengths[materialCount] = materialKeyLength;
+					materialKeys[materialCount] = key;
+					++materialCount;
 				}
 			}
+			_faces[j].materialIndex = lastIndex;
+			
+			// texture size
+			if (![lexer readReal:&max_x] || ![lexer readReal:&max_y])
+			{
+				failFlag = YES;
+				failString = [NSString stringWithFormat:@"%@Failed to read texture size for max_x and max_y in face[%d] in TEXTURES at line %u\n", failString, j, [lexer lineNumber]];
+				break;
+			}
 			
-			// Get explicit tangents (only together with vertices).
-			if ([scanner scanString:@"TANGENTS" intoString:NULL])
+			// vertices
+			for (i = 0; i < 3; i++)
 			{
-				for (j = 0; j < vertexCount; j++)
+				if ([lexer readReal:&s] && [lexer readReal:&t])
 				{
-					float x, y, z;
-					if (!failFlag)
-					{
-						if (![scanner scanFloat:&x])  failFlag = YES;
-						if (![scanner scanFloat:&y])  failFlag = YES;
-						if (![scanner scanFloat:&z])  failFlag = YES;
-						if (!failFlag)
-						{
-							_tangents[j] = vector_normal(make_vector(x, y, z));
-						}
-						else
-						{
-							failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@\n", failString, j, @"TANGENTS"];
-						}
-					}
+					_faces[j].s[i] = s / max_x;
+					_faces[j].t[i] = t / max_y;
+				}
+				else
+				{
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Failed to read s t coordinates for vertex[%d] in face[%d] in TEXTURES at line %u\n", failString, i, j, [lexer lineNumber]];
+					break;
 				}
 			}
 		}
+	}
+	else
+	{
+		failFlag = YES;
+		failString = [failString stringByAppendingString:@"Failed to find TEXTURES data (will use placeholder material)\n"];
+		materialKeys[0] = @"_oo_placeholder_material";
+		materialCount = 1;
 		
-		PROFILE(@"finished parsing");
-		
-		if (IsLegacyNormalMode(_normalMode))
+		for (j = 0; j < faceCount; j++)
 		{
-			[self checkNormalsAndAdjustWinding];
-			PROFILE(@"finished checkNormalsAndAdjustWinding");
+			_faces[j].materialIndex = 0;
 		}
-		if (!explicitTangents)
+	}
+	
+	if ([lexer readKeyword:"NAMES"])
+	{
+		int count;
+		if (![lexer readInteger:&count] || count < 0)
 		{
-			[self generateFaceTangents];
-			PROFILE(@"finished generateFaceTangents");
+			failFlag = YES;
+			failString = [NSString stringWithFormat:@"%@Expected count after NAMES at line %u\n", failString, [lexer lineNumber]];
 		}
-		
-		// check for smooth shading and recalculate normals
-		if (_normalMode == kNormalModeSmooth)
+		else
 		{
-			if (![self allocateNormalBuffersWithCount:vertexCount])
+			for (j = 0; j < (unsigned)count; j++)
 			{
-				OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
-				return NO;
+				NSString *name = nil;
+				if (![lexer readLine:&name])
+				{
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Expected file name at line %u\n", failString, [lexer lineNumber]];
+					break;
+				}
+				else
+				{
+					[self renameTexturesFrom:[NSString stringWithFormat:@"%u", j] to:name];
+				}
 			}
-			[self calculateVertexNormalsAndTangentsWithFaceRefs:faceRefs];
-			PROFILE(@"finished calculateVertexNormalsAndTangents");
-			
 		}
-		else if (IsPerVertexNormalMode(_normalMode) && !explicitTangents)
+	}
+	
+	BOOL explicitTangents = NO;
+	
+	// Get explicit normals.
+	if ([lexer readKeyword:"NORMALS"])
+	{
+		_normalMode = kNormalModeExplicit;
+		if (![self allocateNormalBuffersWithCount:vertexCount])
 		{
-			[self calculateVertexTangentsWithFaceRefs:faceRefs];
-			PROFILE(@"finished calculateVertexTangents");
+			OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
+			return NO;
 		}
 		
-		// save the resulting data for possible reuse
-		[OOCacheManager setMeshData:[self modelData] forName:cacheKey];
-		PROFILE(@"saved to cache");
+		for (j = 0; j < vertexCount && !failFlag; j++)
+		{
+			float x, y, z;
+			if ([lexer readReal:&x] && [lexer readReal:&y] && [lexer readReal:&z])
+			{
+				_normals[j] = vector_normal(make_vector(x, y, z));
+			}
+			else
+			{
+				failFlag = YES;
+				failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@ at line %u\n", failString, j, @"NORMALS", [lexer lineNumber]];
+			}
+		}
 		
-		if (failFlag)
+		// Get explicit tangents (only together with vertices).
+		if ([lexer readKeyword:"TANGENTS"])
 		{
-			OOLog(@"mesh.error", @"%@ ..... from %@ %@", failString, filename, (using_preloaded)? @"(from preloaded data)" :@"(from file)");
+			for (j = 0; j < vertexCount && !failFlag; j++)
+			{
+				float x, y, z;
+				if ([lexer readReal:&x] && [lexer readReal:&y] && [lexer readReal:&z])
+				{
+					_tangents[j] = vector_normal(make_vector(x, y, z));
+				}
+				else
+				{
+					failFlag = YES;
+					failString = [NSString stringWithFormat:@"%@Failed to read a value for vertex[%d] in %@ at line %u\n", failString, j, @"TANGENTS", [lexer lineNumber]];
+				}
+			}
 		}
 	}
 	
-	[self calculateBoundingVolumes];
-	PROFILE(@"finished calculateBoundingVolumes");
+	PROFILE(@"finished parsing");
+	
+	if (IsLegacyNormalMode(_normalMode))
+	{
+		[self checkNormalsAndAdjustWinding];
+		PROFILE(@"finished checkNormalsAndAdjustWinding");
+	}
+	if (!explicitTangents)
+	{
+		[self generateFaceTangents];
+		PROFILE(@"finished generateFaceTangents");
+	}
+	
+	// check for smooth shading and recalculate normals
+	if (_normalMode == kNormalModeSmooth)
+	{
+		if (![self allocateNormalBuffersWithCount:vertexCount])
+		{
+			OOLog(kOOLogAllocationFailure, @"***** ERROR: failed to allocate memory for model %@ (%u vertices).", filename, vertexCount);
+			return NO;
+		}
+		[self calculateVertexNormalsAndTangentsWithFaceRefs:faceRefs];
+		PROFILE(@"finished calculateVertexNormalsAndTangents");
+		
+	}
+	else if (IsPerVertexNormalMode(_normalMode) && !explicitTangents)
+	{
+		[self calculateVertexTangentsWithFaceRefs:faceRefs];
+		PROFILE(@"finished calculateVertexTangents");
+	}
 	
 	// set up vertex arrays for drawing
 	if (![self setUpVertexArrays])  return NO;
 	PROFILE(@"finished setUpVertexArrays");
 	
+	if (failFlag)
+	{
+		OOLog(@"mesh.error", @"%@ ..... from %@ (from file)", failString, filename);
+	}
+	
 	return YES;
 	
 	OOJS_PROFILE_EXIT
@@ -1965,6 +2142,19 @@ static float FaceAreaCorrect(GLuint *vertIndices, Vector *vertices)
 	OOMeshVertexCount	i;
 	Vector				*vertex = NULL;
 	
+	/*	The vertex buffers may belong to the mesh this was copied from, or be
+		mapped read-only from the mesh cache, so work on private copies.
+	*/
+	NSMutableDictionary *retainedObjects = [_retainedObjects mutableCopy];
+	[_retainedObjects release];
+	_retainedObjects = retainedObjects;
+	_vertices = [self copyOfBytes:_vertices size:sizeof *_vertices count:vertexCount key:@"vertices"];
+	_displayLists.vertexArray = [self copyOfBytes:_displayLists.vertexArray size:sizeof *_displayLists.vertexArray count:_displayLists.count key:@"vertexArray"];
+	if (_vertices == NULL || _displayLists.vertexArray == NULL)
+	{
+		[NSException raise:NSMallocException format:@"Failed to allocate memory to rescale mesh %@.", self];
+	}
+	
 	for (i = 0; i != vertexCount; ++i)
 	{
 		vertex = &_vertices[i];
@@ -2088,6 +2278,17 @@ static void Scribble(void *bytes, size_t size)
 }
 
 
+- (void *) copyOfBytes:(const void *)bytes size:(size_t)size count:(OOUInteger)count key:(NSString *)key
+{
+	// Keep the old buffer alive until the copy is made, even if it's the one being replaced.
+	[[[_retainedObjects objectForKey:key] retain] autorelease];
+	
+	void *result = [self allocateBytesWithSize:size count:count key:key];
+	if (result != NULL && bytes != NULL)  memcpy(result, bytes, size * count);
+	return result;
+}
+
+
 - (BOOL) allocateVertexBuffersWithCount:(OOUInteger)count
 {
 	_vertices = [self allocateBytesWithSize:sizeof *_vertices count:vertexCount key:@"vertices"];
@@ -2146,28 +2347,87 @@ static void Scribble(void *bytes, size_t size)
 @end
 
 
-static NSString * const kOOCacheMeshes = @"OOMesh";
+static void AppendMeshCacheSection(NSMutableData *data, OOMeshCacheHeader *header, unsigned section, const void *bytes, size_t length)
+{
+	OOUInteger offset = ([data length] + kMeshCacheAlignment - 1) & ~(OOUInteger)(kMeshCacheAlignment - 1);
+	[data setLength:offset];
+	if (length != 0)  [data appendBytes:bytes length:length];
+	
+	header->sectionOffset[section] = offset;
+	header->sectionLength[section] = length;
+}
+
+
+static const void *GetMeshCacheSection(NSData *data, const OOMeshCacheHeader *header, unsigned section, size_t expectedLength)
+{
+	size_t offset = header->sectionOffset[section];
+	size_t length = header->sectionLength[section];
+	
+	if (length != expectedLength || offset % kMeshCacheAlignment != 0)  return NULL;
+	if (offset < sizeof *header || offset > [data length] || length > [data length] - offset)  return NULL;
+	
+	return (const char *)[data bytes] + offset;
+}
+
+
+/*	The mapped cache file for a cache key, if it was written for the current
+	OOMesh data cache entry for the key.
+*/
+static NSData *MappedMeshCacheFile(NSString *cacheKey)
+{
+	NSDictionary *record = [[OOCacheManager sharedCache] objectForKey:cacheKey inCache:kOOCacheMeshes];
+	if (record == nil)  return nil;
+	
+	NSData *data = [sMeshFileCache mappedEntryForKey:cacheKey];
+	if ([data length] < sizeof (OOMeshCacheHeader))  return nil;
+	const OOMeshCacheHeader *header = [data bytes];
+	
+	// A file left over from before the data cache entry was last dropped.
+	if (header->stamp != [record oo_unsignedLongLongForKey:@"stamp"])  return nil;
+	
+	// The file may belong to another key with the same hash.
+	NSData *keyData = [cacheKey dataUsingEncoding:NSUTF8StringEncoding];
+	const void *keyBytes = GetMeshCacheSection(data, header, kMeshCacheKey, [keyData length]);
+	if (keyBytes == NULL || memcmp(keyBytes, [keyData bytes], [keyData length]) != 0)  return nil;
+	
+	return data;
+}
+
 
 @implementation OOCacheManager (OOMesh)
 
-+ (NSDictionary *)meshDataForName:(NSString *)inShipName
++ (NSData *)meshDataForName:(NSString *)inShipName
 {
-	return [[self sharedCache] objectForKey:inShipName inCache:kOOCacheMeshes];
+	NSData *data = MappedMeshCacheFile(inShipName);
+	if (data != nil)  [sMeshFileCache touchEntryForKey:inShipName];
+	return data;
 }
 
 
-+ (void)setMeshData:(NSDictionary *)inData forName:(NSString *)inShipName
++ (BOOL)hasMeshDataForName:(NSString *)inShipName
 {
-	if (inData != nil && inShipName != nil)
-	{
-		[[self sharedCache] setObject:inData forKey:inShipName inCache:kOOCacheMeshes];
-	}
+	// Mapping the file only reads the header and key.
+	return MappedMeshCacheFile(inShipName) != nil;
+}
+
+
++ (void)setMeshData:(NSData *)inData forName:(NSString *)inShipName
+{
+	OOCacheManager *cache = [self sharedCache];
+	
+	if (sMeshFileCache == nil || inData == nil || inShipName == nil || [inData length] < sizeof (OOMeshCacheHeader) || ![cache allowCacheWrites])  return;
+	
+	[sMeshFileCache storeEntry:inData forKey:inShipName];
+	
+	NSNumber *stamp = [NSNumber numberWithUnsignedLongLong:((const OOMeshCacheHeader *)[inData bytes])->stamp];
+	[cache setObject:[NSDictionary dictionaryWithObject:stamp forKey:@"stamp"]
+			  forKey:inShipName
+			 inCache:kOOCacheMeshes];
 }
 
 @end
 
 
-static NSString * const kOOCacheOctrees = @"octrees";
 
 @implementation OOCacheManager (Octree)
 
@@ -107,6 +107,16 @@ SOFTWARE.
 #define OO_TEXTURE_CUBE_MAP		0
 #endif
 
+/*	Block-compressed (S3TC/DXT) textures require GL_ARB_texture_compression
+	(core in OpenGL 1.3) for the upload and readback functions, and
+	GL_EXT_texture_compression_s3tc for the formats.
+*/
+#if GL_ARB_texture_compression && GL_EXT_texture_compression_s3tc
+#define OO_TEXTURE_COMPRESSION	1
+#else
+#define OO_TEXTURE_COMPRESSION	0
+#endif
+
 
 
 #define OOOPENGLEXTMGR_LOCK_SET_ACCESS		(!OOLITE_MAC_OS_X)
@@ -145,6 +155,9 @@ SOFTWARE.
 	BOOL					textureCombinersSupported;
 	GLint					textureUnitCount;
 #endif
+#if OO_TEXTURE_COMPRESSION
+	BOOL					textureCompressionSupported;
+#endif
 }
 
 + (id)sharedManager;
@@ -162,6 +175,7 @@ SOFTWARE.
 - (BOOL)fboSupported;					// Frame buffer objects
 - (BOOL)textureCombinersSupported;
 - (OOUInteger)textureUnitCount;			// Fixed function multitexture limit, does not apply to shaders. (GL_MAX_TEXTURE_UNITS_ARB)
+- (BOOL)textureCompressionSupported;	// S3TC block-compressed textures
 
 - (OOUInteger)majorVersionNumber;
 - (OOUInteger)minorVersionNumber;
@@ -235,6 +249,11 @@ PFNGLBINDBUFFERARBPROC					glBindBufferARB;
 PFNGLBUFFERDATAARBPROC					glBufferDataARB;
 #endif
 
+#if OO_TEXTURE_COMPRESSION
+PFNGLCOMPRESSEDTEXIMAGE2DARBPROC		glCompressedTexImage2DARB;
+PFNGLGETCOMPRESSEDTEXIMAGEARBPROC		glGetCompressedTexImageARB;
+#endif
+
 #if OO_USE_FBO
 PFNGLGENFRAMEBUFFERSEXTPROC				glGenFramebuffersEXT;
 PFNGLBINDFRAMEBUFFEREXTPROC				glBindFramebufferEXT;
@@ -95,6 +95,11 @@ PFNGLBINDBUFFERARBPROC					glBindBufferARB					= (PFNGLBINDBUFFERARBPROC)&OOBadO
 PFNGLBUFFERDATAARBPROC					glBufferDataARB					= (PFNGLBUFFERDATAARBPROC)&OOBadOpenGLExtensionUsed;
 #endif
 
+#if OO_TEXTURE_COMPRESSION
+PFNGLCOMPRESSEDTEXIMAGE2DARBPROC		glCompressedTexImage2DARB		= (PFNGLCOMPRESSEDTEXIMAGE2DARBPROC)&OOBadOpenGLExtensionUsed;
+PFNGLGETCOMPRESSEDTEXIMAGEARBPROC		glGetCompressedTexImageARB		= (PFNGLGETCOMPRESSEDTEXIMAGEARBPROC)&OOBadOpenGLExtensionUsed;
+#endif
+
 #if OO_USE_FBO
 PFNGLGENFRAMEBUFFERSEXTPROC				glGenFramebuffersEXT			= (PFNGLGENFRAMEBUFFERSEXTPROC)&OOBadOpenGLExtensionUsed;
 PFNGLBINDFRAMEBUFFEREXTPROC				glBindFramebufferEXT			= (PFNGLBINDFRAMEBUFFEREXTPROC)&OOBadOpenGLExtensionUsed;
@@ -134,6 +139,10 @@ static unsigned IntegerFromString(const GLubyte **ioString);
 - (void)checkFBOSupported;
 #endif
 
+#if OO_TEXTURE_COMPRESSION
+- (void)checkTextureCompressionSupported;
+#endif
+
 #if GL_ARB_texture_env_combine
 - (void)checkTextureCombinersSupported;
 #endif
@@ -276,6 +285,10 @@ static NSArray *ArrayOfExtensions(NSString *extensionString)
 	GLint texUnitOverride = [gpuConfig oo_unsignedIntegerForKey:@"texture_units" defaultValue:textureUnitCount];
 	if (texUnitOverride < textureUnitCount)  textureUnitCount = texUnitOverride;
 #endif
+#if OO_TEXTURE_COMPRESSION
+	[self checkTextureCompressionSupported];
+	if (![gpuConfig oo_boolForKey:@"use_texture_compression" defaultValue:YES])  textureCompressionSupported = NO;
+#endif
 	
 	usePointSmoothing = [gpuConfig oo_boolForKey:@"smooth_points" defaultValue:YES];
 	useLineSmoothing = [gpuConfig oo_boolForKey:@"smooth_lines" defaultValue:YES];
@@ -383,6 +396,16 @@ static NSArray *ArrayOfExtensions(NSString *extensionString)
 }
 
 
+- (BOOL)textureCompressionSupported
+{
+#if OO_TEXTURE_COMPRESSION
+	return textureCompressionSupported;
+#else
+	return NO;
+#endif
+}
+
+
 - (BOOL)textureCombinersSupported
 {
 #if OO_MULTITEXTURE
@@ -597,6 +620,23 @@ static unsigned IntegerFromString(const GLubyte **ioString)
 #endif
 
 
+#if OO_TEXTURE_COMPRESSION
+- (void)checkTextureCompressionSupported
+{
+	textureCompressionSupported = ([self versionIsAtLeastMajor:1 minor:3] || [self haveExtension:@"GL_ARB_texture_compression"]) &&
+								  [self haveExtension:@"GL_EXT_texture_compression_s3tc"];
+	
+#if OOLITE_WINDOWS
+	if (textureCompressionSupported)
+	{
+		glCompressedTexImage2DARB = (PFNGLCOMPRESSEDTEXIMAGE2DARBPROC)wglGetProcAddress("glCompressedTexImage2DARB");
+		glGetCompressedTexImageARB = (PFNGLGETCOMPRESSEDTEXIMAGEARBPROC)wglGetProcAddress("glGetCompressedTexImageARB");
+	}
+#endif
+}
+#endif
+
+
 #if OO_MULTITEXTURE
 - (void)checkTextureCombinersSupported
 {
@@ -0,0 +1,93 @@
+/*
+
+OOResourceIndex.h
+
+Index of the files in the resource search paths, used by ResourceManager to
+find "file X in folder Y" without probing every search path in turn.
+
+Each search path is listed once: the entries at its top level, and the
+entries in each of its top-level folders (except OXPs, which are search
+paths in their own right). Hidden files and deeper folders are not listed;
+lookups of names containing a path separator can't be answered by the
+index, and must be handled by probing as before.
+
+Listings are stored in the data cache with the modification dates of the
+folders listed, and reused on later runs. A search path is listed again if
+the date of any of its listed folders has changed, since that's what
+happens when a file is added, removed or renamed.
+
+Each listed file also has a fingerprint (size and modification date), and
+each search path a digest of its fingerprints. ResourceManager compares the
+digests with those stored when the data cache was last validated to decide
+whether cached data is stale, and uses -changedFileNames to discard only
+the cached lookups that can have been affected. Hidden files are not
+fingerprinted, so Finder or Explorer droppings don't invalidate anything.
+A file replaced in place without touching its folder's date is not noticed,
+as before; holding down shift at startup still flushes everything.
+
+On Mac OS X and Windows, whose file systems normally ignore case, lookups
+ignore case too.
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+
+
+@interface OOResourceIndex: NSObject
+{
+@private
+	NSArray					*_searchPaths;
+	NSMutableDictionary		*_entries;		// Lookup key -> NSIndexSet of search path indices.
+	NSMutableArray			*_digests;
+	NSMutableSet			*_changedFileNames;
+}
+
+- (id) initWithSearchPaths:(NSArray *)searchPaths;
+
+- (NSArray *) searchPaths;
+
+// One digest string per search path, changing when any listed file does.
+- (NSArray *) contentDigests;
+
+/*	Names of files added, removed or changed in search paths listed again
+	when the index was built. Search paths listed for the first time count
+	as having changed entirely.
+*/
+- (NSSet *) changedFileNames;
+
+// NO if the index can't answer lookups for this file name and folder.
+- (BOOL) canResolveFileNamed:(NSString *)fileName inFolder:(NSString *)folderName;
+
+/*	Every copy of a file, in the order ResourceManager merges them: for each
+	search path, the file at the top level, then the one in folderName.
+	Returns nil if there are none.
+*/
+- (NSArray *) pathsForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName;
+
+// The copy which overrides all others, i.e. the last of the above.
+- (NSString *) pathForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName;
+
+@end
+
+
+// Data cache used for listings.
+extern NSString * const kOOCacheResourceIndex;
@@ -0,0 +1,337 @@
+/*
+
+OOResourceIndex.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOResourceIndex.h"
+#import "OOCacheManager.h"
+#import "OOCollectionExtractors.h"
+#import "OOProfilingStopwatch.h"
+#import "NSStringOOExtensions.h"
+
+
+#define OO_CASE_INSENSITIVE_FILE_SYSTEM		(OOLITE_MAC_OS_X || OOLITE_WINDOWS)
+
+
+NSString * const kOOCacheResourceIndex				= @"resource index";
+
+static NSString * const kListingEntries				= @"entries";		// Relative path -> fingerprint.
+static NSString * const kListingFolderDates			= @"folder dates";	// Keyed by folder name; the search path itself is "".
+static NSString * const kListingDigest				= @"digest";
+
+
+static NSDictionary *ListSearchPath(NSFileManager *fmgr, NSString *searchPath);
+static BOOL ListingIsCurrent(NSFileManager *fmgr, NSString *searchPath, NSDictionary *listing);
+static void AddChangedNames(NSMutableSet *names, NSDictionary *oldEntries, NSDictionary *newEntries);
+static NSNumber *ModificationDate(NSFileManager *fmgr, NSString *path);
+static NSString *Fingerprint(NSFileManager *fmgr, NSString *path, BOOL isDirectory);
+static NSString *Digest(NSDictionary *entries);
+
+OOINLINE NSString *LookupKey(NSString *relativePath)
+{
+#if OO_CASE_INSENSITIVE_FILE_SYSTEM
+	return [relativePath lowercaseString];
+#else
+	return relativePath;
+#endif
+}
+
+
+@interface OOResourceIndex (Private)
+
+- (void) addListing:(NSDictionary *)listing forSearchPathAtIndex:(OOUInteger)index;
+
+@end
+
+
+@implementation OOResourceIndex
+
+- (id) initWithSearchPaths:(NSArray *)searchPaths
+{
+	if ((self = [super init]))
+	{
+		_searchPaths = [searchPaths copy];
+		_entries = [[NSMutableDictionary alloc] init];
+		_digests = [[NSMutableArray alloc] initWithCapacity:[_searchPaths count]];
+		_changedFileNames = [[NSMutableSet alloc] init];
+		if (_searchPaths == nil || _entries == nil || _digests == nil || _changedFileNames == nil)
+		{
+			[self release];
+			return nil;
+		}
+		
+		OOCacheManager			*cache = [OOCacheManager sharedCache];
+		NSFileManager			*fmgr = [NSFileManager defaultManager];
+		OOProfilingStopwatch	*stopwatch = [OOProfilingStopwatch stopwatch];
+		OOUInteger				i, count = [_searchPaths count], listed = 0;
+		
+		for (i = 0; i < count; i++)
+		{
+			NSString *searchPath = [_searchPaths objectAtIndex:i];
+			NSDictionary *listing = [cache objectForKey:searchPath inCache:kOOCacheResourceIndex];
+			
+			if (listing == nil || !ListingIsCurrent(fmgr, searchPath, listing))
+			{
+				NSDictionary *newListing = ListSearchPath(fmgr, searchPath);
+				AddChangedNames(_changedFileNames, [listing oo_dictionaryForKey:kListingEntries], [newListing oo_dictionaryForKey:kListingEntries]);
+				
+				listing = newListing;
+				[cache setObject:listing forKey:searchPath inCache:kOOCacheResourceIndex];
+				listed++;
+			}
+			
+			[self addListing:listing forSearchPathAtIndex:i];
+			[_digests addObject:[listing oo_stringForKey:kListingDigest defaultValue:@""]];
+		}
+		
+		OOLog(@"resourceManager.index", @"Indexed %u resource names in %u search paths (%u listed, the rest from cache; %u names changed) in %.1f ms.", [_entries count], count, listed, [_changedFileNames count], [stopwatch currentTime] * 1000.0);
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_searchPaths);
+	DESTROY(_entries);
+	DESTROY(_digests);
+	DESTROY(_changedFileNames);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%u names in %u search paths", [_entries count], [_searchPaths count]];
+}
+
+
+- (NSArray *) searchPaths
+{
+	return _searchPaths;
+}
+
+
+- (NSArray *) contentDigests
+{
+	return _digests;
+}
+
+
+- (NSSet *) changedFileNames
+{
+	return _changedFileNames;
+}
+
+
+- (BOOL) canResolveFileNamed:(NSString *)fileName inFolder:(NSString *)folderName
+{
+	return fileName != nil &&
+		   [fileName rangeOfString:@"/"].location == NSNotFound &&
+		   (folderName == nil || [folderName rangeOfString:@"/"].location == NSNotFound);
+}
+
+
+- (NSArray *) pathsForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName
+{
+	NSIndexSet *topLevel = [_entries objectForKey:LookupKey(fileName)];
+	NSIndexSet *inFolder = (folderName != nil) ? [_entries objectForKey:LookupKey([folderName stringByAppendingPathComponent:fileName])] : nil;
+	if (topLevel == nil && inFolder == nil)  return nil;
+	
+	NSMutableIndexSet *indices = [NSMutableIndexSet indexSet];
+	if (topLevel != nil)  [indices addIndexes:topLevel];
+	if (inFolder != nil)  [indices addIndexes:inFolder];
+	
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:[topLevel count] + [inFolder count]];
+	NSUInteger i;
+	for (i = [indices firstIndex]; i != NSNotFound; i = [indices indexGreaterThanIndex:i])
+	{
+		NSString *searchPath = [_searchPaths objectAtIndex:i];
+		if ([topLevel containsIndex:i])  [result addObject:[searchPath stringByAppendingPathComponent:fileName]];
+		if ([inFolder containsIndex:i])  [result addObject:[[searchPath stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName]];
+	}
+	
+	return result;
+}
+
+
+- (NSString *) pathForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName
+{
+	NSIndexSet *topLevel = [_entries objectForKey:LookupKey(fileName)];
+	NSIndexSet *inFolder = (folderName != nil) ? [_entries objectForKey:LookupKey([folderName stringByAppendingPathComponent:fileName])] : nil;
+	NSUInteger topLevelIndex = (topLevel != nil) ? [topLevel lastIndex] : NSNotFound;
+	NSUInteger inFolderIndex = (inFolder != nil) ? [inFolder lastIndex] : NSNotFound;
+	
+	// Within a search path, the copy in the folder takes precedence.
+	if (inFolderIndex != NSNotFound && (topLevelIndex == NSNotFound || inFolderIndex >= topLevelIndex))
+	{
+		return [[[_searchPaths objectAtIndex:inFolderIndex] stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
+	}
+	if (topLevelIndex != NSNotFound)
+	{
+		return [[_searchPaths objectAtIndex:topLevelIndex] stringByAppendingPathComponent:fileName];
+	}
+	return nil;
+}
+
+@end
+
+
+@implementation OOResourceIndex (Private)
+
+- (void) addListing:(NSDictionary *)listing forSearchPathAtIndex:(OOUInteger)index
+{
+	NSString *relativePath = nil;
+	
+	foreachkey (relativePath, [listing oo_dictionaryForKey:kListingEntries])
+	{
+		NSString *key = LookupKey(relativePath);
+		NSMutableIndexSet *indices = [_entries objectForKey:key];
+		if (indices == nil)
+		{
+			indices = [NSMutableIndexSet indexSet];
+			[_entries setObject:indices forKey:key];
+		}
+		[indices addIndex:index];
+	}
+}
+
+@end
+
+
+static NSDictionary *ListSearchPath(NSFileManager *fmgr, NSString *searchPath)
+{
+	NSMutableDictionary	*entries = [NSMutableDictionary dictionary];
+	NSMutableDictionary	*folderDates = [NSMutableDictionary dictionary];
+	NSString			*name = nil;
+	NSString			*subName = nil;
+	NSNumber			*date = nil;
+	BOOL				isDirectory;
+	
+	date = ModificationDate(fmgr, searchPath);
+	if (date != nil)  [folderDates setObject:date forKey:@""];
+	
+	foreach (name, [fmgr directoryContentsAtPath:searchPath])
+	{
+		if ([name hasPrefix:@"."])  continue;
+		
+		NSString *path = [searchPath stringByAppendingPathComponent:name];
+		if (![fmgr fileExistsAtPath:path isDirectory:&isDirectory])  continue;
+		[entries setObject:Fingerprint(fmgr, path, isDirectory) forKey:name];
+		
+		// OXPs in a root path are search paths themselves, and are listed separately.
+		if (!isDirectory || [[[name pathExtension] lowercaseString] isEqualToString:@"oxp"])  continue;
+		
+		date = ModificationDate(fmgr, path);
+		if (date != nil)  [folderDates setObject:date forKey:name];
+		
+		foreach (subName, [fmgr directoryContentsAtPath:path])
+		{
+			if ([subName hasPrefix:@"."])  continue;
+			
+			NSString *subPath = [path stringByAppendingPathComponent:subName];
+			if (![fmgr fileExistsAtPath:subPath isDirectory:&isDirectory])  continue;
+			[entries setObject:Fingerprint(fmgr, subPath, isDirectory) forKey:[name stringByAppendingPathComponent:subName]];
+		}
+	}
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			entries, kListingEntries,
+			folderDates, kListingFolderDates,
+			Digest(entries), kListingDigest,
+			nil];
+}
+
+
+static BOOL ListingIsCurrent(NSFileManager *fmgr, NSString *searchPath, NSDictionary *listing)
+{
+	NSDictionary		*folderDates = [listing oo_dictionaryForKey:kListingFolderDates];
+	NSString			*name = nil;
+	
+	if (folderDates == nil || [listing oo_dictionaryForKey:kListingEntries] == nil || [listing oo_stringForKey:kListingDigest] == nil)  return NO;
+	
+	foreachkey (name, folderDates)
+	{
+		NSString *path = ([name length] != 0) ? [searchPath stringByAppendingPathComponent:name] : searchPath;
+		if (![ModificationDate(fmgr, path) isEqual:[folderDates objectForKey:name]])  return NO;
+	}
+	
+	return YES;
+}
+
+
+// Names (last path components) of entries which were added, removed or changed.
+static void AddChangedNames(NSMutableSet *names, NSDictionary *oldEntries, NSDictionary *newEntries)
+{
+	NSString			*relativePath = nil;
+	
+	foreachkey (relativePath, oldEntries)
+	{
+		if (![[oldEntries objectForKey:relativePath] isEqual:[newEntries objectForKey:relativePath]])  [names addObject:[relativePath lastPathComponent]];
+	}
+	foreachkey (relativePath, newEntries)
+	{
+		if ([oldEntries objectForKey:relativePath] == nil)  [names addObject:[relativePath lastPathComponent]];
+	}
+}
+
+
+static NSNumber *ModificationDate(NSFileManager *fmgr, NSString *path)
+{
+	NSDate *date = [[fmgr fileAttributesAtPath:path traverseLink:YES] objectForKey:NSFileModificationDate];
+	if (date == nil)  return nil;
+	
+	// Doubles rather than dates, which the cache may not handle under GNUstep.
+	return [NSNumber numberWithDouble:[date timeIntervalSince1970]];
+}
+
+
+/*	Size and modification date of a file. Folders get a fixed fingerprint,
+	since their dates change whenever anything (even a hidden file) is
+	added to them; changes to their contents show up in their own entries.
+*/
+static NSString *Fingerprint(NSFileManager *fmgr, NSString *path, BOOL isDirectory)
+{
+	if (isDirectory)  return @"folder";
+	
+	NSDictionary *attributes = [fmgr fileAttributesAtPath:path traverseLink:YES];
+	return [NSString stringWithFormat:@"%llu@%.3f", [attributes fileSize], [[attributes fileModificationDate] timeIntervalSince1970]];
+}
+
+
+static NSString *Digest(NSDictionary *entries)
+{
+	// Hash of the sorted entries.
+	NSArray				*keys = [[entries allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	NSString			*key = nil;
+	NSMutableString		*listing = [NSMutableString string];
+	
+	foreach (key, keys)
+	{
+		[listing appendFormat:@"%@\t%@\n", key, [entries objectForKey:key]];
+	}
+	
+	return [NSString stringWithFormat:@"%016llx", (unsigned long long)[listing oo_hash64]];
+}
@@ -48,6 +48,7 @@ SOFTWARE.
 - (NSDictionary *) shipyardInfoForKey:(NSString *)key;
 - (OOProbabilitySet *) probabilitySetForRole:(NSString *)role;
 
+- (NSArray *) shipKeys;
 - (NSArray *) demoShipKeys;
 - (NSArray *) playerShipKeys;
 
@@ -38,9 +38,15 @@ SOFTWARE.
 #import "OOLegacyScriptWhitelist.h"
 #import "OODeepCopy.h"
 #import "OOColor.h"
+#import "OOAsyncWorkManager.h"
+#import "OOCPUInfo.h"
 
 
-#define PRELOAD 0
+/*	If set, mesh preloading is compiled in. It is still only done if the
+	"preload-ship-meshes" user default is set, since it loads every mesh
+	at startup.
+*/
+#define PRELOAD 1
 
 
 static void DumpStringAddrs(NSDictionary *dict, NSString *context);
@@ -73,7 +79,7 @@ static NSString * const	kDefaultDemoShip = @"coriolis-station";
 - (BOOL) sanitizeConditions:(NSMutableDictionary *)ioData;
 
 #if PRELOAD
-- (BOOL) preloadShipMeshes:(NSMutableDictionary *)ioData;
+- (void) preloadShipMeshes:(NSDictionary *)shipData;
 #endif
 
 - (NSMutableDictionary *) mergeShip:(NSDictionary *)child withParent:(NSDictionary *)parent;
@@ -109,6 +115,35 @@ static NSString * const	kDefaultDemoShip = @"coriolis-station";
 @end
 
 
+#if PRELOAD
+/*	Loads one mesh and its octree on a worker thread, and stores them in the
+	cache when completed on the main thread. Run directly on the main thread
+	when concurrent preloading isn't possible.
+*/
+@interface OOShipMeshPreloadTask: NSObject <OOAsyncWorkTask>
+{
+@private
+	NSString				*_modelName;
+	NSString				*_path;
+	BOOL					_smooth;
+	BOOL					_queued;
+	BOOL					_succeeded;
+	OOMesh					*_mesh;
+}
+
+- (id) initWithModelName:(NSString *)modelName path:(NSString *)path smooth:(BOOL)smooth;
+
+- (BOOL) queued;
+- (void) setQueued:(BOOL)queued;
+- (BOOL) succeeded;
+
+// Store the mesh in the cache. Must be called on the main thread after the task has run.
+- (void) cacheResult;
+
+@end
+#endif
+
+
 @implementation OOShipRegistry
 
 + (OOShipRegistry *) sharedRegistry
@@ -212,6 +247,12 @@ static NSString * const	kDefaultDemoShip = @"coriolis-station";
 }
 
 
+- (NSArray *) shipKeys
+{
+	return [_shipData allKeys];
+}
+
+
 - (NSArray *) demoShipKeys
 {
 	return _demoShips;
@@ -308,9 +349,12 @@ static NSString * const	kDefaultDemoShip = @"coriolis-station";
 	OOLog(@"shipData.load.done", @"Finished validating data...");
 	
 #if PRELOAD
-	// Preload and cache meshes.
-	if (![self preloadShipMeshes:result])  return;
-	OOLog(@"shipData.load.done", @"Finished loading meshes...");
+	// Warm the mesh and octree caches. Ships are never removed here; a model which can't be loaded is reported when it's used.
+	if ([[NSUserDefaults standardUserDefaults] oo_boolForKey:@"preload-ship-meshes" defaultValue:NO])
+	{
+		[self preloadShipMeshes:result];
+		OOLog(@"shipData.load.done", @"Finished loading meshes...");
+	}
 #endif
 	
 	_shipData = OODeepCopy(result);
@@ -952,50 +996,101 @@ static NSString * const	kDefaultDemoShip = @"coriolis-station";
 
 
 #if PRELOAD
-- (BOOL) preloadShipMeshes:(NSMutableDictionary *)ioData
+- (void) preloadShipMeshes:(NSDictionary *)shipData
 {
 	NSEnumerator			*shipKeyEnum = nil;
 	NSString				*shipKey = nil;
-	NSMutableDictionary		*shipEntry = nil;
-	BOOL					remove;
+	NSDictionary			*shipEntry = nil;
 	NSString				*modelName = nil;
-	OOMesh					*mesh = nil;
+	NSString				*taskKey = nil;
+	NSMutableDictionary		*tasksByKey = nil;
+	NSMutableArray			*tasks = nil;
+	NSMutableSet			*failedKeys = nil;
+	OOShipMeshPreloadTask	*task = nil;
 	NSAutoreleasePool		*pool = nil;
-	OOUInteger				i = 0, count;
+	OOUInteger				i, count;
 	
-	count = [ioData count];
+	tasksByKey = [NSMutableDictionary dictionary];
+	tasks = [NSMutableArray array];
+	failedKeys = [NSMutableSet set];
 	
-	// Preload ship meshes. (Iterates over a copy of keys since it mutates the dictionary.)
-	for (shipKeyEnum = [[ioData allKeys] objectEnumerator]; (shipKey = [shipKeyEnum nextObject]); )
+	/*	Work out which meshes need loading. Ships often share models, and the
+		cache and file lookups aren't thread-safe, so this is done up front.
+		Keys are sorted so that the tasks are in the same order every time.
+	*/
+	for (shipKeyEnum = [[[shipData allKeys] sortedArrayUsingSelector:@selector(compare:)] objectEnumerator]; (shipKey = [shipKeyEnum nextObject]); )
 	{
-		pool = [[NSAutoreleasePool alloc] init];
+		shipEntry = [shipData objectForKey:shipKey];
+		modelName = [shipEntry oo_stringForKey:@"model"];
+		if (modelName == nil)  continue;
 		
-		[[GameController sharedController] setProgressBarValue:(float)i++ / (float)count];
+		BOOL smooth = [shipEntry oo_boolForKey:@"smooth"];
+		taskKey = [NSString stringWithFormat:@"%@:%u", modelName, smooth];
+		if ([tasksByKey objectForKey:taskKey] != nil || [failedKeys containsObject:taskKey])  continue;
+		if ([OOMesh isCachedWithName:modelName smooth:smooth])  continue;
 		
-		shipEntry = [ioData objectForKey:shipKey];
-		remove = NO;
+		NSString *path = [ResourceManager pathForFileNamed:modelName inFolder:@"Models"];
+		if (path == nil)
+		{
+			[failedKeys addObject:taskKey];
+			continue;
+		}
 		
-		modelName = [shipEntry oo_stringForKey:@"model"];
-		mesh = [OOMesh meshWithName:modelName
-				 materialDictionary:[shipEntry oo_dictionaryForKey:@"materials"]
-				  shadersDictionary:[shipEntry oo_dictionaryForKey:@"shaders"]
-							 smooth:[shipEntry oo_boolForKey:@"smooth"]
-					   shaderMacros:nil
-				shaderBindingTarget:nil];
+		task = [[OOShipMeshPreloadTask alloc] initWithModelName:modelName path:path smooth:smooth];
+		if (task == nil)  continue;
+		[tasksByKey setObject:task forKey:taskKey];
+		[tasks addObject:task];
+		[task release];
+	}
+	
+	count = [tasks count];
+	BOOL concurrent = count > 1 && OOCPUCount() > 1 && [[NSUserDefaults standardUserDefaults] oo_boolForKey:@"concurrent-mesh-preload" defaultValue:YES];
+	OOLog(@"shipData.load.preload", @"Preloading %lu meshes%@.", (unsigned long)count, concurrent ? @" concurrently" : @"");
+	
+	if (concurrent)
+	{
+		OOAsyncWorkManager *workManager = [OOAsyncWorkManager sharedAsyncWorkManager];
+		for (i = 0; i < count; i++)
+		{
+			task = [tasks objectAtIndex:i];
+			[task setQueued:[workManager addTask:task priority:kOOAsyncPriorityHigh]];
+		}
+	}
+	
+	/*	Results are cached in task order, whatever order the workers finish
+		in. -waitForTaskToComplete: may complete other tasks along the way,
+		which is why completion doesn't touch the cache; -cacheResult does.
+	*/
+	for (i = 0; i < count; i++)
+	{
+		pool = [[NSAutoreleasePool alloc] init];
 		
-		[pool release];	// NOTE: mesh is now invalid, but pointer nil check is OK.
+		[[GameController sharedController] setProgressBarValue:(float)i / (float)count];
 		
-		if (mesh == nil)
+		task = [tasks objectAtIndex:i];
+		if ([task queued])
 		{
-			// FIXME: what if it's a subentity? Need to rearrange things.
-			OOLogERR(@"shipData.load.error", @"model \"%@\" could not be loaded for ship \"%@\", removing.", modelName, shipKey);
-			[ioData removeObjectForKey:shipKey];
+			[[OOAsyncWorkManager sharedAsyncWorkManager] waitForTaskToComplete:task];
+		}
+		else
+		{
+			[task performAsyncTask];
 		}
+		[task cacheResult];
+		
+		[pool release];
 	}
 	
-	[[GameController sharedController] setProgressBarValue:-1.0f];
+	for (shipKeyEnum = [tasksByKey keyEnumerator]; (taskKey = [shipKeyEnum nextObject]); )
+	{
+		if (![[tasksByKey objectForKey:taskKey] succeeded])  [failedKeys addObject:taskKey];
+	}
+	if ([failedKeys count] != 0)
+	{
+		OOLog(@"shipData.load.preload.failed", @"Could not preload %lu meshes: %@", (unsigned long)[failedKeys count], [[[failedKeys allObjects] sortedArrayUsingSelector:@selector(compare:)] componentsJoinedByString:@", "]);
+	}
 	
-	return YES;
+	[[GameController sharedController] setProgressBarValue:-1.0f];
 }
 #endif
 
@@ -1521,3 +1616,77 @@ static void GatherStringAddrs(id object, NSMutableSet *strings, NSString *contex
 		GatherStringAddrsDict(object, strings, context);
 	}
 }
+
+
+#if PRELOAD
+@implementation OOShipMeshPreloadTask
+
+- (id) initWithModelName:(NSString *)modelName path:(NSString *)path smooth:(BOOL)smooth
+{
+	if ((self = [super init]))
+	{
+		_modelName = [modelName copy];
+		_path = [path copy];
+		_smooth = smooth;
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	DESTROY(_modelName);
+	DESTROY(_path);
+	DESTROY(_mesh);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"\"%@\"%@", _modelName, _smooth ? @" (smooth)" : @""];
+}
+
+
+- (BOOL) queued
+{
+	return _queued;
+}
+
+
+- (void) setQueued:(BOOL)queued
+{
+	_queued = !!queued;
+}
+
+
+- (BOOL) succeeded
+{
+	return _succeeded;
+}
+
+
+- (void) performAsyncTask
+{
+	_mesh = [[OOMesh alloc] initForPreloadingWithName:_modelName path:_path smooth:_smooth];
+}
+
+
+- (void) completeAsyncTask
+{
+	// The mesh is cached by -cacheResult, in task order rather than completion order.
+}
+
+
+- (void) cacheResult
+{
+	// Released here, on the main thread, rather than wherever the task itself ends up being released.
+	[OOMesh cachePreloadedMesh:_mesh smooth:_smooth];
+	_succeeded = (_mesh != nil);
+	DESTROY(_mesh);
+}
+
+@end
+#endif
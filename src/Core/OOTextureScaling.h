@@ -45,3 +45,12 @@ OOPixMap OOScalePixMap(OOPixMap srcPixMap, OOPixMapDimension dstWidth, OOPixMapD
 	Buffer must have space for (4 * width * height) / 3 pixels.
 */
 BOOL OOGenerateMipMaps(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format);
+
+
+/*	Where OOCPUInfo reports support, vectorised (SSE2) implementations of the
+	scalers are used. They produce exactly the same output as the scalar ones.
+	OOTextureScalingSetVectorEnabled(NO) forces the scalar implementations,
+	for testing and benchmarking.
+*/
+BOOL OOTextureScalingVectorAvailable(void);
+void OOTextureScalingSetVectorEnabled(BOOL enabled);
@@ -37,6 +37,18 @@ SOFTWARE.
 #define DUMP_SCALE		0
 
 
+/*	SSE2 scalers are built where the compiler can target SSE2 per function
+	(clang, or GCC 4.9 and later), and used if OOCPUHasSSE2() says so.
+*/
+#if (defined(__i386__) || defined(__x86_64__)) && (defined(__clang__) || OOLITE_GCC_VERSION >= 40900)
+#define OO_TEXTURE_SCALING_SSE2		1
+#include <emmintrin.h>
+#define SSE2_FUNC					__attribute__((target("sse2")))
+#else
+#define OO_TEXTURE_SCALING_SSE2		0
+#endif
+
+
 /*	Internal function declarations.
 	
 	NOTE: the function definitions are grouped together for best code cache
@@ -91,12 +103,48 @@ static void SqueezeHorizontally4(OOPixMap srcPx, OOPixMapDimension dstWidth);
 static BOOL EnsureCorrectDataSize(OOPixMap *pixMap, BOOL leaveSpaceForMipMaps) NONNULL_FUNC;
 
 
+#if OO_TEXTURE_SCALING_SSE2
+
+static BOOL sUseSSE2Inited = NO;
+static BOOL sUseSSE2 = NO;
+
+OOINLINE BOOL UseSSE2(void)
+{
+	if (EXPECT_NOT(!sUseSSE2Inited))
+	{
+		sUseSSE2 = OOCPUHasSSE2();
+		sUseSSE2Inited = YES;
+	}
+	return sUseSSE2;
+}
+
+/*	SSE2 versions of the scalers. The ones returning BOOL return NO if they
+	can't handle the request, in which case the scalar version should be used.
+*/
+static void ScaleToHalf_SSE2(void *srcBytes, void *dstBytes, size_t rowBytes, OOPixMapDimension srcHeight, unsigned planes) NONNULL_FUNC;
+static void StretchVertically_SSE2(OOPixMap srcPx, OOPixMap dstPx);
+static BOOL SqueezeVertically_SSE2(OOPixMap srcPx, OOPixMapDimension dstHeight);
+static BOOL StretchHorizontally_SSE2(OOPixMap srcPx, OOPixMap dstPx);
+static BOOL SqueezeHorizontally_SSE2(OOPixMap srcPx, OOPixMapDimension dstWidth);
+
+#endif
+
+
 #if !OOLITE_NATIVE_64_BIT
 
 static void StretchVerticallyN_x4(OOPixMap srcPx, OOPixMap dstPx);
 
 OOINLINE void StretchVertically(OOPixMap srcPx, OOPixMap dstPx)
 {
+#if OO_TEXTURE_SCALING_SSE2
+	// StretchVerticallyN_x4() ignores trailing bytes in padded rows; leave that case to it.
+	if (UseSSE2() && (((srcPx.rowBytes) & 3) || !((srcPx.width * OOPixMapBytesPerPixel(srcPx)) & 3)))
+	{
+		StretchVertically_SSE2(srcPx, dstPx);
+		return;
+	}
+#endif
+	
 	if (!((srcPx.rowBytes) & 3))
 	{
 		StretchVerticallyN_x4(srcPx, dstPx);
@@ -113,6 +161,15 @@ static void StretchVerticallyN_x8(OOPixMap srcPx, OOPixMap dstPx);
 
 OOINLINE void StretchVertically(OOPixMap srcPx, OOPixMap dstPx)
 {
+#if OO_TEXTURE_SCALING_SSE2
+	// StretchVerticallyN_x8() ignores trailing bytes in padded rows; leave that case to it.
+	if (UseSSE2() && (((srcPx.rowBytes) & 7) || !((srcPx.width * OOPixMapBytesPerPixel(srcPx)) & 7)))
+	{
+		StretchVertically_SSE2(srcPx, dstPx);
+		return;
+	}
+#endif
+	
 	if (!((srcPx.rowBytes) & 7))
 	{
 		StretchVerticallyN_x8(srcPx, dstPx);
@@ -128,6 +185,10 @@ OOINLINE void StretchVertically(OOPixMap srcPx, OOPixMap dstPx)
 
 OOINLINE void SqueezeVertically(OOPixMap pixMap, OOPixMapDimension dstHeight)
 {
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2() && pixMap.format != kOOPixMapInvalidFormat && SqueezeVertically_SSE2(pixMap, dstHeight))  return;
+#endif
+	
 	switch (pixMap.format)
 	{
 		case kOOPixMapRGBA:
@@ -158,6 +219,10 @@ OOINLINE void StretchHorizontally(OOPixMap srcPx, OOPixMap dstPx)
 {
 	NSCParameterAssert(srcPx.format == dstPx.format);
 	
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2() && srcPx.format != kOOPixMapInvalidFormat && StretchHorizontally_SSE2(srcPx, dstPx))  return;
+#endif
+	
 	switch (srcPx.format)
 	{
 		case kOOPixMapRGBA:
@@ -186,6 +251,10 @@ OOINLINE void StretchHorizontally(OOPixMap srcPx, OOPixMap dstPx)
 
 OOINLINE void SqueezeHorizontally(OOPixMap pixMap, OOPixMapDimension dstHeight)
 {
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2() && pixMap.format != kOOPixMapInvalidFormat && SqueezeHorizontally_SSE2(pixMap, dstHeight))  return;
+#endif
+	
 	switch (pixMap.format)
 	{
 		case kOOPixMapRGBA:
@@ -368,12 +437,31 @@ BOOL OOGenerateMipMaps(void *textureBytes, OOPixMapDimension width, OOPixMapDime
 			break;
 	}
 	
-
+	
 	OOLog(kOOLogParameterError, @"%s(): bad pixmap format (%@) - ignoring, data will be junk.", __PRETTY_FUNCTION__, OOPixMapFormatName(format));
 	return NO;
 }
 
 
+BOOL OOTextureScalingVectorAvailable(void)
+{
+#if OO_TEXTURE_SCALING_SSE2
+	return OOCPUHasSSE2();
+#else
+	return NO;
+#endif
+}
+
+
+void OOTextureScalingSetVectorEnabled(BOOL enabled)
+{
+#if OO_TEXTURE_SCALING_SSE2
+	sUseSSE2 = enabled && OOCPUHasSSE2();
+	sUseSSE2Inited = YES;
+#endif
+}
+
+
 static BOOL GenerateMipMaps1(void *textureBytes, OOPixMapDimension width, OOPixMapDimension height)
 {
 	OOPixMapDimension		w = width, h = height;
@@ -382,6 +470,23 @@ static BOOL GenerateMipMaps1(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(1);
 	curr = textureBytes;
 	
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2())
+	{
+		while (16 <= w * 1 && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_SSE2(curr, next, w * 1, h, 1);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 #if OOLITE_NATIVE_64_BIT
 	while (8 < w && 1 < h)
 	{
@@ -604,6 +709,23 @@ static BOOL GenerateMipMaps2(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(2);
 	curr = textureBytes;
 	
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2())
+	{
+		while (16 <= w * 2 && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_SSE2(curr, next, w * 2, h, 2);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 	// TODO: multiple pixel two-plane scalers.
 #if 0
 #if OOLITE_NATIVE_64_BIT
@@ -701,6 +823,23 @@ static BOOL GenerateMipMaps4(void *textureBytes, OOPixMapDimension width, OOPixM
 	DUMP_MIP_MAP_PREPARE(4);
 	curr = textureBytes;
 	
+#if OO_TEXTURE_SCALING_SSE2
+	if (UseSSE2())
+	{
+		while (16 <= w * 4 && 1 < h)
+		{
+			DUMP_MIP_MAP_DUMP(curr, w, h);
+			
+			next = curr + w * h;
+			ScaleToHalf_SSE2(curr, next, w * 4, h, 4);
+			
+			w >>= 1;
+			h >>= 1;
+			curr = next;
+		}
+	}
+#endif
+	
 #if OOLITE_NATIVE_64_BIT
 	while (2 < w && 1 < h)
 	{
@@ -1659,6 +1798,475 @@ static void SqueezeVertically4(OOPixMap srcPx, OOPixMapDimension dstHeight)
 }
 
 
+#if OO_TEXTURE_SCALING_SSE2
+
+/*	SSE2 implementations of the scalers.
+	
+	These must produce exactly the same output as the scalar implementations
+	above, including their quirks at the edges; OOTextureScalingSetVectorEnabled()
+	exists so that this can be tested. All averages are rounded down, as in
+	the scalar code. The squeeze scalers divide in double precision, which is
+	exact for sums below 2^31; kMaxVectorSqueezeRatio keeps them there.
+*/
+
+enum
+{
+	kMaxVectorSqueezeRatio		= 16384
+};
+
+
+// Divide four 32-bit sums by the corresponding weights, rounding down.
+SSE2_FUNC OOINLINE __m128i DivideSums_SSE2(__m128i sums, __m128d weightsLo, __m128d weightsHi)
+{
+	__m128d lo = _mm_div_pd(_mm_cvtepi32_pd(sums), weightsLo);
+	__m128d hi = _mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2))), weightsHi);
+	return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+
+// Sixteen bytes of (px0 * (0x100 - weight1) + px1 * weight1) >> 8, with a 16-bit weight per byte.
+SSE2_FUNC OOINLINE __m128i Lerp_SSE2(__m128i px0, __m128i px1, __m128i weight1Lo, __m128i weight1Hi)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(0x100);
+	
+	__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(px0, zero), _mm_sub_epi16(one, weight1Lo)),
+							   _mm_mullo_epi16(_mm_unpacklo_epi8(px1, zero), weight1Lo));
+	__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(px0, zero), _mm_sub_epi16(one, weight1Hi)),
+							   _mm_mullo_epi16(_mm_unpackhi_epi8(px1, zero), weight1Hi));
+	
+	return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+
+
+// Add sixteen bytes multiplied by weight (at most 0xFF) to four 32-bit accumulators.
+SSE2_FUNC OOINLINE void Accumulate_SSE2(__m128i accum[4], const uint8_t *src, __m128i weight)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i px = _mm_loadu_si128((const __m128i *)src);
+	__m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), weight);
+	__m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), weight);
+	
+	accum[0] = _mm_add_epi32(accum[0], _mm_unpacklo_epi16(lo, zero));
+	accum[1] = _mm_add_epi32(accum[1], _mm_unpackhi_epi16(lo, zero));
+	accum[2] = _mm_add_epi32(accum[2], _mm_unpacklo_epi16(hi, zero));
+	accum[3] = _mm_add_epi32(accum[3], _mm_unpackhi_epi16(hi, zero));
+}
+
+
+// Pack sixteen quotients, each no greater than 0xFF, into bytes.
+SSE2_FUNC OOINLINE __m128i PackQuotients_SSE2(__m128i q0, __m128i q1, __m128i q2, __m128i q3)
+{
+	return _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+}
+
+
+/*	Scale to half size in each dimension, sixteen source bytes at a time.
+	rowBytes must be a multiple of 16. Equivalent to the ScaleToHalf_P_xN
+	functions.
+*/
+SSE2_FUNC static void ScaleToHalf_SSE2(void *srcBytes, void *dstBytes, size_t rowBytes, OOPixMapDimension srcHeight, unsigned planes)
+{
+	const __m128i		zero = _mm_setzero_si128();
+	const __m128i		lowWords = _mm_set1_epi32(0x0000FFFF);
+	uint8_t				*src0, *src1, *dst;
+	size_t				x;
+	OOPixMapDimension	y;
+	
+	src0 = srcBytes;
+	dst = dstBytes;
+	
+	for (y = srcHeight >> 1; y != 0; --y)
+	{
+		src1 = src0 + rowBytes;
+		
+		for (x = 0; x != rowBytes; x += 16)
+		{
+			__m128i row0 = _mm_loadu_si128((__m128i *)(src0 + x));
+			__m128i row1 = _mm_loadu_si128((__m128i *)(src1 + x));
+			
+			// Add the two rows, widening to 16 bits...
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+			__m128i sums;
+			
+			// ...add horizontally adjacent pixels, giving eight sums...
+			switch (planes)
+			{
+				case 1:
+					lo = _mm_and_si128(_mm_add_epi16(lo, _mm_srli_epi32(lo, 16)), lowWords);
+					hi = _mm_and_si128(_mm_add_epi16(hi, _mm_srli_epi32(hi, 16)), lowWords);
+					sums = _mm_packs_epi32(lo, hi);
+					break;
+					
+				case 2:
+					lo = _mm_shuffle_epi32(_mm_add_epi16(lo, _mm_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+					hi = _mm_shuffle_epi32(_mm_add_epi16(hi, _mm_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+					sums = _mm_unpacklo_epi64(lo, hi);
+					break;
+					
+				default:
+					lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+					hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+					sums = _mm_unpacklo_epi64(lo, hi);
+			}
+			
+			// ...shift the sums into place...
+			sums = _mm_srli_epi16(sums, 2);
+			
+			// ...and write eight output bytes.
+			_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(sums, sums));
+			dst += 8;
+		}
+		
+		// Skip a row for each source row
+		src0 = src1 + rowBytes;
+	}
+}
+
+
+SSE2_FUNC static void StretchVertically_SSE2(OOPixMap srcPx, OOPixMap dstPx)
+{
+	uint8_t				*src, *src0, *src1, *prev, *dst;
+	uint_fast32_t		x, y, xCount, srcRowBytes;
+	uint_fast16_t		weight0, weight1;
+	uint_fast32_t		fractY;	// Y coordinate, fixed-point (24.8)
+	
+	src = srcPx.pixels;
+	srcRowBytes = srcPx.rowBytes;
+	dst = dstPx.pixels;	// Assumes dstPx.width == dstPx.rowBytes.
+	
+	src0 = prev = src;
+	
+	xCount = srcPx.width * OOPixMapBytesPerPixel(srcPx);
+	
+	for (y = 1; y != dstPx.height; ++y)
+	{
+		fractY = ((srcPx.height * y) << 8) / dstPx.height;
+		
+		src0 = prev;
+		prev = src1 = src + srcRowBytes * (fractY >> 8);
+		
+		weight1 = fractY & 0xFF;
+		weight0 = 0x100 - weight1;
+		
+		__m128i weight1s = _mm_set1_epi16(weight1);
+		for (x = 0; x + 16 <= xCount; x += 16)
+		{
+			__m128i px0 = _mm_loadu_si128((__m128i *)(src0 + x));
+			__m128i px1 = _mm_loadu_si128((__m128i *)(src1 + x));
+			_mm_storeu_si128((__m128i *)(dst + x), Lerp_SSE2(px0, px1, weight1s, weight1s));
+		}
+		for (; x != xCount; ++x)
+		{
+			dst[x] = (src0[x] * weight0 + src1[x] * weight1) >> 8;
+		}
+		
+		dst += xCount;
+		src0 += xCount;	// As in the scalar versions, the last row is copied from here.
+	}
+	
+	// Copy last row (without referring to the last-plus-oneth row)
+	memcpy(dst, src0, xCount);
+}
+
+
+/*	The source pixels used by each output pixel are the same in every row, so
+	their offsets and weights are worked out once. For each row, the source
+	pixels are gathered into a buffer, after the first pixel of the row, so
+	that output byte i interpolates between buffer bytes i and i + planes.
+	Returns NO if it can't allocate its buffers.
+*/
+SSE2_FUNC static BOOL StretchHorizontally_SSE2(OOPixMap srcPx, OOPixMap dstPx)
+{
+	uint8_t				*srcStart, *dst, *gathered = NULL;
+	uint16_t			*weights = NULL;
+	uint32_t			*offsets = NULL;
+	uint_fast32_t		x, y, i, xCount, gatherCount, xBytes, srcRowBytes;
+	uint_fast32_t		fractX, deltaX;	// X coordinate, fixed-point (20.12), allowing widths up to 1 mebipixel
+	unsigned			planes, p;
+	
+	planes = OOPixMapBytesPerPixel(srcPx);
+	NSCParameterAssert(OOIsValidPixMap(srcPx) && OOIsValidPixMap(dstPx) && OOPixMapBytesPerPixel(dstPx) == planes);
+	
+	srcStart = srcPx.pixels;
+	srcRowBytes = srcPx.rowBytes;
+	xCount = dstPx.width;
+	xBytes = xCount * planes;
+	dst = dstPx.pixels;	// Assumes no row padding
+	
+	weights = malloc(xBytes * sizeof *weights);
+	offsets = malloc(xCount * sizeof *offsets);
+	gathered = malloc(xBytes + planes);
+	if (EXPECT_NOT(weights == NULL || offsets == NULL || gathered == NULL))
+	{
+		free(weights);
+		free(offsets);
+		free(gathered);
+		return NO;
+	}
+	
+	deltaX = (srcPx.width << 12) / dstPx.width;
+	fractX = 0;
+	for (x = 0; x != xCount; ++x)
+	{
+		fractX += deltaX;
+		offsets[x] = (fractX >> 12) * planes;
+		for (p = 0; p != planes; ++p)  weights[x * planes + p] = (fractX >> 4) & 0xFF;
+	}
+	
+	for (y = 0; y != dstPx.height; ++y)
+	{
+		// StretchHorizontally4() doesn't read the last source pixel of the last row, but repeats the one before.
+		gatherCount = xCount;
+		if (planes == 4 && y == dstPx.height - 1u)  gatherCount--;
+		
+		memcpy(gathered, srcStart, planes);
+		switch (planes)
+		{
+			case 1:
+				for (x = 0; x != gatherCount; ++x)  gathered[x + 1] = srcStart[offsets[x]];
+				break;
+				
+			case 2:
+				for (x = 0; x != gatherCount; ++x)  memcpy(gathered + (x + 1) * 2, srcStart + offsets[x], 2);
+				break;
+				
+			default:
+				for (x = 0; x != gatherCount; ++x)  memcpy(gathered + (x + 1) * 4, srcStart + offsets[x], 4);
+		}
+		if (gatherCount != xCount)  memcpy(gathered + xBytes, gathered + xBytes - planes, planes);
+		
+		for (i = 0; i + 16 <= xBytes; i += 16)
+		{
+			__m128i px0 = _mm_loadu_si128((__m128i *)(gathered + i));
+			__m128i px1 = _mm_loadu_si128((__m128i *)(gathered + i + planes));
+			__m128i weight1Lo = _mm_loadu_si128((__m128i *)(weights + i));
+			__m128i weight1Hi = _mm_loadu_si128((__m128i *)(weights + i + 8));
+			_mm_storeu_si128((__m128i *)(dst + i), Lerp_SSE2(px0, px1, weight1Lo, weight1Hi));
+		}
+		for (; i != xBytes; ++i)
+		{
+			dst[i] = (gathered[i] * (0x100 - weights[i]) + gathered[i + planes] * weights[i]) >> 8;
+		}
+		
+		dst += xBytes;
+		srcStart += srcRowBytes;
+	}
+	
+	free(weights);
+	free(offsets);
+	free(gathered);
+	return YES;
+}
+
+
+/*	Sixteen bytes of each output row are accumulated at a time, walking down
+	the source rows. As with the scalar versions, the one-channel version
+	counts the weight of the end row even when it doesn't read it.
+	Returns NO if the sums could be too large.
+*/
+SSE2_FUNC static BOOL SqueezeVertically_SSE2(OOPixMap srcPx, OOPixMapDimension dstHeight)
+{
+	uint8_t				*src, *srcStart, *dst;
+	uint_fast32_t		x, y, xBytes, startY, endY, srcRowBytes, lastRow;
+	uint_fast32_t		endFractY, deltaY;
+	uint_fast32_t		accum, weight;
+	uint_fast8_t		startWeight, endWeight;
+	unsigned			planes;
+	BOOL				readEndRow;
+	
+	NSCParameterAssert(OOIsValidPixMap(srcPx));
+	
+	if (srcPx.height / dstHeight >= kMaxVectorSqueezeRatio)  return NO;
+	
+	planes = OOPixMapBytesPerPixel(srcPx);
+	dst = srcPx.pixels;	// Output is placed in same buffer, without line padding.
+	srcRowBytes = srcPx.rowBytes;
+	xBytes = srcPx.width * planes;
+	
+	deltaY = (srcPx.height << 12) / dstHeight;
+	endFractY = 0;
+	
+	endWeight = 0;
+	endY = 0;
+	
+	lastRow = srcPx.height - 1;
+	
+	while (endY < lastRow)
+	{
+		endFractY += deltaY;
+		startY = endY;
+		endY = endFractY >> 12;
+		
+		startWeight = 0xFF - endWeight;
+		endWeight = (endFractY >> 4) & 0xFF;
+		
+		readEndRow = (planes == 1) ? (endY < lastRow) : (endY <= lastRow);
+		weight = startWeight + 0xFF * (endY - startY - 1);
+		if (readEndRow || planes == 1)  weight += endWeight;
+		
+		srcStart = srcPx.pixels + srcRowBytes * startY;
+		
+		__m128d weights = _mm_set1_pd(weight);
+		__m128i startWeights = _mm_set1_epi16(startWeight);
+		__m128i middleWeights = _mm_set1_epi16(0xFF);
+		__m128i endWeights = _mm_set1_epi16(endWeight);
+		
+		for (x = 0; x + 16 <= xBytes; x += 16)
+		{
+			__m128i sums[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+			
+			src = srcStart + x;
+			Accumulate_SSE2(sums, src, startWeights);
+			for (y = startY + 1; y < endY; ++y)
+			{
+				src += srcRowBytes;
+				Accumulate_SSE2(sums, src, middleWeights);
+			}
+			if (readEndRow)  Accumulate_SSE2(sums, src + srcRowBytes, endWeights);
+			
+			_mm_storeu_si128((__m128i *)dst, PackQuotients_SSE2(DivideSums_SSE2(sums[0], weights, weights),
+																 DivideSums_SSE2(sums[1], weights, weights),
+																 DivideSums_SSE2(sums[2], weights, weights),
+																 DivideSums_SSE2(sums[3], weights, weights)));
+			dst += 16;
+		}
+		
+		for (; x != xBytes; ++x)
+		{
+			src = srcStart + x;
+			accum = *src * startWeight;
+			for (y = startY + 1; y < endY; ++y)
+			{
+				src += srcRowBytes;
+				accum += *src * 0xFF;
+			}
+			if (readEndRow)  accum += src[srcRowBytes] * endWeight;
+			
+			*dst++ = accum / weight;
+		}
+	}
+	
+	return YES;
+}
+
+
+/*	The span of source pixels used by each output pixel is the same in every
+	row, so it is worked out once. Each row is summed into a buffer, which is
+	then divided by the weights sixteen bytes at a time; this avoids the
+	integer divisions which dominate the scalar versions. As with those, the
+	last output pixel uses its first source pixel in place of its last.
+	Returns NO if the sums could be too large or it can't allocate its
+	buffers.
+*/
+SSE2_FUNC static BOOL SqueezeHorizontally_SSE2(OOPixMap srcPx, OOPixMapDimension dstWidth)
+{
+	typedef struct
+	{
+		uint32_t		startX, endX;	// Source pixels with startWeight and endWeight.
+		uint32_t		middleCount;	// Pixels between them, with weight 0xFF.
+		uint8_t			startWeight, endWeight;
+	} Span;
+	
+	uint8_t				*srcStart, *dst, *src;
+	Span				*spans = NULL;
+	uint32_t			*sums = NULL;
+	double				*weights = NULL;
+	uint_fast32_t		x, y, i, m, xBytes, srcRowBytes;
+	uint_fast32_t		endFractX, deltaX, startX, endX, accum;
+	uint_fast8_t		endWeight;
+	unsigned			planes, p;
+	
+	NSCParameterAssert(OOIsValidPixMap(srcPx));
+	
+	if (srcPx.width / dstWidth >= kMaxVectorSqueezeRatio)  return NO;
+	
+	planes = OOPixMapBytesPerPixel(srcPx);
+	srcStart = srcPx.pixels;
+	dst = srcStart;	// Output is placed in same buffer, without line padding.
+	srcRowBytes = srcPx.rowBytes;
+	xBytes = dstWidth * planes;
+	
+	spans = malloc(dstWidth * sizeof *spans);
+	sums = malloc(xBytes * sizeof *sums);
+	weights = malloc(xBytes * sizeof *weights);
+	if (EXPECT_NOT(spans == NULL || sums == NULL || weights == NULL))
+	{
+		free(spans);
+		free(sums);
+		free(weights);
+		return NO;
+	}
+	
+	deltaX = (srcPx.width << 12) / dstWidth;
+	endFractX = 0;
+	endX = 0;
+	endWeight = 0;
+	for (x = 0; x != dstWidth; ++x)
+	{
+		endFractX += deltaX;
+		startX = endX;
+		endX = endFractX >> 12;
+		
+		spans[x].startX = startX;
+		spans[x].endX = (x != dstWidth - 1u) ? endX : startX;
+		spans[x].middleCount = endX - startX - 1;
+		spans[x].startWeight = 0xFF - endWeight;
+		endWeight = (endFractX >> 4) & 0xFF;
+		spans[x].endWeight = endWeight;
+		
+		for (p = 0; p != planes; ++p)
+		{
+			weights[x * planes + p] = spans[x].startWeight + endWeight + 0xFF * spans[x].middleCount;
+		}
+	}
+	
+	for (y = 0; y != srcPx.height; ++y)
+	{
+		for (x = 0; x != dstWidth; ++x)
+		{
+			Span span = spans[x];
+			for (p = 0; p != planes; ++p)
+			{
+				src = srcStart + span.startX * planes + p;
+				accum = 0;
+				for (m = span.middleCount; m != 0; --m)
+				{
+					src += planes;
+					accum += *src;
+				}
+				
+				sums[x * planes + p] = accum * 0xFF + srcStart[span.startX * planes + p] * span.startWeight + srcStart[span.endX * planes + p] * span.endWeight;
+			}
+		}
+		
+		for (i = 0; i + 16 <= xBytes; i += 16)
+		{
+			__m128i q0 = DivideSums_SSE2(_mm_loadu_si128((__m128i *)(sums + i)), _mm_loadu_pd(weights + i), _mm_loadu_pd(weights + i + 2));
+			__m128i q1 = DivideSums_SSE2(_mm_loadu_si128((__m128i *)(sums + i + 4)), _mm_loadu_pd(weights + i + 4), _mm_loadu_pd(weights + i + 6));
+			__m128i q2 = DivideSums_SSE2(_mm_loadu_si128((__m128i *)(sums + i + 8)), _mm_loadu_pd(weights + i + 8), _mm_loadu_pd(weights + i + 10));
+			__m128i q3 = DivideSums_SSE2(_mm_loadu_si128((__m128i *)(sums + i + 12)), _mm_loadu_pd(weights + i + 12), _mm_loadu_pd(weights + i + 14));
+			_mm_storeu_si128((__m128i *)(dst + i), PackQuotients_SSE2(q0, q1, q2, q3));
+		}
+		for (; i != xBytes; ++i)
+		{
+			dst[i] = sums[i] / (uint_fast32_t)weights[i];
+		}
+		
+		dst += xBytes;
+		srcStart += srcRowBytes;
+	}
+	
+	free(spans);
+	free(sums);
+	free(weights);
+	return YES;
+}
+
+#endif	// OO_TEXTURE_SCALING_SSE2
+
+
 static BOOL EnsureCorrectDataSize(OOPixMap *pixMap, BOOL leaveSpaceForMipMaps)
 {
 	size_t				correctSize;
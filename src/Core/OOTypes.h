@@ -165,14 +165,13 @@ typedef uint64_t	OOCreditsQuantity;
 typedef uint16_t	OOKeyCode;
 
 
-typedef uint16_t	OOUniversalID;		// Valid IDs range from 100 to 1000.
+typedef uint16_t	OOUniversalID;		// Valid IDs range from MIN_ENTITY_UID to MAX_ENTITY_UID.
 
 enum
 {
-	UNIVERSE_MAX_ENTITIES	= 2048,
 	NO_TARGET				= 0,
 	MIN_ENTITY_UID			= 100,
-	MAX_ENTITY_UID			= MIN_ENTITY_UID + UNIVERSE_MAX_ENTITIES + 1
+	MAX_ENTITY_UID			= 0xFFFF				// Limited by OOUniversalID.
 };
 
 
@@ -44,6 +44,18 @@ typedef struct
 } Octree_details;
 
 
+/*	Alongside the recursive octree buffer, each Octree keeps a flattened
+	breadth-first copy of its nodes for collision testing. The eight children
+	of a node are contiguous, and each node carries a mask of its non-empty
+	children, so the collision tests can walk the tree with an explicit stack
+	instead of recursing. Traversal order, and hence the results and the
+	collision marks used by the debug drawing, are the same as the recursive
+	tests, which are kept as a reference. Octrees too deep for the fixed
+	traversal stack have no flattened copy and use the recursive tests.
+*/
+struct OOOctreeFlatNode;
+
+
 @interface Octree: NSObject
 {
 	GLfloat			radius;
@@ -52,6 +64,9 @@ typedef struct
 	BOOL			hasCollision;
 	
 	unsigned char	*octree_collision;
+	
+	struct OOOctreeFlatNode	*flatNodes;
+	unsigned		flatDepth;
 }
 
 - (GLfloat)	radius;
@@ -31,6 +31,14 @@ MA 02110-1301, USA.
 #import "OODebugFlags.h"
 #import "NSObjectOOExtensions.h"
 
+#if OO_DEBUG
+#import "PlayerEntity.h"
+#import "OOShipRegistry.h"
+#import "OOMesh.h"
+#import "OOCollectionExtractors.h"
+#import "OOProfilingStopwatch.h"
+#endif
+
 
 #ifndef NDEBUG
 #define OctreeDebugLog(format, ...) do { if (EXPECT_NOT(gDebugFlags & DEBUG_OCTREE_LOGGING))  OOLog(@"octree.debug", format, ## __VA_ARGS__); } while (0)
@@ -40,8 +48,43 @@ MA 02110-1301, USA.
 #endif
 
 
+enum
+{
+	kMaxFlatOctreeDepth		= 16,
+	
+	// The traversal stacks hold one entry per level; octree-octree tests descend both octrees.
+	kFlatLineStackSize		= kMaxFlatOctreeDepth + 1,
+	kFlatOctreeStackSize	= 2 * kMaxFlatOctreeDepth + 1
+};
+
+
+struct OOOctreeFlatNode
+{
+	int32_t				firstChild;		// 0 if empty, -1 if solid, otherwise index of the first of eight children.
+	int32_t				source;			// Index of the node in octree and octree_collision.
+	uint8_t				childMask;		// Bit n is set if child n is not empty.
+};
+typedef struct OOOctreeFlatNode FlatNode;
+
+
+/*	The box tests use GCC/Clang vector extensions where the compiler supports
+	comparisons on them, which makes them SSE or NEON code as appropriate.
+	The lanes do exactly the arithmetic of the scalar tests, so results do not
+	depend on which is used.
+*/
+#if __clang__ || OOLITE_GCC_VERSION >= 40700
+#define OCTREE_VECTOR_TESTS		1
+typedef GLfloat OctreeVec __attribute__((vector_size(4 * sizeof (GLfloat))));
+typedef int32_t OctreeMask __attribute__((vector_size(4 * sizeof (int32_t))));
+#else
+#define OCTREE_VECTOR_TESTS		0
+#endif
+
+
 @interface Octree (Private)
 
+- (GLfloat) isHitByLineRecursive:(Vector)v0 :(Vector)v1;
+
 #ifndef OODEBUGLDRAWING_DISABLE
 
 - (void) drawOctreeFromLocation:(int) loc :(GLfloat) scale :(Vector) offset;
@@ -58,6 +101,10 @@ static Vector randomFullNodeFrom(Octree_details details, Vector offset);
 
 static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetails, Vector delta, Triangle other_ijk);
 
+static FlatNode *FlattenOctree(const int *octbuffer, int leafCount, unsigned *outDepth);
+static BOOL isHitByLineFlat(const FlatNode *nodes, unsigned char *collbuffer, GLfloat rad, Vector v0, Vector v1, BOOL *outEntered, GLfloat *outDistance);
+static BOOL isHitByOctreeFlat(const FlatNode *axialNodes, Octree_details axialDetails, const FlatNode *otherNodes, Octree_details otherDetails, Vector otherPosition, Triangle other_ijk);
+
 
 @implementation Octree
 
@@ -71,6 +118,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 	octree[0] = 0;
 	octree_collision[0] = (char)0;
 	hasCollision = NO;
+	flatNodes = FlattenOctree(octree, 1, &flatDepth);
 	return self;
 }
 
@@ -78,6 +126,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 {
 	free(octree);
 	free(octree_collision);
+	free(flatNodes);
 	[super dealloc];
 }
 
@@ -138,6 +187,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 	}
 	
 	copyRepresentationIntoOctree( octreeArray, octree, 0, 1);
+	flatNodes = FlattenOctree(octree, leafs, &flatDepth);
 	
 	return self;
 }
@@ -159,6 +209,7 @@ static BOOL	isHitByOctree(Octree_details axialDetails, Octree_details otherDetai
 		octree[i] = data[i];
 		octree_collision[i] = (char)0;
 	}
+	flatNodes = FlattenOctree(octree, leafs, &flatDepth);
 	
 	return self;
 }
@@ -211,6 +262,94 @@ Vector offsetForOctant(int oct, GLfloat r)
 }
 
 
+static FlatNode *FlattenOctree(const int *octbuffer, int leafCount, unsigned *outDepth)
+{
+	if (octbuffer == NULL || leafCount <= 0)  return NULL;
+	
+	// Every node of a well-formed octree buffer is reachable exactly once, so leafCount nodes is enough.
+	FlatNode *nodes = malloc(leafCount * sizeof *nodes);
+	if (nodes == NULL)  return NULL;
+	
+	int			i, oct, count = 1, levelEnd = 1;
+	unsigned	depth = 0;
+	
+	nodes[0].source = 0;
+	for (i = 0; i < count; i++)
+	{
+		if (i == levelEnd)
+		{
+			// Everything from here to count is on the next level down.
+			levelEnd = count;
+			if (++depth > kMaxFlatOctreeDepth)  goto FAIL;
+		}
+		
+		FlatNode *node = &nodes[i];
+		int value = octbuffer[node->source];
+		
+		node->childMask = 0;
+		if (value == 0 || value == -1)
+		{
+			node->firstChild = value;
+			continue;
+		}
+		
+		int first = node->source + value;
+		if (value < 0 || first + 8 > leafCount || count + 8 > leafCount)  goto FAIL;
+		
+		node->firstChild = count;
+		for (oct = 0; oct < 8; oct++)
+		{
+			nodes[count + oct].source = first + oct;
+			if (octbuffer[first + oct] != 0)  node->childMask |= 1 << oct;
+		}
+		count += 8;
+	}
+	
+	*outDepth = depth;
+	return nodes;
+	
+FAIL:
+	OOLog(@"octree.flatten.failed", @"Octree is too deep or malformed for flat collision tests, using recursive tests.");
+	free(nodes);
+	*outDepth = 0;
+	return NULL;
+}
+
+
+// YES if a cube of half-size radius at centre and one of half-size boxRadius at the origin are separated on some axis.
+OOINLINE BOOL CubesSeparated(Vector centre, GLfloat radius, GLfloat boxRadius)
+{
+#if OCTREE_VECTOR_TESTS
+	OctreeVec c = { centre.x, centre.y, centre.z, 0.0f };
+	OctreeVec r = { radius, radius, radius, radius };
+	OctreeVec b = { boxRadius, boxRadius, boxRadius, boxRadius };
+	OctreeMask m = (c + r < -b) | (c - r > b);
+	return (m[0] | m[1] | m[2]) != 0;
+#else
+	return	(centre.x + radius < -boxRadius)||(centre.x - radius > boxRadius)||
+			(centre.y + radius < -boxRadius)||(centre.y - radius > boxRadius)||
+			(centre.z + radius < -boxRadius)||(centre.z - radius > boxRadius);
+#endif
+}
+
+
+// YES if both ends of the line are outside the same face of the cube, in which case lineCubeIntersection() returns 0.
+OOINLINE BOOL LineOutsideOneFace(Vector u0, Vector u1, GLfloat rad)
+{
+#if OCTREE_VECTOR_TESTS
+	OctreeVec a = { u0.x, u0.y, u0.z, 0.0f };
+	OctreeVec b = { u1.x, u1.y, u1.z, 0.0f };
+	OctreeVec r = { rad, rad, rad, rad };
+	OctreeMask m = ((a > r) & (b > r)) | ((a < -r) & (b < -r));
+	return (m[0] | m[1] | m[2]) != 0;
+#else
+	return	(u0.x > rad && u1.x > rad)||(u0.x < -rad && u1.x < -rad)||
+			(u0.y > rad && u1.y > rad)||(u0.y < -rad && u1.y < -rad)||
+			(u0.z > rad && u1.z > rad)||(u0.z < -rad && u1.z < -rad);
+#endif
+}
+
+
 #ifndef OODEBUGLDRAWING_DISABLE
 
 - (void) drawOctree
@@ -396,6 +535,42 @@ OOINLINE BOOL isHitByLineSub(int* octbuffer, unsigned char* collbuffer, int next
 }
 
 
+// Work out which child octant a line entering a cube through the given faces meets first.
+static int octantIntersectedByLine(Vector u0, Vector u1, int faces, GLfloat rad)
+{
+	int octantIntersected = 0;
+	
+	if (faces > 0)
+	{
+		Vector vi = lineIntersectionWithFace( u0, u1, faces, rad);
+		
+		if (CUBE_FACE_FRONT & faces)
+			octantIntersected = ((vi.x < 0.0)? 1: 5) + ((vi.y < 0.0)? 0: 2);
+		if (CUBE_FACE_BACK & faces)
+			octantIntersected = ((vi.x < 0.0)? 0: 4) + ((vi.y < 0.0)? 0: 2);
+		
+		if (CUBE_FACE_RIGHT & faces)
+			octantIntersected = ((vi.y < 0.0)? 4: 6) + ((vi.z < 0.0)? 0: 1);
+		if (CUBE_FACE_LEFT & faces)
+			octantIntersected = ((vi.y < 0.0)? 0: 2) + ((vi.z < 0.0)? 0: 1);
+
+		if (CUBE_FACE_TOP & faces)
+			octantIntersected = ((vi.x < 0.0)? 2: 6) + ((vi.z < 0.0)? 0: 1);
+		if (CUBE_FACE_BOTTOM & faces)
+			octantIntersected = ((vi.x < 0.0)? 0: 4) + ((vi.z < 0.0)? 0: 1);
+
+		OctreeDebugLog(@"----> found intersection with face 0x%2x of cube of radius %.2f at ( %.2f, %.2f, %.2f) octant:%d",
+				faces, rad, vi.x, vi.y, vi.z, octantIntersected);
+	}
+	else
+	{	
+		OctreeDebugLog(@"----> inside cube of radius %.2f octant:%d", rad, octantIntersected);
+	}
+	
+	return octantIntersected;
+}
+
+
 BOOL hasCollided = NO;
 GLfloat hit_dist = 0.0;
 static BOOL isHitByLine(int* octbuffer, unsigned char* collbuffer, int level, GLfloat rad, Vector v0, Vector v1, Vector off, int face_hit)
@@ -431,34 +606,7 @@ static BOOL isHitByLine(int* octbuffer, unsigned char* collbuffer, int level, GL
 		return NO;
 	}
 	
-	int octantIntersected = 0;
-	
-	if (faces > 0)
-	{
-		Vector vi = lineIntersectionWithFace( u0, u1, faces, rad);
-		
-		if (CUBE_FACE_FRONT & faces)
-			octantIntersected = ((vi.x < 0.0)? 1: 5) + ((vi.y < 0.0)? 0: 2);
-		if (CUBE_FACE_BACK & faces)
-			octantIntersected = ((vi.x < 0.0)? 0: 4) + ((vi.y < 0.0)? 0: 2);
-		
-		if (CUBE_FACE_RIGHT & faces)
-			octantIntersected = ((vi.y < 0.0)? 4: 6) + ((vi.z < 0.0)? 0: 1);
-		if (CUBE_FACE_LEFT & faces)
-			octantIntersected = ((vi.y < 0.0)? 0: 2) + ((vi.z < 0.0)? 0: 1);
-
-		if (CUBE_FACE_TOP & faces)
-			octantIntersected = ((vi.x < 0.0)? 2: 6) + ((vi.z < 0.0)? 0: 1);
-		if (CUBE_FACE_BOTTOM & faces)
-			octantIntersected = ((vi.x < 0.0)? 0: 4) + ((vi.z < 0.0)? 0: 1);
-
-		OctreeDebugLog(@"----> found intersection with face 0x%2x of cube of radius %.2f at ( %.2f, %.2f, %.2f) octant:%d",
-				faces, rad, vi.x, vi.y, vi.z, octantIntersected);
-	}
-	else
-	{	
-		OctreeDebugLog(@"----> inside cube of radius %.2f octant:%d", rad, octantIntersected);
-	}
+	int octantIntersected = octantIntersectedByLine(u0, u1, faces, rad);
 	
 	hasCollided = YES;
 	
@@ -503,7 +651,110 @@ static BOOL isHitByLine(int* octbuffer, unsigned char* collbuffer, int level, GL
 	return NO;
 }
 
+typedef struct
+{
+	int32_t			node;
+	GLfloat			rad;
+	Vector			u0, u1;		// The line, displaced to the centre of the node.
+	uint8_t			firstOctant;
+	uint8_t			step;		// Number of children tried so far.
+} LineFrame;
+
+
+// Order in which isHitByLine() tests child octants, as offsets from the first octant hit.
+static const int kLineOctantOrder[8] = { 0, 1, 2, 4, 6, 5, 3, 7 };
+
+
+// Returns NO if the line misses the non-solid node, otherwise marks it and sets up a frame for testing its children.
+OOINLINE BOOL EnterLineFrame(LineFrame *frame, const FlatNode *node, int32_t index, unsigned char *collbuffer, GLfloat rad, Vector u0, Vector u1)
+{
+	if (LineOutsideOneFace(u0, u1, rad))  return NO;
+	
+	int faces = lineCubeIntersection(u0, u1, rad);
+	if (faces == 0)  return NO;
+	
+	collbuffer[node->source] = 1;	// red
+	
+	frame->node = index;
+	frame->rad = rad;
+	frame->u0 = u0;
+	frame->u1 = u1;
+	frame->firstOctant = octantIntersectedByLine(u0, u1, faces, rad);
+	frame->step = 0;
+	return YES;
+}
+
+
+/*	Iterative version of isHitByLine(). Each level of the stack steps through
+	the children of one node in the same order as the recursive version, so
+	nodes are visited - and marked - in the same order, and the first solid
+	node found is the same.
+*/
+static BOOL isHitByLineFlat(const FlatNode *nodes, unsigned char *collbuffer, GLfloat rad, Vector v0, Vector v1, BOOL *outEntered, GLfloat *outDistance)
+{
+	LineFrame		stack[kFlatLineStackSize];
+	unsigned		top = 0;
+	
+	if (nodes[0].firstChild == 0)  return NO;
+	if (nodes[0].firstChild == -1)
+	{
+		collbuffer[nodes[0].source] = 2;	// green
+		*outDistance = sqrt(v0.x * v0.x + v0.y * v0.y + v0.z * v0.z);
+		return YES;
+	}
+	if (!EnterLineFrame(&stack[0], &nodes[0], 0, collbuffer, rad, v0, v1))  return NO;
+	*outEntered = YES;
+	top = 1;
+	
+	while (top != 0)
+	{
+		LineFrame *frame = &stack[top - 1];
+		if (frame->step == 8)
+		{
+			top--;
+			continue;
+		}
+		
+		const FlatNode *node = &nodes[frame->node];
+		int oct = frame->firstOctant ^ kLineOctantOrder[frame->step++];
+		if (!(node->childMask & (1 << oct)))  continue;
+		
+		int32_t index = node->firstChild + oct;
+		const FlatNode *child = &nodes[index];
+		Vector moveLine = offsetForOctant(oct, frame->rad);
+		Vector u0 = make_vector(frame->u0.x + moveLine.x, frame->u0.y + moveLine.y, frame->u0.z + moveLine.z);
+		
+		if (child->firstChild == -1)
+		{
+			collbuffer[child->source] = 2;	// green
+			*outDistance = sqrt(u0.x * u0.x + u0.y * u0.y + u0.z * u0.z);
+			return YES;
+		}
+		
+		Vector u1 = make_vector(frame->u1.x + moveLine.x, frame->u1.y + moveLine.y, frame->u1.z + moveLine.z);
+		if (EnterLineFrame(&stack[top], child, index, collbuffer, 0.5 * frame->rad, u0, u1))  top++;
+	}
+	
+	return NO;
+}
+
+
 - (GLfloat) isHitByLine: (Vector) v0: (Vector) v1
+{
+	if (flatNodes == NULL)  return [self isHitByLineRecursive:v0 :v1];
+	
+	memset(octree_collision, 0, leafs * sizeof *octree_collision);
+	
+	BOOL	entered = NO;
+	GLfloat	distance = 0.0f;
+	BOOL	hit = isHitByLineFlat(flatNodes, octree_collision, radius, v0, v1, &entered, &distance);
+	
+	hasCollision = entered;
+	return hit ? distance : 0.0f;
+}
+
+
+- (GLfloat) isHitByLineRecursive:(Vector)v0 :(Vector)v1
 {
 	int i;
 	for (i = 0; i< leafs; i++) octree_collision[i] = (char)0;
@@ -664,11 +915,157 @@ BOOL	isHitByOctree(	Octree_details axialDetails,
 	return NO;
 }
 
+typedef struct
+{
+	int32_t			axial, other;
+	GLfloat			axialRadius, otherRadius;
+	unsigned		otherDepth;
+	Vector			otherPosition;	// In axial coordinates, relative to the centre of the axial node.
+	uint8_t			nearestOctant;
+	uint8_t			step;			// Number of children tried so far.
+	BOOL			splitOther;		// YES if stepping through the other node's children, NO for the axial node's.
+} OctreeFrame;
+
+
+/*	Iterative version of isHitByOctree(). As with isHitByLineFlat(), each
+	level of the stack steps through the children of one node in the same
+	order as the recursive version. The offsets of the other octree's
+	children, which need transforming into axial coordinates, depend only on
+	the level, so they are worked out once per level rather than once per
+	node.
+*/
+static BOOL isHitByOctreeFlat(const FlatNode *axialNodes, Octree_details axialDetails, const FlatNode *otherNodes, Octree_details otherDetails, Vector otherPosition, Triangle other_ijk)
+{
+	OctreeFrame			stack[kFlatOctreeStackSize];
+	unsigned			top = 0;
+	Vector				otherOffsets[kMaxFlatOctreeDepth][8];
+	uint32_t			otherOffsetsReady = 0;
+	int					oct;
+	
+	if (axialNodes[0].firstChild == 0 || otherNodes[0].firstChild == 0)  return NO;
+	
+	int32_t		axial = 0, other = 0;
+	GLfloat		axialRadius = axialDetails.radius, otherRadius = otherDetails.radius;
+	unsigned	otherDepth = 0;
+	Vector		position = otherPosition;
+	
+	for (;;)
+	{
+		// Test the pair of nodes in axial, other and position.
+		BOOL separated;
+		if (otherRadius < axialRadius)
+		{
+			separated = CubesSeparated(position, otherRadius, axialRadius);
+		}
+		else
+		{
+			Vector	d2 = make_vector( - position.x, - position.y, -position.z);
+			Vector	axialPosition = resolveVectorInIJK( d2, other_ijk);
+			separated = CubesSeparated(axialPosition, axialRadius, otherRadius);
+		}
+		
+		if (!separated)
+		{
+			const FlatNode *axialNode = &axialNodes[axial];
+			const FlatNode *otherNode = &otherNodes[other];
+			OctreeFrame *frame = &stack[top++];
+			
+			frame->axial = axial;
+			frame->other = other;
+			frame->axialRadius = axialRadius;
+			frame->otherRadius = otherRadius;
+			frame->otherDepth = otherDepth;
+			frame->otherPosition = position;
+			frame->step = 0;
+			
+			if (axialNode->firstChild == -1)
+			{
+				if (otherNode->firstChild == -1)
+				{
+					axialDetails.octree_collision[axialNode->source] = (unsigned char)255;	// mark
+					otherDetails.octree_collision[otherNode->source] = (unsigned char)255;	// mark
+					return YES;
+				}
+				
+				if (!(otherOffsetsReady & (1U << otherDepth)))
+				{
+					for (oct = 0; oct < 8; oct++)
+					{
+						otherOffsets[otherDepth][oct] = resolveVectorInIJK( offsetForOctant( oct, otherRadius), other_ijk);
+					}
+					otherOffsetsReady |= 1U << otherDepth;
+				}
+				frame->splitOther = YES;
+				frame->nearestOctant = ((position.x > 0.0)? 0:4)|((position.y > 0.0)? 0:2)|((position.z > 0.0)? 0:1);
+			}
+			else
+			{
+				frame->splitOther = NO;
+				frame->nearestOctant = ((position.x > 0.0)? 4:0)|((position.y > 0.0)? 2:0)|((position.z > 0.0)? 1:0);
+			}
+		}
+		
+		// Find the next pair to test, nearest octant first.
+		for (;;)
+		{
+			if (top == 0)  return NO;
+			
+			OctreeFrame *frame = &stack[top - 1];
+			if (frame->step == 8)
+			{
+				top--;
+				continue;
+			}
+			
+			oct = frame->nearestOctant ^ change_oct[frame->step++];
+			
+			axial = frame->axial;
+			other = frame->other;
+			axialRadius = frame->axialRadius;
+			otherRadius = frame->otherRadius;
+			otherDepth = frame->otherDepth;
+			position = frame->otherPosition;
+			
+			if (frame->splitOther)
+			{
+				const FlatNode *otherNode = &otherNodes[other];
+				if (!(otherNode->childMask & (1 << oct)))  continue;
+				
+				Vector voff = otherOffsets[otherDepth][oct];
+				other = otherNode->firstChild + oct;
+				otherRadius = 0.5 * otherRadius;
+				otherDepth++;
+				position = make_vector(position.x - voff.x, position.y - voff.y, position.z - voff.z);
+			}
+			else
+			{
+				const FlatNode *axialNode = &axialNodes[axial];
+				if (!(axialNode->childMask & (1 << oct)))  continue;
+				
+				Vector voff = offsetForOctant(oct, axialRadius);
+				axial = axialNode->firstChild + oct;
+				axialRadius = 0.5 * axialRadius;
+				position = make_vector(position.x + voff.x, position.y + voff.y, position.z + voff.z);
+			}
+			break;
+		}
+	}
+}
+
+
 - (BOOL) isHitByOctree:(Octree*) other withOrigin: (Vector) v0 andIJK: (Triangle) ijk
 {
 	if (other == nil)  return NO;
 	
-	BOOL hit = isHitByOctree( [self octreeDetails], [other octreeDetails], v0, ijk);
+	BOOL hit;
+	if (flatNodes != NULL && other->flatNodes != NULL)
+	{
+		hit = isHitByOctreeFlat(flatNodes, [self octreeDetails], other->flatNodes, [other octreeDetails], v0, ijk);
+	}
+	else
+	{
+		hit = isHitByOctree( [self octreeDetails], [other octreeDetails], v0, ijk);
+	}
 	
 	hasCollision = hasCollision | hit;
 	[other setHasCollision: [other hasCollision] | hit];
@@ -684,7 +1081,15 @@ BOOL	isHitByOctree(	Octree_details axialDetails,
 	details1.radius *= s1;
 	details2.radius *= s2;
 	
-	BOOL hit = isHitByOctree( details1, details2, v0, ijk);
+	BOOL hit;
+	if (flatNodes != NULL && other != nil && other->flatNodes != NULL)
+	{
+		hit = isHitByOctreeFlat(flatNodes, details1, other->flatNodes, details2, v0, ijk);
+	}
+	else
+	{
+		hit = isHitByOctree( details1, details2, v0, ijk);
+	}
 	
 	hasCollision = hasCollision | hit;
 	[other setHasCollision: [other hasCollision] | hit];
@@ -800,8 +1205,152 @@ static Vector randomFullNodeFrom(Octree_details details, Vector offset)
 #ifndef NDEBUG
 - (size_t) totalSize
 {
-	return [self oo_objectSize] + leafs * (sizeof *octree + sizeof *octree_collision);
+	return [self oo_objectSize] + leafs * (sizeof *octree + sizeof *octree_collision) + (flatNodes != NULL ? leafs * sizeof *flatNodes : 0);
 }
 #endif
 
 @end
+
+
+#if OO_DEBUG
+
+typedef struct
+{
+	Octree			*octree;
+	Vector			v0, v1;
+} OctreeLineTest;
+
+
+typedef struct
+{
+	Octree			*axial, *other;
+	Vector			position;
+	Triangle		ijk;
+} OctreePairTest;
+
+
+@implementation PlayerEntity (OOOctreeBenchmark)
+
+// :setM octreeBench PS.callObjC("benchmarkOctreeCollisions:", PARAM)
+// :octreeBench 20000
+
+- (NSString *) benchmarkOctreeCollisions:(NSString *)countString
+{
+	int				count = [countString intValue];
+	if (count <= 0)  count = 20000;
+	if (count > 1000000)  count = 1000000;
+	
+	// Collect the hull octrees of the player and demo ship models.
+	OOShipRegistry	*registry = [OOShipRegistry sharedRegistry];
+	NSMutableSet	*shipKeys = [NSMutableSet setWithArray:[registry playerShipKeys]];
+	[shipKeys addObjectsFromArray:[registry demoShipKeys]];
+	NSMutableArray	*octrees = [NSMutableArray array];
+	NSEnumerator	*keyEnum = nil;
+	NSString		*key = nil;
+	
+	for (keyEnum = [shipKeys objectEnumerator]; (key = [keyEnum nextObject]); )
+	{
+		NSDictionary *shipDict = [registry shipInfoForKey:key];
+		NSString *modelName = [shipDict oo_stringForKey:@"model"];
+		if (modelName == nil)  continue;
+		
+		OOMesh *mesh = [OOMesh meshWithName:modelName
+								   cacheKey:key
+						 materialDictionary:nil
+						  shadersDictionary:nil
+									 smooth:[shipDict oo_boolForKey:@"smooth" defaultValue:NO]
+							   shaderMacros:nil
+						shaderBindingTarget:nil];
+		Octree *octree = [mesh octree];
+		if (octree != nil && [octree radius] > 0.0f)  [octrees addObject:octree];
+	}
+	
+	unsigned		modelCount = [octrees count];
+	if (modelCount == 0)  return @"No ship models with octrees.";
+	
+	OctreeLineTest	*lineTests = malloc(count * sizeof *lineTests);
+	OctreePairTest	*pairTests = malloc(count * sizeof *pairTests);
+	GLfloat			*lineResults = malloc(count * sizeof *lineResults);
+	BOOL			*pairResults = malloc(count * sizeof *pairResults);
+	if (lineTests == NULL || pairTests == NULL || lineResults == NULL || pairResults == NULL)
+	{
+		free(lineTests);
+		free(pairTests);
+		free(lineResults);
+		free(pairResults);
+		return @"Out of memory.";
+	}
+	
+	/*	Laser-like lines from outside each hull towards somewhere inside its
+		bounding sphere, and pairs of hulls placed close enough for their
+		bounding spheres to overlap, which is when the game tests octrees.
+	*/
+	int				i;
+	for (i = 0; i < count; i++)
+	{
+		Octree *octree = [octrees objectAtIndex:Ranrot() % modelCount];
+		GLfloat r = [octree radius];
+		lineTests[i].octree = octree;
+		lineTests[i].v0 = vector_multiply_scalar(OORandomUnitVector(), 2.0f * r);
+		lineTests[i].v1 = OOVectorRandomSpatial(r);
+		
+		Octree *other = [octrees objectAtIndex:Ranrot() % modelCount];
+		Quaternion q = OORandomQuaternion();
+		pairTests[i].axial = octree;
+		pairTests[i].other = other;
+		pairTests[i].position = OOVectorRandomSpatial(r + [other radius]);
+		pairTests[i].ijk.v[0] = vector_right_from_quaternion(q);
+		pairTests[i].ijk.v[1] = vector_up_from_quaternion(q);
+		pairTests[i].ijk.v[2] = vector_forward_from_quaternion(q);
+	}
+	
+	NSMutableString	*result = [NSMutableString stringWithFormat:@"%u models, %i tests of each kind:", modelCount, count];
+	unsigned		hits = 0, mismatches = 0;
+	OOProfilingStopwatch *stopwatch = [OOProfilingStopwatch stopwatch];
+	OOTimeDelta		recursiveTime, flatTime;
+	
+	// Line tests.
+	[stopwatch reset];
+	for (i = 0; i < count; i++)
+	{
+		lineResults[i] = [lineTests[i].octree isHitByLineRecursive:lineTests[i].v0 :lineTests[i].v1];
+	}
+	recursiveTime = [stopwatch reset];
+	for (i = 0; i < count; i++)
+	{
+		GLfloat distance = [lineTests[i].octree isHitByLine:lineTests[i].v0 :lineTests[i].v1];
+		if (distance != 0.0f)  hits++;
+		if (distance != lineResults[i])  mismatches++;
+	}
+	flatTime = [stopwatch reset];
+	[result appendFormat:@"\n  line: recursive %8.3f ms, flat %8.3f ms, %u hits, %u mismatches", recursiveTime * 1000.0, flatTime * 1000.0, hits, mismatches];
+	
+	// Octree-octree tests.
+	hits = 0;
+	mismatches = 0;
+	[stopwatch reset];
+	for (i = 0; i < count; i++)
+	{
+		pairResults[i] = isHitByOctree([pairTests[i].axial octreeDetails], [pairTests[i].other octreeDetails], pairTests[i].position, pairTests[i].ijk);
+	}
+	recursiveTime = [stopwatch reset];
+	for (i = 0; i < count; i++)
+	{
+		BOOL hit = [pairTests[i].axial isHitByOctree:pairTests[i].other withOrigin:pairTests[i].position andIJK:pairTests[i].ijk];
+		if (hit)  hits++;
+		if (hit != pairResults[i])  mismatches++;
+	}
+	flatTime = [stopwatch reset];
+	[result appendFormat:@"\noctree: recursive %8.3f ms, flat %8.3f ms, %u hits, %u mismatches", recursiveTime * 1000.0, flatTime * 1000.0, hits, mismatches];
+	
+	free(lineTests);
+	free(pairTests);
+	free(lineResults);
+	free(pairResults);
+	
+	return result;
+}
+
+@end
+
+#endif
@@ -83,6 +83,12 @@ typedef enum
 + (NSString *) stringFromFilesNamed:(NSString *)fileName inFolder:(NSString *)folderName;
 + (NSString *) stringFromFilesNamed:(NSString *)fileName inFolder:(NSString *)folderName cache:(BOOL)useCache;
 
+/*	Contents of the file found by +pathForFileNamed:inFolder:, memory-mapped
+	rather than read in, so pages are only loaded as they are used. The data
+	is read-only.
+*/
++ (NSData *) dataForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName;
+
 + (NSDictionary *)loadScripts;
 
 + (BOOL) writeDiagnosticData:(NSData *)data toFileNamed:(NSString *)name;
@@ -34,6 +34,7 @@ MA 02110-1301, USA.
 #import "MyOpenGLView.h"
 #import "OOCollectionExtractors.h"
 #import "OOLogOutputHandler.h"
+#import "OOResourceIndex.h"
 
 #import "OOJSScript.h"
 #import "OOPListScript.h"
@@ -44,10 +45,14 @@ MA 02110-1301, USA.
 static NSString * const kOOLogCacheUpToDate				= @"dataCache.upToDate";
 static NSString * const kOOLogCacheExplicitFlush		= @"dataCache.rebuild.explicitFlush";
 static NSString * const kOOLogCacheStalePaths			= @"dataCache.rebuild.pathsChanged";
-static NSString * const kOOLogCacheStaleDates			= @"dataCache.rebuild.datesChanged";
-static NSString * const kOOCacheSearchPathModDates		= @"search path modification dates";
+static NSString * const kOOLogCacheStaleContents		= @"dataCache.rebuild.contentsChanged";
+static NSString * const kOOCacheSearchPathContents		= @"search path contents";
 static NSString * const kOOCacheKeySearchPaths			= @"search paths";
-static NSString * const kOOCacheKeyModificationDates	= @"modification dates";
+static NSString * const kOOCacheKeyContentDigests		= @"content digests";
+static NSString * const kOOCacheResolvedPaths			= @"resolved paths";
+
+static NSArray *FileKeyedCaches(void);
+static NSString *SourceFileNameForCacheKey(NSString *cacheName, NSString *key);
 
 
 extern NSDictionary* ParseOOSScripts(NSString* script);
@@ -61,6 +66,8 @@ extern NSDictionary* ParseOOSScripts(NSString* script);
 + (void) addErrorWithKey:(NSString *)descriptionKey param1:(id)param1 param2:(id)param2;
 + (void) checkCacheUpToDateForPaths:(NSArray *)searchPaths;
 + (void) logPaths;
++ (OOResourceIndex *) resourceIndex;
++ (NSArray *) pathsForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName;
 
 @end
 
@@ -70,6 +77,7 @@ static BOOL				sUseAddOns = YES;
 static NSMutableArray	*sOXPsWithMessagesFound;
 static NSMutableArray	*sExternalPaths;
 static NSMutableArray	*sErrors;
+static OOResourceIndex	*sResourceIndex;
 
 // caches allow us to load any given file once only
 //
@@ -281,6 +289,7 @@ static NSMutableDictionary *sStringCache;
 	if (![sSearchPaths containsObject:path])
 	{
 		[sSearchPaths addObject:path];
+		DESTROY(sResourceIndex);
 		
 		if (sExternalPaths == nil)  sExternalPaths = [[NSMutableArray alloc] init];
 		[sExternalPaths addObject:path];
@@ -429,67 +438,127 @@ static NSMutableDictionary *sStringCache;
 + (void)checkCacheUpToDateForPaths:(NSArray *)searchPaths
 {
 	/*	Check if caches are up to date.
-		The strategy is to use a two-entry cache. One entry is an array
-		containing the search paths, the other an array of modification dates
-		(in the same order). If either fails to match the correct settings,
-		we delete both.
+		The cache holds the search paths and, in the same order, the resource
+		index's digest of each one's contents. If the paths have changed, all
+		cached data except the index's own listings is deleted. If only the
+		contents have changed, the caches listed by FileKeyedCaches() are also
+		kept, except for entries built from files which were added, removed or
+		modified.
 	*/
 	OOCacheManager		*cacheMgr = [OOCacheManager sharedCache];
-	NSFileManager		*fmgr = [NSFileManager defaultManager];
-	BOOL				upToDate = YES;
+	BOOL				flush = NO;
 	id					oldPaths = nil;
-	NSMutableArray		*modDates = nil;
-	NSEnumerator		*pathEnum = nil;
-	NSString			*path = nil;
-	id					modDate = nil;
+	NSArray				*digests = nil;
+	NSMutableSet		*changedNames = nil;
+	NSString			*name = nil;
+	NSString			*cacheName = nil;
+	NSString			*key = nil;
 	
 	if ([[NSUserDefaults standardUserDefaults] boolForKey:@"always-flush-cache"])
 	{
 		OOLog(kOOLogCacheExplicitFlush, @"Cache explicitly flushed with always-flush-cache preference. Rebuilding from scratch.");
-		upToDate = NO;
+		flush = YES;
 	}
 	
-	if (upToDate && [MyOpenGLView pollShiftKey])
+	if (!flush && [MyOpenGLView pollShiftKey])
 	{
 		OOLog(kOOLogCacheExplicitFlush, @"Cache explicitly flushed with shift key. Rebuilding from scratch.");
-		upToDate = NO;
+		flush = YES;
 	}
 	
-	oldPaths = [cacheMgr objectForKey:kOOCacheKeySearchPaths inCache:kOOCacheSearchPathModDates];
-	if (upToDate && ![oldPaths isEqual:searchPaths])
+	// An explicit flush also discards the listings, so the index is built from scratch.
+	if (flush)  [cacheMgr clearAllCaches];
+	
+	// Index the paths we were given, rather than calling back into +paths while they're being set up.
+	[sResourceIndex release];
+	sResourceIndex = [[OOResourceIndex alloc] initWithSearchPaths:searchPaths];
+	digests = [sResourceIndex contentDigests];
+	oldPaths = [cacheMgr objectForKey:kOOCacheKeySearchPaths inCache:kOOCacheSearchPathContents];
+	
+	if (flush)
+	{
+		// Already cleared.
+	}
+	else if (![oldPaths isEqual:searchPaths])
 	{
 		// OXPs added/removed
 		if (oldPaths != nil) OOLog(kOOLogCacheStalePaths, @"Cache is stale (search paths have changed). Rebuilding from scratch.");
-		upToDate = NO;
+		[cacheMgr clearAllCachesExcept:[NSArray arrayWithObject:kOOCacheResourceIndex]];
 	}
-	
-	// Build modification date list. (We need this regardless of whether the search paths matched.)
-	
-	modDates = [NSMutableArray arrayWithCapacity:[searchPaths count]];
-	for (pathEnum = [searchPaths objectEnumerator]; (path = [pathEnum nextObject]); )
+	else if (![[cacheMgr objectForKey:kOOCacheKeyContentDigests inCache:kOOCacheSearchPathContents] isEqual:digests])
 	{
-		modDate = [[fmgr fileAttributesAtPath:path traverseLink:YES] objectForKey:NSFileModificationDate];
-		if (modDate != nil)
+		changedNames = [NSMutableSet set];
+		foreach (name, [sResourceIndex changedFileNames])
 		{
-			// Converts to double because I'm not sure the cache can deal with dates under GNUstep.
-			modDate = [NSNumber numberWithDouble:[modDate timeIntervalSince1970]];
-			[modDates addObject:modDate];
+			[changedNames addObject:[name lowercaseString]];
 		}
-	}
+		OOLog(kOOLogCacheStaleContents, @"Cache is stale (%u files have changed). Rebuilding, keeping data from other files.", [changedNames count]);
+		
+		[cacheMgr clearAllCachesExcept:[FileKeyedCaches() arrayByAddingObject:kOOCacheResourceIndex]];
 		
-	if (upToDate && ![[cacheMgr objectForKey:kOOCacheKeyModificationDates inCache:kOOCacheSearchPathModDates] isEqual:modDates])
+		foreach (cacheName, FileKeyedCaches())
+		{
+			foreach (key, [cacheMgr keysInCache:cacheName])
+			{
+				if ([changedNames containsObject:SourceFileNameForCacheKey(cacheName, key)])
+				{
+					[cacheMgr removeObjectForKey:key inCache:cacheName];
+				}
+			}
+		}
+	}
+	else
+	{
+		OOLog(kOOLogCacheUpToDate, @"Data cache is up to date.");
+		return;
+	}
+	
+	[cacheMgr setObject:searchPaths forKey:kOOCacheKeySearchPaths inCache:kOOCacheSearchPathContents];
+	[cacheMgr setObject:digests forKey:kOOCacheKeyContentDigests inCache:kOOCacheSearchPathContents];
+}
+
+
+/*	Caches whose entries are each built from the files of one name, found
+	from the entry's key by SourceFileNameForCacheKey(). When files change,
+	only their entries are dropped from these; other caches are cleared.
+*/
+static NSArray *FileKeyedCaches(void)
+{
+	static NSArray *sCaches = nil;
+	
+	if (sCaches == nil)
 	{
-		OOLog(kOOLogCacheStaleDates, @"Cache is stale (modification dates have changed). Rebuilding from scratch.");
-		upToDate = NO;
+		sCaches = [[NSArray alloc] initWithObjects:
+				   kOOCacheResolvedPaths,				// "name"
+				   @"dictionaries",						// "Folder/name merge:mode"
+				   @"arrays",							// "Folder/name merge:mode"
+				   @"AIs",								// "name"
+				   @"compiled JavaScript scripts",		// "path"
+				   @"sanitized legacy scripts",			// "path"
+				   @"OOMesh",							// "name:normalMode"
+				   @"octrees",							// "name"
+				   nil];
 	}
 	
-	if (!upToDate)
+	return sCaches;
+}
+
+
+static NSString *SourceFileNameForCacheKey(NSString *cacheName, NSString *key)
+{
+	NSRange suffix = { NSNotFound, 0 };
+	
+	if ([cacheName isEqualToString:@"dictionaries"] || [cacheName isEqualToString:@"arrays"])
 	{
-		[cacheMgr clearAllCaches];
-		[cacheMgr setObject:searchPaths forKey:kOOCacheKeySearchPaths inCache:kOOCacheSearchPathModDates];
-		[cacheMgr setObject:modDates forKey:kOOCacheKeyModificationDates inCache:kOOCacheSearchPathModDates];
+		suffix = [key rangeOfString:@" merge:" options:NSBackwardsSearch];
 	}
-	else OOLog(kOOLogCacheUpToDate, @"Data cache is up to date.");
+	else if ([cacheName isEqualToString:@"OOMesh"])
+	{
+		suffix = [key rangeOfString:@":" options:NSBackwardsSearch];
+	}
+	if (suffix.location != NSNotFound)  key = [key substringToIndex:suffix.location];
+	
+	return [[key lastPathComponent] lowercaseString];
 }
 
 
@@ -512,7 +581,6 @@ static NSMutableDictionary *sStringCache;
 	NSString		*mergeType = nil;
 	OOCacheManager	*cacheMgr = [OOCacheManager sharedCache];
 	NSEnumerator	*enumerator = nil;
-	NSString		*path = nil;
 	NSString		*dictPath = nil;
 	NSDictionary	*dict = nil;
 	
@@ -555,15 +623,8 @@ static NSMutableDictionary *sStringCache;
 	if (mergeMode == MERGE_NONE)
 	{
 		// Find "last" matching dictionary
-		for (enumerator = [ResourceManager reversePathEnumerator]; (path = [enumerator nextObject]); )
+		for (enumerator = [[self pathsForFileNamed:fileName inFolder:folderName] reverseObjectEnumerator]; (dictPath = [enumerator nextObject]); )
 		{
-			if (folderName != nil)
-			{
-				dictPath = [[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
-				dict = OODictionaryFromFile(dictPath);
-				if (dict != nil)  break;
-			}
-			dictPath = [path stringByAppendingPathComponent:fileName];
 			dict = OODictionaryFromFile(dictPath);
 			if (dict != nil)  break;
 		}
@@ -573,17 +634,10 @@ static NSMutableDictionary *sStringCache;
 	{
 		// Find all matching dictionaries
 		results = [NSMutableArray array];
-		for (enumerator = [ResourceManager pathEnumerator]; (path = [enumerator nextObject]); )
+		for (enumerator = [[self pathsForFileNamed:fileName inFolder:folderName] objectEnumerator]; (dictPath = [enumerator nextObject]); )
 		{
-			dictPath = [path stringByAppendingPathComponent:fileName];
 			dict = OODictionaryFromFile(dictPath);
 			if (dict != nil)  [results addObject:dict];
-			if (folderName != nil)
-			{
-				dictPath = [[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
-				dict = OODictionaryFromFile(dictPath);
-				if (dict != nil)  [results addObject:dict];
-			}
 		}
 		
 		if ([results count] == 0)  return nil;
@@ -618,7 +672,6 @@ static NSMutableDictionary *sStringCache;
 	NSString		*cacheKey = nil;
 	OOCacheManager	*cache = [OOCacheManager sharedCache];
 	NSEnumerator	*enumerator = nil;
-	NSString		*path = nil;
 	NSString		*arrayPath = nil;
 	NSMutableArray	*array = nil;
 	NSArray			*arrayNonEditable = nil;
@@ -635,15 +688,8 @@ static NSMutableDictionary *sStringCache;
 	if (!mergeFiles)
 	{
 		// Find "last" matching array
-		for (enumerator = [ResourceManager reversePathEnumerator]; (path = [enumerator nextObject]); )
+		for (enumerator = [[self pathsForFileNamed:fileName inFolder:folderName] reverseObjectEnumerator]; (arrayPath = [enumerator nextObject]); )
 		{
-			if (folderName != nil)
-			{
-				arrayPath = [[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
-				arrayNonEditable = OOArrayFromFile(arrayPath);
-				if (arrayNonEditable != nil)  break;
-			}
-			arrayPath = [path stringByAppendingPathComponent:fileName];
 			arrayNonEditable = OOArrayFromFile(arrayPath);
 			if (arrayNonEditable != nil)  break;
 		}
@@ -653,9 +699,8 @@ static NSMutableDictionary *sStringCache;
 	{
 		// Find all matching arrays
 		results = [NSMutableArray array];
-		for (enumerator = [ResourceManager pathEnumerator]; (path = [enumerator nextObject]); )
+		for (enumerator = [[self pathsForFileNamed:fileName inFolder:folderName] objectEnumerator]; (arrayPath = [enumerator nextObject]); )
 		{
-			arrayPath = [path stringByAppendingPathComponent:fileName];
 			array = [[OOArrayFromFile(arrayPath) mutableCopy] autorelease];
 			if (array != nil) [results addObject:array];
 	
@@ -667,18 +712,6 @@ static NSMutableDictionary *sStringCache;
 				if ([[fileName lowercaseString] isEqualToString:@"equipment.plist"])
 					[self handleEquipmentListMerging:results forLookupIndex:3]; // Index 3 is the role string (EQ_*).
 			}
-			if (folderName != nil)
-			{
-				arrayPath = [[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
-				array = [[OOArrayFromFile(arrayPath) mutableCopy] autorelease];
-				if (array != nil)  [results addObject:array];
-				
-				if ([array count] != 0 && [[array objectAtIndex:0] isKindOfClass:[NSArray class]])
-				{
-					if ([[fileName lowercaseString] isEqualToString:@"equipment.plist"])
-						[self handleEquipmentListMerging:results forLookupIndex:3]; // Index 3 is the role string (EQ_*).
-				}
-			}
 		}
 		
 		if ([results count] == 0)  return nil;
@@ -762,47 +795,56 @@ static NSMutableDictionary *sStringCache;
 {
 	NSString		*result = nil;
 	NSString		*cacheKey = nil;
+	NSString		*nameKey = nil;
+	NSDictionary	*resolved = nil;
 	OOCacheManager	*cache = [OOCacheManager sharedCache];
+	OOResourceIndex	*index = nil;
 	NSEnumerator	*pathEnum = nil;
-	NSString		*path = nil;
 	NSString		*filePath = nil;
 	NSFileManager	*fmgr = nil;
 	
 	if (fileName == nil)  return nil;
 	
-	if (cache)
+	/*	Resolved paths are grouped by file name, so that those affected by a
+		changed file can be discarded together by +checkCacheUpToDateForPaths:.
+	*/
+	if (useCache)
 	{
 		if (folderName != nil)  cacheKey = [NSString stringWithFormat:@"%@/%@", folderName, fileName];
 		else  cacheKey = fileName;
-		result = [cache objectForKey:cacheKey inCache:@"resolved paths"];
+		nameKey = [[fileName lastPathComponent] lowercaseString];
+		resolved = [cache objectForKey:nameKey inCache:kOOCacheResolvedPaths];
+		result = [resolved oo_stringForKey:cacheKey];
 		if (result != nil)  return result;
 	}
 	
 	// Search for file
-	fmgr = [NSFileManager defaultManager];
-	for (pathEnum = [[ResourceManager paths] reverseObjectEnumerator]; (path = [pathEnum nextObject]); )
+	index = [self resourceIndex];
+	if ([index canResolveFileNamed:fileName inFolder:folderName])
 	{
-		filePath = [[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName];
-		if ([fmgr fileExistsAtPath:filePath])
-		{
-			result = filePath;
-			break;
-		}
-		
-		filePath = [path stringByAppendingPathComponent:fileName];
-		if ([fmgr fileExistsAtPath:filePath])
+		result = [index pathForFileNamed:fileName inFolder:folderName];
+	}
+	else
+	{
+		fmgr = [NSFileManager defaultManager];
+		for (pathEnum = [[self pathsForFileNamed:fileName inFolder:folderName] reverseObjectEnumerator]; (filePath = [pathEnum nextObject]); )
 		{
-			result = filePath;
-			break;
+			if ([fmgr fileExistsAtPath:filePath])
+			{
+				result = filePath;
+				break;
+			}
 		}
 	}
 	
 	if (result != nil)
 	{
-		OOLog(@"resourceManager.foundFile", @"Found %@/%@ at %@", folderName, fileName, filePath);
+		OOLog(@"resourceManager.foundFile", @"Found %@/%@ at %@", folderName, fileName, result);
 		if (useCache)
 		{
-			[cache setObject:result forKey:cacheKey inCache:@"resolved paths"];
+			NSMutableDictionary *newResolved = [NSMutableDictionary dictionaryWithDictionary:resolved];
+			[newResolved setObject:result forKey:cacheKey];
+			[cache setObject:newResolved forKey:nameKey inCache:kOOCacheResolvedPaths];
 		}
 	}
 	return result;
@@ -889,7 +931,7 @@ static NSMutableDictionary *sStringCache;
 	}
 	
 	path = [self pathForFileNamed:fileName inFolder:folderName cache:useCache];
-	if (path != nil)  result = [NSString stringWithContentsOfUnicodeFile:path];
+	if (path != nil)  result = [NSString stringWithUnicodeData:[NSData dataWithContentsOfMappedFile:path]];
 	
 	if (result != nil && useCache)
 	{
@@ -901,6 +943,15 @@ static NSMutableDictionary *sStringCache;
 }
 
 
++ (NSData *) dataForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName
+{
+	NSString *path = [self pathForFileNamed:fileName inFolder:folderName];
+	if (path == nil)  return nil;
+	
+	return [NSData dataWithContentsOfMappedFile:path];
+}
+
+
 + (NSDictionary *)loadScripts
 {
 	NSMutableDictionary			*loadedScripts = nil;
@@ -1051,6 +1102,42 @@ static NSMutableDictionary *sStringCache;
 	sSoundCache = nil;
 	[sStringCache release];
 	sStringCache = nil;
+	DESTROY(sResourceIndex);
+}
+
+
++ (OOResourceIndex *) resourceIndex
+{
+	if (sResourceIndex == nil)
+	{
+		sResourceIndex = [[OOResourceIndex alloc] initWithSearchPaths:[self paths]];
+	}
+	
+	return sResourceIndex;
+}
+
+
+/*	Every place a file may be found, in merge order. Where the resource index
+	can answer, only files which exist are included; otherwise, each must be
+	checked.
+*/
++ (NSArray *) pathsForFileNamed:(NSString *)fileName inFolder:(NSString *)folderName
+{
+	OOResourceIndex		*index = [self resourceIndex];
+	NSMutableArray		*result = nil;
+	NSEnumerator		*pathEnum = nil;
+	NSString			*path = nil;
+	
+	if ([index canResolveFileNamed:fileName inFolder:folderName])  return [index pathsForFileNamed:fileName inFolder:folderName];
+	
+	result = [NSMutableArray array];
+	for (pathEnum = [self pathEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		[result addObject:[path stringByAppendingPathComponent:fileName]];
+		if (folderName != nil)  [result addObject:[[path stringByAppendingPathComponent:folderName] stringByAppendingPathComponent:fileName]];
+	}
+	
+	return result;
 }
 
 @end
@@ -89,13 +89,35 @@ void OOJSStopTimeLimiter(void);
 */
 
 
-@class OOTimeProfile, OOTimeProfileEntry;
+/*
+	Timeline recording.
+	
+	OOJSBeginTimelineRecording(capacity), OOJSEndTimelineRecording(),
+	OOJSIsRecordingTimeline()
+	Start, stop and query timeline recording. While recording, every entry to
+	and exit from a profileable function (and, with MOZ_TRACE_JSCALLS, every
+	JavaScript function) is recorded with a time stamp in a ring buffer of
+	capacity events (0 for the default), so a recording can be left running
+	for as long as needed and holds the most recent activity. Unlike
+	profiling, recording spans game frames; it is a hard error to start
+	profiling or recording while either is active.
+	
+	Calls in progress when recording starts are not recorded. JavaScript
+	functions are named when entered, by name and source location.
+*/
+
+
+@class OOTimeProfile, OOTimeProfileEntry, OOJSTimeline;
 
 
 void OOJSBeginProfiling(BOOL trace);
 OOTimeProfile *OOJSEndProfiling(void);
 BOOL OOJSIsProfiling(void);
 
+BOOL OOJSBeginTimelineRecording(OOUInteger capacity);	// Returns NO if the buffer can't be allocated.
+OOJSTimeline *OOJSEndTimelineRecording(void);
+BOOL OOJSIsRecordingTimeline(void);
+
 OOHighResTimeValue OOJSCopyTimeLimiterNominalStartTime(void);
 
 void OOJSResetTimeLimiter(void);
@@ -169,6 +191,38 @@ void OOJSSetTimeLimiterLimit(OOTimeDelta limit);
 
 @end
 
+
+@interface OOJSTimeline: NSObject
+{
+@private
+	struct OOJSTimelineEvent	*_events;
+	OOUInteger					_eventCount;
+	unsigned long long			_droppedEventCount;
+	unsigned long long			_skippedFrameCount;
+	double						_duration;
+	NSSet						*_javaScriptNames;
+}
+
+- (OOUInteger) eventCount;
+- (unsigned long long) droppedEventCount;	// Events overwritten when the ring buffer wrapped.
+- (unsigned long long) skippedFrameCount;	// Calls nested too deeply to record.
+- (double) duration;
+
+/*	Chrome Trace Event format, as UTF-8 JSON, for chrome://tracing and similar
+	viewers. Each call is a complete ("X") event; calls whose start was
+	overwritten begin at the start of the buffer, and calls still running at
+	the end of recording end there.
+*/
+- (NSData *) chromeTraceData;
+
+/*	Folded stacks, one "outer;inner;innermost microseconds" line per distinct
+	stack, giving the self time spent with that stack. This is the input
+	format of flamegraph.pl and similar tools.
+*/
+- (NSString *) foldedStacks;
+
+@end
+
 #endif
 
 
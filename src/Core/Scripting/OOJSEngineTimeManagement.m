@@ -261,6 +261,52 @@ static double					sProfilerEntryTimeLimit;
 static OOHighResTimeValue		sProfilerStartTime;
 
 
+enum
+{
+	kTimelineDefaultCapacity	= 1 << 18,
+	kTimelineMaximumCapacity	= 1 << 24,
+	kTimelineMaximumDepth		= 1024
+};
+
+
+typedef struct OOJSTimelineEvent
+{
+	double					time;			// Seconds since recording started.
+	const void				*key;			// Function name for native frames, interned NSString name for JS frames.
+	BOOL					isExit;
+	BOOL					isJavaScript;
+} OOJSTimelineEvent;
+
+
+/*	Calls being recorded. Native frames are identified by their profiler stack
+	frame, which is only filled in while profiling, and JS frames by their
+	function.
+*/
+typedef struct
+{
+	const void				*frame;
+	const void				*key;
+	BOOL					isJavaScript;
+} TimelineStackEntry;
+
+
+static BOOL						sRecording = NO;
+static OOJSTimelineEvent		*sTimelineEvents;
+static OOUInteger				sTimelineCapacity;
+static unsigned long long		sTimelineEventCount;
+static unsigned long long		sTimelineSkippedFrameCount;
+static TimelineStackEntry		sTimelineStack[kTimelineMaximumDepth];
+static unsigned					sTimelineDepth;
+static NSMapTable				*sTimelineJavaScriptNames;		// JSFunction * -> name, for functions on sTimelineStack.
+static NSMutableSet				*sTimelineInternedNames;
+static OOHighResTimeValue		sTimelineStartTime;
+
+
+static void TimelineEnter(const void *frame, const void *key, BOOL isJavaScript);
+static void TimelineExit(const void *frame);
+static void TimelineForgetJSFunction(const void *function);
+
+
 @interface OOTimeProfile (Private)
 
 - (void) setTotalTime:(double)value;
@@ -277,6 +323,18 @@ static OOHighResTimeValue		sProfilerStartTime;
 @end
 
 
+@interface OOJSTimeline (Private)
+
+- (id) initWithEvents:(OOJSTimelineEvent *)events
+				count:(OOUInteger)count
+	droppedEventCount:(unsigned long long)droppedEventCount
+	skippedFrameCount:(unsigned long long)skippedFrameCount
+			 duration:(double)duration
+	  javaScriptNames:(NSSet *)names;
+
+@end
+
+
 @interface OOTimeProfileEntry (Private)
 
 - (id) initWithCName:(const char *)name;
@@ -293,7 +351,7 @@ static OOHighResTimeValue		sProfilerStartTime;
 
 void OOJSBeginProfiling(BOOL trace)
 {
-	assert(sProfiling == NO);
+	assert(sProfiling == NO && sRecording == NO);
 	sProfiling = YES;
 	sTracing = trace;
 	sProfileInfo = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100);
@@ -361,6 +419,74 @@ BOOL OOJSIsProfiling(void)
 	return sProfiling;
 }
 
+
+BOOL OOJSBeginTimelineRecording(OOUInteger capacity)
+{
+	assert(sProfiling == NO && sRecording == NO);
+	
+	if (capacity == 0)  capacity = kTimelineDefaultCapacity;
+	capacity = MIN(capacity, (OOUInteger)kTimelineMaximumCapacity);
+	
+	sTimelineEvents = malloc(capacity * sizeof *sTimelineEvents);
+	if (sTimelineEvents == NULL)  return NO;
+	
+	sTimelineCapacity = capacity;
+	sTimelineEventCount = 0;
+	sTimelineSkippedFrameCount = 0;
+	sTimelineDepth = 0;
+	sTimelineJavaScriptNames = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100);
+	sTimelineInternedNames = [[NSMutableSet alloc] init];
+	
+	sTimelineStartTime = OOGetHighResTime();
+	sRecording = YES;
+	
+	return YES;
+}
+
+
+OOJSTimeline *OOJSEndTimelineRecording(void)
+{
+	OOHighResTimeValue now = OOGetHighResTime();
+	double duration = OOHighResTimeDeltaInSeconds(sTimelineStartTime, now);
+	OODisposeHighResTime(now);
+	
+	assert(sRecording);
+	sRecording = NO;
+	
+	// Unroll the ring buffer, oldest event first.
+	OOUInteger count = MIN(sTimelineEventCount, (unsigned long long)sTimelineCapacity);
+	OOUInteger first = (sTimelineEventCount > sTimelineCapacity) ? sTimelineEventCount % sTimelineCapacity : 0;
+	OOJSTimelineEvent *events = malloc(MAX(count, 1U) * sizeof *events);
+	if (events != NULL)
+	{
+		memcpy(events, sTimelineEvents + first, (count - first) * sizeof *events);
+		memcpy(events + count - first, sTimelineEvents, first * sizeof *events);
+	}
+	else  count = 0;
+	
+	OOJSTimeline *result = [[OOJSTimeline alloc] initWithEvents:events
+														  count:count
+											  droppedEventCount:sTimelineEventCount - count
+											  skippedFrameCount:sTimelineSkippedFrameCount
+													   duration:duration
+												javaScriptNames:sTimelineInternedNames];
+	
+	free(sTimelineEvents);
+	sTimelineEvents = NULL;
+	NSFreeMapTable(sTimelineJavaScriptNames);
+	sTimelineJavaScriptNames = NULL;
+	DESTROY(sTimelineInternedNames);
+	OODisposeHighResTime(sTimelineStartTime);
+	
+	return [result autorelease];
+}
+
+
+BOOL OOJSIsRecordingTimeline(void)
+{
+	return sRecording;
+}
+
 void OOJSBeginTracing(void);
 void OOJSEndTracing(void);
 BOOL OOJSIsTracing(void);
@@ -376,6 +502,74 @@ static void CleanUpJSFrame(OOJSProfileStackFrame *frame)
 }
 
 
+/*	Name of a JS function, with its source location if it isn't native. The
+	location is found from the top stack frame, so this must be called when
+	the function has just been entered. May call profileable functions.
+*/
+static NSString *DescribeJSFunction(JSContext *context, JSFunction *function)
+{
+	NSString *funcName = nil;
+	JSString *jsName = JS_GetFunctionId(function);
+	if (jsName != NULL)  funcName = OOStringFromJSString(context, jsName);
+	else  funcName = @"<anonymous>";
+	
+	// If it's a non-native function, get its source location.
+	NSString *location = nil;
+	if (JS_GetFunctionNative(context, function) == NULL)
+	{
+		JSStackFrame *frame = NULL;
+		if (JS_FrameIterator(context, &frame) != NULL)
+		{
+			location = OOJSDescribeLocation(context, frame);
+		}
+	}
+	
+	if (location != nil)  return [NSString stringWithFormat:@"(%@) %@", location, funcName];
+	else  return funcName;
+}
+
+
+static void TimelineJSFunctionCallback(JSFunction *function, JSScript *script, JSContext *context, int entering)
+{
+	// As when profiling, native functions are ignored; ours record themselves.
+	if (EXPECT_NOT(function == NULL) || JS_GetFunctionNative(context, function) != NULL)  return;
+	
+	if (entering > 0)
+	{
+		/*	Events are keyed by name rather than by function, since a function
+			may be collected and its address reused once it has returned. The
+			name is only remembered while the function is on the stack.
+		*/
+		NSString *name = NSMapGet(sTimelineJavaScriptNames, function);
+		if (name == nil && sTimelineDepth < kTimelineMaximumDepth)
+		{
+			NSAutoreleasePool *pool = [NSAutoreleasePool new];
+			
+			// Don't record the calls made to describe the function.
+			sRecording = NO;
+			NSString *description = DescribeJSFunction(context, function);
+			sRecording = YES;
+			
+			name = [sTimelineInternedNames member:description];
+			if (name == nil)
+			{
+				name = description;
+				[sTimelineInternedNames addObject:name];
+			}
+			NSMapInsertKnownAbsent(sTimelineJavaScriptNames, function, name);
+			
+			[pool release];
+		}
+		
+		TimelineEnter(function, name, YES);
+	}
+	else
+	{
+		TimelineExit(function);
+	}
+}
+
+
 static void TraceEnterJSFunction(JSContext *context, JSFunction *function, OOTimeProfileEntry *profileEntry)
 {
 	NSMutableString		*name = [NSMutableString stringWithFormat:@"%@(", [profileEntry function]];
@@ -445,7 +639,11 @@ static void TraceEnterJSFunction(JSContext *context, JSFunction *function, OOTim
 
 static void FunctionCallback(JSFunction *function, JSScript *script, JSContext *context, int entering)
 {
-	if (EXPECT(!sProfiling))  return;
+	if (EXPECT(!sProfiling))
+	{
+		if (EXPECT_NOT(sRecording))  TimelineJSFunctionCallback(function, script, context, entering);
+		return;
+	}
 	
 	// Ignore native functions. Ours get their own entries anyway, SpiderMonkey's are elided.
 	if (!sTracing && JS_GetFunctionNative(context, function) != NULL)  return;
@@ -509,7 +707,11 @@ static void FunctionCallback(JSFunction *function, JSScript *script, JSContext *
 
 void OOJSProfileEnter(OOJSProfileStackFrame *frame, const char *function)
 {
-	if (EXPECT(!sProfiling))  return;
+	if (EXPECT(!sProfiling))
+	{
+		if (EXPECT_NOT(sRecording))  TimelineEnter(frame, function, NO);
+		return;
+	}
 	if (EXPECT_NOT(sTracing))
 	{
 		// We use EXPECT_NOT here because profiles are time-critical and traces are not.
@@ -531,7 +733,11 @@ void OOJSProfileEnter(OOJSProfileStackFrame *frame, const char *function)
 
 void OOJSProfileExit(OOJSProfileStackFrame *frame)
 {
-	if (EXPECT(!sProfiling))  return;
+	if (EXPECT(!sProfiling))
+	{
+		if (EXPECT_NOT(sRecording))  TimelineExit(frame);
+		return;
+	}
 	
 	OOHighResTimeValue	now = OOGetHighResTime();
 	NSAutoreleasePool	*pool = [NSAutoreleasePool new];
@@ -571,6 +777,72 @@ void OOJSProfileExit(OOJSProfileStackFrame *frame)
 }
 
 
+static void TimelineRecord(double time, const void *key, BOOL isExit, BOOL isJavaScript)
+{
+	OOJSTimelineEvent *event = &sTimelineEvents[sTimelineEventCount++ % sTimelineCapacity];
+	event->time = time;
+	event->key = key;
+	event->isExit = isExit;
+	event->isJavaScript = isJavaScript;
+}
+
+
+static double TimelineNow(void)
+{
+	OOHighResTimeValue now = OOGetHighResTime();
+	double result = OOHighResTimeDeltaInSeconds(sTimelineStartTime, now);
+	OODisposeHighResTime(now);
+	return result;
+}
+
+
+static void TimelineEnter(const void *frame, const void *key, BOOL isJavaScript)
+{
+	if (EXPECT_NOT(sTimelineDepth == kTimelineMaximumDepth))
+	{
+		sTimelineSkippedFrameCount++;
+		return;
+	}
+	
+	sTimelineStack[sTimelineDepth++] = (TimelineStackEntry){ .frame = frame, .key = key, .isJavaScript = isJavaScript };
+	TimelineRecord(TimelineNow(), key, NO, isJavaScript);
+}
+
+
+static void TimelineExit(const void *frame)
+{
+	unsigned i = sTimelineDepth;
+	
+	// Calls in progress when recording started, or nested too deeply, aren't on the stack.
+	while (i != 0 && sTimelineStack[i - 1].frame != frame)  i--;
+	if (i == 0)  return;
+	
+	/*	Anything above the frame is a JS frame which was unwound without an
+		exit callback, as OOJSProfileExit() allows for; end it here too.
+	*/
+	double now = TimelineNow();
+	while (sTimelineDepth >= i)
+	{
+		TimelineStackEntry *entry = &sTimelineStack[--sTimelineDepth];
+		TimelineRecord(now, entry->key, YES, entry->isJavaScript);
+		if (entry->isJavaScript)  TimelineForgetJSFunction(entry->frame);
+	}
+}
+
+
+// Forget the name of a JS function once it has no calls in progress, since it may then be collected.
+static void TimelineForgetJSFunction(const void *function)
+{
+	unsigned i;
+	for (i = 0; i < sTimelineDepth; i++)
+	{
+		if (sTimelineStack[i].frame == function)  return;
+	}
+	
+	NSMapRemove(sTimelineJavaScriptNames, function);
+}
+
+
 static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame *frame)
 {
 	sProfileStack = frame->back;
@@ -790,28 +1062,7 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 		// Temporarily disable profiling so we don't profile the profiler while it's profiling the profilee.
 		sProfiling = NO;
 		_jsFunction = function;
-		
-		NSString *funcName = nil;
-		JSString *jsName = JS_GetFunctionId(_jsFunction);
-		if (jsName != NULL)  funcName = [OOStringFromJSString(context, jsName) retain];
-		else  funcName = @"<anonymous>";
-		
-		// If it's a non-native function, get its source location.
-		NSString *location = nil;
-		if (JS_GetFunctionNative(context, function) == NULL)
-		{
-			JSStackFrame *frame = NULL;
-			if (JS_FrameIterator(context, &frame) != NULL)
-			{
-				location = OOJSDescribeLocation(context, frame);
-			}
-		}
-		
-		if (location != nil)
-		{
-			_function = [[NSString alloc] initWithFormat:@"(%@) %@", location, funcName];
-		}
-		else  _function = [funcName retain];
+		_function = [DescribeJSFunction(context, function) retain];
 		
 		sProfiling = YES;
 	}
@@ -989,4 +1240,294 @@ static void UpdateProfileForFrame(OOHighResTimeValue now, OOJSProfileStackFrame
 
 @end
 
+
+
+typedef struct
+{
+	const void				*key;
+	BOOL					isJavaScript;
+	double					start;
+	double					childTime;
+} TimelineReplayFrame;
+
+typedef void (*TimelineFrameFunction)(OOJSTimeline *timeline, const TimelineReplayFrame *stack, unsigned depth, double end, void *context);
+
+typedef struct
+{
+	NSMutableString			*json;
+	NSMapTable				*names;
+} ChromeTraceContext;
+
+typedef struct
+{
+	NSMutableDictionary		*selfTimes;
+	NSMapTable				*names;
+} FoldedStacksContext;
+
+
+static void AppendChromeTraceEvent(OOJSTimeline *timeline, const TimelineReplayFrame *stack, unsigned depth, double end, void *context);
+static void AddFoldedStackSample(OOJSTimeline *timeline, const TimelineReplayFrame *stack, unsigned depth, double end, void *context);
+static NSString *JSONEscapedString(NSString *string);
+static NSString *FoldedStackName(NSString *name);
+
+
+@implementation OOJSTimeline
+
+- (id) initWithEvents:(OOJSTimelineEvent *)events
+				count:(OOUInteger)count
+	droppedEventCount:(unsigned long long)droppedEventCount
+	skippedFrameCount:(unsigned long long)skippedFrameCount
+			 duration:(double)duration
+	  javaScriptNames:(NSSet *)names
+{
+	if ((self = [super init]))
+	{
+		_events = events;
+		_eventCount = count;
+		_droppedEventCount = droppedEventCount;
+		_skippedFrameCount = skippedFrameCount;
+		_duration = duration;
+		_javaScriptNames = [names copy];
+	}
+	
+	return self;
+}
+
+
+- (void) dealloc
+{
+	free(_events);
+	DESTROY(_javaScriptNames);
+	
+	[super dealloc];
+}
+
+
+- (NSString *) descriptionComponents
+{
+	return [NSString stringWithFormat:@"%lu events, %g ms", (unsigned long)_eventCount, _duration * 1000.0];
+}
+
+
+- (OOUInteger) eventCount
+{
+	return _eventCount;
+}
+
+
+- (unsigned long long) droppedEventCount
+{
+	return _droppedEventCount;
+}
+
+
+- (unsigned long long) skippedFrameCount
+{
+	return _skippedFrameCount;
+}
+
+
+- (double) duration
+{
+	return _duration;
+}
+
+
+- (NSString *) nameForKey:(const void *)key isJavaScript:(BOOL)isJavaScript
+{
+	if (!isJavaScript)  return [NSString stringWithUTF8String:key];
+	
+	// The key is one of the names in _javaScriptNames, which keeps it alive.
+	return (NSString *)key;
+}
+
+
+/*	Call function for each call in the timeline as it ends, with the stack of
+	calls it was made from.
+*/
+- (void) replayWithFunction:(TimelineFrameFunction)function context:(void *)context
+{
+	TimelineReplayFrame		*stack = malloc(kTimelineMaximumDepth * sizeof *stack);
+	const OOJSTimelineEvent	**unmatched = malloc(kTimelineMaximumDepth * sizeof *unmatched);
+	unsigned				depth = 0, unmatchedCount = 0;
+	OOUInteger				i;
+	double					start = (_eventCount != 0) ? _events[0].time : 0.0;
+	NSAutoreleasePool		*pool = nil;
+	
+	if (stack == NULL || unmatched == NULL)
+	{
+		free(stack);
+		free(unmatched);
+		return;
+	}
+	
+	/*	If the ring buffer wrapped, the exits of the outermost calls may have
+		lost their entries, innermost first. Those calls are taken to start at
+		the start of the buffer.
+	*/
+	for (i = 0; i < _eventCount; i++)
+	{
+		if (!_events[i].isExit)  depth++;
+		else if (depth != 0)  depth--;
+		else if (unmatchedCount < kTimelineMaximumDepth)  unmatched[unmatchedCount++] = &_events[i];
+	}
+	for (depth = 0; depth < unmatchedCount; depth++)
+	{
+		const OOJSTimelineEvent *event = unmatched[unmatchedCount - 1 - depth];
+		stack[depth] = (TimelineReplayFrame){ .key = event->key, .isJavaScript = event->isJavaScript, .start = start };
+	}
+	
+	// Recording never goes deeper than kTimelineMaximumDepth, so neither does this.
+	pool = [[NSAutoreleasePool alloc] init];
+	for (i = 0; i < _eventCount; i++)
+	{
+		const OOJSTimelineEvent *event = &_events[i];
+		if (!event->isExit)
+		{
+			NSAssert(depth < kTimelineMaximumDepth, @"Timeline is deeper than it could have been recorded.");
+			stack[depth++] = (TimelineReplayFrame){ .key = event->key, .isJavaScript = event->isJavaScript, .start = event->time };
+		}
+		else if (depth != 0)
+		{
+			function(self, stack, depth, event->time, context);
+			double time = event->time - stack[depth - 1].start;
+			if (--depth != 0)  stack[depth - 1].childTime += time;
+		}
+		
+		if ((i & 0xFFF) == 0xFFF)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	
+	// Calls still running when recording stopped end there.
+	while (depth != 0)
+	{
+		function(self, stack, depth, _duration, context);
+		double time = _duration - stack[depth - 1].start;
+		if (--depth != 0)  stack[depth - 1].childTime += time;
+	}
+	[pool release];
+	
+	free(stack);
+	free(unmatched);
+}
+
+
+- (NSData *) chromeTraceData
+{
+	ChromeTraceContext context =
+	{
+		.json = [NSMutableString stringWithString:@"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+												   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"JavaScript\"}}"],
+		.names = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100)
+	};
+	
+	[self replayWithFunction:AppendChromeTraceEvent context:&context];
+	[context.json appendString:@"\n]}\n"];
+	
+	NSFreeMapTable(context.names);
+	return [context.json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+- (NSString *) foldedStacks
+{
+	FoldedStacksContext context =
+	{
+		.selfTimes = [NSMutableDictionary dictionary],
+		.names = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks, NSObjectMapValueCallBacks, 100)
+	};
+	
+	[self replayWithFunction:AddFoldedStackSample context:&context];
+	NSFreeMapTable(context.names);
+	
+	NSMutableString *result = [NSMutableString string];
+	NSEnumerator *stackEnum = nil;
+	NSString *stack = nil;
+	for (stackEnum = [[[context.selfTimes allKeys] sortedArrayUsingSelector:@selector(compare:)] objectEnumerator]; (stack = [stackEnum nextObject]); )
+	{
+		long long microseconds = llround([context.selfTimes oo_doubleForKey:stack] * 1e6);
+		if (microseconds > 0)  [result appendFormat:@"%@ %lld\n", stack, microseconds];
+	}
+	
+	return result;
+}
+
+@end
+
+
+static void AppendChromeTraceEvent(OOJSTimeline *timeline, const TimelineReplayFrame *stack, unsigned depth, double end, void *context)
+{
+	ChromeTraceContext *trace = context;
+	const TimelineReplayFrame *frame = &stack[depth - 1];
+	
+	NSString *name = NSMapGet(trace->names, frame->key);
+	if (name == nil)
+	{
+		name = JSONEscapedString([timeline nameForKey:frame->key isJavaScript:frame->isJavaScript]);
+		NSMapInsertKnownAbsent(trace->names, frame->key, name);
+	}
+	
+	// Times are in microseconds.
+	[trace->json appendFormat:@",\n{\"name\":\"%@\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+	 name, frame->isJavaScript ? "JavaScript" : "native", frame->start * 1e6, (end - frame->start) * 1e6];
+}
+
+
+static void AddFoldedStackSample(OOJSTimeline *timeline, const TimelineReplayFrame *stack, unsigned depth, double end, void *context)
+{
+	FoldedStacksContext *folded = context;
+	NSMutableString *path = [NSMutableString string];
+	unsigned i;
+	
+	for (i = 0; i < depth; i++)
+	{
+		NSString *name = NSMapGet(folded->names, stack[i].key);
+		if (name == nil)
+		{
+			name = FoldedStackName([timeline nameForKey:stack[i].key isJavaScript:stack[i].isJavaScript]);
+			NSMapInsertKnownAbsent(folded->names, stack[i].key, name);
+		}
+		
+		if (i != 0)  [path appendString:@";"];
+		[path appendString:name];
+	}
+	
+	const TimelineReplayFrame *frame = &stack[depth - 1];
+	double selfTime = end - frame->start - frame->childTime;
+	[folded->selfTimes setObject:[NSNumber numberWithDouble:[folded->selfTimes oo_doubleForKey:path] + selfTime] forKey:path];
+}
+
+
+static NSString *JSONEscapedString(NSString *string)
+{
+	NSMutableString			*result = [NSMutableString stringWithCapacity:[string length]];
+	OOUInteger				i, length = [string length];
+	unichar					c;
+	
+	for (i = 0; i < length; i++)
+	{
+		c = [string characterAtIndex:i];
+		if (c == '\"' || c == '\\')  [result appendFormat:@"\\%C", c];
+		else if (c < 0x20)  [result appendFormat:@"\\u%04X", (unsigned)c];
+		else  [result appendFormat:@"%C", c];
+	}
+	
+	return result;
+}
+
+
+// Folded stacks are separated by semicolons and end at a line break.
+static NSString *FoldedStackName(NSString *name)
+{
+	NSMutableString *result = [[name mutableCopy] autorelease];
+	
+	[result replaceOccurrencesOfString:@";" withString:@"," options:0 range:NSMakeRange(0, [result length])];
+	[result replaceOccurrencesOfString:@"\n" withString:@" " options:0 range:NSMakeRange(0, [result length])];
+	
+	return result;
+}
+
 #endif
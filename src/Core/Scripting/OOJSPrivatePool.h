@@ -0,0 +1,99 @@
+/*
+
+OOJSPrivatePool.h
+
+Fixed-size allocator for the private storage of small JavaScript objects,
+such as the Vector and Quaternion structs behind Vector3D and Quaternion.
+
+Scripts create and drop these objects by the thousand each frame, and each
+used to cost a malloc() in the constructor and a free() in the finalizer.
+A pool instead hands out elements carved from slabs of a few kilobytes, and
+keeps freed elements on a free list for reuse, so the usual case is a couple
+of pointer moves. Slabs are never returned to the system; a pool holds on to
+as much memory as the largest number of elements ever live at once needed.
+
+Pools are not thread-safe. Like the rest of the JavaScript glue, they must
+only be used by the thread running scripts (finalizers are run by the
+garbage collector on that thread).
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOCocoa.h"
+#import "OOFunctionAttributes.h"
+
+
+typedef struct OOJSPrivatePool
+{
+	size_t					elementSize;
+	void					*freeList;
+	void					*slabs;
+	
+	OOUInteger				slabCount;
+	OOUInteger				liveCount;
+	OOUInteger				peakCount;
+	unsigned long long		allocationCount;
+	unsigned long long		slabAllocationCount;
+} OOJSPrivatePool;
+
+
+/*	Static initializer for a pool of TYPE. Elements are rounded up to a
+	multiple of the pointer size, since free elements hold the free list link.
+*/
+#define OOJS_PRIVATE_POOL_INIT(TYPE) \
+	{ ((sizeof (TYPE) + sizeof (void *) - 1) / sizeof (void *)) * sizeof (void *), NULL, NULL, 0, 0, 0, 0, 0 }
+
+
+// Slow path of OOJSPrivatePoolAllocate(): add a slab. Returns NULL if out of memory.
+void *OOJSPrivatePoolAllocateFromNewSlab(OOJSPrivatePool *pool)  NONNULL_FUNC;
+
+
+OOINLINE void *OOJSPrivatePoolAllocate(OOJSPrivatePool *pool)  NONNULL_FUNC;
+OOINLINE void *OOJSPrivatePoolAllocate(OOJSPrivatePool *pool)
+{
+	void *result = pool->freeList;
+	if (EXPECT_NOT(result == NULL))  return OOJSPrivatePoolAllocateFromNewSlab(pool);
+	
+	pool->freeList = *(void **)result;
+	pool->allocationCount++;
+	if (++pool->liveCount > pool->peakCount)  pool->peakCount = pool->liveCount;
+	
+	return result;
+}
+
+
+// Return an element to its pool. element may be NULL.
+OOINLINE void OOJSPrivatePoolFree(OOJSPrivatePool *pool, void *element)  GCC_ATTR((nonnull (1)));
+OOINLINE void OOJSPrivatePoolFree(OOJSPrivatePool *pool, void *element)
+{
+	if (EXPECT_NOT(element == NULL))  return;
+	
+	*(void **)element = pool->freeList;
+	pool->freeList = element;
+	pool->liveCount--;
+}
+
+
+#if OO_DEBUG
+// Statistics for debug reports, in the style of the JS conversion statistics.
+NSString *OOJSPrivatePoolStatistics(OOJSPrivatePool *pool)  NONNULL_FUNC;
+void OOJSPrivatePoolClearStatistics(OOJSPrivatePool *pool)  NONNULL_FUNC;
+#endif
@@ -0,0 +1,92 @@
+/*
+
+OOJSPrivatePool.m
+
+
+Oolite
+Copyright (C) 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+#import "OOJSPrivatePool.h"
+
+
+enum
+{
+	kSlabSize				= 4096
+};
+
+
+/*	A slab is a link to the next slab, followed by as many elements as fit in
+	kSlabSize. The link is a full element so that elements keep the alignment
+	malloc() gives the slab.
+*/
+void *OOJSPrivatePoolAllocateFromNewSlab(OOJSPrivatePool *pool)
+{
+	size_t					elementSize = pool->elementSize;
+	size_t					i, count = kSlabSize / elementSize - 1;
+	char					*slab = NULL;
+	char					*element = NULL;
+	
+	NSCParameterAssert(elementSize >= sizeof (void *) && pool->freeList == NULL);
+	
+	slab = malloc(kSlabSize);
+	if (EXPECT_NOT(slab == NULL))  return NULL;
+	
+	*(void **)slab = pool->slabs;
+	pool->slabs = slab;
+	pool->slabCount++;
+	pool->slabAllocationCount++;
+	
+	// Keep the first element for the caller, and chain the rest in address order.
+	element = slab + elementSize;
+	for (i = count - 1; i > 0; i--)
+	{
+		*(void **)(element + i * elementSize) = pool->freeList;
+		pool->freeList = element + i * elementSize;
+	}
+	
+	pool->allocationCount++;
+	if (++pool->liveCount > pool->peakCount)  pool->peakCount = pool->liveCount;
+	
+	return element;
+}
+
+
+#if OO_DEBUG
+
+NSString *OOJSPrivatePoolStatistics(OOJSPrivatePool *pool)
+{
+	return [NSString stringWithFormat:
+		   @"pool allocations: %llu (%llu slabs allocated)\n"
+			"    live objects: %lu (peak %lu)\n"
+			"       pool size: %lu slabs, %lu KiB",
+			pool->allocationCount, pool->slabAllocationCount,
+			(long)pool->liveCount, (long)pool->peakCount,
+			(long)pool->slabCount, (long)(pool->slabCount * kSlabSize / 1024)];
+}
+
+
+void OOJSPrivatePoolClearStatistics(OOJSPrivatePool *pool)
+{
+	pool->allocationCount = 0;
+	pool->slabAllocationCount = 0;
+	pool->peakCount = pool->liveCount;
+}
+
+#endif
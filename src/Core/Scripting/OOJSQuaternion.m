@@ -34,10 +34,14 @@ MA 02110-1301, USA.
 #import "OOConstToString.h"
 #import "OOJSEntity.h"
 #import "OOJSVector.h"
+#import "OOJSPrivatePool.h"
 
 
 static JSObject *sQuaternionPrototype;
 
+// Private storage of quaternion objects.
+static OOJSPrivatePool sQuaternionPool = OOJS_PRIVATE_POOL_INIT(Quaternion);
+
 
 static BOOL GetThisQuaternion(JSContext *context, JSObject *quaternionObj, Quaternion *outQuaternion, NSString *method)  NONNULL_FUNC;
 
@@ -147,7 +151,7 @@ JSObject *JSQuaternionWithQuaternion(JSContext *context, Quaternion quaternion)
 	JSObject				*result = NULL;
 	Quaternion				*private = NULL;
 	
-	private = malloc(sizeof *private);
+	private = OOJSPrivatePoolAllocate(&sQuaternionPool);
 	if (EXPECT_NOT(private == NULL))  return NULL;
 	
 	*private = quaternion;
@@ -158,7 +162,7 @@ JSObject *JSQuaternionWithQuaternion(JSContext *context, Quaternion quaternion)
 		if (!JS_SetPrivate(context, result, private))  result = NULL;
 	}
 	
-	if (EXPECT_NOT(result == NULL)) free(private);
+	if (EXPECT_NOT(result == NULL)) OOJSPrivatePoolFree(&sQuaternionPool, private);
 	
 	return result;
 	
@@ -236,9 +240,19 @@ static QuaternionStatistics sQuaternionConversionStats;
 }
 
 
+// :setM quatPoolStats PS.callObjC("reportJSQuaternionPoolStatistics")
+// :quatPoolStats
+
+- (NSString *) reportJSQuaternionPoolStatistics
+{
+	return OOJSPrivatePoolStatistics(&sQuaternionPool);
+}
+
+
 - (void) clearJSQuaternionStatistics
 {
 	memset(&sQuaternionConversionStats, 0, sizeof sQuaternionConversionStats);
+	OOJSPrivatePoolClearStatistics(&sQuaternionPool);
 }
 
 @end
@@ -529,7 +543,7 @@ static void QuaternionFinalize(JSContext *context, JSObject *this)
 	private = JS_GetInstancePrivate(context, this, &sQuaternionClass, NULL);
 	if (private != NULL)
 	{
-		free(private);
+		OOJSPrivatePoolFree(&sQuaternionPool, private);
 	}
 }
 
@@ -542,17 +556,21 @@ static JSBool QuaternionConstruct(JSContext *context, uintN argc, jsval *vp)
 	Quaternion				*private = NULL;
 	JSObject				*this = NULL;
 	
-	private = malloc(sizeof *private);
+	private = OOJSPrivatePoolAllocate(&sQuaternionPool);
 	if (EXPECT_NOT(private == NULL))  return NO;
 	
 	this = JS_NewObject(context, &sQuaternionClass, NULL, NULL);
-	if (EXPECT_NOT(this == NULL))  return NO;
+	if (EXPECT_NOT(this == NULL))
+	{
+		OOJSPrivatePoolFree(&sQuaternionPool, private);
+		return NO;
+	}
 	
 	if (argc != 0)
 	{
 		if (EXPECT_NOT(!QuaternionFromArgumentListNoErrorInternal(context, argc, OOJS_ARGV, &quaternion, NULL, YES)))
 		{
-			free(private);
+			OOJSPrivatePoolFree(&sQuaternionPool, private);
 			OOJSReportBadArguments(context, NULL, NULL, argc, OOJS_ARGV,
 								   @"Could not construct quaternion from parameters",
 								   @"Quaternion, Entity or array of four numbers");
@@ -564,7 +582,7 @@ static JSBool QuaternionConstruct(JSContext *context, uintN argc, jsval *vp)
 	
 	if (!JS_SetPrivate(context, this, private))
 	{
-		free(private);
+		OOJSPrivatePoolFree(&sQuaternionPool, private);
 		return NO;
 	}
 	
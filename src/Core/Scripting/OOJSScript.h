@@ -38,6 +38,8 @@ MA 02110-1301, USA.
 	NSString			*filePath;
 	
 	OOWeakReference		*weakSelf;
+	
+	BOOL				_tracksHandlerChanges;
 }
 
 + (id) scriptWithPath:(NSString *)path properties:(NSDictionary *)properties;
@@ -64,6 +66,20 @@ MA 02110-1301, USA.
 	  withArguments:(jsval *)argv count:(intN)argc
 			 result:(jsval *)outResult;
 
+/*	YES if the script has a property methodID which -callMethod:... would
+	try to call. Requires a request on context.
+*/
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context;
+
+/*	Changes whenever a function-valued property may have been added to,
+	replaced on or removed from a script which tracks handler changes, so
+	that lists of the scripts with a given handler can be rebuilt when needed.
+	Only world scripts need to be tracked; changes to other scripts, such as
+	ship scripts setting up their handlers on spawn, are ignored.
+*/
++ (uint32_t) handlerGeneration;
+- (void) setTracksHandlerChanges:(BOOL)flag;
+
 - (id) propertyWithID:(jsid)propID inContext:(JSContext *)context;
 // Set a property which can be modified or deleted by the script.
 - (BOOL) setProperty:(id)value withID:(jsid)propID inContext:(JSContext *)context;
@@ -85,6 +101,8 @@ MA 02110-1301, USA.
 	  withArguments:(jsval *)argv count:(intN)argc
 			 result:(jsval *)outResult;
 
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context;
+
 @end
 
 
@@ -54,6 +54,7 @@ struct RunningStack
 
 static JSObject			*sScriptPrototype;
 static RunningStack		*sRunningStack = NULL;
+static uint32_t			sHandlerGeneration = 0;
 
 
 static void AddStackToArrayReversed(NSMutableArray *array, RunningStack *stack);
@@ -67,16 +68,20 @@ static JSScript *ScriptWithCompiledData(JSContext *context, NSData *data);
 
 static NSString *StrippedName(NSString *string);
 
+static JSBool ScriptAddProperty(JSContext *context, JSObject *this, jsid propID, jsval *value);
+static JSBool ScriptDeleteProperty(JSContext *context, JSObject *this, jsid propID, jsval *value);
+static JSBool ScriptSetProperty(JSContext *context, JSObject *this, jsid propID, JSBool strict, jsval *value);
+
 
 static JSClass sScriptClass =
 {
 	"Script",
 	JSCLASS_HAS_PRIVATE,
 	
+	ScriptAddProperty,
+	ScriptDeleteProperty,
 	JS_PropertyStub,
-	JS_PropertyStub,
-	JS_PropertyStub,
-	JS_StrictPropertyStub,
+	ScriptSetProperty,
 	JS_EnumerateStub,
 	JS_ResolveStub,
 	JS_ConvertStub,
@@ -95,6 +100,7 @@ static JSFunctionSpec sScriptMethods[] =
 @interface OOJSScript (OOPrivate)
 
 - (NSString *)scriptNameFromPath:(NSString *)path;
+- (BOOL) tracksHandlerChanges;
 
 @end
 
@@ -429,6 +435,36 @@ static JSFunctionSpec sScriptMethods[] =
 }
 
 
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context
+{
+	NSParameterAssert(context != NULL && JS_IsInRequest(context));
+	if (_jsSelf == NULL)  return NO;
+	
+	jsval					method;
+	
+	// Same test as -callMethod:..., so anything it would try to call counts.
+	return JS_GetMethodById(context, _jsSelf, methodID, NULL, &method) && !JSVAL_IS_VOID(method);
+}
+
+
++ (uint32_t) handlerGeneration
+{
+	return sHandlerGeneration;
+}
+
+
+- (void) setTracksHandlerChanges:(BOOL)flag
+{
+	_tracksHandlerChanges = !!flag;
+}
+
+
+- (BOOL) tracksHandlerChanges
+{
+	return _tracksHandlerChanges;
+}
+
+
 - (id) propertyWithID:(jsid)propID inContext:(JSContext *)context
 {
 	NSParameterAssert(context != NULL && JS_IsInRequest(context));
@@ -600,6 +636,12 @@ static JSFunctionSpec sScriptMethods[] =
 	return NO;
 }
 
+
+- (BOOL) hasMethod:(jsid)methodID inContext:(JSContext *)context
+{
+	return NO;
+}
+
 @end
 
 
@@ -723,3 +765,54 @@ static NSString *StrippedName(NSString *string)
 	
 	return [string stringByTrimmingCharactersInSet:invalidSet];
 }
+
+
+/*	Property hooks for script objects, which keep track of changes to event
+	handlers of scripts which track them (world scripts). Only functions
+	count, so ordinary script state doesn't invalidate handler caches.
+*/
+static BOOL TracksHandlerChanges(JSContext *context, JSObject *this)
+{
+	// The private is NULL until the script object is set up.
+	return [[(id)JS_GetPrivate(context, this) weakRefUnderlyingObject] tracksHandlerChanges];
+}
+
+
+// YES if the property currently holds a function. In the delete and set hooks, the property still has its old value.
+static BOOL PropertyIsFunction(JSContext *context, JSObject *this, jsid propID)
+{
+	jsval					value;
+	
+	return JS_LookupPropertyById(context, this, propID, &value) && OOJSValueIsFunction(context, value);
+}
+
+
+static JSBool ScriptAddProperty(JSContext *context, JSObject *this, jsid propID, jsval *value)
+{
+	if (OOJSValueIsFunction(context, *value) && TracksHandlerChanges(context, this))
+	{
+		sHandlerGeneration++;
+	}
+	return YES;
+}
+
+
+static JSBool ScriptDeleteProperty(JSContext *context, JSObject *this, jsid propID, jsval *value)
+{
+	if (TracksHandlerChanges(context, this) && PropertyIsFunction(context, this, propID))
+	{
+		sHandlerGeneration++;
+	}
+	return YES;
+}
+
+
+static JSBool ScriptSetProperty(JSContext *context, JSObject *this, jsid propID, JSBool strict, jsval *value)
+{
+	if (TracksHandlerChanges(context, this) &&
+		(OOJSValueIsFunction(context, *value) || PropertyIsFunction(context, this, propID)))
+	{
+		sHandlerGeneration++;
+	}
+	return YES;
+}
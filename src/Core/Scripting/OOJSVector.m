@@ -34,10 +34,14 @@ MA 02110-1301, USA.
 #import "OOConstToString.h"
 #import "OOJSEntity.h"
 #import "OOJSQuaternion.h"
+#import "OOJSPrivatePool.h"
 
 
 static JSObject *sVectorPrototype;
 
+// Private storage of vector objects.
+static OOJSPrivatePool sVectorPool = OOJS_PRIVATE_POOL_INIT(Vector);
+
 
 static BOOL GetThisVector(JSContext *context, JSObject *vectorObj, Vector *outVector, NSString *method)  NONNULL_FUNC;
 
@@ -163,7 +167,7 @@ JSObject *JSVectorWithVector(JSContext *context, Vector vector)
 	JSObject				*result = NULL;
 	Vector					*private = NULL;
 	
-	private = malloc(sizeof *private);
+	private = OOJSPrivatePoolAllocate(&sVectorPool);
 	if (EXPECT_NOT(private == NULL))  return NULL;
 	
 	*private = vector;
@@ -174,7 +178,7 @@ JSObject *JSVectorWithVector(JSContext *context, Vector vector)
 		if (EXPECT_NOT(!JS_SetPrivate(context, result, private)))  result = NULL;
 	}
 	
-	if (EXPECT_NOT(result == NULL)) free(private);
+	if (EXPECT_NOT(result == NULL)) OOJSPrivatePoolFree(&sVectorPool, private);
 	
 	return result;
 	
@@ -259,9 +263,19 @@ static VectorStatistics sVectorConversionStats;
 }
 
 
+// :setM vectorPoolStats PS.callObjC("reportJSVectorPoolStatistics")
+// :vectorPoolStats
+
+- (NSString *) reportJSVectorPoolStatistics
+{
+	return OOJSPrivatePoolStatistics(&sVectorPool);
+}
+
+
 - (void) clearJSVectorStatistics
 {
 	memset(&sVectorConversionStats, 0, sizeof sVectorConversionStats);
+	OOJSPrivatePoolClearStatistics(&sVectorPool);
 }
 
 @end
@@ -541,7 +555,7 @@ static void VectorFinalize(JSContext *context, JSObject *this)
 	private = JS_GetInstancePrivate(context, this, &sVectorClass, NULL);
 	if (private != NULL)
 	{
-		free(private);
+		OOJSPrivatePoolFree(&sVectorPool, private);
 	}
 	
 	OOJS_PROFILE_EXIT_VOID
@@ -556,17 +570,21 @@ static JSBool VectorConstruct(JSContext *context, uintN argc, jsval *vp)
 	Vector					*private = NULL;
 	JSObject				*this = NULL;
 	
-	private = malloc(sizeof *private);
+	private = OOJSPrivatePoolAllocate(&sVectorPool);
 	if (EXPECT_NOT(private == NULL))  return NO;
 	
 	this = JS_NewObject(context, &sVectorClass, NULL, NULL);
-	if (EXPECT_NOT(this == NULL))  return NO;
+	if (EXPECT_NOT(this == NULL))
+	{
+		OOJSPrivatePoolFree(&sVectorPool, private);
+		return NO;
+	}
 	
 	if (argc != 0)
 	{
 		if (EXPECT_NOT(!VectorFromArgumentListNoErrorInternal(context, argc, OOJS_ARGV, &vector, NULL, YES)))
 		{
-			free(private);
+			OOJSPrivatePoolFree(&sVectorPool, private);
 			OOJSReportBadArguments(context, NULL, NULL, argc, OOJS_ARGV,
 								   @"Could not construct vector from parameters",
 								   @"Vector, Entity or array of three numbers");
@@ -578,7 +596,7 @@ static JSBool VectorConstruct(JSContext *context, uintN argc, jsval *vp)
 	
 	if (EXPECT_NOT(!JS_SetPrivate(context, this, private)))
 	{
-		free(private);
+		OOJSPrivatePoolFree(&sVectorPool, private);
 		return NO;
 	}
 	
@@ -39,7 +39,7 @@ MA 02110-1301, USA.
 #include <espeak/speak_lib.h>
 #endif
 
-@class	GameController, CollisionRegion, MyOpenGLView, GuiDisplayGen,
+@class	GameController, CollisionRegion, OOCollisionBroadPhase, OOAIScheduler, OOTexturePreloader, OOEntitySpatialIndex, MyOpenGLView, GuiDisplayGen,
 		Entity, ShipEntity, StationEntity, OOPlanetEntity, OOSunEntity,
 		PlayerEntity, OORoleSet;
 
@@ -126,7 +126,8 @@ enum
 #define PLANETINFO_UNIVERSAL_KEY			@"universal"
 
 // Derived constants (MIN_ENTITY_UID, MAX_ENTITY_UID) are defined in OOTypes.h
-#define	UNIVERSE_MAX_ENTITIES				2048
+// There is no fixed limit on entities; above this many, explosions produce less optional debris.
+#define	UNIVERSE_DEBRIS_ENTITY_THRESHOLD	2048
 
 #define OOLITE_EXCEPTION_LOOPING			@"OoliteLoopingException"
 #define OOLITE_EXCEPTION_DATA_NOT_FOUND		@"OoliteDataNotFoundException"
@@ -155,11 +156,36 @@ typedef uint8_t		OOGovernmentID;		// 0..7
 typedef uint8_t		OOEconomyID;		// 0..7
 
 
+enum
+{
+	kOOEntityHotFlagShip				= 0x01,
+	kOOEntityHotFlagStation				= 0x02,
+	kOOEntityHotFlagPlayer				= 0x04,
+	kOOEntityHotFlagEffect				= 0x08,
+	kOOEntityHotFlagCanCollide			= 0x10
+};
+typedef uint8_t		OOEntityHotFlags;
+
+
+/*	Frequently scanned entity data, as parallel arrays indexed like
+	sortedEntities. This is a snapshot: see -hotEntityData.
+*/
+typedef struct OOEntityHotData
+{
+	Vector					*position;
+	GLfloat					*collisionRadius;
+	GLfloat					*zeroDistance;
+	int16_t					*status;			// OOEntityStatus
+	OOEntityHotFlags		*flags;
+	unsigned				count;
+} OOEntityHotData;
+
+
 @interface Universe: OOWeakRefObject
 {
 @public
 	// use a sorted list for drawing and other activities
-	Entity					*sortedEntities[UNIVERSE_MAX_ENTITIES];
+	Entity					**sortedEntities;
 	unsigned				n_entities;
 	
 	int						cursor_row;
@@ -185,7 +211,21 @@ typedef uint8_t		OOEconomyID;		// 0..7
 	MyOpenGLView			*gameView;
 	
 	int						next_universal_id;
-	Entity					*entity_for_uid[MAX_ENTITY_UID];
+	Entity					**entity_for_uid;
+	unsigned				entity_for_uid_capacity;
+	
+	// Storage parallel to sortedEntities, grown together by -ensureEntityCapacity:.
+	unsigned				entityCapacity;
+	OOEntityHotData			hotEntityData;
+	BOOL					hotEntityDataStale;
+	Entity					**updateEntities;		// per-update snapshot of sortedEntities
+	Entity					**concurrentUpdateEntities;	// entities deferred to the concurrent update phase
+	Entity					**drawEntities;			// per-frame list of visible entities
+	
+	// Indexes for entity queries; see -findEntitiesMatchingPredicate:parameter:inRange:ofEntity:.
+	OOEntitySpatialIndex	*entitySpatialIndex;
+	BOOL					entitySpatialIndexStale;
+	NSCountedSet			*shipPrimaryRoleCounts;
 
 	NSMutableArray			*entities;
 	
@@ -278,6 +318,9 @@ typedef uint8_t		OOEconomyID;		// 0..7
 	NSMutableArray			*characterPool;
 	
 	CollisionRegion			*universeRegion;
+	OOCollisionBroadPhase	*collisionBroadPhase;
+	OOAIScheduler			*aiScheduler;
+	OOTexturePreloader		*texturePreloader;
 	
 	// check and maintain linked lists occasionally
 	BOOL					doLinkedListMaintenanceThisUpdate;
@@ -435,6 +478,20 @@ typedef uint8_t		OOEconomyID;		// 0..7
 
 - (BOOL) addEntity:(Entity *) entity;
 - (BOOL) removeEntity:(Entity *) entity;
+
+/*	Hot data for sortedEntities. It is rebuilt on demand after entities have
+	been added or removed and at the start of each update, and an entity's
+	entry is refreshed after its own update and by -refitIndexForEntity:, so
+	queries made partway through an update see current positions.
+*/
+- (const OOEntityHotData *) hotEntityData;
+
+/*	Keep the entity query indexes current. Entities are refitted after their
+	own update; these are for changes made at other times, such as scripts
+	moving an entity or changing its scan class.
+*/
+- (void) refitIndexForEntity:(Entity *)entity;
+- (void) ship:(ShipEntity *)ship didChangePrimaryRoleFrom:(NSString *)oldRole;
 - (void) ensureEntityReallyRemoved:(Entity *)entity;
 - (void) removeAllEntitiesExceptPlayer;
 - (void) removeDemoShips;
@@ -457,7 +514,11 @@ typedef uint8_t		OOEconomyID;		// 0..7
 - (void) sendShipsWithPrimaryRole:(NSString *)role messageToAI:(NSString *)message;
 
 
-// General count/search methods. Pass range of -1 and entity of nil to search all of system.
+/*	General count/search methods. Pass range of -1 and entity of nil to search
+	all of system. Ranged and nearest searches use a spatial index, so they only
+	visit entities near the reference entity; results are still in
+	sortedEntities order.
+*/
 - (unsigned) countEntitiesMatchingPredicate:(EntityFilterPredicate)predicate
 								  parameter:(void *)parameter
 									inRange:(double)range
@@ -517,6 +578,11 @@ typedef uint8_t		OOEconomyID;		// 0..7
 
 - (void) filterSortedLists;
 
+- (OOCollisionBroadPhase *) collisionBroadPhase;
+- (void) setCollisionBroadPhase:(OOCollisionBroadPhase *)broadPhase;
+
+- (OOAIScheduler *) aiScheduler;
+
 ///////////////////////////////////////
 
 - (void) setGalaxySeed:(Random_Seed) gal_seed;
@@ -46,6 +46,9 @@ MA 02110-1301, USA.
 
 #import "Octree.h"
 #import "CollisionRegion.h"
+#import "OOCollisionBroadPhase.h"
+#import "OOEntitySpatialIndex.h"
+#import "OOConcurrentEntityUpdater.h"
 #import "OOGraphicsResetManager.h"
 #import "OODebugSupport.h"
 #import "OOEntityFilterPredicate.h"
@@ -73,6 +76,8 @@ MA 02110-1301, USA.
 
 #import "OOMusicController.h"
 #import "OOAsyncWorkManager.h"
+#import "OOAIScheduler.h"
+#import "OOTexturePreloader.h"
 #import "OODebugFlags.h"
 #import "OOLoggingExtended.h"
 #import "OOJSEngineTimeManagement.h"
@@ -184,6 +189,10 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 @interface Universe (OOPrivate)
 
 - (BOOL) doRemoveEntity:(Entity *)entity;
+- (void) ensureEntityCapacity:(unsigned)minCapacity;
+- (OOEntitySpatialIndex *) entitySpatialIndex;
+- (Entity **) copyEntitiesNear:(Vector)point inRange:(double)range count:(OOUInteger *)outCount;
+- (void) maintainSortedPositionOfEntity:(Entity *)thing;
 - (void) preloadSounds;
 - (void) setUpSettings;
 - (void) setUpInitialUniverse;
@@ -295,6 +304,11 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 #endif
 #endif
 	
+	[self ensureEntityCapacity:MAX_NUMBER_OF_ENTITIES];
+	entitySpatialIndex = [[OOEntitySpatialIndex alloc] init];
+	entitySpatialIndexStale = YES;
+	shipPrimaryRoleCounts = [[NSCountedSet alloc] init];
+	
 	[[GameController sharedController] logProgress:DESC(@"loading-ships")];
 	// Load ship data
 	
@@ -320,6 +334,10 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 	[OOLightParticleEntity setUpTexture];
 	[OOFlashEffectEntity setUpTexture];
 	
+	[[GameController sharedController] logProgress:DESC(@"preloading-textures")];
+	texturePreloader = [[OOTexturePreloader alloc] init];
+	[texturePreloader preloadTexturesForShipRegistry:[OOShipRegistry sharedRegistry]];
+	
 	player = [PlayerEntity sharedPlayer];
 	[player deferredInit];
 	[self addEntity:player];
@@ -330,6 +348,9 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 	[self setUpInitialUniverse];
 	
 	universeRegion = [[CollisionRegion alloc] initAsUniverse];
+	collisionBroadPhase = [[OOCollisionBroadPhase broadPhaseNamed:nil] retain];
+	if (collisionBroadPhase == nil)  collisionBroadPhase = [[OOCollisionBroadPhase broadPhaseNamed:kOOCollisionBroadPhaseGrid] retain];
+	aiScheduler = [[OOAIScheduler alloc] init];
 	entitiesDeadThisUpdate = [[NSMutableSet alloc] init];
 	framesDoneThisUpdate = 0;
 	
@@ -381,6 +402,22 @@ static OOComparisonResult comparePrice(id dict1, id dict2, void * context);
 	[activeWormholes release];				
 	[characterPool release];
 	[universeRegion release];
+	[collisionBroadPhase release];
+	[aiScheduler release];
+	[texturePreloader release];
+	[entitySpatialIndex release];
+	[shipPrimaryRoleCounts release];
+	
+	free(sortedEntities);
+	free(entity_for_uid);
+	free(hotEntityData.position);
+	free(hotEntityData.collisionRadius);
+	free(hotEntityData.zeroDistance);
+	free(hotEntityData.status);
+	free(hotEntityData.flags);
+	free(updateEntities);
+	free(concurrentUpdateEntities);
+	free(drawEntities);
 	
 	DESTROY(_firstBeacon);
 	DESTROY(_lastBeacon);
@@ -3166,11 +3203,12 @@ static const OOMatrix	starboard_matrix =
 			
 			no_update = YES;	// block other attempts to draw
 			
+			[OOTexture updateStreamingTextures];
+			
 			int				i, v_status;
 			Vector			position, view_dir, view_up;
 			OOMatrix		view_matrix;
 			int				ent_count =	n_entities;
-			Entity			*my_entities[ent_count];
 			int				draw_count = 0;
 			PlayerEntity	*player = PLAYER;
 			Entity			*drawthing = nil;
@@ -3184,13 +3222,15 @@ static const OOMatrix	starboard_matrix =
 			}
 			wasDisplayGUI = displayGUI;
 			
-			// use a non-mutable copy so this can't be changed under us.
+			/*	Use a copy so this can't be changed under us. Entities removed
+				while drawing are kept alive by entitiesDeadThisUpdate.
+			*/
 			for (i = 0; i < ent_count; i++)
 			{
 				Entity *e = sortedEntities[i]; // ordered NEAREST -> FURTHEST AWAY
 				if ([e isVisible])
 				{
-					my_entities[draw_count++] = [[e retain] autorelease];
+					drawEntities[draw_count++] = e;
 				}
 			}
 			
@@ -3278,7 +3318,7 @@ static const OOMatrix	starboard_matrix =
 				//		DRAW ALL THE OPAQUE ENTITIES
 				for (i = furthest; i >= nearest; i--)
 				{
-					drawthing = my_entities[i];
+					drawthing = drawEntities[i];
 					OOEntityStatus d_status = [drawthing status];
 					
 					if (bpHide && !drawthing->isImmuneToBreakPatternHide)  continue;
@@ -3342,7 +3382,7 @@ static const OOMatrix	starboard_matrix =
 				CheckOpenGLErrors(@"Universe after setting up for translucent pass");
 				for (i = furthest; i >= nearest; i--)
 				{
-					drawthing = my_entities[i];
+					drawthing = drawEntities[i];
 					OOEntityStatus d_status = [drawthing status];
 					
 					if (bpHide && !drawthing->isImmuneToBreakPatternHide)  continue;
@@ -3520,7 +3560,7 @@ static const OOMatrix	starboard_matrix =
 	if (u_id == 100)
 		return PLAYER;	// the player
 	
-	if (MAX_ENTITY_UID < u_id)
+	if (entity_for_uid_capacity <= u_id)
 	{
 		OOLog(@"universe.badUID", @"Attempt to retrieve entity for out-of-range UID %u. (This is an internal programming error, please report it.)", u_id);
 		return nil;
@@ -3684,6 +3724,138 @@ static BOOL MaintainLinkedLists(Universe *uni)
 }
 
 
+static void *GrowEntityArray(void *array, unsigned capacity, size_t elementSize)
+{
+	void *result = realloc(array, capacity * elementSize);
+	if (EXPECT_NOT(result == NULL))
+	{
+		[NSException raise:NSMallocException format:@"Failed to grow entity store to %u entities.", capacity];
+	}
+	return result;
+}
+
+
+- (void) ensureEntityCapacity:(unsigned)minCapacity
+{
+	if (entity_for_uid == NULL)
+	{
+		entity_for_uid_capacity = MIN_ENTITY_UID + UNIVERSE_DEBRIS_ENTITY_THRESHOLD;
+		entity_for_uid = calloc(entity_for_uid_capacity, sizeof *entity_for_uid);
+		if (EXPECT_NOT(entity_for_uid == NULL))  [NSException raise:NSMallocException format:@"Failed to allocate entity UID table."];
+	}
+	
+	if (EXPECT(minCapacity <= entityCapacity))  return;
+	
+	unsigned capacity = MAX(entityCapacity, (unsigned)MAX_NUMBER_OF_ENTITIES);
+	while (capacity < minCapacity)  capacity *= 2;
+	
+	sortedEntities = GrowEntityArray(sortedEntities, capacity, sizeof *sortedEntities);
+	updateEntities = GrowEntityArray(updateEntities, capacity, sizeof *updateEntities);
+	concurrentUpdateEntities = GrowEntityArray(concurrentUpdateEntities, capacity, sizeof *concurrentUpdateEntities);
+	drawEntities = GrowEntityArray(drawEntities, capacity, sizeof *drawEntities);
+	hotEntityData.position = GrowEntityArray(hotEntityData.position, capacity, sizeof *hotEntityData.position);
+	hotEntityData.collisionRadius = GrowEntityArray(hotEntityData.collisionRadius, capacity, sizeof *hotEntityData.collisionRadius);
+	hotEntityData.zeroDistance = GrowEntityArray(hotEntityData.zeroDistance, capacity, sizeof *hotEntityData.zeroDistance);
+	hotEntityData.status = GrowEntityArray(hotEntityData.status, capacity, sizeof *hotEntityData.status);
+	hotEntityData.flags = GrowEntityArray(hotEntityData.flags, capacity, sizeof *hotEntityData.flags);
+	
+	memset(sortedEntities + entityCapacity, 0, (capacity - entityCapacity) * sizeof *sortedEntities);
+	entityCapacity = capacity;
+}
+
+
+static void SetHotEntityData(OOEntityHotData *hot, unsigned i, Entity *e)
+{
+	OOEntityHotFlags flags = 0;
+	
+	if (e->isShip)  flags |= kOOEntityHotFlagShip;
+	if (e->isStation)  flags |= kOOEntityHotFlagStation;
+	if (e->isPlayer)  flags |= kOOEntityHotFlagPlayer;
+	if ([e isEffect])  flags |= kOOEntityHotFlagEffect;
+	if ([e canCollide])  flags |= kOOEntityHotFlagCanCollide;
+	
+	hot->position[i] = e->position;
+	hot->collisionRadius[i] = e->collision_radius;
+	hot->zeroDistance[i] = e->zero_distance;
+	hot->status[i] = [e status];
+	hot->flags[i] = flags;
+}
+
+
+static void MoveHotEntityData(OOEntityHotData *hot, unsigned from, unsigned to)
+{
+	hot->position[to] = hot->position[from];
+	hot->collisionRadius[to] = hot->collisionRadius[from];
+	hot->zeroDistance[to] = hot->zeroDistance[from];
+	hot->status[to] = hot->status[from];
+	hot->flags[to] = hot->flags[from];
+}
+
+
+- (const OOEntityHotData *) hotEntityData
+{
+	if (EXPECT_NOT(hotEntityDataStale))
+	{
+		unsigned i;
+		for (i = 0; i < n_entities; i++)
+		{
+			SetHotEntityData(&hotEntityData, i, sortedEntities[i]);
+		}
+		hotEntityData.count = n_entities;
+		hotEntityDataStale = NO;
+	}
+	
+	return &hotEntityData;
+}
+
+
+- (OOEntitySpatialIndex *) entitySpatialIndex
+{
+	if (EXPECT_NOT(entitySpatialIndexStale))
+	{
+		[entitySpatialIndex rebuildWithEntities:sortedEntities count:n_entities];
+		entitySpatialIndexStale = NO;
+	}
+	
+	return entitySpatialIndex;
+}
+
+
+- (void) refitIndexForEntity:(Entity *)entity
+{
+	if (!hotEntityDataStale)
+	{
+		int index = entity->zero_index;
+		if (index >= 0 && (unsigned)index < n_entities && sortedEntities[index] == entity)
+		{
+			SetHotEntityData(&hotEntityData, index, entity);
+		}
+	}
+	if (!entitySpatialIndexStale)  [entitySpatialIndex refitEntity:entity];
+}
+
+
+- (void) ship:(ShipEntity *)ship didChangePrimaryRoleFrom:(NSString *)oldRole
+{
+	OOUniversalID uid = [ship universalID];
+	if (uid == NO_TARGET || uid >= entity_for_uid_capacity || entity_for_uid[uid] != ship)  return;
+	
+	[shipPrimaryRoleCounts removeObject:oldRole];
+	[shipPrimaryRoleCounts addObject:[ship primaryRole]];
+}
+
+
+/*	Returns candidates for a ranged search from the spatial index (see
+	-[OOEntitySpatialIndex copyCandidatesNear:radius:count:]), or NULL if the
+	caller should scan sortedEntities instead.
+*/
+- (Entity **) copyEntitiesNear:(Vector)point inRange:(double)range count:(OOUInteger *)outCount
+{
+	if (range < 0)  return NULL;
+	return [[self entitySpatialIndex] copyCandidatesNear:point radius:range count:outCount];
+}
+
+
 - (BOOL) addEntity:(Entity *) entity
 {
 	if (entity)
@@ -3696,31 +3868,36 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		if ([entities containsObject:entity])
 			return YES;
 		
-		if (n_entities >= UNIVERSE_MAX_ENTITIES - 1)
-		{
-			// throw an exception here...
-			OOLog(@"universe.addEntity.failed", @"***** Universe cannot addEntity:%@ -- Universe is full (%d entities out of %d)", entity, n_entities, UNIVERSE_MAX_ENTITIES);
-#ifndef NDEBUG
-			if (OOLogWillDisplayMessagesInClass(@"universe.maxEntitiesDump")) [self debugDumpEntities];
-#endif
-			return NO;
-		}
-		
 		if (![entity isEffect])
 		{
-			unsigned limiter = UNIVERSE_MAX_ENTITIES;
+			unsigned limiter = entity_for_uid_capacity - MIN_ENTITY_UID;
 			while (entity_for_uid[next_universal_id] != nil)	// skip allocated numbers
 			{
 				next_universal_id++;						// increment keeps idkeys unique
-				if (next_universal_id >= MAX_ENTITY_UID)
+				if ((unsigned)next_universal_id >= entity_for_uid_capacity)
 				{
 					next_universal_id = MIN_ENTITY_UID;
 				}
 				if (limiter-- == 0)
 				{
-					// Every slot has been tried! This should not happen due to previous test, but there was a problem here in 1.70.
-					OOLog(@"universe.addEntity.failed", @"***** Universe cannot addEntity:%@ -- Could not find free slot for entity.", entity);
-					return NO;
+					// Every slot in the table is in use; grow it and take the first new one.
+					unsigned oldCapacity = entity_for_uid_capacity;
+					if (oldCapacity > MAX_ENTITY_UID)
+					{
+						OOLog(@"universe.addEntity.failed", @"***** Universe cannot addEntity:%@ -- Could not find free slot for entity.", entity);
+#ifndef NDEBUG
+						if (OOLogWillDisplayMessagesInClass(@"universe.maxEntitiesDump")) [self debugDumpEntities];
+#endif
+						return NO;
+					}
+					unsigned newCapacity = MIN(oldCapacity * 2, (unsigned)MAX_ENTITY_UID + 1);
+					Entity **newTable = realloc(entity_for_uid, newCapacity * sizeof *entity_for_uid);
+					if (newTable == NULL)  return NO;
+					memset(newTable + oldCapacity, 0, (newCapacity - oldCapacity) * sizeof *newTable);
+					entity_for_uid = newTable;
+					entity_for_uid_capacity = newCapacity;
+					next_universal_id = oldCapacity;
+					break;
 				}
 			}
 			[entity setUniversalID:next_universal_id];
@@ -3774,8 +3951,12 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		// add it to the universe
 		[entities addObject:entity];
 		[entity wasAddedToUniverse];
+		if ([entity isShip])  [shipPrimaryRoleCounts addObject:[(ShipEntity *)entity primaryRole]];
 		
 		// maintain sorted list (and for the scanner relative position)
+		[self ensureEntityCapacity:n_entities + 2];	// keep a nil entry after the last entity for -doRemoveEntity:
+		hotEntityDataStale = YES;
+		entitySpatialIndexStale = YES;
 		Vector entity_pos = entity->position;
 		Vector delta = vector_between(entity_pos, PLAYER->position);
 		double z_distance = magnitude2(delta);
@@ -3873,6 +4054,8 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		[self removeEntity:ent];
 	}
 	
+	[aiScheduler removeAllAIs];
+	
 	[activeWormholes release];
 	activeWormholes = savedWormholes;	// will be cleared out by populateFromActiveWormholes
 	
@@ -3958,48 +4141,38 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	if (nearest < 0.0)
 		return YES;			// within range already!
 	
-	int i;
-	int ent_count = n_entities;
-	Entity* my_entities[ent_count];
-	for (i = 0; i < ent_count; i++)
-		my_entities[i] = [sortedEntities[i] retain]; //	retained
+	unsigned i;
+	const OOEntityHotData *hot = [self hotEntityData];
 	
 	if (v1.x || v1.y || v1.z)
 		f1 = vector_normal(v1);   // unit vector in direction of p2 from p1
 	else
 		f1 = make_vector(0, 0, 1);
 	
-	for (i = 0; i < ent_count ; i++)
+	for (i = 0; i < hot->count; i++)
 	{
-		Entity *e2 = my_entities[i];
-		if ((e2 != e1)&&([e2 canCollide]))
+		if ((sortedEntities[i] != e1)&&(hot->flags[i] & kOOEntityHotFlagCanCollide))
 		{
-			Vector epos = e2->position;
+			Vector epos = hot->position[i];
 			epos.x -= p1.x;	epos.y -= p1.y;	epos.z -= p1.z; // epos now holds vector from p1 to this entities position
 			
 			double d_forward = dot_product(epos,f1);	// distance along f1 which is nearest to e2's position
 			
 			if ((d_forward > 0)&&(d_forward < nearest))
 			{
-				double cr = 1.10 * (e2->collision_radius + e1->collision_radius); //  10% safety margin
+				double cr = 1.10 * (hot->collisionRadius[i] + e1->collision_radius); //  10% safety margin
 				Vector p0 = e1->position;
 				p0.x += d_forward * f1.x;	p0.y += d_forward * f1.y;	p0.z += d_forward * f1.z;
 				// p0 holds nearest point on current course to center of incident object
-				Vector epos = e2->position;
+				Vector epos = hot->position[i];
 				p0.x -= epos.x;	p0.y -= epos.y;	p0.z -= epos.z;
 				// compare with center of incident object
 				double  dist2 = p0.x * p0.x + p0.y * p0.y + p0.z * p0.z;
 				if (dist2 < cr*cr)
-				{
-					for (i = 0; i < ent_count; i++)
-						[my_entities[i] release]; //	released
 					return NO;
-				}
 			}
 		}
 	}
-	for (i = 0; i < ent_count; i++)
-		[my_entities[i] release]; //	released
 	return YES;
 }
 
@@ -4020,34 +4193,31 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		return nil;			// within range already!
 	
 	Entity* result = nil;
-	int i;
-	int ent_count = n_entities;
-	Entity* my_entities[ent_count];
-	for (i = 0; i < ent_count; i++)
-		my_entities[i] = [sortedEntities[i] retain]; //	retained
+	unsigned i;
+	const OOEntityHotData *hot = [self hotEntityData];
 	
 	if (v1.x || v1.y || v1.z)
 		f1 = vector_normal(v1);   // unit vector in direction of p2 from p1
 	else
 		f1 = make_vector(0, 0, 1);
 	
-	for (i = 0; (i < ent_count) && (!result) ; i++)
+	for (i = 0; (i < hot->count) && (!result) ; i++)
 	{
-		Entity *e2 = my_entities[i];
-		if ((e2 != e1)&&([e2 canCollide]))
+		Entity *e2 = sortedEntities[i];
+		if ((e2 != e1)&&(hot->flags[i] & kOOEntityHotFlagCanCollide))
 		{
-			Vector epos = e2->position;
+			Vector epos = hot->position[i];
 			epos.x -= p1.x;	epos.y -= p1.y;	epos.z -= p1.z; // epos now holds vector from p1 to this entities position
 			
 			double d_forward = dot_product(epos,f1);	// distance along f1 which is nearest to e2's position
 			
 			if ((d_forward > 0)&&(d_forward < nearest))
 			{
-				double cr = 1.10 * (e2->collision_radius + e1->collision_radius); //  10% safety margin
+				double cr = 1.10 * (hot->collisionRadius[i] + e1->collision_radius); //  10% safety margin
 				Vector p0 = e1->position;
 				p0.x += d_forward * f1.x;	p0.y += d_forward * f1.y;	p0.z += d_forward * f1.z;
 				// p0 holds nearest point on current course to center of incident object
-				Vector epos = e2->position;
+				Vector epos = hot->position[i];
 				p0.x -= epos.x;	p0.y -= epos.y;	p0.z -= epos.z;
 				// compare with center of incident object
 				double  dist2 = p0.x * p0.x + p0.y * p0.y + p0.z * p0.z;
@@ -4056,8 +4226,6 @@ static BOOL MaintainLinkedLists(Universe *uni)
 			}
 		}
 	}
-	for (i = 0; i < ent_count; i++)
-		[my_entities[i] release]; //	released
 	return result;
 }
 
@@ -4074,11 +4242,8 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	
 	Vector  f1;
 	Vector  result = p2;
-	int i;
-	int ent_count = n_entities;
-	Entity* my_entities[ent_count];
-	for (i = 0; i < ent_count; i++)
-		my_entities[i] = [sortedEntities[i] retain];	// retained
+	unsigned i;
+	const OOEntityHotData *hot = [self hotEntityData];
 	Vector p1 = e1->position;
 	Vector v1 = p2;
 	v1.x -= p1.x;   v1.y -= p1.y;   v1.z -= p1.z;   // vector from entity to p2
@@ -4090,23 +4255,22 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	else
 		f1 = make_vector(0, 0, 1);
 	
-	for (i = 0; i < ent_count; i++)
+	for (i = 0; i < hot->count; i++)
 	{
-		Entity *e2 = my_entities[i];
-		if ((e2 != e1)&&([e2 canCollide]))
+		if ((sortedEntities[i] != e1)&&(hot->flags[i] & kOOEntityHotFlagCanCollide))
 		{
-			Vector epos = e2->position;
+			Vector epos = hot->position[i];
 			epos.x -= p1.x;	epos.y -= p1.y;	epos.z -= p1.z;
 			double d_forward = dot_product(epos,f1);
 			if ((d_forward > 0)&&(d_forward < nearest))
 			{
-				double cr = 1.20 * (e2->collision_radius + e1->collision_radius); //  20% safety margin
+				double cr = 1.20 * (hot->collisionRadius[i] + e1->collision_radius); //  20% safety margin
 				
 				Vector p0 = e1->position;
 				p0.x += d_forward * f1.x;	p0.y += d_forward * f1.y;	p0.z += d_forward * f1.z;
 				// p0 holds nearest point on current course to center of incident object
 				
-				Vector epos = e2->position;
+				Vector epos = hot->position[i];
 				p0.x -= epos.x;	p0.y -= epos.y;	p0.z -= epos.z;
 				// compare with center of incident object
 				
@@ -4114,7 +4278,7 @@ static BOOL MaintainLinkedLists(Universe *uni)
 				
 				if (dist2 < cr*cr)
 				{
-					result = e2->position;			// center of incident object
+					result = hot->position[i];			// center of incident object
 					nearest = d_forward;
 					
 					if (dist2 == 0.0)
@@ -4166,8 +4330,6 @@ static BOOL MaintainLinkedLists(Universe *uni)
 			}
 		}
 	}
-	for (i = 0; i < ent_count; i++)
-		[my_entities[i] release]; //	released
 	return result;
 }
 
@@ -4409,6 +4571,9 @@ static BOOL MaintainLinkedLists(Universe *uni)
 
 - (unsigned) countShipsWithPrimaryRole:(NSString *)role inRange:(double)range ofEntity:(Entity *)entity
 {
+	// The reference entity is excluded from searches, so it only matters if it could be counted.
+	if (range < 0 && ![entity isShip])  return [shipPrimaryRoleCounts countForObject:role];
+	
 	return [self countShipsMatchingPredicate:HasPrimaryRolePredicate
 							   parameter:role
 								 inRange:range
@@ -4418,6 +4583,8 @@ static BOOL MaintainLinkedLists(Universe *uni)
 
 - (unsigned) countShipsWithScanClass:(OOScanClass)scanClass inRange:(double)range ofEntity:(Entity *)entity
 {
+	if (range < 0 && ![entity isShip])  return [[self entitySpatialIndex] countShipsWithScanClass:scanClass];
+	
 	return [self countShipsMatchingPredicate:HasScanClassPredicate
 							   parameter:[NSNumber numberWithInt:scanClass]
 								 inRange:range
@@ -4449,7 +4616,9 @@ static BOOL MaintainLinkedLists(Universe *uni)
 									inRange:(double)range
 								   ofEntity:(Entity *)e1
 {
-	unsigned		i, found = 0;
+	unsigned		found = 0;
+	OOUInteger		i, indexedCount = 0;
+	Entity			**indexed = NULL;
 	Vector			p1, p2;
 	double			distance, cr;
 	
@@ -4458,9 +4627,11 @@ static BOOL MaintainLinkedLists(Universe *uni)
 	if (e1 != nil)  p1 = e1->position;
 	else  p1 = kZeroVector;
 	
-	for (i = 0; i < n_entities; i++)
+	indexed = [self copyEntitiesNear:p1 inRange:range count:&indexedCount];
+	
+	for (i = 0; (indexed != NULL) ? (i < indexedCount) : (i < n_entities); i++)
 	{
-		Entity *e2 = sortedEntities[i];
+		Entity *e2 = (indexed != NULL) ? indexed[i] : sortedEntities[i];
 		if (e2 != e1 && predicate(e2, parameter))
 		{
 			if (range < 0)  distance = -1;	// Negative range means infinity
@@ -4477,6 +4648,7 @@ static BOOL MaintainLinkedLists(Universe *uni)
 		}
 	}
 	
+	free(indexed);
 	return found;
 }
 
@@ -4527,7 +4699,8 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 {
 	OOJS_PROFILE_ENTER
 	
-	unsigned		i;
+	OOUInteger		i, indexedCount = 0;
+	Entity			**indexed = NULL;
 	Vector			p1;
 	NSMutableArray	*result = nil;
 	
@@ -4535,14 +4708,15 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 	
 	if (predicate == NULL)  predicate = YESPredicate;
 	
-	result = [NSMutableArray arrayWithCapacity:n_entities];
-	
 	if (e1 != nil)  p1 = [e1 position];
 	else  p1 = kZeroVector;
 	
-	for (i = 0; i < n_entities; i++)
+	indexed = [self copyEntitiesNear:p1 inRange:range count:&indexedCount];
+	result = [NSMutableArray arrayWithCapacity:(indexed != NULL) ? indexedCount : n_entities];
+	
+	for (i = 0; (indexed != NULL) ? (i < indexedCount) : (i < n_entities); i++)
 	{
-		Entity *e2 = sortedEntities[i];
+		Entity *e2 = (indexed != NULL) ? indexed[i] : sortedEntities[i];
 		
 		if (e1 != e2 &&
 			EntityInRange(p1, e2, range) &&
@@ -4552,6 +4726,8 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 		}
 	}
 	
+	free(indexed);
+	
 	OOJSResumeTimeLimiter();
 	
 	return result;
@@ -4614,9 +4790,11 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 							parameter:(void *)parameter
 					 relativeToEntity:(Entity *)entity
 {
-	unsigned		i;
+	OOUInteger		i, indexedCount = 0;
+	Entity			**indexed = NULL;
 	Vector			p1;
 	float			rangeSq = INFINITY;
+	float			searchRadius = SCANNER_MAX_RANGE, searchedSq = 0.0f;
 	id				result = nil;
 	
 	if (predicate == NULL)  predicate = YESPredicate;
@@ -4624,18 +4802,37 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 	if (entity != nil)  p1 = [entity position];
 	else  p1 = kZeroVector;
 	
-	for (i = 0; i < n_entities; i++)
+	/*	Search the spatial index in expanding spheres. Everything within
+		searchRadius is a candidate, so a match closer than that is the
+		nearest. Entities inside an earlier sphere have already been tested.
+		Once the sphere covers too much of the index, fall back to scanning
+		everything.
+	*/
+	for (;;)
 	{
-		Entity *e2 = sortedEntities[i];
-		float distanceToReferenceEntitySquared = (float)distance2(p1, [e2 position]);
+		indexed = [self copyEntitiesNear:p1 inRange:searchRadius count:&indexedCount];
 		
-		if (entity != e2 &&
-			distanceToReferenceEntitySquared < rangeSq &&
-			predicate(e2, parameter))
+		for (i = 0; (indexed != NULL) ? (i < indexedCount) : (i < n_entities); i++)
 		{
-			result = e2;
-			rangeSq = distanceToReferenceEntitySquared;
+			Entity *e2 = (indexed != NULL) ? indexed[i] : sortedEntities[i];
+			float distanceToReferenceEntitySquared = (float)distance2(p1, [e2 position]);
+			
+			if (entity != e2 &&
+				distanceToReferenceEntitySquared >= searchedSq &&
+				distanceToReferenceEntitySquared < rangeSq &&
+				predicate(e2, parameter))
+			{
+				result = e2;
+				rangeSq = distanceToReferenceEntitySquared;
+			}
 		}
+		
+		if (indexed == NULL)  break;
+		free(indexed);
+		
+		searchedSq = searchRadius * searchRadius;
+		if (rangeSq < searchedSq)  break;
+		searchRadius *= 4.0f;
 	}
 	
 	return [[result retain] autorelease];
@@ -4688,7 +4885,7 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 	for (i = 0; i < n_entities; i++)
 		[universeRegion checkEntity: sortedEntities[i]];	//	sorts out which region it's in
 	
-	[universeRegion findCollisions];
+	[universeRegion findCollisionsWithBroadPhase:collisionBroadPhase];
 	
 	// do check for entities that can't see the sun!
 	[universeRegion findShadowedEntities];
@@ -5055,15 +5252,18 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 	if (!no_update)
 	{
 		unsigned	i, ent_count = n_entities;
-		Entity		*my_entities[ent_count];
 		
 		[self verifyEntitySessionIDs];
 		
-		// use a retained copy so this can't be changed under us.
-		for (i = 0; i < ent_count; i++)
-		{
-			my_entities[i] = [sortedEntities[i] retain];	// explicitly retain each one
-		}
+		/*	Use a copy so this can't be changed under us. No retains are
+			needed: -removeEntity: keeps removed entities alive in
+			entitiesDeadThisUpdate until the end of the update. Always go
+			through the updateEntities ivar, since adding entities may
+			reallocate it (preserving its contents).
+		*/
+		memcpy(updateEntities, sortedEntities, ent_count * sizeof *updateEntities);
+		hotEntityDataStale = YES;
+		entitySpatialIndexStale = YES;
 		
 		NSString * volatile update_stage = @"initialisation";
 #ifndef NDEBUG
@@ -5167,10 +5367,11 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 			
 			update_stage = @"update:entity";
 			NSMutableSet *zombies = nil;
+			unsigned concurrentCount = 0;
 			
 			for (i = 0; i < ent_count; i++)
 			{
-				Entity *thing = my_entities[i];
+				Entity *thing = updateEntities[i];
 #ifndef NDEBUG
 				update_stage_param = thing;
 				update_stage = @"update:entity [%@]";
@@ -5183,6 +5384,13 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 					continue;
 				}
 				
+				if ([thing canUpdateConcurrently])
+				{
+					// Effects with no side effects are updated together after everything else.
+					concurrentUpdateEntities[concurrentCount++] = thing;
+					continue;
+				}
+				
 				[thing update:delta_t];
 				if (sessionID != _sessionID)
 				{
@@ -5194,41 +5402,42 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 				update_stage = @"update:list maintenance [%@]";
 #endif
 				
-				// maintain distance-from-player list
-				GLfloat z_distance = thing->zero_distance;
+				[self maintainSortedPositionOfEntity:thing];
 				
-				int index = thing->zero_index;
-				while (index > 0 && z_distance < sortedEntities[index - 1]->zero_distance)
-				{
-					sortedEntities[index] = sortedEntities[index - 1];	// bubble up the list, usually by just one position
-					sortedEntities[index - 1] = thing;
-					thing->zero_index = index - 1;
-					sortedEntities[index]->zero_index = index;
-					index--;
-				}
-				
-				// update deterministic AI
+				// Queue deterministic AI; due AIs think below, within the frame's AI budget.
 				if ([thing isShip])
 				{
-#ifndef NDEBUG
-					update_stage = @"update:think [%@]";
-#endif
-					AI* theShipsAI = [(ShipEntity *)thing getAI];
-					if (theShipsAI)
-					{
-						double thinkTime = [theShipsAI nextThinkTime];
-						if ((universal_time > thinkTime)||(thinkTime == 0.0))
-						{
-							[theShipsAI setNextThinkTime:universal_time + [theShipsAI thinkTimeInterval]];
-							[theShipsAI think];
-						}
-					}
+					[aiScheduler queueAIIfDue:[(ShipEntity *)thing getAI] atTime:universal_time];
 				}
 			}
 #ifndef NDEBUG
 		update_stage_param = nil;
 #endif
 			
+			if (sessionID == _sessionID)
+			{
+				update_stage = @"update:think";
+				[aiScheduler runQueuedAIsAtTime:universal_time];
+			}
+			
+			if (concurrentCount != 0 && sessionID == _sessionID)
+			{
+				update_stage = @"update:concurrent entities";
+				[OOConcurrentEntityUpdater updateEntities:concurrentUpdateEntities count:concurrentCount delta:delta_t];
+				
+				/*	Merge step: everything which may touch the rest of the
+					universe happens here, on the main thread and in snapshot
+					order, so the outcome doesn't depend on thread timing.
+				*/
+				update_stage = @"update:concurrent entity completion";
+				for (i = 0; i < concurrentCount; i++)
+				{
+					Entity *thing = concurrentUpdateEntities[i];
+					[thing completeConcurrentUpdate];
+					[self maintainSortedPositionOfEntity:thing];
+				}
+			}
+			
 			if (zombies != nil)
 			{
 				update_stage = @"shootin' zombies";
@@ -5241,17 +5450,19 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 				}
 			}
 			
+			hotEntityDataStale = YES;
+			
 			// Maintain x/y/z order lists
 			update_stage = @"updating linked lists";
 			for (i = 0; i < ent_count; i++)
 			{
-				[my_entities[i] updateLinkedLists];
+				[updateEntities[i] updateLinkedLists];
 			}
 			
 			// detect collisions and light ships that can see the sun
 			
 			update_stage = @"collision and shadow detection";
-			[self filterSortedLists];
+			[collisionBroadPhase findCandidatePairsForEntities:sortedEntities count:n_entities];
 			[self findCollisionsAndShadows];
 			
 			// do any required check and maintenance of linked lists
@@ -5274,13 +5485,6 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 				[localException raise];
 			}
 		NS_ENDHANDLER
-		
-		// dispose of the non-mutable copy and everything it references neatly
-		update_stage = @"clean up";
-		for (i = 0; i < ent_count; i++)
-		{
-			[my_entities[i] release];	// explicitly release each one
-		}
 	}
 	
 	[entitiesDeadThisUpdate autorelease];
@@ -5321,6 +5525,31 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 #endif
 
 
+- (void) maintainSortedPositionOfEntity:(Entity *)thing
+{
+	// maintain distance-from-player list
+	GLfloat z_distance = thing->zero_distance;
+	
+	// Entities removed earlier in the update are still in the update lists, but no longer sorted.
+	int index = thing->zero_index;
+	if (index < 0 || (unsigned)index >= n_entities || sortedEntities[index] != thing)  return;
+	
+	while (index > 0 && z_distance < sortedEntities[index - 1]->zero_distance)
+	{
+		sortedEntities[index] = sortedEntities[index - 1];	// bubble up the list, usually by just one position
+		sortedEntities[index - 1] = thing;
+		thing->zero_index = index - 1;
+		sortedEntities[index]->zero_index = index;
+		if (!hotEntityDataStale)  MoveHotEntityData(&hotEntityData, index - 1, index);
+		index--;
+	}
+	
+	// Keep route queries later in the update looking at where thing is now.
+	if (!hotEntityDataStale)  SetHotEntityData(&hotEntityData, index, thing);
+	if (!entitySpatialIndexStale)  [entitySpatialIndex refitEntity:thing];
+}
+
+
 - (void) filterSortedLists
 {
 	/*
@@ -5580,6 +5809,28 @@ OOINLINE BOOL EntityInRange(Vector p1, Entity *e2, float range)
 }
 
 
+- (OOCollisionBroadPhase *) collisionBroadPhase
+{
+	return collisionBroadPhase;
+}
+
+
+- (void) setCollisionBroadPhase:(OOCollisionBroadPhase *)broadPhase
+{
+	if (broadPhase == nil)  return;
+	
+	[collisionBroadPhase autorelease];
+	collisionBroadPhase = [broadPhase retain];
+	OOLog(@"collision.broadPhase", @"Using %@ collision broad phase.", [broadPhase name]);
+}
+
+
+- (OOAIScheduler *) aiScheduler
+{
+	return aiScheduler;
+}
+
+
 - (void) setGalaxySeed:(Random_Seed) gal_seed
 {
 	[self setGalaxySeed:gal_seed andReinit:NO];
@@ -8494,7 +8745,7 @@ Entity *gOOJSPlayerIfStale = nil;
 	[self resetBeacons];
 	
 	next_universal_id = 100;	// start arbitrarily above zero
-	memset(entity_for_uid, 0, sizeof entity_for_uid);
+	if (entity_for_uid != NULL)  memset(entity_for_uid, 0, entity_for_uid_capacity * sizeof *entity_for_uid);
 	
 	[self setMainLightPosition:kZeroVector];
 	
@@ -8635,6 +8886,7 @@ Entity *gOOJSPlayerIfStale = nil;
 	assert(player != nil);
 	
 	[self removeAllEntitiesExceptPlayer];
+	[texturePreloader releaseTextures];
 	[OOTexture clearCache];
 	[self resetSystemDataCache];
 	
@@ -8648,6 +8900,7 @@ Entity *gOOJSPlayerIfStale = nil;
 	//       be aware of cache flushes so it can automatically
 	//       reinitialize itself - mwerle 20081107.
 	[OOShipRegistry reload];
+	[texturePreloader preloadTexturesForShipRegistry:[OOShipRegistry sharedRegistry]];
 	[[gameView gameController] unpauseGame];
 	
 	if (strictChanged)
@@ -8837,6 +9090,8 @@ Entity *gOOJSPlayerIfStale = nil;
 	[entity wasRemovedFromUniverse];
 	
 	// maintain sorted lists
+	hotEntityDataStale = YES;
+	entitySpatialIndexStale = YES;
 	int index = entity->zero_index;
 	
 	int n = 1;
@@ -8883,6 +9138,7 @@ Entity *gOOJSPlayerIfStale = nil;
 		if ([entity isShip])
 		{
 			ShipEntity *se = (ShipEntity*)entity;
+			[shipPrimaryRoleCounts removeObject:[se primaryRole]];
 			if ([se isBeacon])
 			{
 				ShipEntity	*beacon = [self firstBeacon];
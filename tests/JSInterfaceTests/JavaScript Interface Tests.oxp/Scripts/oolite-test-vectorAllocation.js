@@ -0,0 +1,124 @@
+/*
+
+oolite-test-vectorAllocation.js
+
+Micro-benchmark for creating and dropping Vector3D and Quaternion objects,
+the pattern of script-heavy OXPs doing vector maths every frame. Each case
+is run for a fixed number of iterations, and the rate of new objects per
+second is written to the log under script.test.benchmark. To compare
+allocation strategies, run the tests with builds from before and after the
+change; in debug builds, PS.callObjC("reportJSVectorPoolStatistics") and
+PS.callObjC("reportJSQuaternionPoolStatistics") show the pool usage.
+
+
+Oolite
+Copyright © 2004-2011 Giles C Williams and contributors
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+MA 02110-1301, USA.
+
+*/
+
+
+this.name			= "oolite-test-vectorAllocation";
+this.author			= "the Oolite team";
+this.copyright		= "© 2011 the Oolite team.";
+this.description	= "Allocation benchmark for Vector3D and Quaternion.";
+this.version		= "1.75";
+
+
+this.startUp = function ()
+{
+	"use strict";
+	
+	var testRig = worldScripts["oolite-script-test-rig"];
+	var require = testRig.$require;
+	
+	const iterations = 200000;
+	
+	/*
+		Run body iterations times, and log the rate of new objects, given
+		that each call creates objectsPerCall of them. The figures include
+		the garbage collections, and so the finalizers, the loop triggers.
+	*/
+	function benchmark(name, objectsPerCall, body)
+	{
+		var start = Date.now();
+		var result = body(iterations);
+		var elapsed = (Date.now() - start) / 1000;
+		
+		var rate = elapsed > 0 ? Math.round(iterations * objectsPerCall / elapsed) : "∞";
+		log("script.test.benchmark", name + ": " + iterations * objectsPerCall + " objects in " + elapsed.toFixed(3) + " s, " + rate + " objects/s.");
+		
+		return result;
+	}
+	
+	testRig.$registerTest("Vector3D allocation benchmark", function ()
+	{
+		var constructed = benchmark("new Vector3D", 1, function (count)
+		{
+			var v, sum = 0;
+			for (var i = 0; i < count; i++)
+			{
+				v = new Vector3D(i, 1, 2);
+				sum += v.x;
+			}
+			return sum;
+		});
+		require("sum of constructed vectors", constructed == iterations * (iterations - 1) / 2);
+		
+		var arithmetic = benchmark("Vector3D arithmetic", 3, function (count)
+		{
+			var a = new Vector3D(1, 0, 0);
+			var b = new Vector3D(0, 1, 0);
+			var v = a;
+			for (var i = 0; i < count; i++)
+			{
+				// add(), subtract() and multiply() each return a new vector.
+				v = v.add(b).subtract(b).multiply(1);
+			}
+			return v;
+		});
+		require("result of vector arithmetic", arithmetic.x == 1 && arithmetic.y == 0 && arithmetic.z == 0);
+	});
+	
+	testRig.$registerTest("Quaternion allocation benchmark", function ()
+	{
+		var constructed = benchmark("new Quaternion", 1, function (count)
+		{
+			var q, sum = 0;
+			for (var i = 0; i < count; i++)
+			{
+				q = new Quaternion(1, 0, 0, i);
+				sum += q.z;
+			}
+			return sum;
+		});
+		require("sum of constructed quaternions", constructed == iterations * (iterations - 1) / 2);
+		
+		var rotated = benchmark("Quaternion rotation", 2, function (count)
+		{
+			var q = new Quaternion(1, 0, 0, 0);
+			var v = new Vector3D(0, 0, 1);
+			for (var i = 0; i < count; i++)
+			{
+				// multiply() returns a new quaternion, vectorForward() a new vector.
+				v = q.multiply(q).vectorForward();
+			}
+			return v;
+		});
+		require("forward vector of identity", rotated.x == 0 && rotated.y == 0 && rotated.z == 1);
+	});
+}
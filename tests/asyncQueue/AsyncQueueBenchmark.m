@@ -0,0 +1,186 @@
+/*	Contention micro-benchmark for OOAsyncQueue.
+	
+	For each combination of producer and consumer thread counts, the producers
+	push kMessagesPerProducer NSNumbers through one queue while the consumers
+	pull them out with -dequeue, and the elapsed time and throughput are
+	logged. Every message is checked off, so lost or duplicated messages are
+	reported too.
+	
+	Build by compiling together with src/Core/OOAsyncQueue.m and its
+	dependencies (OOLogging, NSThreadOOExtensions), with src/Core on the
+	include path. Define OOASYNCQUEUE_LOCK_FREE=0 to measure the lock-based
+	queue for comparison.
+*/
+
+#import <Foundation/Foundation.h>
+#import "OOAsyncQueue.h"
+#include <sys/time.h>
+
+
+enum
+{
+	kMessagesPerProducer	= 200000,
+	kMaxThreads				= 8
+};
+
+
+@interface BenchmarkRun: NSObject
+{
+@public
+	OOAsyncQueue			*queue;
+	NSConditionLock			*doneLock;
+	unsigned				producerCount, consumerCount;
+	unsigned				finishedThreads;
+	unsigned char			*received;
+	unsigned long			duplicates;
+}
+
+- (void) produce:(NSNumber *)producerIndex;
+- (void) consume:(id)unused;
+
+@end
+
+
+static double Now(void);
+static void RunBenchmark(unsigned producers, unsigned consumers);
+
+
+int main (int argc, const char * argv[])
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	unsigned			producers, consumers;
+	
+	NSLog(@"OOAsyncQueue benchmark (%s), %u messages per producer.", OOASYNCQUEUE_LOCK_FREE ? "lock-free" : "locking", kMessagesPerProducer);
+	
+	for (producers = 1; producers <= kMaxThreads; producers *= 2)
+	{
+		for (consumers = 1; consumers <= kMaxThreads; consumers *= 2)
+		{
+			RunBenchmark(producers, consumers);
+		}
+	}
+	
+	[pool release];
+	return 0;
+}
+
+
+static void RunBenchmark(unsigned producers, unsigned consumers)
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	BenchmarkRun		*run = [[BenchmarkRun alloc] init];
+	unsigned			i, total = producers * kMessagesPerProducer;
+	
+	run->queue = [[OOAsyncQueue alloc] init];
+	run->doneLock = [[NSConditionLock alloc] initWithCondition:0];
+	run->producerCount = producers;
+	run->consumerCount = consumers;
+	run->received = calloc(total, 1);
+	
+	double start = Now();
+	
+	for (i = 0; i < consumers; i++)
+	{
+		[NSThread detachNewThreadSelector:@selector(consume:) toTarget:run withObject:nil];
+	}
+	for (i = 0; i < producers; i++)
+	{
+		[NSThread detachNewThreadSelector:@selector(produce:) toTarget:run withObject:[NSNumber numberWithUnsignedInt:i]];
+	}
+	
+	// Wait for the producers, then send one stop message per consumer.
+	[run->doneLock lockWhenCondition:producers];
+	[run->doneLock unlock];
+	for (i = 0; i < consumers; i++)
+	{
+		[run->queue enqueue:[NSNull null]];
+	}
+	[run->doneLock lockWhenCondition:producers + consumers];
+	[run->doneLock unlock];
+	
+	double elapsed = Now() - start;
+	
+	unsigned long missing = 0;
+	for (i = 0; i < total; i++)
+	{
+		if (!run->received[i])  missing++;
+	}
+	
+	NSLog(@"%u producers, %u consumers: %.3f s, %.0f messages/s%@", producers, consumers, elapsed, total / elapsed,
+		  (missing || run->duplicates) ? [NSString stringWithFormat:@" -- ERROR: %lu missing, %lu duplicated", missing, run->duplicates] : @"");
+	
+	free(run->received);
+	[run->queue release];
+	[run->doneLock release];
+	[run release];
+	[pool release];
+}
+
+
+static double Now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+@implementation BenchmarkRun
+
+- (void) finish
+{
+	[doneLock lock];
+	finishedThreads++;
+	[doneLock unlockWithCondition:finishedThreads];
+}
+
+
+- (void) produce:(NSNumber *)producerIndex
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	unsigned			i, base = [producerIndex unsignedIntValue] * kMessagesPerProducer;
+	
+	for (i = 0; i < kMessagesPerProducer; i++)
+	{
+		NSNumber *message = [[NSNumber alloc] initWithUnsignedInt:base + i];
+		[queue enqueue:message];
+		[message release];
+		
+		if ((i & 1023) == 1023)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	
+	[pool release];
+	[self finish];
+}
+
+
+- (void) consume:(id)unused
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	unsigned			count = 0;
+	
+	for (;;)
+	{
+		id message = [queue dequeue];
+		if (message == [NSNull null])  break;
+		
+		unsigned value = [message unsignedIntValue];
+		if (received[value])  duplicates++;	// Not synchronized, but any count is a failure.
+		received[value] = 1;
+		
+		if ((++count & 1023) == 0)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	
+	[pool release];
+	[self finish];
+}
+
+@end
@@ -0,0 +1,264 @@
+/*	Micro-benchmark and sanity check for OOCache.
+
+	A cache with the texture cache's prune threshold is filled with string
+	keys shaped like texture cache keys, and then put through a stream of
+	look-ups with a skewed distribution (most hits on a small working set,
+	like the texture and mesh caches during play) mixed with insertions of
+	new keys, which cause pruning. The same stream is run through an
+	NSMutableDictionary as a baseline. Results are checked against a plain
+	dictionary, so a cache returning the wrong object for a key is reported.
+	
+	The cache is then shared by several threads, each doing look-ups and
+	insertions, once with a single shard and once with the default number of
+	shards.
+	
+	Build by compiling together with src/Core/OOCache.m and its dependencies
+	(OOLogging, OOStringParsing, NSThreadOOExtensions), with src/Core on the
+	include path. To compare with the splay tree implementation, build a
+	second copy against OOCache.m from before the hash table was introduced;
+	it has no -initWithShardCount:, so define NO_SHARDS=1 for that build.
+*/
+
+#import <Foundation/Foundation.h>
+#import "OOCache.h"
+#include <sys/time.h>
+
+
+#ifndef NO_SHARDS
+#define NO_SHARDS			0
+#endif
+
+
+enum
+{
+	kPruneThreshold			= 200,
+	kKeyCount				= 2000,
+	kWorkingSetSize			= 50,
+	kOperations				= 2000000,
+	kInsertInterval			= 16,		// One insertion per this many operations.
+	kThreadCount			= 4,
+	kThreadShards			= 16,
+	kOperationsPerThread	= 500000
+};
+
+
+@interface ThreadRun: NSObject
+{
+@public
+	OOCache					*cache;
+	NSArray					*keys;
+	NSConditionLock			*doneLock;
+	unsigned				finishedThreads;
+	unsigned long			mismatches;
+}
+
+- (void) work:(NSNumber *)seed;
+
+@end
+
+
+static double Now(void);
+static uint32_t Random(uint32_t *state);
+static unsigned PickKey(uint32_t *state);
+static NSArray *MakeKeys(void);
+static void RunSingleThreaded(NSArray *keys);
+static void RunThreaded(NSArray *keys, unsigned shardCount);
+
+
+static unsigned long sFailures = 0;
+
+
+int main (int argc, const char * argv[])
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	NSArray				*keys = nil;
+	
+	OOLoggingInit();
+	
+	keys = MakeKeys();
+	NSLog(@"OOCache benchmark: %u keys, prune threshold %u, working set %u.", kKeyCount, kPruneThreshold, kWorkingSetSize);
+	
+	RunSingleThreaded(keys);
+
+#if !NO_SHARDS
+	RunThreaded(keys, 1);
+	RunThreaded(keys, kThreadShards);
+#endif
+
+	NSLog(@"%lu failures.", sFailures);
+	
+	[pool release];
+	return sFailures < 255 ? sFailures : 255;
+}
+
+
+static double Now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+static uint32_t Random(uint32_t *state)
+{
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 8;
+}
+
+
+// Seven look-ups in eight go to the working set.
+static unsigned PickKey(uint32_t *state)
+{
+	uint32_t r = Random(state);
+	if ((r & 7) != 0)  return (r >> 3) % kWorkingSetSize;
+	return (r >> 3) % kKeyCount;
+}
+
+
+static NSArray *MakeKeys(void)
+{
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:kKeyCount];
+	unsigned i;
+	
+	for (i = 0; i < kKeyCount; i++)
+	{
+		[keys addObject:[NSString stringWithFormat:@"oolite_ship_texture_%u_diffuse.png:{cube_map = 0; mipmap = 1; repeat_s = 0;}", i]];
+	}
+	return keys;
+}
+
+
+static void RunSingleThreaded(NSArray *keys)
+{
+	NSAutoreleasePool		*pool = [[NSAutoreleasePool alloc] init];
+	OOCache					*cache = [[OOCache alloc] init];
+	NSMutableDictionary		*dict = [NSMutableDictionary dictionary];
+	uint32_t				state;
+	unsigned				i, hits = 0, dictHits = 0;
+	double					start, cacheTime, dictTime;
+	
+	[cache setName:@"benchmark"];
+	[cache setPruneThreshold:kPruneThreshold];
+	[cache setAutoPrune:YES];
+	
+	state = 1;
+	start = Now();
+	for (i = 0; i < kOperations; i++)
+	{
+		NSString *key = [keys objectAtIndex:PickKey(&state)];
+		if ((i % kInsertInterval) == 0)
+		{
+			[cache setObject:key forKey:key];
+		}
+		else
+		{
+			id value = [cache objectForKey:key];
+			if (value != nil)
+			{
+				hits++;
+				if (![value isEqual:key])  sFailures++;
+			}
+		}
+		if ((i & 0xFFFF) == 0)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	cacheTime = Now() - start;
+	
+	state = 1;
+	start = Now();
+	for (i = 0; i < kOperations; i++)
+	{
+		NSString *key = [keys objectAtIndex:PickKey(&state)];
+		if ((i % kInsertInterval) == 0)  [dict setObject:key forKey:key];
+		else if ([dict objectForKey:key] != nil)  dictHits++;
+	}
+	dictTime = Now() - start;
+	
+	if ([[cache objectsByAge] count] > kPruneThreshold)
+	{
+		NSLog(@"FAILURE: cache holds %u objects, more than the prune threshold.", [[cache objectsByAge] count]);
+		sFailures++;
+	}
+	
+	NSLog(@"Single thread: OOCache %.1f ns/op (%u hits), NSMutableDictionary %.1f ns/op (%u hits, unbounded).", cacheTime * 1e9 / kOperations, hits, dictTime * 1e9 / kOperations, dictHits);
+	
+	[cache release];
+	[pool release];
+}
+
+
+#if !NO_SHARDS
+static void RunThreaded(NSArray *keys, unsigned shardCount)
+{
+	NSAutoreleasePool		*pool = [[NSAutoreleasePool alloc] init];
+	ThreadRun				*run = [[ThreadRun alloc] init];
+	unsigned				i;
+	double					start, elapsed;
+	
+	run->cache = [[OOCache alloc] initWithShardCount:shardCount];
+	[run->cache setName:@"benchmark"];
+	[run->cache setPruneThreshold:kPruneThreshold];
+	run->keys = keys;
+	run->doneLock = [[NSConditionLock alloc] initWithCondition:0];
+	
+	start = Now();
+	for (i = 0; i < kThreadCount; i++)
+	{
+		[NSThread detachNewThreadSelector:@selector(work:) toTarget:run withObject:[NSNumber numberWithUnsignedInt:i + 1]];
+	}
+	[run->doneLock lockWhenCondition:kThreadCount];
+	[run->doneLock unlock];
+	elapsed = Now() - start;
+	
+	NSLog(@"%u threads, %u shards: %.1f ns/op overall, %u entries at end.", kThreadCount, [run->cache shardCount], elapsed * 1e9 / (kThreadCount * kOperationsPerThread), [run->cache count]);
+	sFailures += run->mismatches;
+	
+	[run->cache release];
+	[run->doneLock release];
+	[run release];
+	[pool release];
+}
+#endif
+
+
+@implementation ThreadRun
+
+- (void) work:(NSNumber *)seed
+{
+	NSAutoreleasePool		*pool = [[NSAutoreleasePool alloc] init];
+	uint32_t				state = [seed unsignedIntValue];
+	unsigned				i;
+	unsigned long			localMismatches = 0;
+	
+	for (i = 0; i < kOperationsPerThread; i++)
+	{
+		NSString *key = [keys objectAtIndex:PickKey(&state)];
+		if ((i % kInsertInterval) == 0)
+		{
+			[cache setObject:key forKey:key];
+		}
+		else
+		{
+			id value = [cache objectForKey:key];
+			if (value != nil && ![value isEqual:key])  localMismatches++;
+		}
+		if ((i & 0xFFFF) == 0)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	
+	[doneLock lock];
+	mismatches += localMismatches;
+	finishedThreads++;
+	[doneLock unlockWithCondition:finishedThreads];
+	
+	[pool release];
+}
+
+@end
@@ -0,0 +1,81 @@
+/*	Minimal stand-in for OOLogging, for ScalingHarness.
+
+	The real OOLogging depends on ResourceManager and so on most of the game.
+	This writes every message to stderr, with its message class.
+*/
+
+#define OOLOG_NO_HIJACK_NSLOG	1
+
+#import "OOLoggingExtended.h"
+#include <stdio.h>
+
+
+NSString * const kOOLogSubclassResponsibility		= @"general.error.subclassResponsibility";
+NSString * const kOOLogParameterError				= @"general.error.parameterError";
+NSString * const kOOLogDeprecatedMethod				= @"general.error.deprecatedMethod";
+NSString * const kOOLogAllocationFailure			= @"general.error.allocationFailure";
+NSString * const kOOLogInconsistentState			= @"general.error.inconsistentState";
+NSString * const kOOLogException					= @"exception";
+NSString * const kOOLogFileNotFound					= @"files.notfound";
+NSString * const kOOLogFileNotLoaded				= @"files.notloaded";
+NSString * const kOOLogOpenGLError					= @"rendering.opengl.error";
+NSString * const kOOLogUnconvertedNSLog				= @"unclassified";
+
+
+void OOLoggingInit(void)
+{
+}
+
+
+BOOL OOLogWillDisplayMessagesInClass(NSString *inMessageClass)
+{
+	return YES;
+}
+
+
+void OOLogWithFunctionFileAndLineAndArguments(NSString *inMessageClass, const char *inFunction, const char *inFile, unsigned long inLine, NSString *inFormat, va_list inArguments)
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSString *message = [[[NSString alloc] initWithFormat:inFormat arguments:inArguments] autorelease];
+	
+	if ([inMessageClass isEqualToString:kOOLogUnconvertedNSLog])
+	{
+		fprintf(stderr, "%s\n", [message UTF8String]);
+	}
+	else
+	{
+		fprintf(stderr, "[%s] %s\n", [inMessageClass UTF8String], [message UTF8String]);
+	}
+	
+	[pool release];
+}
+
+
+void OOLogWithFunctionFileAndLine(NSString *inMessageClass, const char *inFunction, const char *inFile, unsigned long inLine, NSString *inFormat, ...)
+{
+	va_list args;
+	va_start(args, inFormat);
+	OOLogWithFunctionFileAndLineAndArguments(inMessageClass, inFunction, inFile, inLine, inFormat, args);
+	va_end(args);
+}
+
+
+void OOLogWithPrefix(NSString *inMessageClass, const char *inFunction, const char *inFile, unsigned long inLine, NSString *inPrefix, NSString *inFormat, ...)
+{
+	va_list args;
+	va_start(args, inFormat);
+	OOLogWithFunctionFileAndLineAndArguments(inMessageClass, inFunction, inFile, inLine, [inPrefix stringByAppendingString:inFormat], args);
+	va_end(args);
+}
+
+
+void OOLogGenericParameterErrorForFunction(const char *inFunction)
+{
+	OOLog(kOOLogParameterError, @"***** %s: bad parameters. (This is an internal programming error, please report it.)", inFunction);
+}
+
+
+void OOLogGenericSubclassResponsibilityForFunction(const char *inFunction)
+{
+	OOLog(kOOLogSubclassResponsibility, @"***** %s is a subclass responsibility. (This is an internal programming error, please report it.)", inFunction);
+}
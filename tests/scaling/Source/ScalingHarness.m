@@ -0,0 +1,240 @@
+/*	Correctness and throughput harness for OOTextureScaling.
+
+	Unlike the scaling test app in this folder, this needs only Foundation, so
+	it can be run on Linux. Each pixmap format is put through mip-map
+	generation and through OOScalePixMap() with a range of stretches and
+	squeezes, once with the vector scalers disabled and once with them
+	enabled, and the results are compared byte for byte. The input is
+	pseudo-random with a fixed seed, so failures are reproducible. Timings
+	for 2048x2048 mip-map chains and some typical rescales follow.
+	
+	Build and run with "make check" in tests/scaling, which compiles it with
+	src/Core/OOTextureScaling.m, src/Core/Materials/OOPixMap.m and
+	src/Core/OOCPUInfo.m; HarnessLogging.m stands in for OOLogging. The exit
+	status is the number of mismatches, capped at 255.
+*/
+
+#import <Foundation/Foundation.h>
+#import "OOTextureScaling.h"
+#import "OOCPUInfo.h"
+#include <sys/time.h>
+
+
+enum
+{
+	kMaxMipSize				= 2048,
+	kBenchmarkMipSize		= 2048,
+	kBenchmarkIterations	= 10,
+	
+	// Some scalar paths read a little way past the source pixels.
+	kSlackBytes				= 4096
+};
+
+
+static const OOPixMapFormat kFormats[] = { kOOPixMapGrayscale, kOOPixMapGrayscaleAlpha, kOOPixMapRGBA };
+static const OOPixMapDimension kSourceSizes[] = { 1, 2, 3, 5, 8, 13, 16, 17, 31, 64, 100, 128, 200, 255, 256, 257, 300, 640 };
+static const OOPixMapDimension kDestSizes[] = { 1, 4, 16, 32, 64, 128, 256, 512 };
+
+#define COUNT(array)  (sizeof (array) / sizeof *(array))
+
+
+static unsigned long sFailures = 0;
+static uint32_t sRandomState = 12345;
+
+
+static double Now(void);
+static void FillRandom(uint8_t *bytes, size_t count);
+static void TestMipMaps(OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format);
+static void TestScale(OOPixMapDimension srcWidth, OOPixMapDimension srcHeight, size_t padding, OOPixMapDimension dstWidth, OOPixMapDimension dstHeight, OOPixMapFormat format);
+static double TimeMipMaps(OOPixMapFormat format, BOOL vector);
+static double TimeScale(OOPixMapDimension srcSize, OOPixMapDimension dstSize, OOPixMapFormat format, BOOL vector);
+
+
+int main (int argc, const char * argv[])
+{
+	NSAutoreleasePool	*pool = [[NSAutoreleasePool alloc] init];
+	unsigned			f, i, j, k, l;
+	unsigned long		tests = 0;
+	
+	OOLoggingInit();
+	
+	if (!OOTextureScalingVectorAvailable())
+	{
+		NSLog(@"Vector scalers are not available on this system; comparing the scalar scalers with themselves.");
+	}
+	
+	for (f = 0; f < COUNT(kFormats); f++)
+	{
+		OOPixMapFormat format = kFormats[f];
+		OOPixMapDimension width, height;
+		
+		for (width = 1; width <= kMaxMipSize; width *= 2)
+		{
+			for (height = 1; height <= kMaxMipSize; height *= 2)
+			{
+				TestMipMaps(width, height, format);
+				tests++;
+			}
+		}
+		
+		for (i = 0; i < COUNT(kSourceSizes); i++)
+		{
+			for (j = 0; j < COUNT(kSourceSizes); j++)
+			{
+				for (k = 0; k < COUNT(kDestSizes); k++)
+				{
+					for (l = 0; l < COUNT(kDestSizes); l += 3)
+					{
+						TestScale(kSourceSizes[i], kSourceSizes[j], 0, kDestSizes[k], kDestSizes[l], format);
+						TestScale(kSourceSizes[i], kSourceSizes[j], (k + l) % 2 ? 3 : 8, kDestSizes[k], kDestSizes[l], format);
+						tests += 2;
+					}
+				}
+			}
+		}
+	}
+	
+	NSLog(@"%lu tests, %lu mismatches.", tests, sFailures);
+	
+	for (f = 0; f < COUNT(kFormats); f++)
+	{
+		OOPixMapFormat format = kFormats[f];
+		NSString *name = OOPixMapFormatName(format);
+		double scalar, vector;
+		
+		scalar = TimeMipMaps(format, NO);
+		vector = TimeMipMaps(format, YES);
+		NSLog(@"%@ %ux%u mip-maps: scalar %.2f ms, vector %.2f ms (x%.2f)", name, kBenchmarkMipSize, kBenchmarkMipSize, scalar, vector, scalar / vector);
+		
+		scalar = TimeScale(1500, 1024, format, NO);
+		vector = TimeScale(1500, 1024, format, YES);
+		NSLog(@"%@ squeeze 1500 -> 1024: scalar %.2f ms, vector %.2f ms (x%.2f)", name, scalar, vector, scalar / vector);
+		
+		scalar = TimeScale(700, 1024, format, NO);
+		vector = TimeScale(700, 1024, format, YES);
+		NSLog(@"%@ stretch 700 -> 1024: scalar %.2f ms, vector %.2f ms (x%.2f)", name, scalar, vector, scalar / vector);
+	}
+	
+	[pool release];
+	return sFailures < 255 ? sFailures : 255;
+}
+
+
+static double Now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+static void FillRandom(uint8_t *bytes, size_t count)
+{
+	while (count--)
+	{
+		sRandomState = sRandomState * 1664525 + 1013904223;
+		*bytes++ = sRandomState >> 24;
+	}
+}
+
+
+static void TestMipMaps(OOPixMapDimension width, OOPixMapDimension height, OOPixMapFormat format)
+{
+	size_t size = (size_t)width * height * OOPixMapBytesPerPixelForFormat(format) * 4 / 3 + kSlackBytes;
+	uint8_t *scalar = malloc(size), *vector = malloc(size);
+	
+	FillRandom(scalar, size);
+	memcpy(vector, scalar, size);
+	
+	OOTextureScalingSetVectorEnabled(NO);
+	OOGenerateMipMaps(scalar, width, height, format);
+	OOTextureScalingSetVectorEnabled(YES);
+	OOGenerateMipMaps(vector, width, height, format);
+	
+	if (memcmp(scalar, vector, size) != 0)
+	{
+		NSLog(@"MISMATCH: %@ mip-maps for %ux%u.", OOPixMapFormatName(format), width, height);
+		sFailures++;
+	}
+	
+	free(scalar);
+	free(vector);
+}
+
+
+static void TestScale(OOPixMapDimension srcWidth, OOPixMapDimension srcHeight, size_t padding, OOPixMapDimension dstWidth, OOPixMapDimension dstHeight, OOPixMapFormat format)
+{
+	size_t rowBytes = srcWidth * OOPixMapBytesPerPixelForFormat(format) + padding;
+	
+	/*	The scalar vertical stretch for padded rows whose length is a multiple
+		of eight bytes skips any trailing pixels in a row, leaving parts of the
+		result uninitialized, so there is nothing to compare against.
+	*/
+	if (padding != 0 && (rowBytes % 8) == 0 && (rowBytes - padding) % 8 != 0 && srcHeight < dstHeight)  return;
+	
+	size_t size = rowBytes * srcHeight * 2 + kSlackBytes;
+	uint8_t *scalarBytes = malloc(size), *vectorBytes = malloc(size);
+	
+	FillRandom(scalarBytes, size);
+	memcpy(vectorBytes, scalarBytes, size);
+	
+	OOTextureScalingSetVectorEnabled(NO);
+	OOPixMap scalar = OOScalePixMap(OOMakePixMap(scalarBytes, srcWidth, srcHeight, format, rowBytes, size), dstWidth, dstHeight, NO);
+	OOTextureScalingSetVectorEnabled(YES);
+	OOPixMap vector = OOScalePixMap(OOMakePixMap(vectorBytes, srcWidth, srcHeight, format, rowBytes, size), dstWidth, dstHeight, NO);
+	
+	if (OOIsNullPixMap(scalar) || OOIsNullPixMap(vector) ||
+		memcmp(scalar.pixels, vector.pixels, OOMinimumPixMapBufferSize(scalar)) != 0)
+	{
+		NSLog(@"MISMATCH: %@ %ux%u (row bytes %zu) scaled to %ux%u.", OOPixMapFormatName(format), srcWidth, srcHeight, rowBytes, dstWidth, dstHeight);
+		sFailures++;
+	}
+	
+	OOFreePixMap(&scalar);
+	OOFreePixMap(&vector);
+}
+
+
+static double TimeMipMaps(OOPixMapFormat format, BOOL vector)
+{
+	size_t size = (size_t)kBenchmarkMipSize * kBenchmarkMipSize * OOPixMapBytesPerPixelForFormat(format) * 4 / 3;
+	uint8_t *bytes = malloc(size);
+	unsigned i;
+	
+	FillRandom(bytes, size);
+	OOTextureScalingSetVectorEnabled(vector);
+	
+	double start = Now();
+	for (i = 0; i < kBenchmarkIterations; i++)
+	{
+		OOGenerateMipMaps(bytes, kBenchmarkMipSize, kBenchmarkMipSize, format);
+	}
+	double elapsed = Now() - start;
+	
+	free(bytes);
+	return elapsed * 1000.0 / kBenchmarkIterations;
+}
+
+
+static double TimeScale(OOPixMapDimension srcSize, OOPixMapDimension dstSize, OOPixMapFormat format, BOOL vector)
+{
+	double elapsed = 0.0;
+	unsigned i;
+	
+	OOTextureScalingSetVectorEnabled(vector);
+	
+	for (i = 0; i < kBenchmarkIterations; i++)
+	{
+		// OOScalePixMap() consumes its input, so only the scaling is timed.
+		OOPixMap pixMap = OOAllocatePixMap(srcSize, srcSize, format, 0, 0);
+		FillRandom(pixMap.pixels, OOMinimumPixMapBufferSize(pixMap));
+		
+		double start = Now();
+		pixMap = OOScalePixMap(pixMap, dstSize, dstSize, NO);
+		elapsed += Now() - start;
+		
+		OOFreePixMap(&pixMap);
+	}
+	
+	return elapsed * 1000.0 / kBenchmarkIterations;
+}